@@ -39,6 +39,7 @@ struct AppSettings
     int max_pixels = 1500000;
     bool force_recon = false;
     bool write_ply = false;
+    bool compress_mvei = false;
 #ifdef _WIN32
     ProgressStyle progress_style = PROGRESS_SIMPLE;
 #else
@@ -141,6 +142,10 @@ main (int argc, char** argv)
         "specify source image embedding [undistorted]");
     args.add_option('\0', "local-neighbors", true,
         "amount of neighbors for local view selection [4]");
+    args.add_option('\0', "patchmatch", false,
+        "use PatchMatch propagation instead of region growing");
+    args.add_option('\0', "pm-iterations", true,
+        "amount of PatchMatch iterations [4]");
     args.add_option('\0', "keep-dz", false,
         "store dz map into view");
     args.add_option('\0', "keep-conf", false,
@@ -155,6 +160,8 @@ main (int argc, char** argv)
         "progress output style: 'silent', 'simple' or 'fancy'");
     args.add_option('\0', "force", false,
         "Reconstruct and overwrite existing depthmaps");
+    args.add_option('\0', "compress", false,
+        "Save depthmaps in the compressed MVEI format");
     args.parse(argc, argv);
 
     AppSettings conf;
@@ -176,6 +183,10 @@ main (int argc, char** argv)
             conf.mvs.filterWidth = arg->get_arg<unsigned int>();
         else if (arg->opt->lopt == "image")
             conf.mvs.imageEmbedding = arg->get_arg<std::string>();
+        else if (arg->opt->lopt == "patchmatch")
+            conf.mvs.usePatchMatch = true;
+        else if (arg->opt->lopt == "pm-iterations")
+            conf.mvs.patchMatchIterations = arg->get_arg<unsigned int>();
         else if (arg->opt->lopt == "keep-dz")
             conf.mvs.keepDzMap = true;
         else if (arg->opt->lopt == "keep-conf")
@@ -212,6 +223,8 @@ main (int argc, char** argv)
         }
         else if (arg->opt->lopt == "force")
             conf.force_recon = true;
+        else if (arg->opt->lopt == "compress")
+            conf.compress_mvei = true;
         else
         {
             args.generate_helptext(std::cerr);
@@ -229,8 +242,9 @@ main (int argc, char** argv)
     mve::Scene::Ptr scene;
     try
     {
-        scene = mve::Scene::create(conf.scene_path);
+        scene = mve::Scene::create(conf.scene_path, true);
         scene->get_bundle();
+        scene->set_mvei_compression(conf.compress_mvei);
     }
     catch (std::exception& e)
     {
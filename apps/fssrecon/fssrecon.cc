@@ -23,6 +23,8 @@
 #include "util/timer.h"
 #include "util/arguments.h"
 #include "util/system.h"
+#include "util/file_system.h"
+#include "fssr/chunked_reconstruction.h"
 #include "fssr/sample_io.h"
 #include "fssr/iso_octree.h"
 #include "fssr/iso_surface.h"
@@ -35,10 +37,28 @@ struct AppOptions
     std::string out_mesh;
     int refine_octree = 0;
     fssr::InterpolationType interp_type = fssr::INTERPOLATION_CUBIC;
+    std::size_t max_memory = 0;
+    std::string temp_dir;
 };
 
-void
-fssrecon (AppOptions const& app_opts, fssr::SampleIO::Options const& pset_opts)
+mve::TriangleMesh::Ptr
+reconstruct_chunked (AppOptions const& app_opts,
+    fssr::SampleIO::Options const& pset_opts)
+{
+    fssr::ChunkedReconstruction::Options opts;
+    opts.sample_options = pset_opts;
+    opts.interpolation_type = app_opts.interp_type;
+    opts.refine_octree = app_opts.refine_octree;
+    opts.max_memory = app_opts.max_memory;
+    opts.temp_dir = app_opts.temp_dir;
+
+    fssr::ChunkedReconstruction recon(opts);
+    return recon.reconstruct(app_opts.in_files);
+}
+
+mve::TriangleMesh::Ptr
+reconstruct_in_memory (AppOptions const& app_opts,
+    fssr::SampleIO::Options const& pset_opts)
 {
     /* Load input point set and insert samples in the octree. */
     fssr::IsoOctree octree;
@@ -93,6 +113,18 @@ fssrecon (AppOptions const& app_opts, fssr::SampleIO::Options const& pset_opts)
     }
     octree.clear();
 
+    return mesh;
+}
+
+void
+fssrecon (AppOptions const& app_opts, fssr::SampleIO::Options const& pset_opts)
+{
+    mve::TriangleMesh::Ptr mesh;
+    if (app_opts.max_memory > 0)
+        mesh = reconstruct_chunked(app_opts, pset_opts);
+    else
+        mesh = reconstruct_in_memory(app_opts, pset_opts);
+
     /* Check if anything has been extracted. */
     if (mesh->get_vertices().empty())
     {
@@ -147,6 +179,8 @@ main (int argc, char** argv)
     args.add_option('r', "refine-octree", true, "Refines octree with N levels [0]");
     args.add_option('\0', "min-scale", true, "Minimum scale, smaller samples are clamped");
     args.add_option('\0', "max-scale", true, "Maximum scale, larger samples are ignored");
+    args.add_option('m', "max-memory", true, "Reconstruct in chunks with peak memory in MB");
+    args.add_option('\0', "temp-dir", true, "Directory for chunk files [output dir]");
 #if FSSR_USE_DERIVATIVES
     args.add_option('\0', "interpolation", true, "Interpolation: linear, scaling, lsderiv, [cubic]");
 #endif // FSSR_USE_DERIVATIVES
@@ -179,6 +213,10 @@ main (int argc, char** argv)
             pset_opts.min_scale = arg->get_arg<float>();
         else if (arg->opt->lopt == "max-scale")
             pset_opts.max_scale = arg->get_arg<float>();
+        else if (arg->opt->lopt == "max-memory")
+            app_opts.max_memory = arg->get_arg<std::size_t>() << 20;
+        else if (arg->opt->lopt == "temp-dir")
+            app_opts.temp_dir = arg->arg;
         else if (arg->opt->lopt == "interpolation")
         {
             if (arg->arg == "linear")
@@ -211,6 +249,8 @@ main (int argc, char** argv)
     }
     app_opts.out_mesh = app_opts.in_files.back();
     app_opts.in_files.pop_back();
+    if (app_opts.temp_dir.empty())
+        app_opts.temp_dir = util::fs::dirname(app_opts.out_mesh);
 
     if (app_opts.refine_octree < 0 || app_opts.refine_octree > 3)
     {
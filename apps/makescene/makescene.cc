@@ -15,11 +15,14 @@
  *   float formats: PFM
  */
 
+#include <cmath>
 #include <cstring>
 #include <cstdlib>
 
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <tuple>
 #include <vector>
 #include <string>
 #include <algorithm>
@@ -39,6 +42,7 @@
 #include "mve/view.h"
 #include "mve/image.h"
 #include "mve/image_tools.h"
+#include "mve/image_undistort.h"
 #include "mve/image_io.h"
 #include "mve/image_exif.h"
 #include "mve/mesh.h"
@@ -118,18 +122,33 @@ read_noah_imagelist (std::string const& filename, StringVector& files)
 /* ---------------------------------------------------------------- */
 
 mve::ByteImage::Ptr
-load_8bit_image (std::string const& fname, std::string* exif)
+load_8bit_image (std::string const& fname, std::string* exif,
+    int max_pixels = std::numeric_limits<int>::max(),
+    int* original_width = nullptr)
 {
     std::string lcfname(util::string::lowercase(fname));
     std::string ext4 = util::string::right(lcfname, 4);
     std::string ext5 = util::string::right(lcfname, 5);
     try
     {
+        mve::ByteImage::Ptr image;
+        mve::image::ImageHeaders headers;
         if (ext4 == ".jpg" || ext5 == ".jpeg")
-            return mve::image::load_jpg_file(fname, exif);
+        {
+            image = mve::image::load_jpg_file_scaled(fname, max_pixels,
+                exif, &headers);
+            if (original_width != nullptr)
+                *original_width = headers.width;
+            return image;
+        }
         else if (ext4 == ".png" ||  ext4 == ".ppm"
             || ext4 == ".tif" || ext5 == ".tiff")
-            return mve::image::load_file(fname);
+        {
+            image = mve::image::load_file(fname);
+            if (original_width != nullptr && image != nullptr)
+                *original_width = image->width();
+            return image;
+        }
     }
     catch (...)
     { }
@@ -179,19 +198,28 @@ load_float_image (std::string const& fname)
 /* ---------------------------------------------------------------- */
 
 mve::ImageBase::Ptr
-load_any_image (std::string const& fname, std::string* exif)
+load_any_image (std::string const& fname, std::string* exif, int max_pixels,
+    int* original_width)
 {
-    mve::ByteImage::Ptr img_8 = load_8bit_image(fname, exif);
+    /* Large JPEGs are already reduced while decoding. */
+    mve::ByteImage::Ptr img_8 = load_8bit_image(fname, exif, max_pixels,
+        original_width);
     if (img_8 != nullptr)
         return img_8;
 
     mve::RawImage::Ptr img_16 = load_16bit_image(fname);
     if (img_16 != nullptr)
+    {
+        *original_width = img_16->width();
         return img_16;
+    }
 
     mve::FloatImage::Ptr img_float = load_float_image(fname);
     if (img_float != nullptr)
+    {
+        *original_width = img_float->width();
         return img_float;
+    }
 
 #pragma omp critical
     std::cerr << "Skipping file " << util::fs::basename(fname)
@@ -350,6 +378,22 @@ import_bundle_nvm (AppSettings const& conf)
     util::fs::mkdir(conf.output_path.c_str());
     util::fs::mkdir(conf.views_path.c_str());
 
+    /*
+     * Views with identical intrinsics share the undistortion table.
+     * Other views are undistorted directly, which is cheaper than
+     * building a table for a single image.
+     */
+    typedef std::pair<float, float> Intrinsics;
+    std::map<Intrinsics, int> intrinsics_count;
+    for (std::size_t i = 0; i < cameras.size(); ++i)
+        intrinsics_count[Intrinsics(cameras[i].flen,
+            nvm_cams[i].radial_distortion)] += 1;
+    std::vector<bool> shared_intrinsics(cameras.size(), false);
+    for (std::size_t i = 0; i < cameras.size(); ++i)
+        shared_intrinsics[i] = intrinsics_count[Intrinsics(cameras[i].flen,
+            nvm_cams[i].radial_distortion)] > 1;
+    mve::image::UndistortMapCache undistort_cache;
+
     /* Create and write views. */
     std::cout << "Writing MVE views..." << std::endl;
 #pragma omp parallel for schedule(dynamic, 1)
@@ -392,8 +436,14 @@ import_bundle_nvm (AppSettings const& conf)
         int const maxdim = std::max(image->width(), image->height());
         mve_cam.flen = mve_cam.flen / static_cast<float>(maxdim);
 
-        mve::ByteImage::Ptr undist = mve::image::image_undistort_vsfm<uint8_t>
-            (image, mve_cam.flen, nvm_cam.radial_distortion);
+        mve::ByteImage::Ptr undist;
+        if (shared_intrinsics[i])
+            undist = undistort_cache.get_vsfm(image->width(),
+                image->height(), mve_cam.flen, nvm_cam.radial_distortion)
+                ->apply<uint8_t>(image);
+        else
+            undist = mve::image::image_undistort_vsfm<uint8_t>(image,
+                mve_cam.flen, nvm_cam.radial_distortion);
         undist = limit_image_size<uint8_t>(undist, conf.max_pixels);
         view->set_image(undist, "undistorted");
         view->set_camera(mve_cam);
@@ -537,10 +587,18 @@ import_bundle_noah_ps (AppSettings const& conf)
     mve::save_photosynther_bundle(bundle,
         util::fs::join_path(conf.output_path, "synth_0.out"));
 
+    /* Views with identical intrinsics share the undistortion table. */
+    mve::Bundle::Cameras const& cams = bundle->get_cameras();
+    typedef std::tuple<float, float, float> Intrinsics;
+    std::map<Intrinsics, int> intrinsics_count;
+    for (std::size_t i = 0; i < cams.size(); ++i)
+        intrinsics_count[Intrinsics(std::abs(cams[i].flen),
+            cams[i].dist[0], cams[i].dist[1])] += 1;
+    mve::image::UndistortMapCache undistort_cache;
+
     /* Save MVE views. */
     int num_valid_cams = 0;
     int undist_imported = 0;
-    mve::Bundle::Cameras const& cams = bundle->get_cameras();
     for (std::size_t i = 0; i < cams.size(); ++i)
     {
         /*
@@ -631,9 +689,15 @@ import_bundle_noah_ps (AppSettings const& conf)
             cam.flen /= (float)std::max(original->width(), original->height());
             view->set_camera(cam);
 
-            if (cam.flen != 0.0f)
-                undist = mve::image::image_undistort_k2k4<uint8_t>
-                    (original, cam.flen, cam.dist[0], cam.dist[1]);
+            bool const shared_intrinsics = intrinsics_count[Intrinsics(
+                std::abs(cams[i].flen), cam.dist[0], cam.dist[1])] > 1;
+            if (cam.flen != 0.0f && shared_intrinsics)
+                undist = undistort_cache.get_k2k4(original->width(),
+                    original->height(), cam.flen, cam.dist[0], cam.dist[1])
+                    ->apply<uint8_t>(original);
+            else if (cam.flen != 0.0f)
+                undist = mve::image::image_undistort_k2k4<uint8_t>(original,
+                    cam.flen, cam.dist[0], cam.dist[1]);
 
             if (!import_original)
                 original.reset();
@@ -864,7 +928,9 @@ import_images (AppSettings const& conf)
         std::string afname = dir[i].get_absolute_name();
 
         std::string exif;
-        mve::ImageBase::Ptr image = load_any_image(afname, &exif);
+        int original_width = 0;
+        mve::ImageBase::Ptr image = load_any_image(afname, &exif,
+            conf.max_pixels, &original_width);
         if (image == nullptr)
             continue;
 
@@ -879,10 +945,9 @@ import_images (AppSettings const& conf)
         view->set_id(id);
         view->set_name(remove_file_extension(fname));
 
-        /* Rescale and add original image. */
-        int orig_width = image->width();
+        /* Rescale and add original image, reference unscaled JPEGs. */
         image = limit_image_size(image, conf.max_pixels);
-        if (orig_width == image->width() && has_jpeg_extension(fname))
+        if (has_jpeg_extension(fname) && image->width() == original_width)
             view->set_image_ref(afname, "original");
         else
             view->set_image(image, "original");
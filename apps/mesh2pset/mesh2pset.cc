@@ -162,11 +162,11 @@ main (int argc, char** argv)
     if (conf.sample_scale <= 0.0f)
     {
         std::cout << "Computing scale..." << std::endl;
-        mve::MeshInfo mesh_info(mesh);
+        mve::CompactMeshInfo mesh_info(mesh);
         std::size_t num_unreferenced = 0;
         for (std::size_t i = 0; i < mesh_info.size(); ++i)
         {
-            mve::MeshInfo::VertexInfo const& vi = mesh_info[i];
+            mve::CompactMeshInfo::VertexInfo const vi = mesh_info[i];
             if (vi.verts.size() < 3)
             {
                 num_unreferenced += 1;
@@ -7,6 +7,7 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <string>
@@ -15,6 +16,7 @@
 #include "util/timer.h"
 #include "util/arguments.h"
 #include "mve/mesh.h"
+#include "mve/mesh_decimate.h"
 #include "mve/mesh_io.h"
 #include "mve/mesh_io_ply.h"
 #include "mve/mesh_tools.h"
@@ -31,6 +33,7 @@ struct AppSettings
     float conf_threshold = 1.0f;
     float conf_percentile = -1.0f;
     int component_size = 1000;
+    float decimate_fraction = 1.0f;
 };
 
 template <typename T>
@@ -75,6 +78,7 @@ main (int argc, char** argv)
     args.add_option('p', "percentile", true, "Use the nth percentile (0 - 100) as confidence threshold [disabled]");
     args.add_option('c', "component-size", true, "Minimum number of vertices per component [1000]");
     args.add_option('n', "no-clean", false, "Prevents cleanup of degenerated faces");
+    args.add_option('d', "decimate", true, "Decimate to fraction (0 - 1) of faces [disabled]");
     args.add_option('\0', "delete-scale", false, "Delete scale attribute from mesh");
     args.add_option('\0', "delete-conf", false, "Delete confidence attribute from mesh");
     args.add_option('\0', "delete-color", false, "Delete color attribute from mesh");
@@ -99,6 +103,8 @@ main (int argc, char** argv)
             conf.component_size = arg->get_arg<int>();
         else if (arg->opt->lopt == "no-clean")
             conf.clean_degenerated = false;
+        else if (arg->opt->lopt == "decimate")
+            conf.decimate_fraction = arg->get_arg<float>();
         else if (arg->opt->lopt == "delete-scale")
             conf.delete_scale = true;
         else if (arg->opt->lopt == "delete-conf")
@@ -182,6 +188,21 @@ main (int argc, char** argv)
         std::cout << "  Collapsed " << num_collapsed << " edges." << std::endl;
     }
 
+    /* Decimate the mesh if requested. */
+    if (conf.decimate_fraction < 1.0f)
+    {
+        std::size_t num_faces = mesh->get_faces().size() / 3;
+        mve::geom::MeshDecimateOptions decimate_opts;
+        decimate_opts.target_faces = static_cast<std::size_t>(
+            std::max(0.0f, conf.decimate_fraction) * num_faces);
+        std::cout << "Decimating mesh to " << decimate_opts.target_faces
+            << " faces..." << std::endl;
+        std::size_t num_collapses = mve::geom::mesh_decimate(mesh,
+            decimate_opts);
+        std::cout << "  Collapsed " << num_collapses << " edges, "
+            << (mesh->get_faces().size() / 3) << " faces left." << std::endl;
+    }
+
     /* Write output mesh. */
     std::cout << "Writing mesh: " << conf.out_mesh << std::endl;
     if (util::string::right(conf.out_mesh, 4) == ".ply")
@@ -15,6 +15,8 @@
 #include <cstring>
 #include <cerrno>
 #include <cstdlib>
+#include <exception>
+#include <memory>
 
 #include "math/octree_tools.h"
 #include "util/system.h"
@@ -25,8 +27,10 @@
 #include "mve/mesh_io.h"
 #include "mve/mesh_io_ply.h"
 #include "mve/mesh_tools.h"
+#include "mve/point_set_writer.h"
 #include "mve/scene.h"
 #include "mve/view.h"
+#include "mve/view_prefetcher.h"
 
 struct AppSettings
 {
@@ -169,6 +173,22 @@ main (int argc, char** argv)
     std::cout << "Using depthmap \"" << conf.dmname
         << "\" and color image \"" << conf.image << "\"" << std::endl;
 
+    /*
+     * Without masks, the points of every view are streamed to the output
+     * file. Otherwise, the point set is kept in memory for clipping.
+     */
+    std::unique_ptr<mve::geom::PointSetWriter> writer;
+    if (conf.mask.empty()
+        && mve::geom::PointSetWriter::is_supported(conf.outmesh))
+    {
+        mve::geom::PointSetWriter::Options opts;
+        opts.write_normals = conf.with_normals;
+        opts.write_colors = !conf.image.empty();
+        opts.write_confidences = conf.with_conf;
+        opts.write_values = conf.with_scale;
+        writer.reset(new mve::geom::PointSetWriter(conf.outmesh, opts));
+    }
+
     /* Prepare output mesh. */
     mve::TriangleMesh::Ptr pset(mve::TriangleMesh::create());
     mve::TriangleMesh::VertexList& verts(pset->get_vertices());
@@ -178,10 +198,30 @@ main (int argc, char** argv)
     mve::TriangleMesh::ConfidenceList& vconfs(pset->get_vertex_confidences());
 
     /* Load scene. */
-    mve::Scene::Ptr scene = mve::Scene::create(conf.scenedir);
+    mve::Scene::Ptr scene = mve::Scene::create(conf.scenedir, true);
 
-    /* Iterate over views and get points. */
+    /* Load depth maps and color images in the background. */
     mve::Scene::ViewList& views(scene->get_views());
+    std::vector<std::string> embeddings(1, conf.dmname);
+    if (!conf.image.empty())
+        embeddings.push_back(conf.image);
+    /* Select the views before scheduling, scheduled views are busy. */
+    std::vector<bool> selected(views.size(), false);
+    for (std::size_t i = 0; i < views.size(); ++i)
+    {
+        if (views[i] == nullptr || views[i]->get_camera().flen == 0.0f)
+            continue;
+        if (conf.ids.empty() || std::find(conf.ids.begin(), conf.ids.end(),
+            views[i]->get_id()) != conf.ids.end())
+            selected[i] = true;
+    }
+    mve::ViewPrefetcher prefetcher(views, embeddings);
+    for (std::size_t i = 0; i < views.size(); ++i)
+        if (selected[i])
+            prefetcher.prefetch(i);
+
+    /* Iterate over views and get points. */
+    std::exception_ptr write_error;
 #pragma omp parallel for schedule(dynamic)
 #if !defined(_MSC_VER)
     for (std::size_t i = 0; i < views.size(); ++i)
@@ -189,22 +229,18 @@ main (int argc, char** argv)
     for (int64_t i = 0; i < views.size(); ++i)
 #endif
 		{
-        mve::View::Ptr view = views[i];
-        if (view == nullptr)
-            continue;
-
-        std::size_t view_id = view->get_id();
-        if (!conf.ids.empty() && std::find(conf.ids.begin(),
-            conf.ids.end(), view_id) == conf.ids.end())
+        if (!selected[i])
             continue;
 
+        /* The view is accessed only after the prefetcher handed it back. */
+        mve::View::Ptr view = views[i];
+        mve::FloatImage::Ptr dm = prefetcher.get_float_image(i, conf.dmname);
         mve::CameraInfo const& cam = view->get_camera();
-        if (cam.flen == 0.0f)
-            continue;
-
-        mve::FloatImage::Ptr dm = view->get_float_image(conf.dmname);
         if (dm == nullptr)
+        {
+            view->cache_cleanup();
             continue;
+        }
 
         if (conf.min_valid_fraction > 0.0f)
         {
@@ -216,6 +252,8 @@ main (int argc, char** argv)
             float fraction = num_recon / num_total;
             if (fraction < conf.min_valid_fraction)
             {
+                dm.reset();
+                view->cache_cleanup();
                 std::cout << "View " << view->get_name() << ": Fill status "
                     << util::string::get_fixed(fraction * 100.0f, 2)
                     << "%, skipping." << std::endl;
@@ -225,7 +263,7 @@ main (int argc, char** argv)
 
         mve::ByteImage::Ptr ci;
         if (!conf.image.empty())
-            ci = view->get_byte_image(conf.image);
+            ci = prefetcher.get_byte_image(i, conf.image);
 
 #pragma omp critical
         std::cout << "Processing view \"" << view->get_name()
@@ -239,6 +277,7 @@ main (int argc, char** argv)
         mve::TriangleMesh::NormalList const& mnorms(mesh->get_vertex_normals());
         mve::TriangleMesh::ColorList const& mvcol(mesh->get_vertex_colors());
         mve::TriangleMesh::ConfidenceList& mconfs(mesh->get_vertex_confidences());
+        mve::TriangleMesh::ValueList const& mvalues(mesh->get_vertex_values());
 
         if (conf.with_normals)
             mesh->ensure_normals();
@@ -267,10 +306,10 @@ main (int argc, char** argv)
         if (conf.with_scale)
         {
             mvscale.resize(mverts.size(), 0.0f);
-            mve::MeshInfo mesh_info(mesh);
+            mve::CompactMeshInfo mesh_info(mesh);
             for (std::size_t j = 0; j < mesh_info.size(); ++j)
             {
-                mve::MeshInfo::VertexInfo const& vinf = mesh_info[j];
+                mve::CompactMeshInfo::VertexInfo const vinf = mesh_info[j];
                 for (std::size_t k = 0; k < vinf.verts.size(); ++k)
                     mvscale[j] += (mverts[j] - mverts[vinf.verts[k]]).norm();
                 mvscale[j] /= static_cast<float>(vinf.verts.size());
@@ -278,10 +317,40 @@ main (int argc, char** argv)
             }
         }
 
-        /* Add vertices and optional colors and normals to mesh. */
-        if (conf.aabb.empty())
+        /* Keep only the points and the requested attributes. */
+        mesh->get_faces().clear();
+        mesh->get_vertex_values().swap(mvscale);
+        if (!conf.with_normals)
+            mesh->get_vertex_normals().clear();
+        if (!conf.with_conf)
+            mesh->get_vertex_confidences().clear();
+
+        /* Check every point if a bounding box is given. */
+        if (!conf.aabb.empty())
+        {
+            mve::TriangleMesh::DeleteList delete_list(mverts.size(), false);
+            for (std::size_t j = 0; j < mverts.size(); ++j)
+                delete_list[j] = !math::geom::point_box_overlap(mverts[j],
+                    aabbmin, aabbmax);
+            mesh->delete_vertices(delete_list);
+        }
+
+        if (writer != nullptr)
+        {
+            /* Exceptions must not escape the parallel loop. */
+            try
+            {
+                writer->write(mesh);
+            }
+            catch (...)
+            {
+#pragma omp critical
+                if (write_error == nullptr)
+                    write_error = std::current_exception();
+            }
+        }
+        else
         {
-            /* Fast if no bounding box is given. */
 #pragma omp critical
             {
                 verts.insert(verts.end(), mverts.begin(), mverts.end());
@@ -290,39 +359,30 @@ main (int argc, char** argv)
                 if (conf.with_normals)
                     vnorm.insert(vnorm.end(), mnorms.begin(), mnorms.end());
                 if (conf.with_scale)
-                    vvalues.insert(vvalues.end(), mvscale.begin(), mvscale.end());
+                    vvalues.insert(vvalues.end(), mvalues.begin(), mvalues.end());
                 if (conf.with_conf)
                     vconfs.insert(vconfs.end(), mconfs.begin(), mconfs.end());
             }
         }
-        else
-        {
-            /* Check every point if a bounding box is given.  */
-            for (std::size_t i = 0; i < mverts.size(); ++i)
-            {
-                if (!math::geom::point_box_overlap(mverts[i], aabbmin, aabbmax))
-                    continue;
-
-#pragma omp critical
-                {
-                    verts.push_back(mverts[i]);
-                    if (!mvcol.empty())
-                        vcolor.push_back(mvcol[i]);
-                    if (conf.with_normals)
-                        vnorm.push_back(mnorms[i]);
-                    if (conf.with_scale)
-                        vvalues.push_back(mvscale[i]);
-                    if (conf.with_conf)
-                        vconfs.push_back(mconfs[i]);
-                }
-            }
-        }
 
         dm.reset();
         ci.reset();
         view->cache_cleanup();
     }
 
+    if (write_error != nullptr)
+    {
+        try
+        {
+            std::rethrow_exception(write_error);
+        }
+        catch (std::exception& e)
+        {
+            std::cerr << "Error writing point set: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
     /* If a mask is given, clip vertices with the masks in all images. */
     if (!conf.mask.empty())
     {
@@ -383,6 +443,14 @@ main (int argc, char** argv)
             << " points." << std::endl;
     }
 
+    if (writer != nullptr)
+    {
+        writer->close();
+        std::cout << "Wrote final point set ("
+            << writer->get_num_points() << " points)." << std::endl;
+        return EXIT_SUCCESS;
+    }
+
     /* Write mesh to disc. */
     std::cout << "Writing final point set ("
         << verts.size() << " points)..." << std::endl;
@@ -16,6 +16,8 @@
 #include "util/system.h"
 #include "util/arguments.h"
 #include "util/file_system.h"
+#include "mve/scene.h"
+#include "mve/scene_archive.h"
 #include "mve/view.h"
 #include "sfm/bundler_common.h"
 #include "sfm/feature_set.h"
@@ -30,6 +32,7 @@ struct AppSettings
 {
     std::string input_path;
     bool keep_original = false;
+    bool pack_views = false;
 };
 
 /* ------------------- Input for old Prebundle -------------------- */
@@ -280,6 +283,62 @@ convert_scene (AppSettings const& conf)
     }
 }
 
+void
+pack_scene (AppSettings const& conf)
+{
+    std::string const archive_fname = util::fs::join_path(conf.input_path,
+        MVE_SCENE_ARCHIVE_FILE);
+    if (util::fs::file_exists(archive_fname.c_str()))
+        throw util::FileException(archive_fname, "Scene is already packed");
+
+    /* Copy the files of all views with .mve extension into the archive. */
+    util::fs::Directory dir(util::fs::join_path(conf.input_path, "views"));
+    std::sort(dir.begin(), dir.end());
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(archive_fname);
+    for (std::size_t i = 0; i < dir.size(); ++i)
+    {
+        std::string ext4 = util::string::lowercase
+            (util::string::right(dir[i].name, 4));
+        if (ext4 != ".mve" || !dir[i].is_dir)
+            continue;
+
+        std::cout << "Packing " << dir[i].name << "..." << std::endl;
+        util::fs::Directory view_dir(dir[i].get_absolute_name());
+        for (std::size_t j = 0; j < view_dir.size(); ++j)
+        {
+            if (view_dir[j].is_dir)
+                continue;
+            std::string data;
+            util::fs::read_file_to_string(view_dir[j].get_absolute_name(),
+                &data);
+            archive->write_file(dir[i].name + "/" + view_dir[j].name, data);
+        }
+    }
+    archive->flush();
+
+    if (conf.keep_original)
+        return;
+
+    /* Delete the view directories. */
+    for (std::size_t i = 0; i < dir.size(); ++i)
+    {
+        std::string ext4 = util::string::lowercase
+            (util::string::right(dir[i].name, 4));
+        if (ext4 != ".mve" || !dir[i].is_dir)
+            continue;
+
+        util::fs::Directory view_dir(dir[i].get_absolute_name());
+        for (std::size_t j = 0; j < view_dir.size(); ++j)
+            if (!view_dir[j].is_dir)
+                util::fs::unlink(view_dir[j].get_absolute_name().c_str());
+        if (!util::fs::rmdir(dir[i].get_absolute_name().c_str()))
+        {
+            std::cerr << "Warning: Error deleting " << dir[i].name
+                << ": " << std::strerror(errno) << std::endl;
+        }
+    }
+}
+
 int
 main (int argc, char** argv)
 {
@@ -297,8 +356,12 @@ main (int argc, char** argv)
         "file, or an MVE scene to the new format. See the Github wiki for "
         "more details about the new formats. INPUT can either be a single "
         ".mve view, a single .sfm prebundle file, or a scene directory. In "
-        "the latter case, all views and the prebundle.sfm are upgraded.");
+        "the latter case, all views and the prebundle.sfm are upgraded. "
+        "With --pack, the views of the scene are then packed into a single "
+        "scene archive file.");
     args.add_option('k', "keep-original", false, "Keep original files");
+    args.add_option('p', "pack", false, "Pack the views of the scene "
+        "into the file " MVE_SCENE_ARCHIVE_FILE);
     args.parse(argc, argv);
 
     /* Setup defaults. */
@@ -311,6 +374,8 @@ main (int argc, char** argv)
     {
         if (i->opt->lopt == "keep-original")
             conf.keep_original = true;
+        else if (i->opt->lopt == "pack")
+            conf.pack_views = true;
         else
             throw std::invalid_argument("Unexpected option");
     }
@@ -325,7 +390,11 @@ main (int argc, char** argv)
     try
     {
         if (util::fs::dir_exists(conf.input_path.c_str()))
+        {
             convert_scene(conf);
+            if (conf.pack_views)
+                pack_scene(conf);
+        }
         else if (util::fs::file_exists(conf.input_path.c_str()))
             convert_file(conf, conf.input_path);
         else
@@ -9,7 +9,10 @@
 
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <string>
+#include <tuple>
+#include <vector>
 #include <ctime>
 #include <cstdlib>
 
@@ -23,6 +26,8 @@
 #include "mve/bundle_io.h"
 #include "mve/image.h"
 #include "mve/image_tools.h"
+#include "mve/image_undistort.h"
+#include "mve/view_prefetcher.h"
 #include "sfm/nearest_neighbor.h"
 #include "sfm/feature_set.h"
 #include "sfm/bundler_common.h"
@@ -156,7 +161,7 @@ sfm_reconstruct (AppSettings const& conf)
     mve::Scene::Ptr scene;
     try
     {
-        scene = mve::Scene::create(conf.scene_path);
+        scene = mve::Scene::create(conf.scene_path, true);
     }
     catch (std::exception& e)
     {
@@ -410,6 +415,39 @@ sfm_reconstruct (AppSettings const& conf)
         std::exit(EXIT_FAILURE);
     }
 
+    /* Select the views before scheduling, scheduled views are busy. */
+    std::vector<bool> selected(views.size(), false);
+    for (std::size_t i = 0; i < views.size(); ++i)
+        selected[i] = views[i] != nullptr && (bundle_cams[i].flen != 0.0f
+            || views[i]->get_camera().flen != 0.0f);
+
+    /*
+     * Views with identical intrinsics (e.g. fixed intrinsics) share an
+     * undistortion table. Other views are undistorted directly, which is
+     * cheaper than building a table for a single image.
+     */
+    typedef std::tuple<float, float, float> Intrinsics;
+    std::map<Intrinsics, int> intrinsics_count;
+    for (std::size_t i = 0; i < views.size(); ++i)
+        if (selected[i])
+            intrinsics_count[Intrinsics(bundle_cams[i].flen,
+                bundle_cams[i].dist[0], bundle_cams[i].dist[1])] += 1;
+    std::vector<bool> shared_intrinsics(views.size(), false);
+    for (std::size_t i = 0; i < views.size(); ++i)
+        shared_intrinsics[i] = selected[i]
+            && intrinsics_count[Intrinsics(bundle_cams[i].flen,
+            bundle_cams[i].dist[0], bundle_cams[i].dist[1])] > 1;
+    mve::image::UndistortMapCache undistort_cache;
+
+    /* Load the original images in the background. */
+    std::vector<std::string> embeddings;
+    if (!conf.undistorted_name.empty())
+        embeddings.push_back(conf.original_name);
+    mve::ViewPrefetcher prefetcher(views, embeddings);
+    for (std::size_t i = 0; i < views.size(); ++i)
+        if (selected[i] && !embeddings.empty())
+            prefetcher.prefetch(i);
+
 #pragma omp parallel for schedule(dynamic,1)
 #ifndef _MSC_VER
     for (std::size_t i = 0; i < bundle_cams.size(); ++i)
@@ -417,25 +455,31 @@ sfm_reconstruct (AppSettings const& conf)
 	for (int64_t i = 0; i < bundle_cams.size(); ++i)
 #endif
 	{
+        if (!selected[i])
+            continue;
+
+        /* The view is accessed only after the prefetcher handed it back. */
         mve::View::Ptr view = views[i];
         mve::CameraInfo const& cam = bundle_cams[i];
-        if (view == nullptr)
-            continue;
-        if (view->get_camera().flen == 0.0f && cam.flen == 0.0f)
-            continue;
+        mve::ByteImage::Ptr original;
+        if (!conf.undistorted_name.empty())
+            original = prefetcher.get_byte_image(i, conf.original_name);
 
         view->set_camera(cam);
 
         /* Undistort image. */
         if (!conf.undistorted_name.empty())
         {
-            mve::ByteImage::Ptr original
-                = view->get_byte_image(conf.original_name);
             if (original == nullptr)
                 continue;
-            mve::ByteImage::Ptr undist
-                = mve::image::image_undistort_k2k4<uint8_t>
-                (original, cam.flen, cam.dist[0], cam.dist[1]);
+            mve::ByteImage::Ptr undist;
+            if (shared_intrinsics[i])
+                undist = undistort_cache.get_k2k4(original->width(),
+                    original->height(), cam.flen, cam.dist[0], cam.dist[1])
+                    ->apply<uint8_t>(original);
+            else
+                undist = mve::image::image_undistort_k2k4<uint8_t>(original,
+                    cam.flen, cam.dist[0], cam.dist[1]);
             view->set_image(undist, conf.undistorted_name);
         }
 
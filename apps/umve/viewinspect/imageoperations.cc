@@ -162,6 +162,7 @@ struct JobDMRecon : public JobProgress
             case mvs::RECON_IDLE: return "MVS is idle";
             case mvs::RECON_GLOBALVS: return "Global VS...";
             case mvs::RECON_FEATURES: return "Processing Features...";
+            case mvs::RECON_PATCHMATCH: return "PatchMatch...";
             case mvs::RECON_SAVING: return "Saving reconstruction...";
             case mvs::RECON_CANCELLED: return "Cancelled";
             case mvs::RECON_QUEUE:
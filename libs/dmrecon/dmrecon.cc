@@ -24,6 +24,7 @@
 #include "dmrecon/settings.h"
 #include "dmrecon/dmrecon.h"
 #include "dmrecon/global_view_selection.h"
+#include "dmrecon/patch_match.h"
 
 MVS_NAMESPACE_BEGIN
 
@@ -95,8 +96,13 @@ DMRecon::start()
 
         analyzeFeatures();
         globalViewSelection();
-        processFeatures();
-        processQueue();
+        if (settings.usePatchMatch)
+            processPatchMatch();
+        else
+        {
+            processFeatures();
+            processQueue();
+        }
 
         if (progress.cancelled)
         {
@@ -433,4 +439,20 @@ DMRecon::processQueue()
     }
 }
 
+void
+DMRecon::processPatchMatch()
+{
+    progress.status = RECON_PATCHMATCH;
+    if (progress.cancelled)
+        return;
+
+    if (!settings.quiet)
+        std::cout << "Running PatchMatch with " << settings.patchMatchIterations
+            << " iterations..." << std::endl;
+
+    PatchMatch patchMatch(views, settings, neighViews,
+        bundle->get_features(), &progress);
+    patchMatch.compute();
+}
+
 MVS_NAMESPACE_END
@@ -64,6 +64,7 @@ private:
     void globalViewSelection();
     void processFeatures();
     void processQueue();
+    void processPatchMatch();
     void refillQueueFromLowRes();
 };
 
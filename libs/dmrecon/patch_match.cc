@@ -0,0 +1,327 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "math/defines.h"
+#include "math/functions.h"
+#include "math/vector.h"
+#include "dmrecon/patch_match.h"
+#include "dmrecon/patch_sampler.h"
+
+MVS_NAMESPACE_BEGIN
+
+namespace
+{
+    /** Cost of an invalid hypothesis (NCC is bounded by -1). */
+    float const MAX_COST = 2.f;
+    /** Maximum tilt of random planes w.r.t. the viewing direction. */
+    float const MAX_TILT_ANGLE = MATH_DEG2RAD(60.f);
+
+    /*
+     * Deterministic random number in [0, 1] for a pixel and a seed.
+     * This keeps results independent of thread scheduling.
+     */
+    float
+    random_float (int x, int y, unsigned int seed)
+    {
+        unsigned int h = static_cast<unsigned int>(x) * 73856093u
+            ^ static_cast<unsigned int>(y) * 19349663u
+            ^ seed * 83492791u;
+        h = (h ^ 61u) ^ (h >> 16);
+        h *= 9u;
+        h ^= h >> 4;
+        h *= 0x27d4eb2du;
+        h ^= h >> 15;
+        return static_cast<float>(h)
+            / static_cast<float>(std::numeric_limits<unsigned int>::max());
+    }
+}
+
+PatchMatch::PatchMatch(std::vector<SingleView::Ptr> const& _views,
+    Settings const& _settings, IndexSet const& _neighViews,
+    mve::Bundle::Features const& _features, Progress* _progress)
+    : views(_views)
+    , settings(_settings)
+    , neighViews(_neighViews)
+    , features(_features)
+    , progress(_progress)
+    , minDepth(0.f)
+    , maxDepth(0.f)
+{
+    this->refV = views[settings.refViewNr];
+    this->width = refV->depthImg->width();
+    this->height = refV->depthImg->height();
+}
+
+void
+PatchMatch::compute()
+{
+    this->computeDepthRange();
+    this->initialize();
+
+    for (unsigned int i = 0; i < settings.patchMatchIterations; ++i)
+    {
+        if (progress->cancelled)
+            return;
+        if (!settings.quiet)
+            std::cout << "PatchMatch iteration " << (i + 1) << " of "
+                << settings.patchMatchIterations << "..." << std::endl;
+        this->propagate(0, i);
+        this->propagate(1, i);
+    }
+
+    if (progress->cancelled)
+        return;
+    this->finalize();
+}
+
+void
+PatchMatch::computeDepthRange()
+{
+    std::vector<std::size_t> const& featIDs = refV->getFeatureIndices();
+    this->minDepth = std::numeric_limits<float>::max();
+    this->maxDepth = 0.f;
+    for (std::size_t i = 0; i < featIDs.size(); ++i)
+    {
+        math::Vec3f featPos(features[featIDs[i]].pos);
+        float const depth = (featPos - refV->camPos).norm();
+        this->minDepth = std::min(this->minDepth, depth);
+        this->maxDepth = std::max(this->maxDepth, depth);
+    }
+
+    if (this->maxDepth <= 0.f)
+        throw std::runtime_error("No features to determine depth range");
+
+    /* Extend the range to cover surfaces slightly beyond the features. */
+    this->minDepth *= 0.8f;
+    this->maxDepth *= 1.25f;
+
+    if (!settings.quiet)
+        std::cout << "PatchMatch depth range: " << this->minDepth
+            << " - " << this->maxDepth << std::endl;
+}
+
+float
+PatchMatch::maxDerivative(int x, int y, float depth) const
+{
+    math::Vec3f pos = refV->camPos + depth * refV->viewRayScaled(x, y);
+    return refV->footPrintScaled(pos) * std::tan(MAX_TILT_ANGLE);
+}
+
+void
+PatchMatch::initialize()
+{
+    this->costImg = mve::FloatImage::create(width, height, 1);
+    this->costImg->fill(MAX_COST);
+    refV->depthImg->fill(0.f);
+    refV->dzImg->fill(0.f);
+    refV->normalImg->fill(0.f);
+    refV->confImg->fill(0.f);
+
+    float const minInvDepth = 1.f / this->maxDepth;
+    float const maxInvDepth = 1.f / this->minDepth;
+
+    /* Random plane hypotheses, uniformly distributed in inverse depth. */
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < height; ++y)
+    {
+        std::vector<float> ncc;
+        for (int x = 0; x < width; ++x)
+        {
+            float const r1 = random_float(x, y, 1);
+            float const depth = 1.f / (minInvDepth
+                + r1 * (maxInvDepth - minInvDepth));
+            float const max_dz = this->maxDerivative(x, y, depth);
+            float const dzI = (2.f * random_float(x, y, 2) - 1.f) * max_dz;
+            float const dzJ = (2.f * random_float(x, y, 3) - 1.f) * max_dz;
+            this->testHypothesis(x, y, depth, dzI, dzJ, &ncc);
+        }
+    }
+
+    /* Seed fronto-parallel hypotheses from the SfM features. */
+    std::vector<float> ncc;
+    std::vector<std::size_t> const& featIDs = refV->getFeatureIndices();
+    for (std::size_t i = 0; i < featIDs.size(); ++i)
+    {
+        math::Vec3f featPos(features[featIDs[i]].pos);
+        math::Vec2f pixPosF = refV->worldToScreenScaled(featPos);
+        int const x = math::round(pixPosF[0]);
+        int const y = math::round(pixPosF[1]);
+        if (x < 0 || y < 0 || x >= width || y >= height)
+            continue;
+        float const depth = (featPos - refV->camPos).norm();
+        this->testHypothesis(x, y, depth, 0.f, 0.f, &ncc);
+    }
+}
+
+void
+PatchMatch::propagate(int parity, int iteration)
+{
+    /*
+     * Neighbors at odd Manhattan distance have the opposite color in
+     * the checkerboard, hence they are not modified in this pass.
+     */
+    int const offsets[8][2] = {
+        { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+        { -3, 0 }, { 3, 0 }, { 0, -3 }, { 0, 3 }
+    };
+    float const scale = std::pow(0.5f, static_cast<float>(iteration + 1));
+    float const depthRange = 0.5f * (this->maxDepth - this->minDepth);
+    unsigned int const seed = 4 * (iteration + 1) + 2 * parity;
+
+    mve::FloatImage& depthImg = *refV->depthImg;
+    mve::FloatImage& dzImg = *refV->dzImg;
+
+#pragma omp parallel for schedule(dynamic)
+    for (int y = 0; y < height; ++y)
+    {
+        if (progress->cancelled)
+            continue;
+
+        std::vector<float> ncc;
+        for (int x = (y + parity) % 2; x < width; x += 2)
+        {
+            /* Spatial propagation of neighboring planes. */
+            for (int i = 0; i < 8; ++i)
+            {
+                int const nx = x + offsets[i][0];
+                int const ny = y + offsets[i][1];
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height)
+                    continue;
+                if (costImg->at(nx, ny, 0) >= MAX_COST)
+                    continue;
+                float const dzI = dzImg.at(nx, ny, 0);
+                float const dzJ = dzImg.at(nx, ny, 1);
+                float const depth = depthImg.at(nx, ny, 0)
+                    - offsets[i][0] * dzI - offsets[i][1] * dzJ;
+                this->testHypothesis(x, y, depth, dzI, dzJ, &ncc);
+            }
+
+            /* Random refinement of depth and normal separately. */
+            float const depth = depthImg.at(x, y, 0);
+            float const dzI = dzImg.at(x, y, 0);
+            float const dzJ = dzImg.at(x, y, 1);
+            if (depth <= 0.f)
+                continue;
+
+            float const r1 = 2.f * random_float(x, y, seed) - 1.f;
+            this->testHypothesis(x, y, depth + r1 * scale * depthRange,
+                dzI, dzJ, &ncc);
+
+            float const max_dz = scale * this->maxDerivative(x, y, depth);
+            float const r2 = 2.f * random_float(x, y, seed + 1) - 1.f;
+            float const r3 = 2.f * random_float(x, y, seed + 2) - 1.f;
+            this->testHypothesis(x, y, depth, dzI + r2 * max_dz,
+                dzJ + r3 * max_dz, &ncc);
+        }
+    }
+}
+
+void
+PatchMatch::finalize()
+{
+    mve::FloatImage& depthImg = *refV->depthImg;
+    mve::FloatImage& normalImg = *refV->normalImg;
+    mve::FloatImage& dzImg = *refV->dzImg;
+    mve::FloatImage& confImg = *refV->confImg;
+
+    std::size_t filled = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:filled)
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            /* Confidence as in PatchOptimization::computeConfidence(). */
+            float const meanNCC = 1.f - costImg->at(x, y, 0);
+            float score = (meanNCC - settings.acceptNCC)
+                / (1.f - settings.acceptNCC);
+            math::Vec3f normal(0.f);
+            if (score > 0.f)
+            {
+                PatchSampler sampler(views, settings, x, y,
+                    depthImg.at(x, y, 0), dzImg.at(x, y, 0),
+                    dzImg.at(x, y, 1));
+                normal = sampler.getPatchNormal();
+                math::Vec3f viewDir(refV->viewRayScaled(x, y));
+                if (-normal.dot(viewDir) < 0.2f)
+                    score = 0.f;
+            }
+
+            if (score <= 0.f)
+            {
+                depthImg.at(x, y, 0) = 0.f;
+                dzImg.at(x, y, 0) = 0.f;
+                dzImg.at(x, y, 1) = 0.f;
+                confImg.at(x, y, 0) = 0.f;
+                continue;
+            }
+
+            for (int c = 0; c < 3; ++c)
+                normalImg.at(x, y, c) = normal[c];
+            confImg.at(x, y, 0) = score;
+            filled += 1;
+        }
+    }
+
+    progress->filled = filled;
+}
+
+float
+PatchMatch::computeCost(int x, int y, float depth, float dzI, float dzJ,
+    std::vector<float>* ncc) const
+{
+    if (!(depth > 0.f))
+        return MAX_COST;
+
+    PatchSampler sampler(views, settings, x, y, depth, dzI, dzJ);
+    if (!sampler.success[settings.refViewNr])
+        return MAX_COST;
+
+    ncc->clear();
+    for (IndexSet::const_iterator id = neighViews.begin();
+        id != neighViews.end(); ++id)
+        ncc->push_back(sampler.getFastNCC(*id));
+
+    /* Aggregate the best NCC scores to handle occlusions. */
+    std::size_t const num = std::min<std::size_t>(ncc->size(),
+        settings.nrReconNeighbors);
+    if (num == 0)
+        return MAX_COST;
+    std::partial_sort(ncc->begin(), ncc->begin() + num, ncc->end(),
+        std::greater<float>());
+
+    float meanNCC = 0.f;
+    for (std::size_t i = 0; i < num; ++i)
+        meanNCC += ncc->at(i);
+    meanNCC /= static_cast<float>(num);
+
+    return 1.f - meanNCC;
+}
+
+void
+PatchMatch::testHypothesis(int x, int y, float depth, float dzI, float dzJ,
+    std::vector<float>* ncc)
+{
+    float const cost = this->computeCost(x, y, depth, dzI, dzJ, ncc);
+    if (cost >= this->costImg->at(x, y, 0))
+        return;
+
+    this->costImg->at(x, y, 0) = cost;
+    refV->depthImg->at(x, y, 0) = depth;
+    refV->dzImg->at(x, y, 0) = dzI;
+    refV->dzImg->at(x, y, 1) = dzJ;
+}
+
+MVS_NAMESPACE_END
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef DMRECON_PATCH_MATCH_H
+#define DMRECON_PATCH_MATCH_H
+
+#include <vector>
+
+#include "mve/bundle.h"
+#include "mve/image.h"
+#include "dmrecon/defines.h"
+#include "dmrecon/progress.h"
+#include "dmrecon/settings.h"
+#include "dmrecon/single_view.h"
+
+MVS_NAMESPACE_BEGIN
+
+/**
+ * PatchMatch-style depth estimation as an alternative to region growing.
+ *
+ * Every pixel of the reference view carries a plane hypothesis in the
+ * same parametrization as the region growing (depth along the viewing ray
+ * and the depth derivatives dzI, dzJ). Hypotheses are initialized randomly
+ * within the depth range spanned by the SfM features, and seeded with the
+ * features themselves. Each iteration propagates hypotheses in a red-black
+ * checkerboard pattern, followed by a random refinement step. All pixels
+ * of one color are independent and processed in parallel, which makes the
+ * runtime proportional to the image size instead of the scene content.
+ *
+ * The matching cost is one minus the mean of the best 'nrReconNeighbors'
+ * NCC scores against the globally selected views, as computed by the
+ * PatchSampler. The result is written to the depth, normal, dz and
+ * confidence images of the reference view.
+ */
+class PatchMatch
+{
+public:
+    PatchMatch(std::vector<SingleView::Ptr> const& views,
+        Settings const& settings, IndexSet const& neighViews,
+        mve::Bundle::Features const& features, Progress* progress);
+
+    /** Runs initialization, propagation and refinement. */
+    void compute();
+
+private:
+    void computeDepthRange();
+    void initialize();
+    void propagate(int parity, int iteration);
+    void finalize();
+
+    /** Evaluates a hypothesis for the given pixel, returns the cost. */
+    float computeCost(int x, int y, float depth, float dzI, float dzJ,
+        std::vector<float>* ncc) const;
+
+    /** Replaces the hypothesis of a pixel if it has a lower cost. */
+    void testHypothesis(int x, int y, float depth, float dzI, float dzJ,
+        std::vector<float>* ncc);
+
+    /** Depth derivative per pixel for the given tilt angle. */
+    float maxDerivative(int x, int y, float depth) const;
+
+private:
+    std::vector<SingleView::Ptr> const& views;
+    Settings const& settings;
+    IndexSet const& neighViews;
+    mve::Bundle::Features const& features;
+    Progress* progress;
+
+    SingleView::Ptr refV;
+    int width;
+    int height;
+    float minDepth;
+    float maxDepth;
+    mve::FloatImage::Ptr costImg;
+};
+
+MVS_NAMESPACE_END
+
+#endif /* DMRECON_PATCH_MATCH_H */
@@ -20,6 +20,7 @@ enum ReconStatus
     RECON_GLOBALVS,
     RECON_FEATURES,
     RECON_QUEUE,
+    RECON_PATCHMATCH,
     RECON_SAVING,
     RECON_CANCELLED
 };
@@ -40,6 +40,11 @@ struct Settings
     bool useColorScale = true;
     bool writePlyFile = false;
 
+    /** Use PatchMatch propagation instead of region growing. */
+    bool usePatchMatch = false;
+    /** Number of red-black propagation iterations for PatchMatch. */
+    unsigned int patchMatchIterations = 4;
+
     /** Features outside the AABB are ignored. */
     math::Vec3f aabbMin = math::Vec3f(-std::numeric_limits<float>::max());
     math::Vec3f aabbMax = math::Vec3f(std::numeric_limits<float>::max());
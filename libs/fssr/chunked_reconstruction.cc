@@ -0,0 +1,479 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+
+#include "util/exception.h"
+#include "util/file_system.h"
+#include "util/string.h"
+#include "util/timer.h"
+#include "fssr/chunked_reconstruction.h"
+
+#define HISTOGRAM_LEVEL 6
+#define HISTOGRAM_SIZE (1 << HISTOGRAM_LEVEL)
+
+FSSR_NAMESPACE_BEGIN
+
+namespace
+{
+    /*
+     * Estimated peak memory per sample in the octree of a chunk, which
+     * includes the sample, the octree nodes, the voxels and the isosurface.
+     */
+    std::size_t const BYTES_PER_SAMPLE = 512;
+
+    /** Number of samples read from the chunk files at once. */
+    std::size_t const READ_BLOCK_SIZE = 4096;
+
+    std::size_t
+    cell_index (int x, int y, int z)
+    {
+        return (static_cast<std::size_t>(z) * HISTOGRAM_SIZE + y)
+            * HISTOGRAM_SIZE + x;
+    }
+}
+
+mve::TriangleMesh::Ptr
+ChunkedReconstruction::reconstruct (std::vector<std::string> const& filenames)
+{
+    if (this->opts.max_memory == 0)
+        throw std::invalid_argument("No memory limit given");
+    if (filenames.empty())
+        throw std::invalid_argument("No input files given");
+
+    /* Determine the common octree root and the chunks. */
+    this->chunks.clear();
+    std::size_t const num_samples = this->compute_root(filenames);
+    if (num_samples * BYTES_PER_SAMPLE <= this->opts.max_memory)
+    {
+        Chunk chunk;
+        chunk.level = 0;
+        chunk.path = 0;
+        chunk.num_samples = num_samples;
+        this->chunks.push_back(chunk);
+    }
+    else
+    {
+        this->compute_histogram(filenames);
+        this->compute_chunks(0, 0);
+        std::vector<std::size_t>().swap(this->histogram);
+    }
+    std::cout << "Partitioned " << num_samples << " samples into "
+        << this->chunks.size() << " chunks." << std::endl;
+
+    mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+    EdgeVertexMap vertex_map(IsoSurface::EdgeIndex(
+        std::numeric_limits<uint64_t>::max(),
+        std::numeric_limits<uint64_t>::max()));
+    try
+    {
+        if (this->chunks.size() > 1)
+            this->distribute_samples(filenames);
+        std::vector<std::size_t>().swap(this->cell_chunks);
+
+        for (std::size_t i = 0; i < this->chunks.size(); ++i)
+        {
+            if (this->chunks[i].num_samples == 0)
+                continue;
+            std::cout << "Reconstructing chunk " << (i + 1) << " of "
+                << this->chunks.size() << "..." << std::endl;
+            this->reconstruct_chunk(this->chunks[i], filenames,
+                mesh, &vertex_map);
+        }
+    }
+    catch (...)
+    {
+        this->remove_chunk_files();
+        throw;
+    }
+    this->remove_chunk_files();
+
+    return mesh;
+}
+
+std::size_t
+ChunkedReconstruction::compute_root (std::vector<std::string> const& filenames)
+{
+    std::cout << "Computing bounding box of the samples..." << std::endl;
+    util::WallTimer timer;
+
+    math::Vec3d aabb_min(std::numeric_limits<double>::max());
+    math::Vec3d aabb_max(-std::numeric_limits<double>::max());
+    double max_scale = 0.0;
+    std::size_t num_samples = 0;
+    for (std::size_t i = 0; i < filenames.size(); ++i)
+    {
+        SampleIO loader(this->opts.sample_options);
+        loader.open_file(filenames[i]);
+        Sample sample;
+        while (loader.next_sample(&sample))
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                aabb_min[j] = std::min(aabb_min[j], double(sample.pos[j]));
+                aabb_max[j] = std::max(aabb_max[j], double(sample.pos[j]));
+            }
+            max_scale = std::max(max_scale, double(sample.scale));
+            num_samples += 1;
+        }
+    }
+
+    if (num_samples == 0)
+        throw std::invalid_argument("Input files do not contain any samples");
+
+    /*
+     * The root contains all samples and is not smaller than the largest
+     * sample, thus the octrees of the chunks are never expanded.
+     */
+    this->root_center = (aabb_min + aabb_max) / 2.0;
+    this->root_size = max_scale;
+    for (int i = 0; i < 3; ++i)
+        this->root_size = std::max(this->root_size, aabb_max[i] - aabb_min[i]);
+    this->root_size *= 1.01;
+
+    std::cout << "Bounding box computation took "
+        << timer.get_elapsed() << "ms." << std::endl;
+
+    return num_samples;
+}
+
+void
+ChunkedReconstruction::compute_histogram (
+    std::vector<std::string> const& filenames)
+{
+    std::cout << "Computing sample distribution..." << std::endl;
+    util::WallTimer timer;
+
+    this->histogram.clear();
+    this->histogram.resize(HISTOGRAM_SIZE * HISTOGRAM_SIZE * HISTOGRAM_SIZE, 0);
+    for (std::size_t i = 0; i < filenames.size(); ++i)
+    {
+        SampleIO loader(this->opts.sample_options);
+        loader.open_file(filenames[i]);
+        Sample sample;
+        while (loader.next_sample(&sample))
+        {
+            int cell[3], cell_max[3];
+            this->get_cell_range(sample.pos, 0.0f, cell, cell_max);
+            this->histogram[cell_index(cell[0], cell[1], cell[2])] += 1;
+        }
+    }
+
+    std::cout << "Sample distribution took "
+        << timer.get_elapsed() << "ms." << std::endl;
+}
+
+void
+ChunkedReconstruction::compute_chunks (uint8_t level, uint64_t path)
+{
+    if (this->cell_chunks.empty())
+        this->cell_chunks.resize(this->histogram.size(), 0);
+
+    int cell_min[3], cell_max[3];
+    this->get_node_cells(level, path, cell_min, cell_max);
+    std::size_t num_samples = 0;
+    for (int z = cell_min[2]; z <= cell_max[2]; ++z)
+        for (int y = cell_min[1]; y <= cell_max[1]; ++y)
+            for (int x = cell_min[0]; x <= cell_max[0]; ++x)
+                num_samples += this->histogram[cell_index(x, y, z)];
+
+    /* Half of the memory is reserved for samples in the overlap. */
+    if (level < HISTOGRAM_LEVEL
+        && num_samples * BYTES_PER_SAMPLE > this->opts.max_memory / 2)
+    {
+        for (int i = 0; i < 8; ++i)
+            this->compute_chunks(level + 1, (path << 3) | i);
+        return;
+    }
+
+    for (int z = cell_min[2]; z <= cell_max[2]; ++z)
+        for (int y = cell_min[1]; y <= cell_max[1]; ++y)
+            for (int x = cell_min[0]; x <= cell_max[0]; ++x)
+                this->cell_chunks[cell_index(x, y, z)] = this->chunks.size();
+
+    Chunk chunk;
+    chunk.level = level;
+    chunk.path = path;
+    chunk.num_samples = 0;
+    chunk.filename = util::fs::join_path(this->opts.temp_dir,
+        "fssr-chunk-" + util::string::get(this->chunks.size()) + ".tmp");
+    this->chunks.push_back(chunk);
+}
+
+void
+ChunkedReconstruction::distribute_samples (
+    std::vector<std::string> const& filenames)
+{
+    std::cout << "Writing samples to chunk files..." << std::endl;
+    util::WallTimer timer;
+
+    /* Samples are buffered and appended to the files if the memory is full. */
+    std::size_t const max_buffer_size = std::max<std::size_t>(1,
+        this->opts.max_memory / sizeof(Sample));
+    this->buffer_size = 0;
+
+    std::vector<std::size_t> sample_chunks;
+    for (std::size_t i = 0; i < filenames.size(); ++i)
+    {
+        SampleIO loader(this->opts.sample_options);
+        loader.open_file(filenames[i]);
+        Sample sample;
+        while (loader.next_sample(&sample))
+        {
+            /* Find all chunks within the influence of the sample. */
+            int cell_min[3], cell_max[3];
+            this->get_cell_range(sample.pos,
+                this->opts.overlap_factor * sample.scale, cell_min, cell_max);
+            std::size_t const num_cells = static_cast<std::size_t>(
+                cell_max[0] - cell_min[0] + 1)
+                * (cell_max[1] - cell_min[1] + 1)
+                * (cell_max[2] - cell_min[2] + 1);
+
+            sample_chunks.clear();
+            if (num_cells <= this->chunks.size())
+            {
+                for (int z = cell_min[2]; z <= cell_max[2]; ++z)
+                    for (int y = cell_min[1]; y <= cell_max[1]; ++y)
+                        for (int x = cell_min[0]; x <= cell_max[0]; ++x)
+                            sample_chunks.push_back(
+                                this->cell_chunks[cell_index(x, y, z)]);
+                std::sort(sample_chunks.begin(), sample_chunks.end());
+                sample_chunks.erase(std::unique(sample_chunks.begin(),
+                    sample_chunks.end()), sample_chunks.end());
+            }
+            else
+            {
+                for (std::size_t j = 0; j < this->chunks.size(); ++j)
+                {
+                    int node_min[3], node_max[3];
+                    this->get_node_cells(this->chunks[j].level,
+                        this->chunks[j].path, node_min, node_max);
+                    bool overlap = true;
+                    for (int k = 0; k < 3; ++k)
+                        overlap = overlap && node_min[k] <= cell_max[k]
+                            && node_max[k] >= cell_min[k];
+                    if (overlap)
+                        sample_chunks.push_back(j);
+                }
+            }
+
+            for (std::size_t j = 0; j < sample_chunks.size(); ++j)
+            {
+                Chunk& chunk = this->chunks[sample_chunks[j]];
+                chunk.buffer.push_back(sample);
+                chunk.num_samples += 1;
+            }
+            this->buffer_size += sample_chunks.size();
+            if (this->buffer_size >= max_buffer_size)
+                this->flush_chunk_buffers();
+        }
+    }
+    this->flush_chunk_buffers();
+
+    std::cout << "Writing chunk files took "
+        << timer.get_elapsed() << "ms." << std::endl;
+}
+
+void
+ChunkedReconstruction::flush_chunk_buffers (void)
+{
+    for (std::size_t i = 0; i < this->chunks.size(); ++i)
+    {
+        Chunk& chunk = this->chunks[i];
+        if (chunk.buffer.empty())
+            continue;
+
+        /* The file is created by the first flush and appended afterwards. */
+        std::ios::openmode mode = std::ios::binary | std::ios::out;
+        if (chunk.num_samples == chunk.buffer.size())
+            mode |= std::ios::trunc;
+        else
+            mode |= std::ios::app;
+
+        std::ofstream out(chunk.filename.c_str(), mode);
+        if (!out.good())
+            throw util::FileException(chunk.filename, std::strerror(errno));
+        out.write(reinterpret_cast<char const*>(&chunk.buffer[0]),
+            chunk.buffer.size() * sizeof(Sample));
+        if (!out.good())
+            throw util::FileException(chunk.filename, "Error writing samples");
+        out.close();
+
+        SampleList().swap(chunk.buffer);
+    }
+    this->buffer_size = 0;
+}
+
+void
+ChunkedReconstruction::load_chunk (Chunk const& chunk,
+    std::vector<std::string> const& filenames, IsoOctree* octree)
+{
+    /* All chunks share the root and contain the chunk node. */
+    octree->set_root_node(this->root_center, this->root_size);
+    octree->create_node(chunk.level, chunk.path);
+
+    if (this->chunks.size() == 1)
+    {
+        /* A single chunk is read directly from the input files. */
+        for (std::size_t i = 0; i < filenames.size(); ++i)
+        {
+            SampleIO loader(this->opts.sample_options);
+            loader.open_file(filenames[i]);
+            Sample sample;
+            while (loader.next_sample(&sample))
+                octree->insert_sample(sample);
+        }
+    }
+    else
+    {
+        std::ifstream in(chunk.filename.c_str(), std::ios::binary);
+        if (!in.good())
+            throw util::FileException(chunk.filename, std::strerror(errno));
+
+        SampleList samples(READ_BLOCK_SIZE);
+        for (std::size_t i = 0; i < chunk.num_samples; i += READ_BLOCK_SIZE)
+        {
+            std::size_t const num = std::min(READ_BLOCK_SIZE,
+                chunk.num_samples - i);
+            in.read(reinterpret_cast<char*>(&samples[0]),
+                num * sizeof(Sample));
+            if (!in.good())
+                throw util::FileException(chunk.filename, "Unexpected EOF");
+            for (std::size_t j = 0; j < num; ++j)
+                octree->insert_sample(samples[j]);
+        }
+    }
+
+    if (octree->get_root_node_size() != this->root_size)
+        throw std::runtime_error("Octree root of chunk has been expanded");
+}
+
+void
+ChunkedReconstruction::reconstruct_chunk (Chunk const& chunk,
+    std::vector<std::string> const& filenames,
+    mve::TriangleMesh::Ptr mesh, EdgeVertexMap* vertex_map)
+{
+    IsoOctree octree;
+    {
+        util::WallTimer timer;
+        this->load_chunk(chunk, filenames, &octree);
+        std::cout << "Loading " << octree.get_num_samples()
+            << " samples took " << timer.get_elapsed() << "ms." << std::endl;
+    }
+
+    if (octree.get_num_samples() * BYTES_PER_SAMPLE > this->opts.max_memory)
+        std::cout << "WARNING: Chunk exceeds the memory limit." << std::endl;
+
+    /* Refine octree if requested. Each iteration adds one level. */
+    for (int i = 0; i < this->opts.refine_octree; ++i)
+        octree.refine_octree();
+
+    /* Compute voxels. */
+    octree.limit_octree_level();
+    octree.print_stats(std::cout);
+    octree.compute_voxels();
+    octree.clear_samples();
+
+    /* Extract isosurface of the leaves inside the chunk. */
+    mve::TriangleMesh::Ptr chunk_mesh;
+    IsoSurface::EdgeIndexList vertex_edges;
+    {
+        std::cout << "Extracting isosurface..." << std::endl;
+        util::WallTimer timer;
+        IsoSurface iso_surface(&octree, this->opts.interpolation_type);
+        iso_surface.set_extraction_node(chunk.level, chunk.path);
+        chunk_mesh = iso_surface.extract_mesh(&vertex_edges);
+        std::cout << "  Done. Surface extraction took "
+            << timer.get_elapsed() << "ms." << std::endl;
+    }
+    octree.clear();
+
+    /* Stitch the chunk mesh using the edge indices of the vertices. */
+    mve::TriangleMesh::VertexList& verts = mesh->get_vertices();
+    mve::TriangleMesh::ColorList& colors = mesh->get_vertex_colors();
+    mve::TriangleMesh::ValueList& values = mesh->get_vertex_values();
+    mve::TriangleMesh::ConfidenceList& cfs = mesh->get_vertex_confidences();
+    mve::TriangleMesh::FaceList& faces = mesh->get_faces();
+
+    std::vector<std::size_t> vertex_ids(vertex_edges.size());
+    for (std::size_t i = 0; i < vertex_edges.size(); ++i)
+    {
+        std::pair<std::size_t*, bool> result
+            = vertex_map->insert(vertex_edges[i], verts.size());
+        vertex_ids[i] = *result.first;
+        if (!result.second)
+            continue;
+        verts.push_back(chunk_mesh->get_vertices()[i]);
+        colors.push_back(chunk_mesh->get_vertex_colors()[i]);
+        values.push_back(chunk_mesh->get_vertex_values()[i]);
+        cfs.push_back(chunk_mesh->get_vertex_confidences()[i]);
+    }
+
+    mve::TriangleMesh::FaceList const& chunk_faces = chunk_mesh->get_faces();
+    faces.reserve(faces.size() + chunk_faces.size());
+    for (std::size_t i = 0; i < chunk_faces.size(); ++i)
+        faces.push_back(vertex_ids[chunk_faces[i]]);
+}
+
+void
+ChunkedReconstruction::remove_chunk_files (void)
+{
+    if (this->chunks.size() < 2)
+        return;
+    for (std::size_t i = 0; i < this->chunks.size(); ++i)
+        if (this->chunks[i].num_samples > 0)
+            util::fs::unlink(this->chunks[i].filename.c_str());
+}
+
+void
+ChunkedReconstruction::get_cell_range (math::Vec3f const& pos, float radius,
+    int* cell_min, int* cell_max) const
+{
+    double const cell_size = this->root_size / HISTOGRAM_SIZE;
+    for (int i = 0; i < 3; ++i)
+    {
+        double const offset = this->root_center[i] - this->root_size / 2.0;
+        double const lower = (pos[i] - radius - offset) / cell_size;
+        double const upper = (pos[i] + radius - offset) / cell_size;
+        cell_min[i] = static_cast<int>(std::max(0.0, std::min(
+            static_cast<double>(HISTOGRAM_SIZE - 1), std::floor(lower))));
+        cell_max[i] = static_cast<int>(std::max(0.0, std::min(
+            static_cast<double>(HISTOGRAM_SIZE - 1), std::floor(upper))));
+    }
+}
+
+void
+ChunkedReconstruction::get_node_cells (uint8_t level, uint64_t path,
+    int* cell_min, int* cell_max) const
+{
+    /* The octant bits of the path are the bits of the node coordinates. */
+    int node[3] = { 0, 0, 0 };
+    for (int i = 0; i < level; ++i)
+    {
+        int const octant = (path >> ((level - i - 1) * 3)) & 7;
+        for (int j = 0; j < 3; ++j)
+            node[j] = (node[j] << 1) | ((octant >> j) & 1);
+    }
+
+    int const shift = HISTOGRAM_LEVEL - level;
+    for (int i = 0; i < 3; ++i)
+    {
+        cell_min[i] = node[i] << shift;
+        cell_max[i] = ((node[i] + 1) << shift) - 1;
+    }
+}
+
+FSSR_NAMESPACE_END
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef FSSR_CHUNKED_RECONSTRUCTION_HEADER
+#define FSSR_CHUNKED_RECONSTRUCTION_HEADER
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "math/vector.h"
+#include "mve/mesh.h"
+#include "fssr/defines.h"
+#include "fssr/hash_map.h"
+#include "fssr/hermite.h"
+#include "fssr/iso_octree.h"
+#include "fssr/iso_surface.h"
+#include "fssr/sample.h"
+#include "fssr/sample_io.h"
+
+FSSR_NAMESPACE_BEGIN
+
+/**
+ * Out-of-core surface reconstruction for point sets that do not fit in
+ * memory. The bounding cube of all samples is used as common octree root,
+ * and is partitioned into octree nodes (chunks) such that the samples in
+ * each chunk fit into the given memory budget. Every sample is written to
+ * a temporary file for each chunk it influences, i.e., the chunks overlap
+ * by a margin proportional to the sample scale. The chunks are then
+ * reconstructed one after another, and only the polygons of the leaves
+ * inside the chunk are extracted. Because all chunks share the same octree
+ * hierarchy, vertices on chunk boundaries have the same edge index and the
+ * chunk meshes are stitched without seams.
+ *
+ * The input files are read three times: For the bounding box, for the
+ * sample distribution, and to write the chunk files. If everything fits
+ * into memory, a single chunk is reconstructed without temporary files.
+ */
+class ChunkedReconstruction
+{
+public:
+    struct Options
+    {
+        Options (void);
+
+        /** Options for reading the input samples. */
+        SampleIO::Options sample_options;
+        /** Interpolation type for the isosurface extraction. */
+        InterpolationType interpolation_type;
+        /** Refines the octree of every chunk with N levels. */
+        int refine_octree;
+        /** Peak memory for the samples, octree and voxels of one chunk. */
+        std::size_t max_memory;
+        /**
+         * The chunk overlap as factor of the sample scale. The default
+         * covers the support of the basis function (three times the scale)
+         * and the leaves next to the chunk boundary.
+         */
+        double overlap_factor;
+        /** Directory for the temporary chunk files. */
+        std::string temp_dir;
+    };
+
+public:
+    ChunkedReconstruction (Options const& options);
+
+    /** Reconstructs the stitched surface mesh from the input files. */
+    mve::TriangleMesh::Ptr reconstruct (
+        std::vector<std::string> const& filenames);
+
+private:
+    struct Chunk
+    {
+        uint8_t level;
+        uint64_t path;
+        std::string filename;
+        std::size_t num_samples;
+        SampleList buffer;
+    };
+
+    typedef HashMap<IsoSurface::EdgeIndex, std::size_t,
+        IsoSurface::EdgeIndexHash> EdgeVertexMap;
+
+private:
+    std::size_t compute_root (std::vector<std::string> const& filenames);
+    void compute_histogram (std::vector<std::string> const& filenames);
+    void compute_chunks (uint8_t level, uint64_t path);
+    void distribute_samples (std::vector<std::string> const& filenames);
+    void flush_chunk_buffers (void);
+    void load_chunk (Chunk const& chunk,
+        std::vector<std::string> const& filenames, IsoOctree* octree);
+    void reconstruct_chunk (Chunk const& chunk,
+        std::vector<std::string> const& filenames,
+        mve::TriangleMesh::Ptr mesh, EdgeVertexMap* vertex_map);
+    void remove_chunk_files (void);
+
+    void get_cell_range (math::Vec3f const& pos, float radius,
+        int* cell_min, int* cell_max) const;
+    void get_node_cells (uint8_t level, uint64_t path,
+        int* cell_min, int* cell_max) const;
+
+private:
+    Options opts;
+    math::Vec3d root_center;
+    double root_size;
+    std::vector<std::size_t> histogram;
+    std::vector<std::size_t> cell_chunks;
+    std::vector<Chunk> chunks;
+    std::size_t buffer_size;
+};
+
+/* ------------------------- Implementation ---------------------------- */
+
+inline
+ChunkedReconstruction::Options::Options (void)
+    : interpolation_type(INTERPOLATION_CUBIC)
+    , refine_octree(0)
+    , max_memory(0)
+    , overlap_factor(7.0)
+    , temp_dir(".")
+{
+}
+
+inline
+ChunkedReconstruction::ChunkedReconstruction (Options const& options)
+    : opts(options)
+    , root_size(0.0)
+    , buffer_size(0)
+{
+}
+
+FSSR_NAMESPACE_END
+
+#endif /* FSSR_CHUNKED_RECONSTRUCTION_HEADER */
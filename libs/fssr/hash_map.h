@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef FSSR_HASH_MAP_HEADER
+#define FSSR_HASH_MAP_HEADER
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "fssr/defines.h"
+
+FSSR_NAMESPACE_BEGIN
+
+/**
+ * A compact hash map with open addressing and linear probing. Keys and
+ * values are stored inline in a single power-of-two sized array, which
+ * avoids the per-element allocations and pointer chasing of std::map.
+ * A designated empty key marks unused slots and must never be inserted.
+ * Elements cannot be removed. Concurrent lookups are safe as long as
+ * the map is not modified at the same time.
+ */
+template <typename KEY, typename VALUE, typename HASH>
+class HashMap
+{
+public:
+    typedef std::pair<KEY, VALUE> Entry;
+
+public:
+    explicit HashMap (KEY const& empty_key);
+
+    /** Removes all elements and releases the memory. */
+    void clear (void);
+
+    /** Prepares the map for the given amount of elements. */
+    void reserve (std::size_t num_elements);
+
+    /**
+     * Inserts the key/value pair if the key is not in the map. Returns
+     * the value in the map and whether the element was newly inserted.
+     */
+    std::pair<VALUE*, bool> insert (KEY const& key, VALUE const& value);
+
+    /** Returns the value for the key, or null if the key is not found. */
+    VALUE const* find (KEY const& key) const;
+
+    /** Returns the number of elements in the map. */
+    std::size_t size (void) const;
+
+    /** Returns true if the map contains no elements. */
+    bool empty (void) const;
+
+private:
+    void rehash (std::size_t capacity);
+
+private:
+    std::vector<Entry> entries;
+    std::size_t num_elements;
+    KEY empty_key;
+    HASH hash;
+};
+
+/* --------------------------------------------------------------------- */
+
+/** Finalizer of the 64 bit MurmurHash3 to spread the bits of integer keys. */
+inline uint64_t
+hash_mix (uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+/* ------------------------- Implementation ---------------------------- */
+
+template <typename KEY, typename VALUE, typename HASH>
+inline
+HashMap<KEY, VALUE, HASH>::HashMap (KEY const& empty_key)
+    : num_elements(0)
+    , empty_key(empty_key)
+{
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+inline void
+HashMap<KEY, VALUE, HASH>::clear (void)
+{
+    std::vector<Entry>().swap(this->entries);
+    this->num_elements = 0;
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+void
+HashMap<KEY, VALUE, HASH>::reserve (std::size_t num_elements)
+{
+    /* Keep the load factor below 1/2 for short probe sequences. */
+    std::size_t capacity = 16;
+    while (capacity < 2 * num_elements)
+        capacity *= 2;
+    if (capacity > this->entries.size())
+        this->rehash(capacity);
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+std::pair<VALUE*, bool>
+HashMap<KEY, VALUE, HASH>::insert (KEY const& key, VALUE const& value)
+{
+    if (2 * (this->num_elements + 1) > this->entries.size())
+        this->reserve(2 * (this->num_elements + 1));
+
+    std::size_t const mask = this->entries.size() - 1;
+    std::size_t slot = static_cast<std::size_t>(this->hash(key)) & mask;
+    while (true)
+    {
+        Entry& entry = this->entries[slot];
+        if (entry.first == this->empty_key)
+        {
+            entry.first = key;
+            entry.second = value;
+            this->num_elements += 1;
+            return std::make_pair(&entry.second, true);
+        }
+        if (entry.first == key)
+            return std::make_pair(&entry.second, false);
+        slot = (slot + 1) & mask;
+    }
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+VALUE const*
+HashMap<KEY, VALUE, HASH>::find (KEY const& key) const
+{
+    if (this->entries.empty())
+        return nullptr;
+
+    std::size_t const mask = this->entries.size() - 1;
+    std::size_t slot = static_cast<std::size_t>(this->hash(key)) & mask;
+    while (true)
+    {
+        Entry const& entry = this->entries[slot];
+        if (entry.first == key)
+            return &entry.second;
+        if (entry.first == this->empty_key)
+            return nullptr;
+        slot = (slot + 1) & mask;
+    }
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+inline std::size_t
+HashMap<KEY, VALUE, HASH>::size (void) const
+{
+    return this->num_elements;
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+inline bool
+HashMap<KEY, VALUE, HASH>::empty (void) const
+{
+    return this->num_elements == 0;
+}
+
+template <typename KEY, typename VALUE, typename HASH>
+void
+HashMap<KEY, VALUE, HASH>::rehash (std::size_t capacity)
+{
+    std::vector<Entry> old_entries(capacity,
+        std::make_pair(this->empty_key, VALUE()));
+    std::swap(old_entries, this->entries);
+
+    std::size_t const mask = capacity - 1;
+    for (std::size_t i = 0; i < old_entries.size(); ++i)
+    {
+        Entry const& entry = old_entries[i];
+        if (entry.first == this->empty_key)
+            continue;
+        std::size_t slot = static_cast<std::size_t>(this->hash(entry.first))
+            & mask;
+        while (!(this->entries[slot].first == this->empty_key))
+            slot = (slot + 1) & mask;
+        this->entries[slot] = entry;
+    }
+}
+
+FSSR_NAMESPACE_END
+
+#endif /* FSSR_HASH_MAP_HEADER */
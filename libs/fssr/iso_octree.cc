@@ -13,7 +13,8 @@
 #include <fstream>
 #include <vector>
 #include <list>
-#include <set>
+#include <algorithm>
+#include <cstdint>
 #include <stdexcept>
 #include <limits>
 
@@ -23,8 +24,86 @@
 #include "fssr/sample.h"
 #include "fssr/iso_octree.h"
 
+#define VOXEL_BLOCK_SIZE 16384
+#define RADIX_BLOCK_SIZE 65536
+
 FSSR_NAMESPACE_BEGIN
 
+namespace
+{
+    /*
+     * Parallel LSD radix sort for 64 bit keys using 8 bit digits. The keys
+     * are processed in blocks with individual histograms, which keeps the
+     * sort stable and independent of the number of threads. Passes where
+     * all keys have the same digit are skipped.
+     */
+    void
+    radix_sort (std::vector<uint64_t>* keys)
+    {
+        std::size_t const num_keys = keys->size();
+        std::size_t const num_blocks = (num_keys + RADIX_BLOCK_SIZE - 1)
+            / RADIX_BLOCK_SIZE;
+        std::vector<uint64_t> buffer(num_keys);
+        std::vector<std::size_t> offsets(num_blocks * 256);
+
+        for (int shift = 0; shift < 64; shift += 8)
+        {
+            /* Count the digits of every block. */
+            std::fill(offsets.begin(), offsets.end(), 0);
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+            for (std::size_t i = 0; i < num_blocks; ++i)
+#else
+            for (int64_t i = 0; i < num_blocks; ++i)
+#endif
+            {
+                std::size_t* counts = &offsets[i * 256];
+                std::size_t const end = std::min(num_keys,
+                    (i + 1) * RADIX_BLOCK_SIZE);
+                for (std::size_t j = i * RADIX_BLOCK_SIZE; j < end; ++j)
+                    counts[((*keys)[j] >> shift) & 0xff] += 1;
+            }
+
+            /* Compute output offsets, ordered by digit and block. */
+            bool skip_pass = false;
+            std::size_t sum = 0;
+            for (int digit = 0; digit < 256; ++digit)
+            {
+                std::size_t const digit_start = sum;
+                for (std::size_t i = 0; i < num_blocks; ++i)
+                {
+                    std::size_t const count = offsets[i * 256 + digit];
+                    offsets[i * 256 + digit] = sum;
+                    sum += count;
+                }
+                if (sum - digit_start == num_keys)
+                    skip_pass = true;
+            }
+            if (skip_pass)
+                continue;
+
+            /* Scatter the keys to the output offsets. */
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+            for (std::size_t i = 0; i < num_blocks; ++i)
+#else
+            for (int64_t i = 0; i < num_blocks; ++i)
+#endif
+            {
+                std::size_t* positions = &offsets[i * 256];
+                std::size_t const end = std::min(num_keys,
+                    (i + 1) * RADIX_BLOCK_SIZE);
+                for (std::size_t j = i * RADIX_BLOCK_SIZE; j < end; ++j)
+                {
+                    uint64_t const key = (*keys)[j];
+                    buffer[positions[(key >> shift) & 0xff]++] = key;
+                }
+            }
+            std::swap(*keys, buffer);
+        }
+    }
+}
+
 void
 IsoOctree::compute_voxels (void)
 {
@@ -41,28 +120,70 @@ IsoOctree::compute_all_voxels (void)
     /* Locate all leafs and store voxels in a vector. */
     std::cout << "Computing sampling of the implicit function..." << std::endl;
     {
-        /* Make voxels unique by storing them in a set first. */
-        typedef std::set<VoxelIndex> VoxelIndexSet;
-        VoxelIndexSet voxel_set;
-
-        /* Add voxels for all leaf nodes. */
+        std::vector<Octree::Iterator> leaves;
         Octree::Iterator iter = this->get_iterator_for_root();
         for (iter.first_leaf(); iter.current != nullptr; iter.next_leaf())
+            leaves.push_back(iter);
+
+        /*
+         * Generate the voxels for blocks of leaves in parallel. Neighboring
+         * leaves share most of their voxels, thus duplicates are removed
+         * within every block first to reduce memory consumption.
+         */
+        std::size_t const num_blocks = (leaves.size() + VOXEL_BLOCK_SIZE - 1)
+            / VOXEL_BLOCK_SIZE;
+        std::vector<std::vector<uint64_t> > block_voxels(num_blocks);
+#pragma omp parallel for schedule(dynamic)
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < num_blocks; ++i)
+#else
+        for (int64_t i = 0; i < num_blocks; ++i)
+#endif
         {
-            for (int i = 0; i < 8; ++i)
-            {
-                VoxelIndex index;
-                index.from_path_and_corner(iter.level, iter.path, i);
-                voxel_set.insert(index);
-            }
+            std::size_t const end = std::min(leaves.size(),
+                (i + 1) * VOXEL_BLOCK_SIZE);
+            std::vector<uint64_t>& indices = block_voxels[i];
+            indices.reserve((end - i * VOXEL_BLOCK_SIZE) * 8);
+            for (std::size_t j = i * VOXEL_BLOCK_SIZE; j < end; ++j)
+                for (int k = 0; k < 8; ++k)
+                {
+                    VoxelIndex index;
+                    index.from_path_and_corner(leaves[j].level,
+                        leaves[j].path, k);
+                    indices.push_back(index.index);
+                }
+            std::sort(indices.begin(), indices.end());
+            indices.erase(std::unique(indices.begin(), indices.end()),
+                indices.end());
         }
+        std::vector<Octree::Iterator>().swap(leaves);
+
+        /* Make voxels unique by sorting the concatenated blocks. */
+        std::size_t num_indices = 0;
+        for (std::size_t i = 0; i < num_blocks; ++i)
+            num_indices += block_voxels[i].size();
+        std::vector<uint64_t> indices;
+        indices.reserve(num_indices);
+        for (std::size_t i = 0; i < num_blocks; ++i)
+        {
+            indices.insert(indices.end(), block_voxels[i].begin(),
+                block_voxels[i].end());
+            std::vector<uint64_t>().swap(block_voxels[i]);
+        }
+        radix_sort(&indices);
+        indices.erase(std::unique(indices.begin(), indices.end()),
+            indices.end());
 
         /* Copy voxels over to a vector. */
         this->voxels.clear();
-        this->voxels.reserve(voxel_set.size());
-        for (VoxelIndexSet::const_iterator i = voxel_set.begin();
-            i != voxel_set.end(); ++i)
-            this->voxels.push_back(std::make_pair(*i, VoxelData()));
+        this->voxels.resize(indices.size());
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < indices.size(); ++i)
+#else
+        for (int64_t i = 0; i < indices.size(); ++i)
+#endif
+            this->voxels[i].first.index = indices[i];
     }
 
     std::cout << "Sampling the implicit function at " << this->voxels.size()
@@ -20,6 +20,10 @@
 
 #include <iostream>
 #include <bitset>
+#include <limits>
+#include <map>
+#include <stdexcept>
+#include <string>
 
 #include "util/timer.h"
 #include "fssr/octree.h"
@@ -30,12 +34,16 @@
 #define CUBE_CORNERS 8
 #define CUBE_EDGES 12
 #define CUBE_FACES 6
+#define SUBTREE_LEVEL 4
 
 FSSR_NAMESPACE_BEGIN
 
 /** Helper types and functions. */
 namespace
 {
+    /** Voxel indices never set the highest bit, this marks unused keys. */
+    uint64_t const EMPTY_VOXEL_INDEX = std::numeric_limits<uint64_t>::max();
+
     /** Cube face directions. */
     enum CubeFace
     {
@@ -442,13 +450,28 @@ namespace
 }
 
 mve::TriangleMesh::Ptr
-IsoSurface::extract_mesh (void)
+IsoSurface::extract_mesh (EdgeIndexList* vertex_edges)
 {
     std::cout << "  Sanity-checking input data..." << std::flush;
     util::WallTimer timer;
     this->sanity_checks();
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
+    std::cout << "  Building voxel lookup table..." << std::flush;
+    timer.reset();
+    this->build_voxel_map();
+    std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
+
+    /*
+     * The octree is split into subtrees which are processed in parallel.
+     * Subtrees are collected in depth-first order, which guarantees that
+     * concatenating the subtree results yields the same order as a serial
+     * traversal of the octree.
+     */
+    IteratorList inner_nodes, subtrees;
+    this->collect_subtrees(this->octree->get_iterator_for_root(),
+        SUBTREE_LEVEL, &inner_nodes, &subtrees);
+
     /*
      * Assign MC index to every octree node. This can be done in two ways:
      * (1) Iterate all nodes, query corner values, and determine MC index.
@@ -456,9 +479,16 @@ IsoSurface::extract_mesh (void)
      * Strategy (1) is implemented, it is simpler but slightly more expensive.
      */
     std::cout << "  Computing Marching Cubes indices..." << std::flush;
-    Octree::Iterator iter = this->octree->get_iterator_for_root();
-    for (iter.first_node(); iter.current != nullptr; iter.next_node())
-        this->compute_mc_index(iter);
+    timer.reset();
+    for (std::size_t i = 0; i < inner_nodes.size(); ++i)
+        this->compute_mc_index(inner_nodes[i]);
+#pragma omp parallel for schedule(dynamic)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < subtrees.size(); ++i)
+#else
+    for (int64_t i = 0; i < subtrees.size(); ++i)
+#endif
+        this->compute_mc_indices(subtrees[i]);
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
     /*
@@ -469,10 +499,11 @@ IsoSurface::extract_mesh (void)
      */
     std::cout << "  Computing isovertices..." << std::flush;
     timer.reset();
-    EdgeVertexMap edgemap;
+    EdgeVertexMap edgemap(EdgeIndex(EMPTY_VOXEL_INDEX, EMPTY_VOXEL_INDEX));
     IsoVertexVector isovertices;
-    for (iter.first_leaf(); iter.current != nullptr; iter.next_leaf())
-        this->compute_isovertices(iter, &edgemap, &isovertices);
+    EdgeIndexList isovertex_edges;
+    this->compute_isovertices(subtrees, &edgemap, &isovertices,
+        &isovertex_edges);
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
     /*
@@ -484,10 +515,18 @@ IsoSurface::extract_mesh (void)
     std::cout << "  Computing isopolygons..." << std::flush;
     timer.reset();
     PolygonList polygons;
-    for (iter.first_leaf(); iter.current != nullptr; iter.next_leaf())
-        this->compute_isopolygons(iter, edgemap, &polygons);
+    this->compute_isopolygons(subtrees, edgemap, &polygons);
+    edgemap.clear();
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
+    /* Vertices outside the extraction node are not referenced. */
+    if (this->extraction_level > 0)
+        this->remove_unreferenced_isovertices(&polygons, &isovertices,
+            &isovertex_edges);
+    if (vertex_edges != nullptr)
+        std::swap(*vertex_edges, isovertex_edges);
+    EdgeIndexList().swap(isovertex_edges);
+
     /*
      * The vertices are transferred to a mesh and the polygons are
      * triangulated using the minimum area triangulation.
@@ -496,6 +535,7 @@ IsoSurface::extract_mesh (void)
     timer.reset();
     mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
     this->compute_triangulation(isovertices, polygons, mesh);
+    this->voxel_map.clear();
     std::cout << " took " << timer.get_elapsed() << " ms." << std::endl;
 
     return mesh;
@@ -524,6 +564,15 @@ IsoSurface::sanity_checks (void)
     }
 }
 
+void
+IsoSurface::build_voxel_map (void)
+{
+    this->voxel_map.clear();
+    this->voxel_map.reserve(this->voxels->size());
+    for (std::size_t i = 0; i < this->voxels->size(); ++i)
+        this->voxel_map.insert(this->voxels->at(i).first.index, i);
+}
+
 void
 IsoSurface::compute_mc_index (Octree::Iterator const& iter)
 {
@@ -539,8 +588,149 @@ IsoSurface::compute_mc_index (Octree::Iterator const& iter)
 }
 
 void
-IsoSurface::compute_isovertices (Octree::Iterator const& iter,
-    EdgeVertexMap* edgemap, IsoVertexVector* isovertices)
+IsoSurface::compute_mc_indices (Octree::Iterator const& iter)
+{
+    this->compute_mc_index(iter);
+    if (iter.current->children == nullptr)
+        return;
+    for (int i = 0; i < CUBE_CORNERS; ++i)
+        this->compute_mc_indices(iter.descend(i));
+}
+
+void
+IsoSurface::collect_subtrees (Octree::Iterator const& iter, int level,
+    IteratorList* inner_nodes, IteratorList* subtrees)
+{
+    if (iter.current == nullptr)
+        return;
+
+    if (iter.level >= level || iter.current->children == nullptr)
+    {
+        subtrees->push_back(iter);
+        return;
+    }
+
+    inner_nodes->push_back(iter);
+    for (int i = 0; i < CUBE_CORNERS; ++i)
+        this->collect_subtrees(iter.descend(i), level, inner_nodes, subtrees);
+}
+
+void
+IsoSurface::collect_leaves (Octree::Iterator const& iter,
+    IteratorList* leaves)
+{
+    if (iter.current->children == nullptr)
+    {
+        leaves->push_back(iter);
+        return;
+    }
+
+    for (int i = 0; i < CUBE_CORNERS; ++i)
+        this->collect_leaves(iter.descend(i), leaves);
+}
+
+void
+IsoSurface::compute_isovertices (IteratorList const& subtrees,
+    EdgeVertexMap* edgemap, IsoVertexVector* isovertices,
+    EdgeIndexList* vertex_edges)
+{
+    /*
+     * Collect the isovertex edges for every subtree in parallel. Edges
+     * are made unique within the subtree, but edges on the subtree
+     * boundary can still appear in multiple subtrees.
+     */
+    std::vector<IsoVertexEdgeList> subtree_edges(subtrees.size());
+    std::string error;
+#pragma omp parallel for schedule(dynamic)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < subtrees.size(); ++i)
+#else
+    for (int64_t i = 0; i < subtrees.size(); ++i)
+#endif
+    {
+        try
+        {
+            IteratorList leaves;
+            this->collect_leaves(subtrees[i], &leaves);
+            EdgeVertexMap subtree_map(EdgeIndex(EMPTY_VOXEL_INDEX,
+                EMPTY_VOXEL_INDEX));
+            for (std::size_t j = 0; j < leaves.size(); ++j)
+                this->compute_isovertex_edges(leaves[j], &subtree_map,
+                    &subtree_edges[i]);
+        }
+        catch (std::exception& e)
+        {
+#pragma omp critical
+            error = e.what();
+        }
+    }
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    /* Merge the subtree edges in order and remove duplicates. */
+    std::size_t num_edges = 0;
+    for (std::size_t i = 0; i < subtree_edges.size(); ++i)
+        num_edges += subtree_edges[i].size();
+    edgemap->reserve(num_edges);
+
+    IsoVertexEdgeList edges;
+    edges.reserve(num_edges);
+    for (std::size_t i = 0; i < subtree_edges.size(); ++i)
+    {
+        IsoVertexEdgeList const& list = subtree_edges[i];
+        for (std::size_t j = 0; j < list.size(); ++j)
+            if (edgemap->insert(list[j].index, edges.size()).second)
+                edges.push_back(list[j]);
+        IsoVertexEdgeList().swap(subtree_edges[i]);
+    }
+
+    /* Interpolate the isovertices in parallel. */
+    isovertices->resize(edges.size());
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < edges.size(); ++i)
+#else
+    for (int64_t i = 0; i < edges.size(); ++i)
+#endif
+        this->get_isovertex(edges[i].index, edges[i].edge_id,
+            &isovertices->at(i));
+
+    vertex_edges->resize(edges.size());
+    for (std::size_t i = 0; i < edges.size(); ++i)
+        vertex_edges->at(i) = edges[i].index;
+}
+
+void
+IsoSurface::remove_unreferenced_isovertices (PolygonList* polygons,
+    IsoVertexVector* isovertices, EdgeIndexList* vertex_edges)
+{
+    std::size_t const unreferenced = std::numeric_limits<std::size_t>::max();
+    std::vector<std::size_t> remap(isovertices->size(), unreferenced);
+    for (std::size_t i = 0; i < polygons->size(); ++i)
+        for (std::size_t j = 0; j < polygons->at(i).size(); ++j)
+            remap[polygons->at(i)[j]] = 0;
+
+    std::size_t num_vertices = 0;
+    for (std::size_t i = 0; i < remap.size(); ++i)
+    {
+        if (remap[i] == unreferenced)
+            continue;
+        remap[i] = num_vertices;
+        isovertices->at(num_vertices) = isovertices->at(i);
+        vertex_edges->at(num_vertices) = vertex_edges->at(i);
+        num_vertices += 1;
+    }
+    isovertices->resize(num_vertices);
+    vertex_edges->resize(num_vertices);
+
+    for (std::size_t i = 0; i < polygons->size(); ++i)
+        for (std::size_t j = 0; j < polygons->at(i).size(); ++j)
+            polygons->at(i)[j] = remap[polygons->at(i)[j]];
+}
+
+void
+IsoSurface::compute_isovertex_edges (Octree::Iterator const& iter,
+    EdgeVertexMap* edgemap, IsoVertexEdgeList* edges)
 {
     /* This should always be a leaf node. */
     if (iter.current == nullptr || iter.current->children != nullptr)
@@ -557,16 +747,13 @@ IsoSurface::compute_isovertices (Octree::Iterator const& iter,
             continue;
 
         /* Get the finest edge that contains an isovertex. */
-        EdgeIndex edge_index;
-        this->get_finest_cube_edge(iter, i, &edge_index, nullptr);
-        if (edgemap->find(edge_index) != edgemap->end())
+        IsoVertexEdge edge;
+        edge.edge_id = i;
+        this->get_finest_cube_edge(iter, i, &edge.index, nullptr);
+        if (!edgemap->insert(edge.index, edges->size()).second)
             continue;
 
-        /* Interpolate isovertex and add index to map. */
-        IsoVertex isovertex;
-        this->get_isovertex(edge_index, i, &isovertex);
-        edgemap->insert(std::make_pair(edge_index, isovertices->size()));
-        isovertices->push_back(isovertex);
+        edges->push_back(edge);
     }
 }
 
@@ -713,6 +900,54 @@ IsoSurface::is_isovertex_on_edge (int mc_index, int edge_id)
     return ((mc_index >> bit[0]) & 1) ^ ((mc_index >> bit[1]) & 1);
 }
 
+void
+IsoSurface::compute_isopolygons (IteratorList const& subtrees,
+    EdgeVertexMap const& edgemap, PolygonList* polygons)
+{
+    /* Compute polygons per subtree and concatenate in order. */
+    std::vector<PolygonList> subtree_polygons(subtrees.size());
+    std::string error;
+#pragma omp parallel for schedule(dynamic)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < subtrees.size(); ++i)
+#else
+    for (int64_t i = 0; i < subtrees.size(); ++i)
+#endif
+    {
+        try
+        {
+            IteratorList leaves;
+            this->collect_leaves(subtrees[i], &leaves);
+            for (std::size_t j = 0; j < leaves.size(); ++j)
+                if (this->is_leaf_extracted(leaves[j]))
+                    this->compute_isopolygons(leaves[j], edgemap,
+                        &subtree_polygons[i]);
+        }
+        catch (std::exception& e)
+        {
+#pragma omp critical
+            error = e.what();
+        }
+    }
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    std::size_t num_polygons = 0;
+    for (std::size_t i = 0; i < subtree_polygons.size(); ++i)
+        num_polygons += subtree_polygons[i].size();
+    polygons->reserve(num_polygons);
+    for (std::size_t i = 0; i < subtree_polygons.size(); ++i)
+    {
+        PolygonList& list = subtree_polygons[i];
+        for (std::size_t j = 0; j < list.size(); ++j)
+        {
+            polygons->push_back(std::vector<std::size_t>());
+            polygons->back().swap(list[j]);
+        }
+        PolygonList().swap(list);
+    }
+}
+
 void
 IsoSurface::compute_isopolygons (Octree::Iterator const& iter,
     EdgeVertexMap const& edgemap, PolygonList* polygons)
@@ -828,10 +1063,10 @@ std::size_t
 IsoSurface::lookup_edge_vertex (EdgeVertexMap const& edgemap,
     EdgeIndex const& edge)
 {
-    EdgeVertexMap::const_iterator iter = edgemap.find(edge);
-    if (iter == edgemap.end())
+    std::size_t const* vertex_id = edgemap.find(edge);
+    if (vertex_id == nullptr)
         throw std::runtime_error("lookup_edge_vertex(): No such edge vertex");
-    return iter->second;
+    return *vertex_id;
 }
 
 void
@@ -972,20 +1207,54 @@ IsoSurface::compute_triangulation(IsoVertexVector const& isovertices,
         cfs.push_back(vertex.data.conf);
     }
 
-    /* Triangulate isopolygons. */
-    mve::TriangleMesh::FaceList& triangles = mesh->get_faces();
-    fssr::MinAreaTriangulation tri;
-    for (std::size_t i = 0; i < polygons.size(); i++)
+    /* Triangulate isopolygons in parallel blocks, concatenated in order. */
+    std::size_t const block_size = 4096;
+    std::size_t const num_blocks = (polygons.size() + block_size - 1)
+        / block_size;
+    std::vector<mve::TriangleMesh::FaceList> block_triangles(num_blocks);
+    std::string error;
+#pragma omp parallel for schedule(dynamic)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_blocks; ++i)
+#else
+    for (int64_t i = 0; i < num_blocks; ++i)
+#endif
     {
+        fssr::MinAreaTriangulation tri;
         std::vector<math::Vector<float, 3> > loop;
-        loop.resize(polygons[i].size());
-        for (std::size_t j = 0; j < polygons[i].size(); ++j)
-            loop[j] = verts[polygons[i][j]];
         std::vector<unsigned int> result;
-        tri.triangulate(loop, &result);
-        for (std::size_t j = 0; j < result.size(); ++j)
-            triangles.push_back(polygons[i][result[j]]);
+        std::size_t const end = std::min(polygons.size(),
+            (i + 1) * block_size);
+        try
+        {
+            for (std::size_t j = i * block_size; j < end; ++j)
+            {
+                loop.resize(polygons[j].size());
+                for (std::size_t k = 0; k < polygons[j].size(); ++k)
+                    loop[k] = verts[polygons[j][k]];
+                result.clear();
+                tri.triangulate(loop, &result);
+                for (std::size_t k = 0; k < result.size(); ++k)
+                    block_triangles[i].push_back(polygons[j][result[k]]);
+            }
+        }
+        catch (std::exception& e)
+        {
+#pragma omp critical
+            error = e.what();
+        }
     }
+    if (!error.empty())
+        throw std::runtime_error(error);
+
+    mve::TriangleMesh::FaceList& triangles = mesh->get_faces();
+    std::size_t num_indices = 0;
+    for (std::size_t i = 0; i < num_blocks; ++i)
+        num_indices += block_triangles[i].size();
+    triangles.reserve(num_indices);
+    for (std::size_t i = 0; i < num_blocks; ++i)
+        triangles.insert(triangles.end(), block_triangles[i].begin(),
+            block_triangles[i].end());
 }
 
 FSSR_NAMESPACE_END
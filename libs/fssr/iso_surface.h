@@ -17,11 +17,11 @@
 #define FSSR_ISO_SURFACE_HEADER
 
 #include <vector>
-#include <map>
 #include <cstdint>
+#include <limits>
 
-#include "math/algo.h"
 #include "fssr/defines.h"
+#include "fssr/hash_map.h"
 #include "fssr/hermite.h"
 #include "fssr/iso_octree.h"
 #include "fssr/octree.h"
@@ -36,11 +36,38 @@ FSSR_NAMESPACE_BEGIN
  */
 class IsoSurface
 {
+public:
+    /** The edge index identifies an octree edge using two voxel indices. */
+    typedef std::pair<uint64_t, uint64_t> EdgeIndex;
+    /** List of edge indices, one for every mesh vertex. */
+    typedef std::vector<EdgeIndex> EdgeIndexList;
+
+    /** Hash function for edge indices. */
+    struct EdgeIndexHash
+    {
+        uint64_t operator() (EdgeIndex const& edge) const;
+    };
+
 public:
     IsoSurface (IsoOctree* octree,
         InterpolationType interpolation_type = INTERPOLATION_CUBIC);
+
+    /**
+     * Restricts the extracted polygons to the leaves inside the octree node
+     * with the given level and path. Vertices which are not referenced by
+     * these polygons are removed. Since edge indices are unique in octrees
+     * sharing the same hierarchy, meshes extracted from disjoint nodes can
+     * be stitched using the edge indices of the vertices. By default, the
+     * root node is used and the whole octree is extracted.
+     */
+    void set_extraction_node (uint8_t level, uint64_t path);
+
+    /** Extracts the isosurface mesh. */
     mve::TriangleMesh::Ptr extract_mesh (void);
 
+    /** Extracts the isosurface mesh and the edge index of every vertex. */
+    mve::TriangleMesh::Ptr extract_mesh (EdgeIndexList* vertex_edges);
+
 private:
     /** The isovertex contains interpolated position and voxel data. */
     struct IsoVertex
@@ -49,9 +76,6 @@ private:
         VoxelData data;
     };
 
-    /** The edge index identifies an octree edge using two voxel indices. */
-    typedef std::pair<uint64_t, uint64_t> EdgeIndex;
-
     /** Additional information for an edge. */
     struct EdgeInfo
     {
@@ -68,10 +92,29 @@ private:
         EdgeInfo second_info;
     };
 
+    /** An edge with an isovertex as found for a leaf node. */
+    struct IsoVertexEdge
+    {
+        EdgeIndex index;
+        int edge_id;
+    };
+
+    /** Hash function for voxel indices. */
+    struct VoxelIndexHash
+    {
+        uint64_t operator() (uint64_t index) const;
+    };
+
     /** Vector of IsoVertex elements. */
     typedef std::vector<IsoVertex> IsoVertexVector;
+    /** Maps a voxel index to the position in the voxel vector. */
+    typedef HashMap<uint64_t, std::size_t, VoxelIndexHash> VoxelIndexMap;
     /** Maps and edge to an isovertex ID. */
-    typedef std::map<EdgeIndex, std::size_t> EdgeVertexMap;
+    typedef HashMap<EdgeIndex, std::size_t, EdgeIndexHash> EdgeVertexMap;
+    /** List of edges with isovertices. */
+    typedef std::vector<IsoVertexEdge> IsoVertexEdgeList;
+    /** List of octree iterators. */
+    typedef std::vector<Octree::Iterator> IteratorList;
     /** List of polygons, each indexing vertices. */
     typedef std::vector<std::vector<std::size_t> > PolygonList;
     /** List of iso edges connecting vertices on cube edges. */
@@ -79,9 +122,20 @@ private:
 
 private:
     void sanity_checks (void);
+    void build_voxel_map (void);
+    void collect_subtrees (Octree::Iterator const& iter, int level,
+        IteratorList* inner_nodes, IteratorList* subtrees);
+    void collect_leaves (Octree::Iterator const& iter, IteratorList* leaves);
     void compute_mc_index (Octree::Iterator const& iter);
-    void compute_isovertices (Octree::Iterator const& iter,
-        EdgeVertexMap* edgemap, IsoVertexVector* isovertices);
+    void compute_mc_indices (Octree::Iterator const& iter);
+    void compute_isovertices (IteratorList const& subtrees,
+        EdgeVertexMap* edgemap, IsoVertexVector* isovertices,
+        EdgeIndexList* vertex_edges);
+    bool is_leaf_extracted (Octree::Iterator const& iter) const;
+    void remove_unreferenced_isovertices (PolygonList* polygons,
+        IsoVertexVector* isovertices, EdgeIndexList* vertex_edges);
+    void compute_isovertex_edges (Octree::Iterator const& iter,
+        EdgeVertexMap* edgemap, IsoVertexEdgeList* edges);
     bool is_isovertex_on_edge (int mc_index, int edge_id);
     void get_finest_cube_edge (Octree::Iterator const& iter,
         int edge_id, EdgeIndex* edge_index, EdgeInfo* edge_info);
@@ -89,9 +143,11 @@ private:
         int face_id, IsoEdgeList* isoedges, bool descend_only);
     void get_isovertex (EdgeIndex const& edge_index,
         int edge_id, IsoVertex* iso_vertex);
-    void compute_isopolygons(Octree::Iterator const& iter,
+    void compute_isopolygons (IteratorList const& subtrees,
+        EdgeVertexMap const& edgemap, PolygonList* polygons);
+    void compute_isopolygons (Octree::Iterator const& iter,
         EdgeVertexMap const& edgemap, PolygonList* polygons);
-    void compute_triangulation(IsoVertexVector const& isovertices,
+    void compute_triangulation (IsoVertexVector const& isovertices,
         PolygonList const& polygons, mve::TriangleMesh::Ptr mesh);
     VoxelData const* get_voxel_data (VoxelIndex const& index);
     std::size_t lookup_edge_vertex (EdgeVertexMap const& edgemap,
@@ -102,7 +158,10 @@ private:
 private:
     Octree* octree;
     IsoOctree::VoxelVector const* voxels;
+    VoxelIndexMap voxel_map;
     InterpolationType interpolation_type;
+    uint8_t extraction_level;
+    uint64_t extraction_path;
 };
 
 /* --------------------------------------------------------------------- */
@@ -111,14 +170,52 @@ inline
 IsoSurface::IsoSurface (IsoOctree* octree, InterpolationType interpolation_type)
     : octree(octree)
     , voxels(&octree->get_voxels())
+    , voxel_map(std::numeric_limits<uint64_t>::max())
     , interpolation_type(interpolation_type)
+    , extraction_level(0)
+    , extraction_path(0)
+{
+}
+
+inline void
+IsoSurface::set_extraction_node (uint8_t level, uint64_t path)
+{
+    this->extraction_level = level;
+    this->extraction_path = path;
+}
+
+inline mve::TriangleMesh::Ptr
+IsoSurface::extract_mesh (void)
+{
+    return this->extract_mesh(nullptr);
+}
+
+inline bool
+IsoSurface::is_leaf_extracted (Octree::Iterator const& iter) const
+{
+    if (iter.level < this->extraction_level)
+        return false;
+    int const shift = (iter.level - this->extraction_level) * 3;
+    return (iter.path >> shift) == this->extraction_path;
+}
+
+inline uint64_t
+IsoSurface::EdgeIndexHash::operator() (EdgeIndex const& edge) const
+{
+    return hash_mix(edge.first ^ hash_mix(edge.second));
+}
+
+inline uint64_t
+IsoSurface::VoxelIndexHash::operator() (uint64_t index) const
 {
+    return hash_mix(index);
 }
 
 inline VoxelData const*
 IsoSurface::get_voxel_data (VoxelIndex const& index)
 {
-    return math::algo::binary_search(*this->voxels, index);
+    std::size_t const* id = this->voxel_map.find(index.index);
+    return id == nullptr ? nullptr : &(*this->voxels)[*id].second;
 }
 
 FSSR_NAMESPACE_END
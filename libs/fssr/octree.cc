@@ -182,6 +182,36 @@ Octree::insert_sample (Sample const& sample)
     this->num_samples += 1;
 }
 
+void
+Octree::set_root_node (math::Vec3d const& center, double size)
+{
+    if (this->root != nullptr)
+        throw std::logic_error("set_root_node(): Octree is not empty");
+    if (size <= 0.0)
+        throw std::invalid_argument("set_root_node(): Invalid size");
+
+    this->root = new Node();
+    this->root_center = center;
+    this->root_size = size;
+    this->num_nodes = 1;
+}
+
+void
+Octree::create_node (uint8_t level, uint64_t path)
+{
+    if (this->root == nullptr)
+        throw std::logic_error("create_node(): Octree is empty");
+
+    Node* node = this->root;
+    for (int i = 0; i < level; ++i)
+    {
+        if (node->children == nullptr)
+            this->create_children(node);
+        int const octant = (path >> ((level - i - 1) * 3)) & 7;
+        node = node->children + octant;
+    }
+}
+
 void
 Octree::create_children (Node* node)
 {
@@ -99,6 +99,20 @@ public:
      */
     void insert_sample (Sample const& s);
 
+    /**
+     * Creates the root node with the given center and size. This must be
+     * called on an empty octree. Samples inside the root with a scale less
+     * than twice the root size do not expand the octree, which allows
+     * several octrees to share the same hierarchy and voxel indices.
+     */
+    void set_root_node (math::Vec3d const& center, double size);
+
+    /**
+     * Creates the node with the given level and path, and all nodes on
+     * the way from the root, if they do not exist yet. The root must exist.
+     */
+    void create_node (uint8_t level, uint64_t path);
+
     /** Returns the number of samples in the octree. */
     std::size_t get_num_samples (void) const;
 
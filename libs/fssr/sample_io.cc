@@ -7,20 +7,48 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include <cerrno>
 
+#include "util/endian.h"
 #include "util/exception.h"
 #include "util/tokenizer.h"
 #include "mve/mesh_io_ply.h"
 #include "fssr/sample_io.h"
 
+#define RECORD_BLOCK_SIZE 65536
+
 FSSR_NAMESPACE_BEGIN
 
 void
 SampleIO::read_file (std::string const& filename,  SampleList* samples)
 {
+    /*
+     * Binary files are read block-wise with the streaming reader if it
+     * supports the layout. All other files use the generic PLY parser,
+     * which also handles double coordinates and additional elements.
+     */
+    std::string error;
+    if (this->open_file_intern(filename, &error)
+        && this->stream.format != mve::geom::PLY_ASCII)
+    {
+        if (this->stream.num_vertices == 0)
+        {
+            std::cout << "WARNING: No samples in file, skipping." << std::endl;
+            this->reset_stream_state();
+            return;
+        }
+
+        samples->reserve(samples->size() + this->stream.num_vertices);
+        Sample sample;
+        while (this->next_sample(&sample))
+            samples->push_back(sample);
+        return;
+    }
+    this->reset_stream_state();
+
     /* Load point set from PLY file. */
     mve::TriangleMesh::Ptr mesh = mve::geom::load_ply_mesh(filename);
     mve::TriangleMesh::VertexList const& verts = mesh->get_vertices();
@@ -70,6 +98,17 @@ SampleIO::read_file (std::string const& filename,  SampleList* samples)
 
 void
 SampleIO::open_file (std::string const& filename)
+{
+    std::string error;
+    if (!this->open_file_intern(filename, &error))
+    {
+        this->reset_stream_state();
+        throw util::Exception(error);
+    }
+}
+
+bool
+SampleIO::open_file_intern (std::string const& filename, std::string* error)
 {
     this->reset_stream_state();
     this->reset_samples_state(&this->samples);
@@ -83,26 +122,27 @@ SampleIO::open_file (std::string const& filename)
     std::getline(this->stream.stream, line);
     if (line != "ply")
     {
-        this->reset_stream_state();
-        throw util::Exception("Invalid PLY signature");
+        *error = "Invalid PLY signature";
+        return false;
     }
 
     /* Parse PLY headers. */
     bool parsing_vertex_props = false;
+    bool skipped_elements = false;
     this->stream.format = mve::geom::PLY_UNKNOWN;
     while (true)
     {
         std::getline(this->stream.stream, line);
         if (this->stream.stream.eof())
         {
-            this->reset_stream_state();
-            throw util::Exception("EOF while parsing headers");
+            *error = "EOF while parsing headers";
+            return false;
         }
 
         if (!this->stream.stream.good())
         {
-            this->reset_stream_state();
-            throw util::Exception("Read error while parsing headers");
+            *error = "Read error while parsing headers";
+            return false;
         }
 
         util::string::clip_newlines(&line);
@@ -131,6 +171,12 @@ SampleIO::open_file (std::string const& filename)
         {
             if (tokens[1] == "vertex")
             {
+                /* Data of preceding elements (e.g. a camera) is not read. */
+                if (skipped_elements)
+                {
+                    *error = "Unsupported PLY element before vertices";
+                    return false;
+                }
                 parsing_vertex_props = true;
                 this->stream.num_vertices
                     = util::string::convert<unsigned int>(tokens[2]);
@@ -138,6 +184,9 @@ SampleIO::open_file (std::string const& filename)
             }
             else
             {
+                if (this->stream.num_vertices == 0
+                    && util::string::convert<unsigned int>(tokens[2]) > 0)
+                    skipped_elements = true;
                 parsing_vertex_props = false;
                 continue;
             }
@@ -145,7 +194,18 @@ SampleIO::open_file (std::string const& filename)
 
         if (parsing_vertex_props && tokens[0] == "property")
         {
-            if (tokens[1] == "float" && tokens[2] == "x")
+            /* Accept the sized type names for the supported types. */
+            if (tokens.size() > 1 && tokens[1] == "float32")
+                tokens[1] = "float";
+            else if (tokens.size() > 1 && tokens[1] == "uint8")
+                tokens[1] = "uchar";
+
+            if (tokens.size() != 3)
+            {
+                *error = "Unsupported vertex property: " + line;
+                return false;
+            }
+            else if (tokens[1] == "float" && tokens[2] == "x")
                 this->stream.props.push_back(mve::geom::PLY_V_FLOAT_X);
             else if (tokens[1] == "float" && tokens[2] == "y")
                 this->stream.props.push_back(mve::geom::PLY_V_FLOAT_Y);
@@ -187,8 +247,8 @@ SampleIO::open_file (std::string const& filename)
                 this->stream.props.push_back(mve::geom::PLY_V_IGNORE_UINT32);
             else
             {
-                this->reset_stream_state();
-                throw util::Exception("Unknown property type: " + tokens[1]);
+                *error = "Unknown property type: " + tokens[1];
+                return false;
             }
 
             continue;
@@ -206,13 +266,13 @@ SampleIO::open_file (std::string const& filename)
     /* Sanity check gathered data. */
     if (this->stream.format == mve::geom::PLY_UNKNOWN)
     {
-        this->reset_stream_state();
-        throw util::Exception("Unknown PLY file format");
+        *error = "Unknown PLY file format";
+        return false;
     }
 
     /* If the PLY does not contain vertices, ignore properties. */
     if (this->stream.num_vertices == 0)
-        return;
+        return true;
 
     std::vector<bool> prop_table;
     for (std::size_t i = 0; i < this->stream.props.size(); ++i)
@@ -227,21 +287,25 @@ SampleIO::open_file (std::string const& filename)
         || !prop_table[mve::geom::PLY_V_FLOAT_Y]
         || !prop_table[mve::geom::PLY_V_FLOAT_Z])
     {
-        this->reset_stream_state();
-        throw util::Exception("Missing sample coordinates");
+        *error = "Missing sample coordinates";
+        return false;
     }
     if (!prop_table[mve::geom::PLY_V_FLOAT_NX]
         || !prop_table[mve::geom::PLY_V_FLOAT_NY]
         || !prop_table[mve::geom::PLY_V_FLOAT_NZ])
     {
-        this->reset_stream_state();
-        throw util::Exception("Missing sample normals");
+        *error = "Missing sample normals";
+        return false;
     }
     if (!prop_table[mve::geom::PLY_V_FLOAT_VALUE])
     {
-        this->reset_stream_state();
-        throw util::Exception("Missing sample scale");
+        *error = "Missing sample scale";
+        return false;
     }
+
+    if (this->stream.format != mve::geom::PLY_ASCII)
+        this->compute_record_layout();
+    return true;
 }
 
 bool
@@ -274,6 +338,17 @@ SampleIO::next_sample_intern (Sample* sample)
         return false;
     }
 
+    /* Binary files are decoded in blocks. */
+    if (this->stream.format != mve::geom::PLY_ASCII)
+    {
+        if (this->stream.block_pos == this->stream.block.size())
+            this->read_record_block();
+        *sample = this->stream.block[this->stream.block_pos];
+        this->stream.block_pos += 1;
+        this->stream.current_vertex += 1;
+        return true;
+    }
+
     for (std::size_t i = 0; i < this->stream.props.size(); ++i)
     {
         mve::geom::PLYVertexProperty property = this->stream.props[i];
@@ -333,6 +408,10 @@ SampleIO::next_sample_intern (Sample* sample)
                 this->ply_read(&dummy);
                 break;
             }
+            case mve::geom::PLY_V_IGNORE_UINT32:
+                mve::geom::ply_read_value<unsigned int>
+                    (this->stream.stream, this->stream.format);
+                break;
             default:
                 this->reset_stream_state();
                 throw std::runtime_error("Invalid sample attribute");
@@ -349,6 +428,147 @@ SampleIO::next_sample_intern (Sample* sample)
     return true;
 }
 
+void
+SampleIO::compute_record_layout (void)
+{
+    RecordLayout& layout = this->stream.layout;
+    layout.size = 0;
+    for (int i = 0; i < 3; ++i)
+    {
+        layout.pos[i] = -1;
+        layout.normal[i] = -1;
+        layout.color[i] = -1;
+        layout.color_uint8[i] = false;
+    }
+    layout.scale = -1;
+    layout.confidence = -1;
+
+    for (std::size_t i = 0; i < this->stream.props.size(); ++i)
+    {
+        int const offset = static_cast<int>(layout.size);
+        switch (this->stream.props[i])
+        {
+            case mve::geom::PLY_V_FLOAT_X:
+            case mve::geom::PLY_V_FLOAT_Y:
+            case mve::geom::PLY_V_FLOAT_Z:
+                layout.pos[this->stream.props[i]
+                    - mve::geom::PLY_V_FLOAT_X] = offset;
+                layout.size += sizeof(float);
+                break;
+            case mve::geom::PLY_V_FLOAT_NX:
+            case mve::geom::PLY_V_FLOAT_NY:
+            case mve::geom::PLY_V_FLOAT_NZ:
+                layout.normal[this->stream.props[i]
+                    - mve::geom::PLY_V_FLOAT_NX] = offset;
+                layout.size += sizeof(float);
+                break;
+            case mve::geom::PLY_V_FLOAT_R:
+            case mve::geom::PLY_V_FLOAT_G:
+            case mve::geom::PLY_V_FLOAT_B:
+            {
+                int const channel = this->stream.props[i]
+                    - mve::geom::PLY_V_FLOAT_R;
+                layout.color[channel] = offset;
+                layout.color_uint8[channel] = false;
+                layout.size += sizeof(float);
+                break;
+            }
+            case mve::geom::PLY_V_UINT8_R:
+            case mve::geom::PLY_V_UINT8_G:
+            case mve::geom::PLY_V_UINT8_B:
+            {
+                int const channel = this->stream.props[i]
+                    - mve::geom::PLY_V_UINT8_R;
+                layout.color[channel] = offset;
+                layout.color_uint8[channel] = true;
+                layout.size += sizeof(uint8_t);
+                break;
+            }
+            case mve::geom::PLY_V_FLOAT_VALUE:
+                layout.scale = offset;
+                layout.size += sizeof(float);
+                break;
+            case mve::geom::PLY_V_FLOAT_CONF:
+                layout.confidence = offset;
+                layout.size += sizeof(float);
+                break;
+            case mve::geom::PLY_V_IGNORE_FLOAT:
+                layout.size += sizeof(float);
+                break;
+            case mve::geom::PLY_V_IGNORE_UINT8:
+                layout.size += sizeof(uint8_t);
+                break;
+            case mve::geom::PLY_V_IGNORE_UINT32:
+                layout.size += sizeof(uint32_t);
+                break;
+            default:
+                this->reset_stream_state();
+                throw std::runtime_error("Invalid sample attribute");
+        }
+    }
+}
+
+void
+SampleIO::read_record_block (void)
+{
+    std::size_t const num_records = std::min<std::size_t>(RECORD_BLOCK_SIZE,
+        this->stream.num_vertices - this->stream.current_vertex);
+    std::size_t const record_size = this->stream.layout.size;
+    std::vector<char>& buffer = this->stream.buffer;
+    buffer.resize(num_records * record_size);
+    this->stream.stream.read(&buffer[0], buffer.size());
+    if (this->stream.stream.gcount()
+        != static_cast<std::streamsize>(buffer.size()))
+    {
+        std::string const filename = this->stream.filename;
+        this->reset_stream_state();
+        throw util::FileException(filename, "Unexpected EOF");
+    }
+
+    this->stream.block.resize(num_records);
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_records; ++i)
+#else
+    for (int64_t i = 0; i < num_records; ++i)
+#endif
+        this->decode_record(&buffer[i * record_size], &this->stream.block[i]);
+    this->stream.block_pos = 0;
+}
+
+void
+SampleIO::decode_record (char const* record, Sample* sample) const
+{
+    RecordLayout const& layout = this->stream.layout;
+    for (int i = 0; i < 3; ++i)
+    {
+        sample->pos[i] = this->decode_float(record + layout.pos[i]);
+        sample->normal[i] = this->decode_float(record + layout.normal[i]);
+        if (layout.color[i] < 0)
+            sample->color[i] = -1.0f;
+        else if (layout.color_uint8[i])
+            sample->color[i] = static_cast<float>(static_cast<uint8_t>(
+                record[layout.color[i]])) / 255.0f;
+        else
+            sample->color[i] = this->decode_float(record + layout.color[i]);
+    }
+    sample->scale = this->decode_float(record + layout.scale);
+    if (layout.confidence < 0)
+        sample->confidence = 1.0f;
+    else
+        sample->confidence = this->decode_float(record + layout.confidence);
+}
+
+float
+SampleIO::decode_float (char const* value) const
+{
+    float result;
+    std::memcpy(&result, value, sizeof(float));
+    if (this->stream.format == mve::geom::PLY_BINARY_BE)
+        return util::system::betoh(result);
+    return util::system::letoh(result);
+}
+
 void
 SampleIO::ply_read (float* value)
 {
@@ -380,6 +600,9 @@ SampleIO::reset_stream_state (void)
     this->stream.format = mve::geom::PLY_UNKNOWN;
     this->stream.num_vertices = 0;
     this->stream.current_vertex = 0;
+    std::vector<char>().swap(this->stream.buffer);
+    SampleList().swap(this->stream.block);
+    this->stream.block_pos = 0;
 }
 
 void
@@ -12,6 +12,7 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "mve/mesh_io_ply.h"
 #include "fssr/defines.h"
@@ -22,7 +23,10 @@ FSSR_NAMESPACE_BEGIN
 /**
  * Reads samples from a PLY file. Two input types are supported:
  * Reading the whole file at once using the MVE PLY file reader, and a
- * streaming reader which reads one sample at at time.
+ * streaming reader which reads one sample at at time. Binary files are
+ * read with the streaming reader if it supports the vertex layout, which
+ * reads blocks of vertex records and decodes them in parallel using the
+ * precomputed byte offsets of the sample attributes.
  */
 class SampleIO
 {
@@ -49,6 +53,18 @@ public:
     bool next_sample (Sample* sample);
 
 private:
+    /** Byte offsets of the sample attributes in binary vertex records. */
+    struct RecordLayout
+    {
+        std::size_t size;
+        int pos[3];
+        int normal[3];
+        int color[3];
+        bool color_uint8[3];
+        int scale;
+        int confidence;
+    };
+
     struct StreamState
     {
         std::string filename;
@@ -57,6 +73,12 @@ private:
         mve::geom::PLYFormat format;
         unsigned int num_vertices;
         unsigned int current_vertex;
+
+        /* Decoded block of samples for binary files. */
+        RecordLayout layout;
+        std::vector<char> buffer;
+        SampleList block;
+        std::size_t block_pos;
     };
 
     struct SamplesState
@@ -76,7 +98,12 @@ private:
     void ply_read (float* value);
     void ply_read (uint8_t* value);
     void ply_read_convert (float* value);
+    bool open_file_intern (std::string const& filename, std::string* error);
     bool next_sample_intern (Sample* sample);
+    void compute_record_layout (void);
+    void read_record_block (void);
+    void decode_record (char const* record, Sample* sample) const;
+    float decode_float (char const* value) const;
     void reset_stream_state (void);
 
 private:
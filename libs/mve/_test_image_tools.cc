@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "util/timer.h"
+#include "mve/image.h"
+#include "mve/image_tools.h"
+
+/* Runs the kernel repeatedly and prints the throughput in MPixel/s. */
+template <typename FUNC>
+void
+benchmark (std::string const& name, int width, int height, FUNC func)
+{
+    int const repetitions = 10;
+    func();
+    util::WallTimer timer;
+    for (int i = 0; i < repetitions; ++i)
+        func();
+    float const elapsed = std::max(1.0f, timer.get_elapsed_sec() * 1000.0f);
+    float const mpixels = static_cast<float>(width) * height
+        * repetitions / 1000000.0f;
+    std::cout << std::setw(32) << std::left << name
+        << std::setw(8) << std::right << static_cast<int>(elapsed
+        / repetitions) << " ms   " << std::setw(8)
+        << static_cast<int>(mpixels * 1000.0f / elapsed)
+        << " MPixel/s" << std::endl;
+}
+
+int
+main (int argc, char** argv)
+{
+    int const width = argc > 1 ? std::atoi(argv[1]) : 4000;
+    int const height = argc > 2 ? std::atoi(argv[2]) : 3000;
+
+#ifdef __SSE2__
+    std::cout << "SSE2 is enabled!" << std::endl;
+#endif
+
+    std::cout << "Image size " << width << "x" << height << std::endl;
+    mve::ByteImage::Ptr byte_rgb = mve::ByteImage::create(width, height, 3);
+    for (int i = 0; i < byte_rgb->get_value_amount(); ++i)
+        byte_rgb->at(i) = static_cast<uint8_t>(i * 7 + i / 5);
+    mve::ByteImage::Ptr byte_gray = mve::ByteImage::create(width, height, 1);
+    for (int i = 0; i < byte_gray->get_value_amount(); ++i)
+        byte_gray->at(i) = static_cast<uint8_t>(i * 13);
+    mve::FloatImage::Ptr float_rgb = mve::image::byte_to_float_image(byte_rgb);
+    mve::FloatImage::Ptr float_gray
+        = mve::image::byte_to_float_image(byte_gray);
+
+    benchmark("byte_to_float_image (RGB)", width, height, [&] (void)
+        { mve::image::byte_to_float_image(byte_rgb); });
+    benchmark("float_to_byte_image (RGB)", width, height, [&] (void)
+        { mve::image::float_to_byte_image(float_rgb); });
+    benchmark("type_to_type_image (RGB)", width, height, [&] (void)
+        { mve::image::type_to_type_image<float, double>(float_rgb); });
+    benchmark("desaturate<uint8_t> (RGB)", width, height, [&] (void)
+        { mve::image::desaturate<uint8_t>(byte_rgb,
+        mve::image::DESATURATE_LUMINANCE); });
+    benchmark("desaturate<float> (RGB)", width, height, [&] (void)
+        { mve::image::desaturate<float>(float_rgb,
+        mve::image::DESATURATE_MAXIMUM); });
+    benchmark("expand_grayscale<uint8_t>", width, height, [&] (void)
+        { mve::image::expand_grayscale<uint8_t>(byte_gray); });
+    benchmark("expand_grayscale<float>", width, height, [&] (void)
+        { mve::image::expand_grayscale<float>(float_gray); });
+
+    mve::FloatImage::Ptr float_copy = float_rgb->duplicate();
+    benchmark("gamma_correct_srgb<float> (RGB)", width, height, [&] (void)
+        { mve::image::gamma_correct_srgb<float>(float_copy); });
+    mve::ByteImage::Ptr byte_copy = byte_rgb->duplicate();
+    benchmark("gamma_correct_srgb (byte RGB)", width, height, [&] (void)
+        { mve::image::gamma_correct_srgb(byte_copy); });
+
+    return 0;
+}
@@ -8,6 +8,7 @@
  */
 
 #include <algorithm>
+#include <cmath>
 #include <vector>
 #include <list>
 #include <set>
@@ -18,6 +19,10 @@
 #include "mve/depthmap.h"
 #include "mve/mesh_tools.h"
 
+/* Number of block rows in a band of parallel depth map triangulation. */
+#define DM_BAND_ROWS 32
+#define DM_ROW_ARGS(r) r[0], r[1], r[2], r[3]
+
 MVE_NAMESPACE_BEGIN
 MVE_IMAGE_NAMESPACE_BEGIN
 
@@ -157,29 +162,23 @@ pixel_3dpos (std::size_t x, std::size_t y, float depth,
 
 /* ---------------------------------------------------------------- */
 
+/*
+ * Computes the (unnormalized) viewing rays and their norms for a row of
+ * pixels as structure of arrays. The values are identical to the ones in
+ * pixel_3dpos() and pixel_footprint(), but the loop can be vectorized.
+ */
 void
-dm_make_triangle (TriangleMesh* mesh, mve::Image<unsigned int>& vidx,
-    FloatImage const* dm, math::Matrix3f const& invproj,
-    std::size_t i, int* tverts)
+dm_backproject_row (math::Matrix3f const& invproj, int y, int width,
+    float* rx, float* ry, float* rz, float* norms)
 {
-    int const width = vidx.width();
-    //int const height = vidx.height();
-    mve::TriangleMesh::VertexList& verts(mesh->get_vertices());
-    mve::TriangleMesh::FaceList& faces(mesh->get_faces());
-
-    for (int j = 0; j < 3; ++j)
+    float const py = static_cast<float>(y) + 0.5f;
+    for (int x = 0; x < width; ++x)
     {
-        int iidx = i + (tverts[j] % 2) + width * (tverts[j] / 2);
-        int x = iidx % width;
-        int y = iidx / width;
-        if (vidx.at(iidx) == MATH_MAX_UINT)
-        {
-            /* Add vertex for depth pixel. */
-            vidx.at(iidx) = verts.size();
-            float depth = dm->at(iidx, 0);
-            verts.push_back(pixel_3dpos(x, y, depth, invproj));
-        }
-        faces.push_back(vidx.at(iidx));
+        float const px = static_cast<float>(x) + 0.5f;
+        rx[x] = invproj[0] * px + invproj[1] * py + invproj[2];
+        ry[x] = invproj[3] * px + invproj[4] * py + invproj[5];
+        rz[x] = invproj[6] * px + invproj[7] * py + invproj[8];
+        norms[x] = std::sqrt(rx[x] * rx[x] + ry[x] * ry[x] + rz[x] * rz[x]);
     }
 }
 
@@ -207,6 +206,87 @@ dm_is_depthdisc (float* widths, float* depths, float dd_factor, int i1, int i2)
 
 /* ---------------------------------------------------------------- */
 
+/* Possible triangles, vertex indices relative to 2x2 block. */
+int const dm_block_tris[4][3] = {
+    { 0, 2, 1 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 2, 3 }
+};
+
+/*
+ * Decides which triangles to issue for the 2x2 block with the given depth
+ * values. The result encodes up to two triangles (one-based indices into
+ * 'dm_block_tris') with three bits each. The norms of the viewing rays
+ * of both pixel rows are only used for depth discontinuity detection.
+ */
+unsigned char
+dm_block_triangles (float* depths, float const* norms[2], int x,
+    float footprint_factor, float dd_factor)
+{
+    /* Create a mask representation of the available depth values. */
+    int mask = 0;
+    int pixels = 0;
+    for (int j = 0; j < 4; ++j)
+        if (depths[j] > 0.0f)
+        {
+            mask |= 1 << j;
+            pixels += 1;
+        }
+
+    /* At least three valid depth values are required. */
+    if (pixels < 3)
+        return 0;
+
+    /* Decide which triangles to issue. */
+    int tri[2] = { 0, 0 };
+
+    switch (mask)
+    {
+        case 7: tri[0] = 1; break;
+        case 11: tri[0] = 2; break;
+        case 13: tri[0] = 3; break;
+        case 14: tri[0] = 4; break;
+        case 15:
+        {
+            /* Choose the triangulation with smaller diagonal. */
+            float ddiff1 = std::abs(depths[0] - depths[3]);
+            float ddiff2 = std::abs(depths[1] - depths[2]);
+            if (ddiff1 < ddiff2)
+            { tri[0] = 2; tri[1] = 3; }
+            else
+            { tri[0] = 1; tri[1] = 4; }
+            break;
+        }
+        default: return 0;
+    }
+
+    /* Omit depth discontinuity detection if dd_factor is zero. */
+    if (dd_factor > 0.0f)
+    {
+        /* Cache pixel footprints, see pixel_footprint(). */
+        float widths[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            if (depths[j] == 0.0f)
+                continue;
+            widths[j] = footprint_factor * depths[j]
+                / norms[j / 2][x + (j % 2)];
+        }
+
+        /* Check for depth discontinuities. */
+        for (int j = 0; j < 2 && tri[j] != 0; ++j)
+        {
+            int const* tv = dm_block_tris[tri[j] - 1];
+            #define DM_DD_ARGS widths, depths, dd_factor
+            if (dm_is_depthdisc(DM_DD_ARGS, tv[0], tv[1])) tri[j] = 0;
+            if (dm_is_depthdisc(DM_DD_ARGS, tv[1], tv[2])) tri[j] = 0;
+            if (dm_is_depthdisc(DM_DD_ARGS, tv[2], tv[0])) tri[j] = 0;
+        }
+    }
+
+    return static_cast<unsigned char>(tri[0] | (tri[1] << 3));
+}
+
+/* ---------------------------------------------------------------- */
+
 TriangleMesh::Ptr
 depthmap_triangulate (FloatImage::ConstPtr dm, math::Matrix3f const& invproj,
     float dd_factor, mve::Image<unsigned int>* vids)
@@ -219,97 +299,188 @@ depthmap_triangulate (FloatImage::ConstPtr dm, math::Matrix3f const& invproj,
 
     /* Prepare triangle mesh. */
     TriangleMesh::Ptr mesh(TriangleMesh::create());
+    TriangleMesh::VertexList& verts(mesh->get_vertices());
+    TriangleMesh::FaceList& faces(mesh->get_faces());
 
     /* Generate image that maps image pixels to vertex IDs. */
     mve::Image<unsigned int> vidx(width, height, 1);
     vidx.fill(MATH_MAX_UINT);
 
-    /* Iterate over 2x2-blocks in the depthmap and create triangles. */
-    int i = 0;
-    for (int y = 0; y < height - 1; ++y, ++i)
+    /*
+     * The 2x2-blocks are processed in bands of block rows in parallel.
+     * Vertices are numbered in the order they are first referenced by the
+     * triangles, and faces are emitted in block order. The result is thus
+     * identical to a sequential triangulation. A pixel in the first row of
+     * a band belongs to the previous band if that band references it.
+     */
+    int const block_width = std::max(0, width - 1);
+    int const block_rows = std::max(0, height - 1);
+    int const num_bands = (block_rows + DM_BAND_ROWS - 1) / DM_BAND_ROWS;
+    std::vector<unsigned char> codes(block_width * block_rows, 0);
+    std::vector<std::size_t> vert_offsets(num_bands + 1, 0);
+    std::vector<std::size_t> face_offsets(num_bands + 1, 0);
+    std::vector<std::vector<unsigned char> > shared(num_bands + 1);
+
+    /* Decide the triangles for every block. */
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band)
     {
-        for (int x = 0; x < width - 1; ++x, ++i)
+        int const y0 = band * DM_BAND_ROWS;
+        int const y1 = std::min(block_rows, y0 + DM_BAND_ROWS);
+        std::vector<float> buffer(8 * width);
+        float* rows[2][4];
+        for (int j = 0; j < 8; ++j)
+            rows[j / 4][j % 4] = &buffer[j * width];
+        if (dd_factor > 0.0f)
+            dm_backproject_row(invproj, y0, width, DM_ROW_ARGS(rows[0]));
+
+        for (int y = y0; y < y1; ++y)
         {
-            /* Cache the four depth values. */
-            float depths[4] = { dm->at(i, 0), dm->at(i + 1, 0),
-                dm->at(i + width, 0), dm->at(i + width + 1, 0) };
-
-            /* Create a mask representation of the available depth values. */
-            int mask = 0;
-            int pixels = 0;
-            for (int j = 0; j < 4; ++j)
-                if (depths[j] > 0.0f)
-                {
-                    mask |= 1 << j;
-                    pixels += 1;
-                }
-
-            /* At least three valid depth values are required. */
-            if (pixels < 3)
-                continue;
-
-            /* Possible triangles, vertex indices relative to 2x2 block. */
-            int tris[4][3] = {
-                { 0, 2, 1 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 2, 3 }
-            };
+            if (dd_factor > 0.0f)
+                dm_backproject_row(invproj, y + 1, width,
+                    DM_ROW_ARGS(rows[1]));
+            float const* norms[2] = { rows[0][3], rows[1][3] };
 
-            /* Decide which triangles to issue. */
-            int tri[2] = { 0, 0 };
+            float const* row = dm->get_data_pointer() + y * width;
+            for (int x = 0; x < block_width; ++x)
+            {
+                float depths[4] = { row[x], row[x + 1],
+                    row[x + width], row[x + width + 1] };
+                unsigned char const code = dm_block_triangles(depths, norms,
+                    x, invproj[0], dd_factor);
+                codes[y * block_width + x] = code;
+                face_offsets[band + 1] += ((code & 7) ? 3 : 0)
+                    + ((code >> 3) ? 3 : 0);
+            }
+            std::swap(rows[0], rows[1]);
+        }
 
-            switch (mask)
+        /* Mark the pixels of the next row referenced by the band. */
+        std::vector<unsigned char>& marks = shared[band + 1];
+        marks.resize(width, 0);
+        for (int x = 0; x < block_width; ++x)
+        {
+            unsigned char const code = codes[(y1 - 1) * block_width + x];
+            for (int j = 0; j < 2; ++j)
             {
-                case 7: tri[0] = 1; break;
-                case 11: tri[0] = 2; break;
-                case 13: tri[0] = 3; break;
-                case 14: tri[0] = 4; break;
-                case 15:
-                {
-                    /* Choose the triangulation with smaller diagonal. */
-                    float ddiff1 = std::abs(depths[0] - depths[3]);
-                    float ddiff2 = std::abs(depths[1] - depths[2]);
-                    if (ddiff1 < ddiff2)
-                    { tri[0] = 2; tri[1] = 3; }
-                    else
-                    { tri[0] = 1; tri[1] = 4; }
-                    break;
-                }
-                default: continue;
+                int const tri = (code >> (3 * j)) & 7;
+                if (tri == 0)
+                    continue;
+                for (int k = 0; k < 3; ++k)
+                    if (dm_block_tris[tri - 1][k] / 2 == 1)
+                        marks[x + dm_block_tris[tri - 1][k] % 2] = 1;
             }
+        }
+    }
+    if (num_bands > 0)
+        shared[0].resize(width, 0);
 
-            /* Omit depth discontinuity detection if dd_factor is zero. */
-            if (dd_factor > 0.0f)
+    /* Number the vertices first referenced in every band locally. */
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band)
+    {
+        int const y0 = band * DM_BAND_ROWS;
+        int const y1 = std::min(block_rows, y0 + DM_BAND_ROWS);
+        std::vector<unsigned char> const& marks = shared[band];
+        unsigned int num_verts = 0;
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < block_width; ++x)
             {
-                /* Cache pixel footprints. */
-                float widths[4];
-                for (int j = 0; j < 4; ++j)
+                unsigned char const code = codes[y * block_width + x];
+                for (int j = 0; j < 2; ++j)
                 {
-                    if (depths[j] == 0.0f)
+                    int const tri = (code >> (3 * j)) & 7;
+                    if (tri == 0)
                         continue;
-                    widths[j] = pixel_footprint(x + (j % 2), y + (j / 2),
-                        depths[j], invproj);// w, h, focal_len);
-                }
-
-                /* Check for depth discontinuities. */
-                for (int j = 0; j < 2 && tri[j] != 0; ++j)
-                {
-                    int* tv = tris[tri[j] - 1];
-                    #define DM_DD_ARGS widths, depths, dd_factor
-                    if (dm_is_depthdisc(DM_DD_ARGS, tv[0], tv[1])) tri[j] = 0;
-                    if (dm_is_depthdisc(DM_DD_ARGS, tv[1], tv[2])) tri[j] = 0;
-                    if (dm_is_depthdisc(DM_DD_ARGS, tv[2], tv[0])) tri[j] = 0;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        int const tv = dm_block_tris[tri - 1][k];
+                        int const px = x + tv % 2;
+                        int const py = y + tv / 2;
+                        if (py == y0 && marks[px])
+                            continue;
+                        unsigned int& id = vidx.at(px + py * width);
+                        if (id == MATH_MAX_UINT)
+                            id = num_verts++;
+                    }
                 }
             }
+        vert_offsets[band + 1] = num_verts;
+    }
 
-            /* Build triangles. */
-            for (int j = 0; j < 2; ++j)
+    for (int band = 0; band < num_bands; ++band)
+    {
+        vert_offsets[band + 1] += vert_offsets[band];
+        face_offsets[band + 1] += face_offsets[band];
+    }
+    verts.resize(vert_offsets[num_bands]);
+    faces.resize(face_offsets[num_bands]);
+
+    /* Compute global vertex IDs and back-project the vertices. */
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band)
+    {
+        int const y0 = band * DM_BAND_ROWS;
+        int const y1 = std::min(block_rows, y0 + DM_BAND_ROWS);
+        unsigned int const offset
+            = static_cast<unsigned int>(vert_offsets[band]);
+        std::vector<float> buffer(4 * width);
+        float* rays[4];
+        for (int j = 0; j < 4; ++j)
+            rays[j] = &buffer[j * width];
+
+        for (int y = y0; y <= y1; ++y)
+        {
+            dm_backproject_row(invproj, y, width, DM_ROW_ARGS(rays));
+            float const* row = dm->get_data_pointer() + y * width;
+            unsigned int* ids = vidx.get_data_pointer() + y * width;
+            for (int x = 0; x < width; ++x)
             {
-                if (tri[j] == 0) continue;
-                #define DM_MAKE_TRI_ARGS mesh.get(), vidx, dm.get(), invproj, i
-                dm_make_triangle(DM_MAKE_TRI_ARGS, tris[tri[j] - 1]);
+                bool owned;
+                if (y == y0)
+                    owned = !shared[band][x] && ids[x] != MATH_MAX_UINT;
+                else if (y == y1)
+                    owned = shared[band + 1][x] != 0;
+                else
+                    owned = ids[x] != MATH_MAX_UINT;
+                if (!owned)
+                    continue;
+
+                ids[x] += offset;
+                float const depth = row[x];
+                float const norm = rays[3][x];
+                verts[ids[x]] = math::Vec3f(rays[0][x] / norm * depth,
+                    rays[1][x] / norm * depth, rays[2][x] / norm * depth);
             }
         }
     }
 
+    /* Build triangles. */
+#pragma omp parallel for schedule(dynamic)
+    for (int band = 0; band < num_bands; ++band)
+    {
+        int const y0 = band * DM_BAND_ROWS;
+        int const y1 = std::min(block_rows, y0 + DM_BAND_ROWS);
+        std::size_t pos = face_offsets[band];
+        for (int y = y0; y < y1; ++y)
+            for (int x = 0; x < block_width; ++x)
+            {
+                unsigned char const code = codes[y * block_width + x];
+                for (int j = 0; j < 2; ++j)
+                {
+                    int const tri = (code >> (3 * j)) & 7;
+                    if (tri == 0)
+                        continue;
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        int const tv = dm_block_tris[tri - 1][k];
+                        faces[pos++] = vidx.at(x + tv % 2
+                            + (y + tv / 2) * width);
+                    }
+                }
+            }
+    }
+
     /* Provide the vertex ID mapping if requested. */
     if (vids != nullptr)
         std::swap(vidx, *vids);
@@ -506,7 +677,7 @@ depthmap_mesh_confidences (TriangleMesh::Ptr mesh, int iterations)
 
     /* Find boundary vertices and remember them. */
     std::vector<std::size_t> vidx;
-    MeshInfo mesh_info(mesh);
+    CompactMeshInfo mesh_info(mesh);
 
     for (std::size_t i = 0; i < mesh_info.size(); ++i)
     {
@@ -530,7 +701,7 @@ depthmap_mesh_confidences (TriangleMesh::Ptr mesh, int iterations)
         std::swap(vidx, cvidx);
         for (std::size_t i = 0; i < cvidx.size(); ++i)
         {
-            MeshInfo::VertexInfo info = mesh_info[cvidx[i]];
+            CompactMeshInfo::VertexInfo const info = mesh_info[cvidx[i]];
             for (std::size_t j = 0; j < info.verts.size(); ++j)
                 if (confs[info.verts[j]] == 1.0f)
                     vidx.push_back(info.verts[j]);
@@ -559,10 +730,10 @@ depthmap_mesh_peeling (TriangleMesh::Ptr mesh, int iterations)
     /* Iteratively invalidate triangles at the boundary. */
     for (int iter = 0; iter < iterations; ++iter)
     {
-        MeshInfo mesh_info(mesh);
+        CompactMeshInfo mesh_info(mesh);
         for (std::size_t i = 0; i < mesh_info.size(); ++i)
         {
-            MeshInfo::VertexInfo const& info(mesh_info[i]);
+            CompactMeshInfo::VertexInfo const info = mesh_info[i];
             if (info.vclass == MeshInfo::VERTEX_CLASS_BORDER)
                 for (std::size_t j = 0; j < info.faces.size(); ++j)
                     for (int k = 0; k < 3; ++k)
@@ -578,5 +749,49 @@ depthmap_mesh_peeling (TriangleMesh::Ptr mesh, int iterations)
     math::algo::vector_clean(delete_list, &faces);
 }
 
+/* ---------------------------------------------------------------- */
+
+FloatImage::Ptr
+depthmap_from_mesh (MeshBVH const& bvh, CameraInfo const& cam,
+    int width, int height)
+{
+    if (width <= 0 || height <= 0)
+        throw std::invalid_argument("Invalid depth map size");
+
+    math::Matrix3f invcalib, rot;
+    math::Vec3f campos;
+    cam.fill_inverse_calibration(*invcalib, width, height);
+    cam.fill_cam_to_world_rot(*rot);
+    cam.fill_camera_pos(*campos);
+    math::Matrix3f const invproj = rot * invcalib;
+
+    /* Generate the rays in tiles of 4x2 pixels for coherent packets. */
+    std::vector<MeshBVH::Ray> rays;
+    std::vector<int> pixels;
+    rays.reserve(width * height);
+    pixels.reserve(width * height);
+    for (int ty = 0; ty < height; ty += 2)
+        for (int tx = 0; tx < width; tx += 4)
+            for (int y = ty; y < std::min(ty + 2, height); ++y)
+                for (int x = tx; x < std::min(tx + 4, width); ++x)
+                {
+                    MeshBVH::Ray ray;
+                    ray.origin = campos;
+                    ray.dir = invproj * math::Vec3f(x + 0.5f, y + 0.5f, 1.0f);
+                    ray.dir.normalize();
+                    rays.push_back(ray);
+                    pixels.push_back(x + y * width);
+                }
+
+    std::vector<MeshBVH::Hit> hits;
+    bvh.intersect(rays, &hits);
+
+    FloatImage::Ptr dm = FloatImage::create(width, height, 1);
+    for (std::size_t i = 0; i < hits.size(); ++i)
+        if (hits[i].face_id != MATH_MAX_SIZE_T)
+            dm->at(pixels[i]) = hits[i].t;
+    return dm;
+}
+
 MVE_GEOM_NAMESPACE_END
 MVE_NAMESPACE_END
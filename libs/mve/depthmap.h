@@ -16,6 +16,7 @@
 #include "mve/camera.h"
 #include "mve/image.h"
 #include "mve/mesh.h"
+#include "mve/mesh_bvh.h"
 
 MVE_NAMESPACE_BEGIN
 MVE_IMAGE_NAMESPACE_BEGIN
@@ -149,6 +150,15 @@ depthmap_mesh_confidences (TriangleMesh::Ptr mesh, int iterations = 3);
 void
 depthmap_mesh_peeling (TriangleMesh::Ptr mesh, int iterations = 1);
 
+/**
+ * Renders a depth map of the mesh given by the BVH for the given camera.
+ * Depth values are distances to the camera center (MVE convention), and
+ * pixels without surface are zero. Rays are cast in packets of 4x2 pixels.
+ */
+FloatImage::Ptr
+depthmap_from_mesh (MeshBVH const& bvh, CameraInfo const& cam,
+    int width, int height);
+
 MVE_GEOM_NAMESPACE_END
 MVE_NAMESPACE_END
 
@@ -8,23 +8,29 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 #include <limits>
 #include <fstream>
 #include <cstdio>
 #include <cstdarg>
 #include <cstring>
 #include <cerrno>
+#include <vector>
 
 #ifndef MVE_NO_PNG_SUPPORT
 #   include <png.h>
 #endif
 
+/* The tiled MVEI format uses zlib for tile compression. */
+#include <zlib.h>
+
 #ifndef MVE_NO_JPEG_SUPPORT
 /* Include windows.h before jpeglib.h to prevent INT32 typedef collision. */
 #   if defined(_WIN32)
 #       include <windows.h>
 #   endif
 #   include <jpeglib.h>
+#   include <jerror.h>
 #endif
 
 #ifndef MVE_NO_TIFF_SUPPORT
@@ -43,6 +49,7 @@
 
 /* The signature to identify MVEI image files and loader limits. */
 #define MVEI_FILE_SIGNATURE "\211MVE_IMAGE\n"
+#define MVEI_TILED_SIGNATURE "\211MVE_IMAGT\n"
 #define MVEI_FILE_SIGNATURE_LEN 11
 #define MVEI_MAX_PIXEL_AMOUNT (16384 * 16384) /* 2^28 */
 
@@ -209,41 +216,56 @@ save_file (FloatImage::Ptr image, std::string const& filename)
 namespace
 {
     void
-    load_png_headers_intern (FILE* fp, ImageHeaders* headers,
+    png_read_stream (png_structp png, png_bytep data, png_size_t length)
+    {
+        std::istream* in = static_cast<std::istream*>(png_get_io_ptr(png));
+        in->read(reinterpret_cast<char*>(data), length);
+        if (static_cast<png_size_t>(in->gcount()) != length)
+            png_error(png, "Unexpected end of PNG data");
+    }
+
+    void
+    png_write_stream (png_structp png, png_bytep data, png_size_t length)
+    {
+        std::ostream* out = static_cast<std::ostream*>(png_get_io_ptr(png));
+        out->write(reinterpret_cast<char const*>(data), length);
+        if (!out->good())
+            png_error(png, "Error writing PNG data");
+    }
+
+    void
+    png_flush_stream (png_structp png)
+    {
+        static_cast<std::ostream*>(png_get_io_ptr(png))->flush();
+    }
+
+    void
+    load_png_headers_intern (std::istream& in, ImageHeaders* headers,
         png_structp* png, png_infop* png_info)
     {
         /* Identify the PNG signature. */
         png_byte signature[8];
-        if (std::fread(signature, 1, 8, fp) != 8)
-        {
-            std::fclose(fp);
+        in.read(reinterpret_cast<char*>(signature), 8);
+        if (in.gcount() != 8)
             throw util::Exception("PNG signature could not be read");
-        }
         if (png_sig_cmp(signature, 0, 8) != 0)
-        {
-            std::fclose(fp);
             throw util::Exception("PNG signature did not match");
-        }
 
         /* Initialize PNG structures. */
         *png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
             nullptr, nullptr, nullptr);
         if (!*png)
-        {
-            std::fclose(fp);
             throw util::Exception("Out of memory");
-        }
 
         *png_info = png_create_info_struct(*png);
         if (!*png_info)
         {
             png_destroy_read_struct(png, nullptr, nullptr);
-            std::fclose(fp);
             throw util::Exception("Out of memory");
         }
 
-        /* Init PNG file IO */
-        png_init_io(*png, fp);
+        /* Init PNG stream IO */
+        png_set_read_fn(*png, &in, png_read_stream);
         png_set_sig_bytes(*png, 8);
 
         /* Read PNG header info. */
@@ -261,7 +283,6 @@ namespace
         else
         {
             png_destroy_read_struct(png, png_info, nullptr);
-            std::fclose(fp);
             throw util::Exception("PNG with unknown bit depth");
         }
     }
@@ -270,23 +291,26 @@ namespace
 ByteImage::Ptr
 load_png_file (std::string const& filename)
 {
-    // TODO: use throw-safe FILE* wrapper
-    FILE* fp = std::fopen(filename.c_str(), "rb");
-    if (fp == nullptr)
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
+    return load_png_file(in);
+}
 
+ByteImage::Ptr
+load_png_file (std::istream& in)
+{
     /* Read PNG header info. */
     ImageHeaders headers;
     png_structp png = nullptr;
     png_infop png_info = nullptr;
-    load_png_headers_intern(fp, &headers, &png, &png_info);
+    load_png_headers_intern(in, &headers, &png, &png_info);
 
     /* Check if bit depth is valid. */
     int const bit_depth = png_get_bit_depth(png, png_info);
     if (bit_depth > 8)
     {
         png_destroy_read_struct(&png, &png_info, nullptr);
-        std::fclose(fp);
         throw util::Exception("PNG with more than 8 bit");
     }
 
@@ -318,7 +342,6 @@ load_png_file (std::string const& filename)
 
     /* Clean up. */
     png_destroy_read_struct(&png, &png_info, nullptr);
-    std::fclose(fp);
 
     return image;
 }
@@ -326,19 +349,23 @@ load_png_file (std::string const& filename)
 ImageHeaders
 load_png_file_headers (std::string const& filename)
 {
-    FILE* fp = std::fopen(filename.c_str(), "rb");
-    if (fp == nullptr)
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
+    return load_png_file_headers(in);
+}
 
+ImageHeaders
+load_png_file_headers (std::istream& in)
+{
     /* Read PNG header info. */
     ImageHeaders headers;
     png_structp png = nullptr;
     png_infop png_info = nullptr;
-    load_png_headers_intern(fp, &headers, &png, &png_info);
+    load_png_headers_intern(in, &headers, &png, &png_info);
 
     /* Clean up. */
     png_destroy_read_struct(&png, &png_info, nullptr);
-    std::fclose(fp);
 
     return headers;
 }
@@ -350,10 +377,23 @@ save_png_file (ByteImage::ConstPtr image,
     if (image == nullptr)
         throw std::invalid_argument("Null image given");
 
-    FILE *fp = std::fopen(filename.c_str(), "wb");
-    if (!fp)
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.good())
         throw util::FileException(filename, std::strerror(errno));
 
+    save_png_file(image, out, compression_level);
+    out.close();
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+}
+
+void
+save_png_file (ByteImage::ConstPtr image,
+    std::ostream& out, int compression_level)
+{
+    if (image == nullptr)
+        throw std::invalid_argument("Null image given");
+
     //png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING,
     //    (png_voidp)user_error_ptr, user_error_fn, user_warning_fn);
     png_structp png_ptr = png_create_write_struct
@@ -361,7 +401,6 @@ save_png_file (ByteImage::ConstPtr image,
 
     if (!png_ptr)
     {
-        std::fclose(fp);
         throw util::Exception("Out of memory");
     }
 
@@ -369,11 +408,10 @@ save_png_file (ByteImage::ConstPtr image,
     if (!info_ptr)
     {
         png_destroy_write_struct(&png_ptr, (png_infopp)nullptr);
-        std::fclose(fp);
         throw util::Exception("Out of memory");
     }
 
-    png_init_io(png_ptr, fp);
+    png_set_write_fn(png_ptr, &out, png_write_stream, png_flush_stream);
 
     // void write_row_callback(png_ptr, png_uint_32 row, int pass);
     //png_set_write_status_fn(png_ptr, write_row_callback);
@@ -389,7 +427,6 @@ save_png_file (ByteImage::ConstPtr image,
         default:
         {
             png_destroy_write_struct(&png_ptr, &info_ptr);
-            std::fclose(fp);
             throw util::Exception("Cannot determine image color type");
         }
     }
@@ -421,7 +458,6 @@ save_png_file (ByteImage::ConstPtr image,
 
     /* Cleanup. */
     png_destroy_write_struct(&png_ptr, &info_ptr);
-    std::fclose(fp);
 }
 
 #endif /* MVE_NO_PNG_SUPPORT */
@@ -443,13 +479,106 @@ jpg_message_handler (j_common_ptr /*cinfo*/, int msg_level)
         throw util::Exception("JPEG data corrupt");
 }
 
+namespace
+{
+    /* Source manager that reads JPEG data from a stream. */
+    struct JPEGStreamSource
+    {
+        jpeg_source_mgr pub;
+        std::istream* in;
+        JOCTET buffer[4096];
+    };
+
+    void
+    jpg_init_source (j_decompress_ptr /*cinfo*/)
+    {
+    }
+
+    boolean
+    jpg_fill_input_buffer (j_decompress_ptr cinfo)
+    {
+        JPEGStreamSource* src
+            = reinterpret_cast<JPEGStreamSource*>(cinfo->src);
+        src->in->read(reinterpret_cast<char*>(src->buffer),
+            sizeof(src->buffer));
+        std::size_t size = static_cast<std::size_t>(src->in->gcount());
+        if (size == 0)
+        {
+            /* Insert a fake EOI marker, like the libjpeg stdio source. */
+            WARNMS(cinfo, JWRN_JPEG_EOF);
+            src->buffer[0] = static_cast<JOCTET>(0xFF);
+            src->buffer[1] = static_cast<JOCTET>(JPEG_EOI);
+            size = 2;
+        }
+        src->pub.next_input_byte = src->buffer;
+        src->pub.bytes_in_buffer = size;
+        return TRUE;
+    }
+
+    void
+    jpg_skip_input_data (j_decompress_ptr cinfo, long num_bytes)
+    {
+        if (num_bytes <= 0)
+            return;
+        jpeg_source_mgr* src = cinfo->src;
+        while (num_bytes > static_cast<long>(src->bytes_in_buffer))
+        {
+            num_bytes -= static_cast<long>(src->bytes_in_buffer);
+            jpg_fill_input_buffer(cinfo);
+        }
+        src->next_input_byte += num_bytes;
+        src->bytes_in_buffer -= num_bytes;
+    }
+
+    void
+    jpg_term_source (j_decompress_ptr /*cinfo*/)
+    {
+    }
+
+    void
+    jpg_stream_src (j_decompress_ptr cinfo, JPEGStreamSource* src,
+        std::istream& in)
+    {
+        src->pub.init_source = &jpg_init_source;
+        src->pub.fill_input_buffer = &jpg_fill_input_buffer;
+        src->pub.skip_input_data = &jpg_skip_input_data;
+        src->pub.resync_to_restart = &jpeg_resync_to_restart;
+        src->pub.term_source = &jpg_term_source;
+        src->pub.bytes_in_buffer = 0;
+        src->pub.next_input_byte = nullptr;
+        src->in = &in;
+        cinfo->src = &src->pub;
+    }
+}
+
 ByteImage::Ptr
 load_jpg_file (std::string const& filename, std::string* exif)
 {
-    FILE* fp = std::fopen(filename.c_str(), "rb");
-    if (fp == nullptr)
+    return load_jpg_file_scaled(filename,
+        std::numeric_limits<int>::max(), exif);
+}
+
+ByteImage::Ptr
+load_jpg_file_scaled (std::string const& filename, int max_pixels,
+    std::string* exif, ImageHeaders* headers)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
+    return load_jpg_file_scaled(in, max_pixels, exif, headers);
+}
 
+ByteImage::Ptr
+load_jpg_file (std::istream& in, std::string* exif)
+{
+    return load_jpg_file_scaled(in, std::numeric_limits<int>::max(), exif);
+}
+
+ByteImage::Ptr
+load_jpg_file_scaled (std::istream& in, int max_pixels, std::string* exif,
+    ImageHeaders* headers)
+{
+    JPEGStreamSource source;
     jpeg_decompress_struct cinfo;
     jpeg_error_mgr jerr;
     ByteImage::Ptr image;
@@ -460,7 +589,7 @@ load_jpg_file (std::string const& filename, std::string* exif)
         jerr.error_exit = &jpg_error_handler;
         jerr.emit_message = &jpg_message_handler;
         jpeg_create_decompress(&cinfo);
-        jpeg_stdio_src(&cinfo, fp);
+        jpg_stream_src(&cinfo, &source, in);
 
         if (exif)
         {
@@ -490,9 +619,31 @@ load_jpg_file (std::string const& filename, std::string* exif)
             && cinfo.out_color_space != JCS_RGB)
             throw util::Exception("Invalid JPEG color space");
 
+        if (headers != nullptr)
+        {
+            headers->width = cinfo.image_width;
+            headers->height = cinfo.image_height;
+            headers->channels = (cinfo.out_color_space == JCS_RGB ? 3 : 1);
+            headers->type = IMAGE_TYPE_UINT8;
+        }
+
+        /* Reduce the size by the smallest power of two up to 8. */
+        int64_t reduced_width = cinfo.image_width;
+        int64_t reduced_height = cinfo.image_height;
+        unsigned int scale = 1;
+        while (scale < 8 && reduced_width * reduced_height > max_pixels)
+        {
+            reduced_width = (reduced_width + 1) / 2;
+            reduced_height = (reduced_height + 1) / 2;
+            scale *= 2;
+        }
+        cinfo.scale_num = 1;
+        cinfo.scale_denom = scale;
+        jpeg_calc_output_dimensions(&cinfo);
+
         /* Create image. */
-        int const width = cinfo.image_width;
-        int const height = cinfo.image_height;
+        int const width = cinfo.output_width;
+        int const height = cinfo.output_height;
         int const channels = (cinfo.out_color_space == JCS_RGB ? 3 : 1);
         image = ByteImage::create(width, height, channels);
         ByteImage::ImageData& data = image->get_data();
@@ -510,12 +661,10 @@ load_jpg_file (std::string const& filename, std::string* exif)
         /* Shutdown JPEG decompression. */
         jpeg_finish_decompress(&cinfo);
         jpeg_destroy_decompress(&cinfo);
-        std::fclose(fp);
     }
     catch (...)
     {
         jpeg_destroy_decompress(&cinfo);
-        std::fclose(fp);
         throw;
     }
 
@@ -525,10 +674,16 @@ load_jpg_file (std::string const& filename, std::string* exif)
 ImageHeaders
 load_jpg_file_headers (std::string const& filename)
 {
-    FILE* fp = std::fopen(filename.c_str(), "rb");
-    if (fp == nullptr)
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
+    return load_jpg_file_headers(in);
+}
 
+ImageHeaders
+load_jpg_file_headers (std::istream& in)
+{
+    JPEGStreamSource source;
     jpeg_decompress_struct cinfo;
     jpeg_error_mgr jerr;
     ImageHeaders headers;
@@ -539,7 +694,7 @@ load_jpg_file_headers (std::string const& filename)
         jerr.error_exit = &jpg_error_handler;
         jerr.emit_message = &jpg_message_handler;
         jpeg_create_decompress(&cinfo);
-        jpeg_stdio_src(&cinfo, fp);
+        jpg_stream_src(&cinfo, &source, in);
 
         /* Read JPEG header. */
         int ret = jpeg_read_header(&cinfo, /*false*/0);
@@ -556,12 +711,10 @@ load_jpg_file_headers (std::string const& filename)
         headers.type = IMAGE_TYPE_UINT8;
 
         jpeg_destroy_decompress(&cinfo);
-        std::fclose(fp);
     }
     catch (...)
     {
         jpeg_destroy_decompress(&cinfo);
-        std::fclose(fp);
         throw;
     }
 
@@ -1057,13 +1210,32 @@ save_ppm_file (ByteImage::ConstPtr image, std::string const& filename)
 
 namespace
 {
+    /* Layout of the tiled format, which follows the common headers. */
+    struct MVEITiling
+    {
+        bool tiled = false;
+        int compression = MVEI_COMPRESSION_NONE;
+        int tile_size = 0;
+        int tiles_x = 0;
+        int tiles_y = 0;
+    };
+
+    /* Pixel rectangle of a tile or image region. */
+    struct MVEIRect
+    {
+        int x, y, width, height;
+    };
+
     void
-    load_mvei_headers_intern (std::istream& in, ImageHeaders* headers)
+    load_mvei_headers_intern (std::istream& in, ImageHeaders* headers,
+        MVEITiling* tiling = nullptr)
     {
         char signature[MVEI_FILE_SIGNATURE_LEN];
         in.read(signature, MVEI_FILE_SIGNATURE_LEN);
-        if (!std::equal(signature, signature + MVEI_FILE_SIGNATURE_LEN,
-            MVEI_FILE_SIGNATURE))
+        bool const tiled = std::equal(signature,
+            signature + MVEI_FILE_SIGNATURE_LEN, MVEI_TILED_SIGNATURE);
+        if (!tiled && !std::equal(signature,
+            signature + MVEI_FILE_SIGNATURE_LEN, MVEI_FILE_SIGNATURE))
             throw util::Exception("Invalid file signature");
 
         /* Read image headers data, */
@@ -1080,6 +1252,245 @@ namespace
         headers->height = height;
         headers->channels = channels;
         headers->type = static_cast<ImageType>(raw_type);
+
+        if (tiling == nullptr || !tiled)
+            return;
+
+        int32_t compression, tile_size;
+        in.read(reinterpret_cast<char*>(&compression), sizeof(int32_t));
+        in.read(reinterpret_cast<char*>(&tile_size), sizeof(int32_t));
+        if (!in.good())
+            throw util::Exception("Error reading headers");
+        if (compression != MVEI_COMPRESSION_NONE
+            && compression != MVEI_COMPRESSION_DEFLATE)
+            throw util::Exception("Unsupported compression");
+        if (width < 0 || height < 0 || tile_size <= 0)
+            throw util::Exception("Invalid image tiling");
+
+        tiling->tiled = true;
+        tiling->compression = compression;
+        tiling->tile_size = tile_size;
+        tiling->tiles_x = (width + tile_size - 1) / tile_size;
+        tiling->tiles_y = (height + tile_size - 1) / tile_size;
+    }
+
+    std::size_t
+    mvei_pixel_size (ImageBase const& image)
+    {
+        std::size_t const num_pixels
+            = static_cast<std::size_t>(image.width()) * image.height();
+        return num_pixels == 0 ? 0 : image.get_byte_size() / num_pixels;
+    }
+
+    MVEIRect
+    mvei_tile_rect (MVEITiling const& tiling, ImageHeaders const& headers,
+        int tile_id)
+    {
+        MVEIRect rect;
+        rect.x = (tile_id % tiling.tiles_x) * tiling.tile_size;
+        rect.y = (tile_id / tiling.tiles_x) * tiling.tile_size;
+        rect.width = std::min(tiling.tile_size, headers.width - rect.x);
+        rect.height = std::min(tiling.tile_size, headers.height - rect.y);
+        return rect;
+    }
+
+    /*
+     * Copies the overlap of two rectangles with pixel data. Both buffers
+     * store the pixels of their rectangle in row-major order.
+     */
+    void
+    mvei_copy_rect (char const* src, MVEIRect const& src_rect,
+        char* dst, MVEIRect const& dst_rect, std::size_t pixel_size)
+    {
+        int const x0 = std::max(src_rect.x, dst_rect.x);
+        int const x1 = std::min(src_rect.x + src_rect.width,
+            dst_rect.x + dst_rect.width);
+        int const y0 = std::max(src_rect.y, dst_rect.y);
+        int const y1 = std::min(src_rect.y + src_rect.height,
+            dst_rect.y + dst_rect.height);
+        if (x0 >= x1 || y0 >= y1)
+            return;
+
+        std::size_t const row_size = (x1 - x0) * pixel_size;
+        for (int y = y0; y < y1; ++y)
+        {
+            char const* src_row = src + ((std::size_t)(y - src_rect.y)
+                * src_rect.width + (x0 - src_rect.x)) * pixel_size;
+            char* dst_row = dst + ((std::size_t)(y - dst_rect.y)
+                * dst_rect.width + (x0 - dst_rect.x)) * pixel_size;
+            std::copy(src_row, src_row + row_size, dst_row);
+        }
+    }
+
+    /* Groups the i-th bytes of all values, and the inverse operation. */
+    void
+    mvei_shuffle (char const* in, std::size_t size,
+        std::size_t value_size, char* out)
+    {
+        std::size_t const num_values = size / value_size;
+        for (std::size_t i = 0; i < num_values; ++i)
+            for (std::size_t j = 0; j < value_size; ++j)
+                out[j * num_values + i] = in[i * value_size + j];
+    }
+
+    void
+    mvei_unshuffle (char const* in, std::size_t size,
+        std::size_t value_size, char* out)
+    {
+        std::size_t const num_values = size / value_size;
+        for (std::size_t i = 0; i < num_values; ++i)
+            for (std::size_t j = 0; j < value_size; ++j)
+                out[i * value_size + j] = in[j * num_values + i];
+    }
+
+    /*
+     * Compresses the tile pixels. Returns false if the tile does not
+     * compress, in which case the tile is stored as is.
+     */
+    bool
+    mvei_compress_tile (std::vector<char> const& raw, int compression,
+        std::size_t value_size, std::vector<char>* payload)
+    {
+        if (compression != MVEI_COMPRESSION_DEFLATE || raw.empty())
+            return false;
+
+        std::vector<char> shuffled(raw.size());
+        mvei_shuffle(raw.data(), raw.size(), value_size, shuffled.data());
+
+        uLongf size = compressBound(raw.size());
+        payload->resize(size);
+        int const ret = compress2(
+            reinterpret_cast<Bytef*>(payload->data()), &size,
+            reinterpret_cast<Bytef const*>(shuffled.data()), raw.size(),
+            Z_BEST_SPEED);
+        if (ret != Z_OK || size >= raw.size())
+            return false;
+        payload->resize(size);
+        return true;
+    }
+
+    /*
+     * Decodes the payload of a tile, returns false on error. The decoded
+     * size must exactly match the size of 'raw', i.e. the tile width times
+     * the tile height times the pixel size.
+     */
+    bool
+    mvei_decompress_tile (char const* payload, std::size_t payload_size,
+        int compression, std::size_t value_size, std::vector<char>* raw)
+    {
+        if (payload_size == raw->size())
+        {
+            std::copy(payload, payload + payload_size, raw->begin());
+            return true;
+        }
+        if (compression != MVEI_COMPRESSION_DEFLATE)
+            return false;
+
+        std::vector<char> shuffled(raw->size());
+        uLongf size = shuffled.size();
+        int const ret = uncompress(
+            reinterpret_cast<Bytef*>(shuffled.data()), &size,
+            reinterpret_cast<Bytef const*>(payload), payload_size);
+        if (ret != Z_OK || size != shuffled.size())
+            return false;
+        mvei_unshuffle(shuffled.data(), shuffled.size(),
+            value_size, raw->data());
+        return true;
+    }
+
+    /*
+     * Loads the pixels of the given region from the tiled format. Tile
+     * offsets are relative to 'base', the position of the file signature.
+     */
+    void
+    load_mvei_tiles_intern (std::istream& in, std::streamoff base,
+        ImageHeaders const& headers, MVEITiling const& tiling,
+        MVEIRect const& region, ImageBase* image)
+    {
+        /* Determine the stream size to validate the offsets against. */
+        std::streamoff const table_pos = in.tellg();
+        in.seekg(0, std::ios::end);
+        std::streamoff const stream_end = in.tellg();
+        in.seekg(table_pos);
+        if (table_pos < base || stream_end < table_pos || !in.good())
+            throw util::Exception("Error reading tile offsets");
+
+        /* The offset table must fit into the stream before allocating it. */
+        std::size_t const num_tiles
+            = static_cast<std::size_t>(tiling.tiles_x) * tiling.tiles_y;
+        uint64_t const table_begin = table_pos - base;
+        uint64_t const data_end = stream_end - base;
+        if (num_tiles + 1 > (data_end - table_begin) / sizeof(uint64_t))
+            throw util::Exception("Invalid tile offsets");
+
+        std::vector<uint64_t> offsets(num_tiles + 1);
+        in.read(reinterpret_cast<char*>(offsets.data()),
+            offsets.size() * sizeof(uint64_t));
+        if (!in.good())
+            throw util::Exception("Error reading tile offsets");
+
+        /*
+         * Offsets must be monotonic, within the stream, and each payload
+         * must not exceed the uncompressed tile since tiles that do not
+         * compress are stored as is.
+         */
+        std::size_t const pixel_size = mvei_pixel_size(*image);
+        uint64_t const table_end = table_begin
+            + offsets.size() * sizeof(uint64_t);
+        if (offsets[0] < table_end || offsets[num_tiles] > data_end)
+            throw util::Exception("Invalid tile offsets");
+        for (std::size_t i = 0; i < num_tiles; ++i)
+        {
+            MVEIRect const rect = mvei_tile_rect(tiling, headers, i);
+            uint64_t const max_size = static_cast<uint64_t>(rect.width)
+                * rect.height * pixel_size;
+            if (offsets[i] > offsets[i + 1]
+                || offsets[i + 1] - offsets[i] > max_size)
+                throw util::Exception("Invalid tile offsets");
+        }
+
+        /* Read the payloads of the tiles overlapping the region. */
+        std::vector<int> tile_ids;
+        std::vector<std::vector<char> > payloads;
+        for (int i = 0; i < static_cast<int>(num_tiles); ++i)
+        {
+            MVEIRect const rect = mvei_tile_rect(tiling, headers, i);
+            if (rect.x >= region.x + region.width
+                || rect.x + rect.width <= region.x
+                || rect.y >= region.y + region.height
+                || rect.y + rect.height <= region.y)
+                continue;
+
+            tile_ids.push_back(i);
+            payloads.push_back(std::vector<char>(offsets[i + 1] - offsets[i]));
+            in.seekg(base + static_cast<std::streamoff>(offsets[i]));
+            in.read(payloads.back().data(), payloads.back().size());
+            if (!in.good())
+                throw util::Exception("Error reading tile data");
+        }
+
+        /* Decode the tiles in parallel. */
+        std::size_t const value_size
+            = pixel_size / std::max(1, headers.channels);
+        bool success = true;
+#pragma omp parallel for schedule(dynamic) reduction(&&:success)
+        for (int i = 0; i < static_cast<int>(tile_ids.size()); ++i)
+        {
+            MVEIRect const rect = mvei_tile_rect(tiling, headers, tile_ids[i]);
+            std::vector<char> raw((std::size_t)rect.width
+                * rect.height * pixel_size);
+            if (!mvei_decompress_tile(payloads[i].data(), payloads[i].size(),
+                tiling.compression, value_size, &raw))
+            {
+                success = false;
+                continue;
+            }
+            mvei_copy_rect(raw.data(), rect, image->get_byte_pointer(),
+                region, pixel_size);
+        }
+
+        if (!success)
+            throw util::Exception("Error decoding tile data");
     }
 }
 
@@ -1090,16 +1501,87 @@ load_mvei_file (std::string const& filename)
     if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
 
-    /* Load image header data. */
+    try
+    {
+        return load_mvei_file(in);
+    }
+    catch (util::Exception& e)
+    {
+        throw util::FileException(filename, e);
+    }
+}
+
+ImageBase::Ptr
+load_mvei_file (std::istream& in)
+{
+    std::streamoff const base = in.tellg();
     ImageHeaders headers;
-    load_mvei_headers_intern(in, &headers);
+    MVEITiling tiling;
+    load_mvei_headers_intern(in, &headers, &tiling);
     if (headers.width * headers.height > MVEI_MAX_PIXEL_AMOUNT)
         throw util::Exception("Ridiculously large image");
 
-    /* Load image data. */
     ImageBase::Ptr image = create_for_type(headers.type,
         headers.width, headers.height, headers.channels);
+    if (tiling.tiled)
+    {
+        MVEIRect const region = { 0, 0, headers.width, headers.height };
+        load_mvei_tiles_intern(in, base, headers, tiling,
+            region, image.get());
+        return image;
+    }
+
     in.read(image->get_byte_pointer(), image->get_byte_size());
+    if (!in.good())
+        throw util::Exception("Error reading image data");
+
+    return image;
+}
+
+ImageBase::Ptr
+load_mvei_file_region (std::string const& filename,
+    int x, int y, int width, int height)
+{
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    std::streamoff const base = in.tellg();
+    ImageHeaders headers;
+    MVEITiling tiling;
+    load_mvei_headers_intern(in, &headers, &tiling);
+    if (x < 0 || y < 0 || width < 0 || height < 0
+        || x + width > headers.width || y + height > headers.height)
+        throw std::invalid_argument("Region exceeds image dimensions");
+
+    ImageBase::Ptr image = create_for_type(headers.type,
+        width, height, headers.channels);
+    MVEIRect const region = { x, y, width, height };
+    if (tiling.tiled)
+    {
+        try
+        {
+            load_mvei_tiles_intern(in, base, headers, tiling,
+                region, image.get());
+        }
+        catch (util::Exception& e)
+        {
+            throw util::FileException(filename, e);
+        }
+        return image;
+    }
+
+    /* Read the rows of the region from the uncompressed format. */
+    std::size_t const pixel_size = mvei_pixel_size(*image);
+    std::size_t const row_size = width * pixel_size;
+    std::streamoff const data_offset = in.tellg();
+    for (int i = 0; i < height; ++i)
+    {
+        in.seekg(data_offset + static_cast<std::streamoff>(
+            (static_cast<std::size_t>(y + i) * headers.width + x)
+            * pixel_size));
+        in.read(image->get_byte_pointer() + i * row_size, row_size);
+    }
     if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
 
@@ -1113,6 +1595,12 @@ load_mvei_file_headers (std::string const& filename)
     if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
 
+    return load_mvei_file_headers(in);
+}
+
+ImageHeaders
+load_mvei_file_headers (std::istream& in)
+{
     ImageHeaders headers;
     load_mvei_headers_intern(in, &headers);
     return headers;
@@ -1120,6 +1608,29 @@ load_mvei_file_headers (std::string const& filename)
 
 void
 save_mvei_file (ImageBase::ConstPtr image, std::string const& filename)
+{
+    if (image == nullptr)
+        throw std::invalid_argument("Null image given");
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    try
+    {
+        save_mvei_file(image, out);
+    }
+    catch (util::Exception& e)
+    {
+        throw util::FileException(filename, e);
+    }
+    out.close();
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+}
+
+void
+save_mvei_file (ImageBase::ConstPtr image, std::ostream& out)
 {
     if (image == nullptr)
         throw std::invalid_argument("Null image given");
@@ -1131,10 +1642,6 @@ save_mvei_file (ImageBase::ConstPtr image, std::string const& filename)
     char const* data = image->get_byte_pointer();
     std::size_t size = image->get_byte_size();
 
-    std::ofstream out(filename.c_str(), std::ios::binary);
-    if (!out.good())
-        throw util::FileException(filename, std::strerror(errno));
-
     out.write(MVEI_FILE_SIGNATURE, MVEI_FILE_SIGNATURE_LEN);
     out.write(reinterpret_cast<char const*>(&width), sizeof(int32_t));
     out.write(reinterpret_cast<char const*>(&height), sizeof(int32_t));
@@ -1142,8 +1649,87 @@ save_mvei_file (ImageBase::ConstPtr image, std::string const& filename)
     out.write(reinterpret_cast<char const*>(&type), sizeof(int32_t));
     out.write(data, size);
 
+    if (!out.good())
+        throw util::Exception("Error writing image data");
+}
+
+void
+save_mvei_file (ImageBase::ConstPtr image, std::string const& filename,
+    MVEICompression compression, int tile_size)
+{
+    if (image == nullptr)
+        throw std::invalid_argument("Null image given");
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
     if (!out.good())
         throw util::FileException(filename, std::strerror(errno));
+
+    save_mvei_file(image, out, compression, tile_size);
+    out.close();
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+}
+
+void
+save_mvei_file (ImageBase::ConstPtr image, std::ostream& out,
+    MVEICompression compression, int tile_size)
+{
+    if (image == nullptr)
+        throw std::invalid_argument("Null image given");
+    if (tile_size <= 0)
+        throw std::invalid_argument("Invalid tile size");
+
+    ImageHeaders headers;
+    headers.width = image->width();
+    headers.height = image->height();
+    headers.channels = image->channels();
+    headers.type = image->get_type();
+
+    MVEITiling tiling;
+    tiling.tiled = true;
+    tiling.compression = compression;
+    tiling.tile_size = tile_size;
+    tiling.tiles_x = (headers.width + tile_size - 1) / tile_size;
+    tiling.tiles_y = (headers.height + tile_size - 1) / tile_size;
+
+    std::size_t const pixel_size = mvei_pixel_size(*image);
+    std::size_t const value_size = pixel_size / std::max(1, headers.channels);
+    MVEIRect const image_rect = { 0, 0, headers.width, headers.height };
+
+    /* Compress the tiles in parallel. */
+    int const num_tiles = tiling.tiles_x * tiling.tiles_y;
+    std::vector<std::vector<char> > payloads(num_tiles);
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_tiles; ++i)
+    {
+        MVEIRect const rect = mvei_tile_rect(tiling, headers, i);
+        std::vector<char> raw((std::size_t)rect.width
+            * rect.height * pixel_size);
+        mvei_copy_rect(image->get_byte_pointer(), image_rect,
+            raw.data(), rect, pixel_size);
+        if (!mvei_compress_tile(raw, compression, value_size, &payloads[i]))
+            payloads[i].swap(raw);
+    }
+
+    /* Offsets are relative to the signature, the last is the end of file. */
+    std::vector<uint64_t> offsets(num_tiles + 1);
+    offsets[0] = MVEI_FILE_SIGNATURE_LEN + 6 * sizeof(int32_t)
+        + offsets.size() * sizeof(uint64_t);
+    for (int i = 0; i < num_tiles; ++i)
+        offsets[i + 1] = offsets[i] + payloads[i].size();
+
+    int32_t const header_values[6] = { headers.width, headers.height,
+        headers.channels, headers.type, compression, tile_size };
+    out.write(MVEI_TILED_SIGNATURE, MVEI_FILE_SIGNATURE_LEN);
+    out.write(reinterpret_cast<char const*>(header_values),
+        sizeof(header_values));
+    out.write(reinterpret_cast<char const*>(offsets.data()),
+        offsets.size() * sizeof(uint64_t));
+    for (int i = 0; i < num_tiles; ++i)
+        out.write(payloads[i].data(), payloads[i].size());
+
+    if (!out.good())
+        throw util::Exception("Error writing image data");
 }
 
 MVE_IMAGE_NAMESPACE_END
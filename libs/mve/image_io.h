@@ -10,6 +10,8 @@
 #ifndef MVE_IMAGE_FILE_HEADER
 #define MVE_IMAGE_FILE_HEADER
 
+#include <istream>
+#include <ostream>
 #include <string>
 
 #include "mve/defines.h"
@@ -102,6 +104,10 @@ save_file (FloatImage::Ptr image, std::string const& filename);
 ByteImage::Ptr
 load_png_file (std::string const& filename);
 
+/** Loads a PNG file from a stream, see above. May throw util::Exception. */
+ByteImage::Ptr
+load_png_file (std::istream& in);
+
 /**
  * Loads PNG file headers only.
  * May throw util::FileException and util::Exception.
@@ -109,6 +115,10 @@ load_png_file (std::string const& filename);
 ImageHeaders
 load_png_file_headers (std::string const& filename);
 
+/** Loads PNG file headers from a stream. May throw util::Exception. */
+ImageHeaders
+load_png_file_headers (std::istream& in);
+
 /**
  * Saves image data to a PNG file. Supports 1, 2, 3 and 4 channel images.
  * Valid compression levels are in [0, 9], 0 is fastest.
@@ -118,6 +128,11 @@ void
 save_png_file (ByteImage::ConstPtr image,
     std::string const& filename, int compression_level = 1);
 
+/** Writes a PNG file to a stream, see above. */
+void
+save_png_file (ByteImage::ConstPtr image,
+    std::ostream& out, int compression_level = 1);
+
 #endif /* MVE_NO_PNG_SUPPORT */
 
 /* ------------------------- JPEG support ------------------------- */
@@ -132,6 +147,29 @@ save_png_file (ByteImage::ConstPtr image,
 ByteImage::Ptr
 load_jpg_file (std::string const& filename, std::string* exif = nullptr);
 
+/**
+ * Loads a JPEG file with at most 'max_pixels' pixels. Larger images are
+ * reduced while decoding using the DCT scaling of libjpeg by a factor of
+ * 2, 4 or 8, which is much faster and requires less memory than loading
+ * the full image and rescaling. The image size is the same as after
+ * repeated mve::image::rescale_half_size(), but the image is not reduced
+ * by more than a factor of 8 and may still exceed 'max_pixels'. The
+ * headers of the file, i.e. the original image size, may be returned in
+ * 'headers'. May throw util::FileException and util::Exception.
+ */
+ByteImage::Ptr
+load_jpg_file_scaled (std::string const& filename, int max_pixels,
+    std::string* exif = nullptr, ImageHeaders* headers = nullptr);
+
+/** Loads a JPEG file from a stream, see above. May throw util::Exception. */
+ByteImage::Ptr
+load_jpg_file (std::istream& in, std::string* exif = nullptr);
+
+/** Loads a reduced JPEG file from a stream, see above. */
+ByteImage::Ptr
+load_jpg_file_scaled (std::istream& in, int max_pixels,
+    std::string* exif = nullptr, ImageHeaders* headers = nullptr);
+
 /**
  * Loads JPEG file headers only.
  * May throw util::FileException and util::Exception.
@@ -139,6 +177,10 @@ load_jpg_file (std::string const& filename, std::string* exif = nullptr);
 ImageHeaders
 load_jpg_file_headers (std::string const& filename);
 
+/** Loads JPEG file headers from a stream. May throw util::Exception. */
+ImageHeaders
+load_jpg_file_headers (std::istream& in);
+
 /**
  * Saves image data to a JPEG file. Supports 1 and 3 channel images.
  * The quality value is in range [0, 100] from worst to best quality.
@@ -235,20 +277,51 @@ save_ppm_file (ByteImage::ConstPtr image, std::string const& filename);
 
 /* ------------------- Native MVE image support ------------------- */
 
+/** Compression of the tiles in the tiled native MVE image format. */
+enum MVEICompression
+{
+    /* Tiles are stored uncompressed. */
+    MVEI_COMPRESSION_NONE = 0,
+    /* Bytes of the values are shuffled, then compressed with zlib. */
+    MVEI_COMPRESSION_DEFLATE = 1
+};
+
 /**
  * Loads a native MVE image. Supports arbitrary type, size and depth,
- * with a primitive, uncompressed format.
+ * with a primitive, uncompressed format or the tiled format.
  * May throw util::FileException.
  */
 ImageBase::Ptr
 load_mvei_file (std::string const& filename);
 
+/**
+ * Loads a native MVE image from a stream, which is positioned at the file
+ * signature. May throw util::Exception.
+ */
+ImageBase::Ptr
+load_mvei_file (std::istream& in);
+
+/**
+ * Loads a rectangular region of a native MVE image. Only the tiles that
+ * overlap the region are read and decoded from the tiled format, and only
+ * the rows of the region from the uncompressed format. The region must be
+ * inside the image, otherwise std::invalid_argument is thrown.
+ * May throw util::FileException.
+ */
+ImageBase::Ptr
+load_mvei_file_region (std::string const& filename,
+    int x, int y, int width, int height);
+
 /**
  * Loads the meta information for a native MVE image.
  */
 ImageHeaders
 load_mvei_file_headers (std::string const& filename);
 
+/** Loads the meta information for a native MVE image from a stream. */
+ImageHeaders
+load_mvei_file_headers (std::istream& in);
+
 /**
  * Writes a native MVE image. Supports arbitrary type, size and depth,
  * with a primitive, uncompressed format.
@@ -257,6 +330,33 @@ load_mvei_file_headers (std::string const& filename);
 void
 save_mvei_file (ImageBase::ConstPtr image, std::string const& filename);
 
+/**
+ * Writes a native MVE image in the uncompressed format to a stream.
+ * May throw util::Exception.
+ */
+void
+save_mvei_file (ImageBase::ConstPtr image, std::ostream& out);
+
+/**
+ * Writes a native MVE image in the tiled format. The image is divided into
+ * square tiles, which are compressed independently and in parallel. For
+ * compression, the bytes of the values are first shuffled (all first
+ * bytes, all second bytes, and so on), which makes floating point data
+ * much more compressible. Tiles that do not compress are stored as is.
+ * May throw util::FileException.
+ */
+void
+save_mvei_file (ImageBase::ConstPtr image, std::string const& filename,
+    MVEICompression compression, int tile_size = 256);
+
+/**
+ * Writes a native MVE image in the tiled format to a stream, see above.
+ * May throw util::Exception.
+ */
+void
+save_mvei_file (ImageBase::ConstPtr image, std::ostream& out,
+    MVEICompression compression, int tile_size = 256);
+
 MVE_IMAGE_NAMESPACE_END
 MVE_NAMESPACE_END
 
@@ -8,10 +8,17 @@
  */
 
 #include <algorithm>
+#include <cmath>
 
 #include "mve/camera.h"
 #include "mve/image_tools.h"
 
+#define ENABLE_SSE2_IMAGE_CONVERSION 1
+
+#if ENABLE_SSE2_IMAGE_CONVERSION && defined(__SSE2__)
+#   include <emmintrin.h> // SSE2
+#endif
+
 MVE_NAMESPACE_BEGIN
 MVE_IMAGE_NAMESPACE_BEGIN
 
@@ -27,11 +34,34 @@ byte_to_float_image (ByteImage::ConstPtr image)
 
     FloatImage::Ptr img = FloatImage::create();
     img->allocate(image->width(), image->height(), image->channels());
-    for (int i = 0; i < image->get_value_amount(); ++i)
+
+    uint8_t const* src = image->get_data_pointer();
+    float* dst = img->get_data_pointer();
+    int const num_values = image->get_value_amount();
+    int i = 0;
+#if ENABLE_SSE2_IMAGE_CONVERSION && defined(__SSE2__)
+    /*
+     * Converts 16 values at a time. The division is exact and gives the
+     * same results as the scalar code, and clamping is not required.
+     */
+    __m128i const zero = _mm_setzero_si128();
+    __m128 const div = _mm_set1_ps(255.0f);
+    for (; i + 16 <= num_values; i += 16)
     {
-        float value = (float)image->at(i) / 255.0f;
-        img->at(i) = std::min(1.0f, std::max(0.0f, value));
+        __m128i bytes = _mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(bytes, zero);
+        __m128i hi = _mm_unpackhi_epi8(bytes, zero);
+        __m128i v[4] = { _mm_unpacklo_epi16(lo, zero),
+            _mm_unpackhi_epi16(lo, zero), _mm_unpacklo_epi16(hi, zero),
+            _mm_unpackhi_epi16(hi, zero) };
+        for (int j = 0; j < 4; ++j)
+            _mm_storeu_ps(dst + i + 4 * j,
+                _mm_div_ps(_mm_cvtepi32_ps(v[j]), div));
     }
+#endif
+    for (; i < num_values; ++i)
+        dst[i] = static_cast<float>(src[i]) / 255.0f;
     return img;
 }
 
@@ -63,11 +93,42 @@ float_to_byte_image (FloatImage::ConstPtr image, float vmin, float vmax)
 
     ByteImage::Ptr img = ByteImage::create();
     img->allocate(image->width(), image->height(), image->channels());
-    for (int i = 0; i < image->get_value_amount(); ++i)
+
+    float const* src = image->get_data_pointer();
+    uint8_t* dst = img->get_data_pointer();
+    int const num_values = image->get_value_amount();
+    int i = 0;
+#if ENABLE_SSE2_IMAGE_CONVERSION && defined(__SSE2__)
+    /*
+     * Converts 16 values at a time with the same operations as the scalar
+     * code. The maximum is computed first and maps NaN to vmin.
+     */
+    __m128 const min = _mm_set1_ps(vmin);
+    __m128 const max = _mm_set1_ps(vmax);
+    __m128 const scale = _mm_set1_ps(255.0f);
+    __m128 const range = _mm_set1_ps(vmax - vmin);
+    __m128 const half = _mm_set1_ps(0.5f);
+    for (; i + 16 <= num_values; i += 16)
+    {
+        __m128i v[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            __m128 value = _mm_loadu_ps(src + i + 4 * j);
+            value = _mm_min_ps(_mm_max_ps(value, min), max);
+            value = _mm_mul_ps(scale, _mm_sub_ps(value, min));
+            value = _mm_add_ps(_mm_div_ps(value, range), half);
+            v[j] = _mm_cvttps_epi32(value);
+        }
+        __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]),
+            _mm_packs_epi32(v[2], v[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), bytes);
+    }
+#endif
+    for (; i < num_values; ++i)
     {
-        float value = std::min(vmax, std::max(vmin, image->at(i)));
+        float value = std::min(vmax, std::max(vmin, src[i]));
         value = 255.0f * (value - vmin) / (vmax - vmin);
-        img->at(i) = static_cast<uint8_t>(value + 0.5f);
+        dst[i] = static_cast<uint8_t>(value + 0.5f);
     }
     return img;
 }
@@ -181,5 +242,45 @@ gamma_correct (ByteImage::Ptr image, float power)
         image->at(i) = lookup[image->at(i)];
 }
 
+/* ---------------------------------------------------------------- */
+
+void
+gamma_correct_srgb (ByteImage::Ptr image)
+{
+    if (image == nullptr)
+        throw std::invalid_argument("Null image given");
+
+    FloatImage::Ptr values = FloatImage::create(256, 1, 1);
+    for (int i = 0; i < 256; ++i)
+        values->at(i) = static_cast<float>(i) / 255.0f;
+    gamma_correct_srgb<float>(values);
+
+    uint8_t lookup[256];
+    for (int i = 0; i < 256; ++i)
+        lookup[i] = static_cast<uint8_t>(values->at(i) * 255.0f + 0.5f);
+    for (uint8_t* ptr = image->begin(); ptr != image->end(); ++ptr)
+        *ptr = lookup[*ptr];
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+gamma_correct_inv_srgb (ByteImage::Ptr image)
+{
+    if (image == nullptr)
+        throw std::invalid_argument("Null image given");
+
+    FloatImage::Ptr values = FloatImage::create(256, 1, 1);
+    for (int i = 0; i < 256; ++i)
+        values->at(i) = static_cast<float>(i) / 255.0f;
+    gamma_correct_inv_srgb<float>(values);
+
+    uint8_t lookup[256];
+    for (int i = 0; i < 256; ++i)
+        lookup[i] = static_cast<uint8_t>(values->at(i) * 255.0f + 0.5f);
+    for (uint8_t* ptr = image->begin(); ptr != image->end(); ++ptr)
+        *ptr = lookup[*ptr];
+}
+
 MVE_IMAGE_NAMESPACE_END
 MVE_NAMESPACE_END
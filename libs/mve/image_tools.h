@@ -12,7 +12,6 @@
 
 #include <iostream>
 #include <limits>
-#include <complex>
 #include <type_traits>
 
 #include "util/exception.h"
@@ -20,6 +19,7 @@
 #include "math/functions.h"
 #include "mve/defines.h"
 #include "mve/image.h"
+#include "mve/image_undistort.h"
 
 MVE_NAMESPACE_BEGIN
 MVE_IMAGE_NAMESPACE_BEGIN
@@ -111,6 +111,10 @@ float_image_normalize (FloatImage::Ptr image);
  * If both distortion parameters are equal, undistortion has no effect.
  * This distortion model is used by Microsoft's Photosynther and is
  * independent of the focal length.
+ *
+ * To undistort many images with the same size and intrinsics, use an
+ * UndistortMap (or an UndistortMapCache) instead, which computes the
+ * distortion model only once.
  */
 template <typename T>
 typename Image<T>::Ptr
@@ -422,13 +426,18 @@ gamma_correct (ByteImage::Ptr image, float power);
  *
  *   X' = 12.92 * X                   if X <= 0.0031308
  *   X' = 1.055 * X^(1/2.4) - 0.055   otherwise
- *
- * TODO: Implement overloading for integer image types.
  */
 template <typename T>
 void
 gamma_correct_srgb (typename Image<T>::Ptr image);
 
+/**
+ * Applies sRGB gamma correction to a byte image using a lookup table.
+ * Values in [0, 255] are treated as values in [0, 1], see above.
+ */
+void
+gamma_correct_srgb (ByteImage::Ptr image);
+
 /**
  * Applies inverse gamma correction to float/double (in-place) images with
  * nonlinear R'G'B' values in the range [0, 1] to linear sRGB values according
@@ -436,13 +445,18 @@ gamma_correct_srgb (typename Image<T>::Ptr image);
  *
  *   X = X' / 12.92                     if X' <= 0.04045
  *   X = ((X' + 0.055) / (1.055))^2.4   otherwise
- *
- * TODO: Implement overloading for integer image types.
  */
 template <typename T>
 void
 gamma_correct_inv_srgb (typename Image<T>::Ptr image);
 
+/**
+ * Applies inverse sRGB gamma correction to a byte image using a lookup
+ * table. Values in [0, 255] are treated as values in [0, 1], see above.
+ */
+void
+gamma_correct_inv_srgb (ByteImage::Ptr image);
+
 /**
  * Calculates the integral image (or summed area table) for the input image.
  * The integral image is computed channel-wise, i.e. the output image has
@@ -1302,16 +1316,16 @@ template <typename T>
 inline T
 desaturate_maximum (T const* v)
 {
-    return *std::max_element(v, v + 3);
+    return std::max(v[0], std::max(v[1], v[2]));
 }
 
 template <typename T>
 inline T
 desaturate_lightness (T const* v)
 {
-    T const* max = std::max_element(v, v + 3);
-    T const* min = std::min_element(v, v + 3);
-    return math::interpolate(*max, *min, 0.5f, 0.5f);
+    T const max = std::max(v[0], std::max(v[1], v[2]));
+    T const min = std::min(v[0], std::min(v[1], v[2]));
+    return math::interpolate(max, min, 0.5f, 0.5f);
 }
 
 template <typename T>
@@ -1336,6 +1350,30 @@ desaturate_average (T const* v)
     return math::interpolate(v[0], v[1], v[2], third, third, third);
 }
 
+/*
+ * Desaturates all pixels with the given function. The function is a
+ * template parameter and the alpha channel a separate loop, such that
+ * the function is inlined and the loop can be vectorized.
+ */
+template <typename T, T (*FUNC)(T const*)>
+void
+desaturate_pixels (T const* in, T* out, int pixels, bool has_alpha)
+{
+    if (has_alpha)
+    {
+        for (int i = 0; i < pixels; ++i, in += 4, out += 2)
+        {
+            out[0] = FUNC(in);
+            out[1] = in[3];
+        }
+    }
+    else
+    {
+        for (int i = 0; i < pixels; ++i, in += 3)
+            out[i] = FUNC(in);
+    }
+}
+
 /* ---------------------------------------------------------------- */
 
 template <typename T>
@@ -1354,31 +1392,33 @@ desaturate (typename Image<T>::ConstPtr img, DesaturateType type)
     typename Image<T>::Ptr out(Image<T>::create());
     out->allocate(img->width(), img->height(), 1 + has_alpha);
 
-    typedef T(*DesaturateFunc)(T const*);
-    DesaturateFunc func;
-    switch (type)
-    {
-        case DESATURATE_MAXIMUM: func = desaturate_maximum<T>; break;
-        case DESATURATE_LIGHTNESS: func = desaturate_lightness<T>; break;
-        case DESATURATE_LUMINOSITY: func = desaturate_luminosity<T>; break;
-        case DESATURATE_LUMINANCE: func = desaturate_luminance<T>; break;
-        case DESATURATE_AVERAGE: func = desaturate_average<T>; break;
-        default: throw std::invalid_argument("Invalid desaturate type");
-    }
-
-    int outpos = 0;
-    int inpos = 0;
+    T const* in_ptr = img->get_data_pointer();
+    T* out_ptr = out->get_data_pointer();
     int pixels = img->get_pixel_amount();
-    for (int i = 0; i < pixels; ++i)
+    switch (type)
     {
-        T const* v = &img->at(inpos);
-        out->at(outpos) = func(v);
-
-        if (has_alpha)
-            out->at(outpos + 1) = img->at(inpos + 3);
-
-        outpos += 1 + has_alpha;
-        inpos += 3 + has_alpha;
+        case DESATURATE_MAXIMUM:
+            desaturate_pixels<T, desaturate_maximum<T> >
+                (in_ptr, out_ptr, pixels, has_alpha);
+            break;
+        case DESATURATE_LIGHTNESS:
+            desaturate_pixels<T, desaturate_lightness<T> >
+                (in_ptr, out_ptr, pixels, has_alpha);
+            break;
+        case DESATURATE_LUMINOSITY:
+            desaturate_pixels<T, desaturate_luminosity<T> >
+                (in_ptr, out_ptr, pixels, has_alpha);
+            break;
+        case DESATURATE_LUMINANCE:
+            desaturate_pixels<T, desaturate_luminance<T> >
+                (in_ptr, out_ptr, pixels, has_alpha);
+            break;
+        case DESATURATE_AVERAGE:
+            desaturate_pixels<T, desaturate_average<T> >
+                (in_ptr, out_ptr, pixels, has_alpha);
+            break;
+        default:
+            throw std::invalid_argument("Invalid desaturate type");
     }
 
     return out;
@@ -1402,14 +1442,21 @@ expand_grayscale (typename Image<T>::ConstPtr image)
     typename Image<T>::Ptr out(Image<T>::create());
     out->allocate(image->width(), image->height(), 3 + has_alpha);
 
-    int pixels = image->get_pixel_amount();
-    for (int i = 0; i < pixels; ++i)
+    T const* in = image->get_data_pointer();
+    T* dst = out->get_data_pointer();
+    int const pixels = image->get_pixel_amount();
+    if (has_alpha)
+    {
+        for (int i = 0; i < pixels; ++i, in += 2, dst += 4)
+        {
+            dst[0] = dst[1] = dst[2] = in[0];
+            dst[3] = in[1];
+        }
+    }
+    else
     {
-        out->at(i, 0) = image->at(i, 0);
-        out->at(i, 1) = image->at(i, 0);
-        out->at(i, 2) = image->at(i, 0);
-        if (has_alpha)
-            out->at(i, 3) = image->at(i, 1);
+        for (int i = 0; i < pixels; ++i, dst += 3)
+            dst[0] = dst[1] = dst[2] = in[i];
     }
 
     return out;
@@ -1600,28 +1647,70 @@ integral_image (typename Image<T_IN>::ConstPtr image)
 
     typename Image<T_OUT>::Ptr ret(Image<T_OUT>::create());
     ret->allocate(width, height, chans);
-
-    /* Input image row and destination image rows. */
-    std::vector<T_OUT> zeros(row_stride, T_OUT(0));
-    T_IN const* inrow = image->get_data_pointer();
-    T_OUT* dest = ret->get_data_pointer();
-    T_OUT* prev = &zeros[0];
+    if (row_stride == 0)
+        return ret;
 
     /*
      * I(x,y) = i(x,y) + I(x-1,y) + I(x,y-1) - I(x-1,y-1)
+     *
+     * This is computed as I(x,y) = I(x,y-1) + sum of i(0..x,y), row by row.
+     * For parallelization, the image is divided into blocks of columns,
+     * which are processed independently. To this end, the sums of the
+     * rows left of every block are computed first.
      */
+    int const block_size = 256 * chans;
+    int const num_blocks = (row_stride + block_size - 1) / block_size;
+    T_IN const* in = image->get_data_pointer();
+    T_OUT* out = ret->get_data_pointer();
+    std::vector<T_OUT> row_sums(height * num_blocks * chans, T_OUT(0));
+#pragma omp parallel for schedule(static)
     for (int y = 0; y < height; ++y)
     {
-        /* Calculate first pixel in row. */
-        for (int cc = 0; cc < chans; ++cc)
-            dest[cc] = static_cast<T_OUT>(inrow[cc]) + prev[cc];
-        /* Calculate all following pixels in row. */
-        for (int i = chans; i < row_stride; ++i)
-            dest[i] = inrow[i] + prev[i] + dest[i - chans] - prev[i - chans];
-
-        prev = dest;
-        dest += row_stride;
-        inrow += row_stride;
+        T_IN const* inrow = in + y * row_stride;
+        T_OUT* sums = &row_sums[y * num_blocks * chans];
+        for (int b = 1; b < num_blocks; ++b)
+            for (int cc = 0; cc < chans; ++cc)
+            {
+                T_OUT sum = sums[(b - 1) * chans + cc];
+                for (int i = (b - 1) * block_size + cc;
+                    i < b * block_size; i += chans)
+                    sum += static_cast<T_OUT>(inrow[i]);
+                sums[b * chans + cc] = sum;
+            }
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int b = 0; b < num_blocks; ++b)
+    {
+        int const begin = b * block_size;
+        int const end = std::min(begin + block_size, row_stride);
+        for (int y = 0; y < height; ++y)
+        {
+            T_IN const* inrow = in + y * row_stride;
+            T_OUT* dest = out + y * row_stride;
+            T_OUT const* sums = &row_sums[(y * num_blocks + b) * chans];
+            for (int cc = 0; cc < chans; ++cc)
+            {
+                T_OUT sum = sums[cc];
+                if (y == 0)
+                {
+                    for (int i = begin + cc; i < end; i += chans)
+                    {
+                        sum += static_cast<T_OUT>(inrow[i]);
+                        dest[i] = sum;
+                    }
+                }
+                else
+                {
+                    T_OUT const* prev = dest - row_stride;
+                    for (int i = begin + cc; i < end; i += chans)
+                    {
+                        sum += static_cast<T_OUT>(inrow[i]);
+                        dest[i] = prev[i] + sum;
+                    }
+                }
+            }
+        }
     }
 
     return ret;
@@ -1689,35 +1778,11 @@ template <typename T>
 typename Image<T>::Ptr
 image_undistort_msps (typename Image<T>::ConstPtr img, double k0, double k1)
 {
-    int const width = img->width();
-    int const height = img->height();
-    int const chans = img->channels();
-    int const D = std::max(width, height);
-
-    double const width_half = static_cast<double>(width) / 2.0;
-    double const height_half = static_cast<double>(height) / 2.0;
-
-    typename Image<T>::Ptr out = Image<T>::create(width, height, chans);
-    out->fill(T(0));
-    T* out_ptr = out->get_data_pointer();
-
-    for (int y = 0; y < height; y++)
-        for (int x = 0; x < width; x++, out_ptr += chans)
-        {
-            double fx = static_cast<double>(x) - width_half;
-            double fy = static_cast<double>(y) - height_half;
-            double const s1 = D * D + k1 * (fx * fx + fy * fy);
-            double const s2 = D * D + k0 * (fx * fx + fy * fy);
-            double const factor = s1 / s2;
-            fx = fx * factor + width_half;
-            fy = fy * factor + height_half;
-
-            if (fx < -0.5 || fx > width - 0.5 || fy < -0.5 || fy > height - 0.5)
-                continue;
-            img->linear_at(fx, fy, out_ptr);
-        }
+    if (img == nullptr)
+        throw std::invalid_argument("Null image given");
 
-    return out;
+    UndistortModelMsps const model(img->width(), img->height(), k0, k1);
+    return image_undistort_model<T>(img, model);
 }
 
 /* ---------------------------------------------------------------- */
@@ -1733,33 +1798,9 @@ image_undistort_k2k4 (typename Image<T>::ConstPtr img,
     if (k2 == 0.0 && k4 == 0.0)
         return img->duplicate();
 
-    int const width = img->width();
-    int const height = img->height();
-    int const chans = img->channels();
-    typename Image<T>::Ptr out = Image<T>::create(width, height, chans);
-    out->fill(T(0));
-    T* out_ptr = out->get_data_pointer();
-
-    double const fwidth2 = static_cast<double>(width) / 2.0;
-    double const fheight2 = static_cast<double>(height) / 2.0;
-    double const fnorm = static_cast<double>(std::max(width, height));
-    for (int y = 0; y < height; ++y)
-        for (int x = 0; x < width; ++x, out_ptr += chans)
-        {
-            double const fx = (static_cast<double>(x) + 0.5 - fwidth2) / fnorm;
-            double const fy = (static_cast<double>(y) + 0.5 - fheight2) / fnorm;
-            double const rd = (fx * fx + fy * fy) / MATH_POW2(focal_length);
-            double const rd_factor = 1.0 + k2 * rd + k4 * rd * rd;
-            double const dist_x = fx * rd_factor;
-            double const dist_y = fy * rd_factor;
-            float const ix = dist_x * fnorm + fwidth2 - 0.5;
-            float const iy = dist_y * fnorm + fheight2 - 0.5;
-            if (ix < -0.5 || ix > width - 0.5 || iy < -0.5 || iy > height - 0.5)
-                continue;
-            img->linear_at(ix, iy, out_ptr);
-        }
-
-    return out;
+    UndistortModelK2K4 const model(img->width(), img->height(),
+        focal_length, k2, k4);
+    return image_undistort_model<T>(img, model);
 }
 
 /* ---------------------------------------------------------------- */
@@ -1775,76 +1816,9 @@ image_undistort_vsfm (typename Image<T>::ConstPtr img,
     if (k1 == 0.0)
         return img->duplicate();
 
-    int const width = img->width();
-    int const height = img->height();
-    int const chans = img->channels();
-
-    /*
-     * The image coordinates must be normalized before the distortion
-     * model is applied. The image coordinates are first centered at
-     * the origin and then scaled w.r.t. the focal length in pixel.
-     */
-    double const norm = focal_length * std::max(width, height);
-    double const width_half = static_cast<double>(width) / 2.0;
-    double const height_half = static_cast<double>(height) / 2.0;
-
-    typename Image<T>::Ptr out = Image<T>::create(width, height, chans);
-    out->fill(T(0));
-    T* out_ptr = out->begin();
-
-    for (int y = 0; y < height; ++y)
-    {
-        for (int x = 0; x < width; ++x, out_ptr += chans)
-        {
-            double fx = (static_cast<double>(x) - width_half) / norm;
-            double fy = (static_cast<double>(y) - height_half) / norm;
-            if (fy == 0.0)
-                fy = 1e-10;
-
-            double const t2 = fy * fy;
-            double const t3 = t2 * t2 * t2;
-            double const t4 = fx * fx;
-            double const t7 = k1 * (t2 + t4);
-
-            if (k1 > 0.0)
-            {
-                double const t8 = 1.0 / t7;
-                double const t10 = t3 / (t7 * t7);
-                double const t14 = std::sqrt(t10 * (0.25 + t8 / 27.0));
-                double const t15 = t2 * t8 * fy * 0.5;
-                double const t17 = std::pow(t14 + t15, 1.0/3.0);
-                double const t18 = t17 - t2 * t8 / (t17 * 3.0);
-                fx = t18 * fx / fy;
-                fy = t18;
-            }
-            else
-            {
-                double const t9 = t3 / (t7 * t7 * 4.0);
-                double const t11 = t3 / (t7 * t7 * t7 * 27.0);
-                std::complex<double> const t12 = t9 + t11;
-                std::complex<double> const t13 = std::sqrt(t12);
-                double const t14 = t2 / t7;
-                double const t15 = t14 * fy * 0.5;
-                std::complex<double> const t16 = t13 + t15;
-                std::complex<double> const t17 = std::pow(t16, 1.0/3.0);
-                std::complex<double> const t18 = (t17 + t14 / (t17 * 3.0))
-                    * std::complex<double>(0.0, std::sqrt(3.0));
-                std::complex<double> const t19 = -0.5 * (t17 + t18)
-                    + t14 / (t17 * 6.0);
-                fx = t19.real() * fx / fy;
-                fy = t19.real();
-            }
-
-            fx = fx * norm + width_half;
-            fy = fy * norm + height_half;
-
-            if (fx < -0.5 || fx > width - 0.5 || fy < -0.5 || fy > height - 0.5)
-                continue;
-            img->linear_at(fx, fy, out_ptr);
-        }
-    }
-
-    return out;
+    UndistortModelVsfm const model(img->width(), img->height(),
+        focal_length, k1);
+    return image_undistort_model<T>(img, model);
 }
 
 MVE_IMAGE_NAMESPACE_END
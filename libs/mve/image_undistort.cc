@@ -0,0 +1,353 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+#include "math/functions.h"
+#include "mve/image_undistort.h"
+
+MVE_NAMESPACE_BEGIN
+MVE_IMAGE_NAMESPACE_BEGIN
+
+UndistortModelMsps::UndistortModelMsps (int width, int height,
+    double k0, double k1)
+    : k0(k0)
+    , k1(k1)
+    , dim2(MATH_POW2(static_cast<double>(std::max(width, height))))
+    , width_half(static_cast<double>(width) / 2.0)
+    , height_half(static_cast<double>(height) / 2.0)
+{
+}
+
+bool
+UndistortModelMsps::is_identity (void) const
+{
+    return this->k0 == this->k1;
+}
+
+void
+UndistortModelMsps::map (int x, int y, double* fx, double* fy) const
+{
+    double const cx = static_cast<double>(x) - this->width_half;
+    double const cy = static_cast<double>(y) - this->height_half;
+    double const r2 = cx * cx + cy * cy;
+    double const factor = (this->dim2 + this->k1 * r2)
+        / (this->dim2 + this->k0 * r2);
+    *fx = cx * factor + this->width_half;
+    *fy = cy * factor + this->height_half;
+}
+
+/* ---------------------------------------------------------------- */
+
+UndistortModelK2K4::UndistortModelK2K4 (int width, int height,
+    double focal_length, double k2, double k4)
+    : flen2(MATH_POW2(focal_length))
+    , k2(k2)
+    , k4(k4)
+    , fnorm(static_cast<double>(std::max(width, height)))
+    , width_half(static_cast<double>(width) / 2.0)
+    , height_half(static_cast<double>(height) / 2.0)
+{
+}
+
+bool
+UndistortModelK2K4::is_identity (void) const
+{
+    return this->k2 == 0.0 && this->k4 == 0.0;
+}
+
+void
+UndistortModelK2K4::map (int x, int y, double* fx, double* fy) const
+{
+    double const cx = (static_cast<double>(x) + 0.5 - this->width_half)
+        / this->fnorm;
+    double const cy = (static_cast<double>(y) + 0.5 - this->height_half)
+        / this->fnorm;
+    double const rd = (cx * cx + cy * cy) / this->flen2;
+    double const rd_factor = 1.0 + this->k2 * rd + this->k4 * rd * rd;
+    *fx = cx * rd_factor * this->fnorm + this->width_half - 0.5;
+    *fy = cy * rd_factor * this->fnorm + this->height_half - 0.5;
+}
+
+/* ---------------------------------------------------------------- */
+
+UndistortModelVsfm::UndistortModelVsfm (int width, int height,
+    double focal_length, double k1)
+    : k1(k1)
+    , norm(focal_length * std::max(width, height))
+    , width_half(static_cast<double>(width) / 2.0)
+    , height_half(static_cast<double>(height) / 2.0)
+{
+}
+
+bool
+UndistortModelVsfm::is_identity (void) const
+{
+    return this->k1 == 0.0;
+}
+
+void
+UndistortModelVsfm::map (int x, int y, double* fx, double* fy) const
+{
+    /*
+     * The image coordinates must be normalized before the distortion
+     * model is applied. The image coordinates are first centered at
+     * the origin and then scaled w.r.t. the focal length in pixel.
+     */
+    double cx = (static_cast<double>(x) - this->width_half) / this->norm;
+    double cy = (static_cast<double>(y) - this->height_half) / this->norm;
+    if (cy == 0.0)
+        cy = 1e-10;
+
+    double const t2 = cy * cy;
+    double const t3 = t2 * t2 * t2;
+    double const t4 = cx * cx;
+    double const t7 = this->k1 * (t2 + t4);
+
+    if (this->k1 > 0.0)
+    {
+        double const t8 = 1.0 / t7;
+        double const t10 = t3 / (t7 * t7);
+        double const t14 = std::sqrt(t10 * (0.25 + t8 / 27.0));
+        double const t15 = t2 * t8 * cy * 0.5;
+        double const t17 = std::pow(t14 + t15, 1.0/3.0);
+        double const t18 = t17 - t2 * t8 / (t17 * 3.0);
+        cx = t18 * cx / cy;
+        cy = t18;
+    }
+    else
+    {
+        double const t9 = t3 / (t7 * t7 * 4.0);
+        double const t11 = t3 / (t7 * t7 * t7 * 27.0);
+        std::complex<double> const t12 = t9 + t11;
+        std::complex<double> const t13 = std::sqrt(t12);
+        double const t14 = t2 / t7;
+        double const t15 = t14 * cy * 0.5;
+        std::complex<double> const t16 = t13 + t15;
+        std::complex<double> const t17 = std::pow(t16, 1.0/3.0);
+        std::complex<double> const t18 = (t17 + t14 / (t17 * 3.0))
+            * std::complex<double>(0.0, std::sqrt(3.0));
+        std::complex<double> const t19 = -0.5 * (t17 + t18)
+            + t14 / (t17 * 6.0);
+        cx = t19.real() * cx / cy;
+        cy = t19.real();
+    }
+
+    *fx = cx * this->norm + this->width_half;
+    *fy = cy * this->norm + this->height_half;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+UndistortMap::set_entry (int x, int y, double fx, double fy)
+{
+    Entry& entry = this->entries[y * this->w + x];
+    if (fx < -0.5 || fx > this->w - 0.5 || fy < -0.5 || fy > this->h - 0.5)
+    {
+        entry.index = INVALID_INDEX;
+        entry.wx = 0;
+        entry.wy = 0;
+        return;
+    }
+
+    /* Same clamping as Image::linear_at(). */
+    float const px = std::max(0.0f, std::min(static_cast<float>(this->w - 1),
+        static_cast<float>(fx)));
+    float const py = std::max(0.0f, std::min(static_cast<float>(this->h - 1),
+        static_cast<float>(fy)));
+    int ix = static_cast<int>(px);
+    int iy = static_cast<int>(py);
+    float wx = px - static_cast<float>(ix);
+    float wy = py - static_cast<float>(iy);
+
+    /* Move samples on the last row or column inwards so that the right
+     * and bottom neighbors are always valid. */
+    if (ix == this->w - 1 && this->w > 1)
+    {
+        ix -= 1;
+        wx = 1.0f;
+    }
+    if (iy == this->h - 1 && this->h > 1)
+    {
+        iy -= 1;
+        wy = 1.0f;
+    }
+
+    float const one = static_cast<float>(1u << WEIGHT_BITS);
+    entry.index = static_cast<uint32_t>(iy * this->w + ix);
+    entry.wx = static_cast<uint16_t>(wx * one + 0.5f);
+    entry.wy = static_cast<uint16_t>(wy * one + 0.5f);
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+UndistortMap::set_identity (void)
+{
+    for (int y = 0; y < this->h; ++y)
+        for (int x = 0; x < this->w; ++x)
+            this->set_entry(x, y, x, y);
+}
+
+/* ---------------------------------------------------------------- */
+
+UndistortMap::Ptr
+UndistortMap::create_msps (int width, int height, double k0, double k1)
+{
+    return create(width, height, UndistortModelMsps(width, height, k0, k1));
+}
+
+UndistortMap::Ptr
+UndistortMap::create_k2k4 (int width, int height,
+    double focal_length, double k2, double k4)
+{
+    return create(width, height,
+        UndistortModelK2K4(width, height, focal_length, k2, k4));
+}
+
+UndistortMap::Ptr
+UndistortMap::create_vsfm (int width, int height,
+    double focal_length, double k1)
+{
+    return create(width, height,
+        UndistortModelVsfm(width, height, focal_length, k1));
+}
+
+/* ---------------------------------------------------------------- */
+
+namespace
+{
+    enum UndistortModel
+    {
+        UNDISTORT_MSPS,
+        UNDISTORT_K2K4,
+        UNDISTORT_VSFM
+    };
+}
+
+bool
+UndistortMapCache::Key::operator== (Key const& other) const
+{
+    return this->model == other.model
+        && this->width == other.width
+        && this->height == other.height
+        && std::equal(this->params, this->params + 3, other.params);
+}
+
+UndistortMapCache::UndistortMapCache (std::size_t max_bytes)
+    : max_bytes(max_bytes)
+    , num_bytes(0)
+{
+}
+
+UndistortMap::ConstPtr
+UndistortMapCache::get (Key const& key,
+    std::function<UndistortMap::Ptr (void)> const& create)
+{
+    std::promise<UndistortMap::ConstPtr> promise;
+    MapFuture future;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto iter = this->entries.begin();
+            iter != this->entries.end(); ++iter)
+        {
+            if (!(iter->key == key))
+                continue;
+            /* Move the entry to the front to mark it as recently used. */
+            this->entries.splice(this->entries.begin(), this->entries, iter);
+            future = iter->map;
+            break;
+        }
+
+        if (!future.valid())
+        {
+            /* Release least recently used tables until the new one fits. */
+            std::size_t const bytes
+                = UndistortMap::get_byte_size(key.width, key.height);
+            CacheEntry entry = { key, promise.get_future(), bytes };
+            this->entries.push_front(entry);
+            this->num_bytes += bytes;
+            while (this->num_bytes > this->max_bytes
+                && this->entries.size() > 1)
+            {
+                this->num_bytes -= this->entries.back().bytes;
+                this->entries.pop_back();
+            }
+        }
+    }
+
+    /* Wait for the table if it is already built or being built. */
+    if (future.valid())
+        return future.get();
+
+    /* Build the table without holding the lock. */
+    try
+    {
+        UndistortMap::ConstPtr map = create();
+        promise.set_value(map);
+        return map;
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(this->mutex);
+        for (auto iter = this->entries.begin();
+            iter != this->entries.end(); ++iter)
+            if (iter->key == key)
+            {
+                this->num_bytes -= iter->bytes;
+                this->entries.erase(iter);
+                break;
+            }
+        throw;
+    }
+}
+
+UndistortMap::ConstPtr
+UndistortMapCache::get_msps (int width, int height, double k0, double k1)
+{
+    Key const key = { UNDISTORT_MSPS, width, height, { k0, k1, 0.0 } };
+    return this->get(key, [=] (void)
+        { return UndistortMap::create_msps(width, height, k0, k1); });
+}
+
+UndistortMap::ConstPtr
+UndistortMapCache::get_k2k4 (int width, int height,
+    double focal_length, double k2, double k4)
+{
+    Key const key = { UNDISTORT_K2K4, width, height,
+        { focal_length, k2, k4 } };
+    return this->get(key, [=] (void)
+        { return UndistortMap::create_k2k4(width, height,
+            focal_length, k2, k4); });
+}
+
+UndistortMap::ConstPtr
+UndistortMapCache::get_vsfm (int width, int height,
+    double focal_length, double k1)
+{
+    Key const key = { UNDISTORT_VSFM, width, height,
+        { focal_length, k1, 0.0 } };
+    return this->get(key, [=] (void)
+        { return UndistortMap::create_vsfm(width, height, focal_length, k1); });
+}
+
+void
+UndistortMapCache::clear (void)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->entries.clear();
+    this->num_bytes = 0;
+}
+
+MVE_IMAGE_NAMESPACE_END
+MVE_NAMESPACE_END
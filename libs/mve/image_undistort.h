@@ -0,0 +1,384 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_IMAGE_UNDISTORT_HEADER
+#define MVE_IMAGE_UNDISTORT_HEADER
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "math/functions.h"
+#include "mve/defines.h"
+#include "mve/image.h"
+
+MVE_NAMESPACE_BEGIN
+MVE_IMAGE_NAMESPACE_BEGIN
+
+/**
+ * Distortion models, which map a pixel of the undistorted image to the
+ * position in the distorted input image. See image_tools.h for a
+ * description of the models.
+ */
+struct UndistortModelMsps
+{
+    UndistortModelMsps (int width, int height, double k0, double k1);
+    bool is_identity (void) const;
+    void map (int x, int y, double* fx, double* fy) const;
+
+    double k0, k1;
+    double dim2, width_half, height_half;
+};
+
+struct UndistortModelK2K4
+{
+    UndistortModelK2K4 (int width, int height,
+        double focal_length, double k2, double k4);
+    bool is_identity (void) const;
+    void map (int x, int y, double* fx, double* fy) const;
+
+    double flen2, k2, k4;
+    double fnorm, width_half, height_half;
+};
+
+struct UndistortModelVsfm
+{
+    UndistortModelVsfm (int width, int height,
+        double focal_length, double k1);
+    bool is_identity (void) const;
+    void map (int x, int y, double* fx, double* fy) const;
+
+    double k1;
+    double norm, width_half, height_half;
+};
+
+/**
+ * Undistorts the image by evaluating the model for every pixel. Pixels
+ * that map outside of the input image are set to zero. This is faster
+ * than building an UndistortMap for a single image.
+ */
+template <typename T, typename MODEL>
+typename Image<T>::Ptr
+image_undistort_model (typename Image<T>::ConstPtr img, MODEL const& model);
+
+/* ---------------------------------------------------------------- */
+
+/**
+ * Precomputed remap table for undistorting images of a fixed size.
+ * Computing the distortion model for every pixel is expensive, in
+ * particular for the VisualSfM model. The table stores, for every pixel
+ * of the undistorted image, the source pixel and 15-bit fixed point
+ * bilinear weights (8 bytes per pixel). Applying the table to an image
+ * is a cheap pass over the pixels. Building the table costs more than
+ * undistorting a single image directly, so a table only pays off if it
+ * is shared by several images with identical size and intrinsics.
+ */
+class UndistortMap
+{
+public:
+    typedef std::shared_ptr<UndistortMap> Ptr;
+    typedef std::shared_ptr<UndistortMap const> ConstPtr;
+
+public:
+    /** Table for the given model. */
+    template <typename MODEL>
+    static Ptr create (int width, int height, MODEL const& model);
+
+    /** Table for Microsoft's Photosynther model, see image_tools.h. */
+    static Ptr create_msps (int width, int height, double k0, double k1);
+    /**
+     * Table for the MVE and Noah's bundler model, see image_tools.h.
+     * Without distortion (k2 = k4 = 0), the table leaves images as is.
+     */
+    static Ptr create_k2k4 (int width, int height,
+        double focal_length, double k2, double k4);
+    /**
+     * Table for the VisualSfM model, see image_tools.h.
+     * Without distortion (k1 = 0), the table leaves images as is.
+     */
+    static Ptr create_vsfm (int width, int height,
+        double focal_length, double k1);
+
+    int width (void) const;
+    int height (void) const;
+    /** Returns the memory consumption of the table in bytes. */
+    std::size_t get_byte_size (void) const;
+    /** Returns the memory consumption of a table of the given size. */
+    static std::size_t get_byte_size (int width, int height);
+
+    /**
+     * Returns the undistorted image. Pixels that map outside of the
+     * input image are set to zero. The input image must match the size
+     * of the table.
+     */
+    template <typename T>
+    typename Image<T>::Ptr apply (typename Image<T>::ConstPtr img) const;
+
+private:
+    /* Source pixel of the top left neighbor and weights of the right
+     * and bottom neighbors. The index is INVALID_INDEX for pixels that
+     * map outside of the image. */
+    struct Entry
+    {
+        uint32_t index;
+        uint16_t wx;
+        uint16_t wy;
+    };
+
+    static uint32_t const INVALID_INDEX = 0xffffffffu;
+    /* Weights are stored with 15 bits, byte images use 12 bits. */
+    static int const WEIGHT_BITS = 15;
+    static int const BYTE_WEIGHT_BITS = 12;
+
+private:
+    UndistortMap (int width, int height);
+    void set_entry (int x, int y, double fx, double fy);
+    void set_identity (void);
+
+    template <typename T>
+    static T blend (T const* row1, T const* row2, int step,
+        uint32_t wx, uint32_t wy);
+
+private:
+    int w;
+    int h;
+    std::vector<Entry> entries;
+};
+
+/* ---------------------------------------------------------------- */
+
+/**
+ * Thread-safe cache of undistortion tables keyed by image size, model
+ * and distortion parameters. Tables are kept as long as they fit into
+ * 'max_bytes', the least recently used table is released first. The
+ * most recent table is always kept. Different tables are built
+ * concurrently, concurrent requests for the same table wait for a
+ * single construction.
+ *
+ * Use the cache only for images that share their intrinsics, e.g.
+ * images of the same camera with fixed intrinsics. Otherwise every
+ * image builds its own table, which is slower than undistorting the
+ * images directly with the image_undistort_* functions.
+ */
+class UndistortMapCache
+{
+public:
+    UndistortMapCache (std::size_t max_bytes = 256 * 1024 * 1024);
+
+    UndistortMap::ConstPtr get_msps (int width, int height,
+        double k0, double k1);
+    UndistortMap::ConstPtr get_k2k4 (int width, int height,
+        double focal_length, double k2, double k4);
+    UndistortMap::ConstPtr get_vsfm (int width, int height,
+        double focal_length, double k1);
+
+    void clear (void);
+
+private:
+    struct Key
+    {
+        int model;
+        int width;
+        int height;
+        double params[3];
+        bool operator== (Key const& other) const;
+    };
+    typedef std::shared_future<UndistortMap::ConstPtr> MapFuture;
+    struct CacheEntry
+    {
+        Key key;
+        MapFuture map;
+        std::size_t bytes;
+    };
+
+private:
+    UndistortMap::ConstPtr get (Key const& key,
+        std::function<UndistortMap::Ptr (void)> const& create);
+
+private:
+    std::size_t max_bytes;
+    std::size_t num_bytes;
+    std::list<CacheEntry> entries;
+    std::mutex mutex;
+};
+
+/* ------------------------- Implementation ----------------------- */
+
+inline
+UndistortMap::UndistortMap (int width, int height)
+    : w(width)
+    , h(height)
+{
+    if (width <= 0 || height <= 0)
+        throw std::invalid_argument("Invalid image dimensions");
+    this->entries.resize(static_cast<std::size_t>(width) * height);
+}
+
+inline int
+UndistortMap::width (void) const
+{
+    return this->w;
+}
+
+inline int
+UndistortMap::height (void) const
+{
+    return this->h;
+}
+
+inline std::size_t
+UndistortMap::get_byte_size (void) const
+{
+    return this->entries.capacity() * sizeof(Entry);
+}
+
+inline std::size_t
+UndistortMap::get_byte_size (int width, int height)
+{
+    return static_cast<std::size_t>(width) * height * sizeof(Entry);
+}
+
+template <typename MODEL>
+typename UndistortMap::Ptr
+UndistortMap::create (int width, int height, MODEL const& model)
+{
+    Ptr map(new UndistortMap(width, height));
+    if (model.is_identity())
+    {
+        map->set_identity();
+        return map;
+    }
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            double fx, fy;
+            model.map(x, y, &fx, &fy);
+            map->set_entry(x, y, fx, fy);
+        }
+
+    return map;
+}
+
+template <typename T>
+inline T
+UndistortMap::blend (T const* row1, T const* row2, int step,
+    uint32_t wx, uint32_t wy)
+{
+    /* Same weights as Image::linear_at(). */
+    float const w1 = static_cast<float>(wx) / (1u << WEIGHT_BITS);
+    float const w0 = 1.0f - w1;
+    float const w3 = static_cast<float>(wy) / (1u << WEIGHT_BITS);
+    float const w2 = 1.0f - w3;
+    return math::interpolate<T>(row1[0], row1[step], row2[0], row2[step],
+        w0 * w2, w1 * w2, w0 * w3, w1 * w3);
+}
+
+template <>
+inline uint8_t
+UndistortMap::blend<uint8_t> (uint8_t const* row1, uint8_t const* row2,
+    int step, uint32_t weight_x, uint32_t weight_y)
+{
+    /* The weights sum to 2^24, which keeps the result within 32 bits. */
+    int const shift = WEIGHT_BITS - BYTE_WEIGHT_BITS;
+    uint32_t const one = 1u << BYTE_WEIGHT_BITS;
+    uint32_t const wx = (weight_x + (1u << (shift - 1))) >> shift;
+    uint32_t const wy = (weight_y + (1u << (shift - 1))) >> shift;
+    uint32_t const top = row1[0] * (one - wx) + row1[step] * wx;
+    uint32_t const bottom = row2[0] * (one - wx) + row2[step] * wx;
+    uint32_t const value = top * (one - wy) + bottom * wy;
+    return static_cast<uint8_t>((value + (1u << (2 * BYTE_WEIGHT_BITS - 1)))
+        >> (2 * BYTE_WEIGHT_BITS));
+}
+
+template <typename T>
+typename Image<T>::Ptr
+UndistortMap::apply (typename Image<T>::ConstPtr img) const
+{
+    if (img == nullptr)
+        throw std::invalid_argument("Null image given");
+    if (img->width() != this->w || img->height() != this->h)
+        throw std::invalid_argument("Image does not match undistortion map");
+
+    int const chans = img->channels();
+    int const step_x = this->w > 1 ? chans : 0;
+    int const step_y = this->h > 1 ? this->w * chans : 0;
+    typename Image<T>::Ptr out = Image<T>::create(this->w, this->h, chans);
+    T const* in_ptr = img->get_data_pointer();
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < this->h; ++y)
+    {
+        Entry const* entry = &this->entries[y * this->w];
+        T* out_ptr = out->get_data_pointer()
+            + static_cast<std::size_t>(y) * this->w * chans;
+        for (int x = 0; x < this->w; ++x, ++entry, out_ptr += chans)
+        {
+            if (entry->index == INVALID_INDEX)
+            {
+                std::fill(out_ptr, out_ptr + chans, T(0));
+                continue;
+            }
+            T const* row1 = in_ptr
+                + static_cast<std::size_t>(entry->index) * chans;
+            T const* row2 = row1 + step_y;
+            for (int c = 0; c < chans; ++c)
+                out_ptr[c] = blend<T>(row1 + c, row2 + c, step_x,
+                    entry->wx, entry->wy);
+        }
+    }
+
+    return out;
+}
+
+/* ---------------------------------------------------------------- */
+
+template <typename T, typename MODEL>
+typename Image<T>::Ptr
+image_undistort_model (typename Image<T>::ConstPtr img, MODEL const& model)
+{
+    if (img == nullptr)
+        throw std::invalid_argument("Null image given");
+
+    int const width = img->width();
+    int const height = img->height();
+    int const chans = img->channels();
+    typename Image<T>::Ptr out = Image<T>::create(width, height, chans);
+    out->fill(T(0));
+
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < height; ++y)
+    {
+        T* out_ptr = out->get_data_pointer()
+            + static_cast<std::size_t>(y) * width * chans;
+        for (int x = 0; x < width; ++x, out_ptr += chans)
+        {
+            double fx, fy;
+            model.map(x, y, &fx, &fy);
+            if (fx < -0.5 || fx > width - 0.5
+                || fy < -0.5 || fy > height - 0.5)
+                continue;
+            img->linear_at(fx, fy, out_ptr);
+        }
+    }
+
+    return out;
+}
+
+MVE_IMAGE_NAMESPACE_END
+MVE_NAMESPACE_END
+
+#endif /* MVE_IMAGE_UNDISTORT_HEADER */
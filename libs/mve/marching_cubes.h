@@ -17,6 +17,7 @@
 #include "mve/defines.h"
 #include "mve/mesh.h"
 #include "mve/image.h"
+#include "mve/volume.h"
 
 MVE_NAMESPACE_BEGIN
 MVE_GEOM_NAMESPACE_BEGIN
@@ -55,6 +56,16 @@ template <typename T>
 TriangleMesh::Ptr
 marching_cubes (T& accessor);
 
+/**
+ * Polygonizes the SDF in the volume with marching cubes. The volume is
+ * split into slabs of cube layers, which are polygonized in parallel.
+ * Cubes with all voxels on one side of the surface are skipped after a
+ * sign classification of the cube rows. The result is identical to
+ * marching_cubes() with a VolumeMCAccessor.
+ */
+TriangleMesh::Ptr
+volume_marching_cubes (FloatVolume::ConstPtr volume);
+
 MVE_GEOM_NAMESPACE_END
 MVE_NAMESPACE_END
 
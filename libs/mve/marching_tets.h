@@ -16,6 +16,7 @@
 #include "math/functions.h"
 #include "mve/defines.h"
 #include "mve/mesh.h"
+#include "mve/volume.h"
 
 MVE_NAMESPACE_BEGIN
 MVE_GEOM_NAMESPACE_BEGIN
@@ -43,6 +44,14 @@ template <typename T>
 TriangleMesh::Ptr
 marching_tetrahedra (T& accessor);
 
+/**
+ * Polygonizes the SDF in the volume with marching tetrahedra using the
+ * Freudenthal cube partitioning, in parallel like volume_marching_cubes().
+ * The result is identical to marching_tetrahedra() with a VolumeMTAccessor.
+ */
+TriangleMesh::Ptr
+volume_marching_tetrahedra (FloatVolume::ConstPtr volume);
+
 /* ------------------------- Lookup tables ------------------------ */
 
 /**
@@ -0,0 +1,842 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <stdexcept>
+
+#include "mve/mesh_bvh.h"
+
+/* Number of SAH bins per axis. */
+#define BVH_NUM_BINS 16
+/* Maximum number of triangles in a leaf. */
+#define BVH_MAX_LEAF_SIZE 8
+/* Cost of traversing a node relative to intersecting a triangle. */
+#define BVH_TRAVERSAL_COST 1.0f
+/* Maximum depth of the hierarchy, which bounds the traversal stack. */
+#define BVH_MAX_DEPTH 60
+/* Number of subtrees built in parallel, and minimum subtree size. */
+#define BVH_NUM_SUBTREES 128
+#define BVH_MIN_SUBTREE_SIZE 4096
+/* Minimum number of triangles to bin a node in parallel. */
+#define BVH_MIN_PARALLEL_SIZE 65536
+/* Number of rays traversed together in a packet. */
+#define BVH_PACKET_SIZE 8
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+namespace
+{
+    struct AABB
+    {
+        math::Vec3f min;
+        math::Vec3f max;
+
+        AABB (void);
+        void grow (math::Vec3f const& point);
+        void grow (AABB const& other);
+        float surface_area (void) const;
+    };
+
+    AABB::AABB (void)
+        : min(std::numeric_limits<float>::max())
+        , max(-std::numeric_limits<float>::max())
+    {
+    }
+
+    void
+    AABB::grow (math::Vec3f const& point)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            this->min[i] = std::min(this->min[i], point[i]);
+            this->max[i] = std::max(this->max[i], point[i]);
+        }
+    }
+
+    void
+    AABB::grow (AABB const& other)
+    {
+        /* Growing by an empty box leaves the box unchanged. */
+        for (int i = 0; i < 3; ++i)
+        {
+            this->min[i] = std::min(this->min[i], other.min[i]);
+            this->max[i] = std::max(this->max[i], other.max[i]);
+        }
+    }
+
+    float
+    AABB::surface_area (void) const
+    {
+        if (this->min[0] > this->max[0])
+            return 0.0f;
+        math::Vec3f const ext = this->max - this->min;
+        return 2.0f * (ext[0] * ext[1] + ext[1] * ext[2] + ext[2] * ext[0]);
+    }
+
+    /* Slab test, returns the entry distance in 'tnear'. */
+    bool
+    ray_box_test (math::Vec3f const& aabb_min, math::Vec3f const& aabb_max,
+        math::Vec3f const& origin, math::Vec3f const& inv_dir,
+        float tmin, float tmax, float* tnear)
+    {
+        for (int i = 0; i < 3; ++i)
+        {
+            float const t1 = (aabb_min[i] - origin[i]) * inv_dir[i];
+            float const t2 = (aabb_max[i] - origin[i]) * inv_dir[i];
+            tmin = std::max(tmin, std::min(t1, t2));
+            tmax = std::min(tmax, std::max(t1, t2));
+        }
+        *tnear = tmin;
+        return tmin <= tmax;
+    }
+
+    float
+    point_box_square_distance (math::Vec3f const& aabb_min,
+        math::Vec3f const& aabb_max, math::Vec3f const& point)
+    {
+        float dist = 0.0f;
+        for (int i = 0; i < 3; ++i)
+        {
+            float const d = std::max(0.0f, std::max(aabb_min[i] - point[i],
+                point[i] - aabb_max[i]));
+            dist += d * d;
+        }
+        return dist;
+    }
+
+    /*
+     * Closest point on triangle (a, b, c) to point p, returned as
+     * barycentric coordinates. See Ericson, Real-Time Collision Detection,
+     * Section 5.1.5.
+     */
+    math::Vec3f
+    closest_point_on_triangle (math::Vec3f const& p, math::Vec3f const& a,
+        math::Vec3f const& b, math::Vec3f const& c)
+    {
+        math::Vec3f const ab = b - a;
+        math::Vec3f const ac = c - a;
+        math::Vec3f const ap = p - a;
+        float const d1 = ab.dot(ap);
+        float const d2 = ac.dot(ap);
+        if (d1 <= 0.0f && d2 <= 0.0f)
+            return math::Vec3f(1.0f, 0.0f, 0.0f);
+
+        math::Vec3f const bp = p - b;
+        float const d3 = ab.dot(bp);
+        float const d4 = ac.dot(bp);
+        if (d3 >= 0.0f && d4 <= d3)
+            return math::Vec3f(0.0f, 1.0f, 0.0f);
+
+        float const vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            float const v = d1 / (d1 - d3);
+            return math::Vec3f(1.0f - v, v, 0.0f);
+        }
+
+        math::Vec3f const cp = p - c;
+        float const d5 = ab.dot(cp);
+        float const d6 = ac.dot(cp);
+        if (d6 >= 0.0f && d5 <= d6)
+            return math::Vec3f(0.0f, 0.0f, 1.0f);
+
+        float const vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            float const w = d2 / (d2 - d6);
+            return math::Vec3f(1.0f - w, 0.0f, w);
+        }
+
+        float const va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f)
+        {
+            float const w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+            return math::Vec3f(0.0f, 1.0f - w, w);
+        }
+
+        /* Degenerate triangles are handled by the edge cases above. */
+        float const denom = 1.0f / (va + vb + vc);
+        float const v = vb * denom;
+        float const w = vc * denom;
+        return math::Vec3f(1.0f - v - w, v, w);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+struct MeshBVH::BuildData
+{
+    std::vector<AABB> bounds;
+    std::vector<math::Vec3f> centroids;
+    std::vector<unsigned int> indices;
+};
+
+/* ---------------------------------------------------------------- */
+
+MeshBVH::MeshBVH (TriangleMesh::ConstPtr mesh)
+{
+    if (mesh == nullptr)
+        throw std::invalid_argument("Null mesh given");
+
+    TriangleMesh::VertexList const& verts = mesh->get_vertices();
+    TriangleMesh::FaceList const& faces = mesh->get_faces();
+    std::size_t const num_tris = faces.size() / 3;
+    if (num_tris >= MATH_MAX_UINT)
+        throw std::invalid_argument("Too many faces");
+    if (num_tris == 0)
+        return;
+
+    BuildData data;
+    data.bounds.resize(num_tris);
+    data.centroids.resize(num_tris);
+    data.indices.resize(num_tris);
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_tris; ++i)
+#else
+    for (int64_t i = 0; i < num_tris; ++i)
+#endif
+    {
+        for (int j = 0; j < 3; ++j)
+            data.bounds[i].grow(verts[faces[i * 3 + j]]);
+        data.centroids[i] = (data.bounds[i].min + data.bounds[i].max) / 2.0f;
+        data.indices[i] = static_cast<unsigned int>(i);
+    }
+
+    /* Split the upper levels until there are enough subtrees. */
+    std::deque<BuildRange> open;
+    std::vector<BuildRange> jobs;
+    BuildRange root = { 0, 0, num_tris, 0 };
+    open.push_back(root);
+    this->nodes.resize(1);
+    while (!open.empty())
+    {
+        BuildRange const range = open.front();
+        open.pop_front();
+        if (range.end - range.begin <= BVH_MIN_SUBTREE_SIZE
+            || open.size() + jobs.size() + 1 >= BVH_NUM_SUBTREES)
+        {
+            jobs.push_back(range);
+            continue;
+        }
+
+        Node node;
+        std::size_t mid;
+        if (!this->split_node(&data, range, &node, &mid))
+        {
+            this->nodes[range.node] = node;
+            continue;
+        }
+
+        node.first = static_cast<unsigned int>(this->nodes.size());
+        node.count = 0;
+        this->nodes[range.node] = node;
+        this->nodes.resize(this->nodes.size() + 2);
+        BuildRange left = { node.first, range.begin, mid, range.depth + 1 };
+        BuildRange right = { node.first + 1, mid, range.end, range.depth + 1 };
+        open.push_back(left);
+        open.push_back(right);
+    }
+
+    /* Build the subtrees in parallel and append them. */
+    std::vector<std::vector<Node> > subtrees(jobs.size());
+#pragma omp parallel for schedule(dynamic, 1)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+#else
+    for (int64_t i = 0; i < jobs.size(); ++i)
+#endif
+        this->build_subtree(&data, jobs[i], &subtrees[i]);
+
+    for (std::size_t i = 0; i < jobs.size(); ++i)
+    {
+        std::vector<Node>& subtree = subtrees[i];
+        unsigned int const offset
+            = static_cast<unsigned int>(this->nodes.size()) - 1;
+        for (std::size_t j = 0; j < subtree.size(); ++j)
+            if (subtree[j].count == 0)
+                subtree[j].first += offset;
+        this->nodes[jobs[i].node] = subtree[0];
+        this->nodes.insert(this->nodes.end(), subtree.begin() + 1,
+            subtree.end());
+        std::vector<Node>().swap(subtree);
+    }
+
+    /* Copy the triangles in leaf order. */
+    this->tri_verts.resize(num_tris * 3);
+    this->tri_faces.resize(num_tris);
+    this->face_tris.resize(num_tris);
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_tris; ++i)
+#else
+    for (int64_t i = 0; i < num_tris; ++i)
+#endif
+    {
+        unsigned int const face_id = data.indices[i];
+        for (int j = 0; j < 3; ++j)
+            this->tri_verts[i * 3 + j] = verts[faces[face_id * 3 + j]];
+        this->tri_faces[i] = face_id;
+        this->face_tris[face_id] = static_cast<unsigned int>(i);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+MeshBVH::split_node (BuildData* data, BuildRange const& range,
+    Node* node, std::size_t* mid) const
+{
+    std::size_t const num = range.end - range.begin;
+    unsigned int* indices = &data->indices[range.begin];
+
+    /* Compute the bounds of the node and of the centroids. */
+    AABB bounds, cbounds;
+#pragma omp parallel if (num >= BVH_MIN_PARALLEL_SIZE)
+    {
+        AABB local_bounds, local_cbounds;
+#pragma omp for
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < num; ++i)
+#else
+        for (int64_t i = 0; i < num; ++i)
+#endif
+        {
+            local_bounds.grow(data->bounds[indices[i]]);
+            local_cbounds.grow(data->centroids[indices[i]]);
+        }
+#pragma omp critical
+        {
+            bounds.grow(local_bounds);
+            cbounds.grow(local_cbounds);
+        }
+    }
+
+    node->aabb_min = bounds.min;
+    node->aabb_max = bounds.max;
+    node->first = static_cast<unsigned int>(range.begin);
+    node->count = static_cast<unsigned int>(num);
+    if (num <= 2 || range.depth >= BVH_MAX_DEPTH)
+        return false;
+
+    /* Bin the centroids along all axes. */
+    std::size_t bin_counts[3][BVH_NUM_BINS] = {};
+    AABB bin_bounds[3][BVH_NUM_BINS];
+    math::Vec3f scale;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float const ext = cbounds.max[axis] - cbounds.min[axis];
+        scale[axis] = ext > 0.0f ? BVH_NUM_BINS / ext : 0.0f;
+    }
+
+#pragma omp parallel if (num >= BVH_MIN_PARALLEL_SIZE)
+    {
+        std::size_t local_counts[3][BVH_NUM_BINS] = {};
+        AABB local_bounds[3][BVH_NUM_BINS];
+#pragma omp for
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < num; ++i)
+#else
+        for (int64_t i = 0; i < num; ++i)
+#endif
+        {
+            math::Vec3f const& c = data->centroids[indices[i]];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                int const bin = std::min(BVH_NUM_BINS - 1, static_cast<int>(
+                    (c[axis] - cbounds.min[axis]) * scale[axis]));
+                local_counts[axis][bin] += 1;
+                local_bounds[axis][bin].grow(data->bounds[indices[i]]);
+            }
+        }
+#pragma omp critical
+        for (int axis = 0; axis < 3; ++axis)
+            for (int bin = 0; bin < BVH_NUM_BINS; ++bin)
+            {
+                bin_counts[axis][bin] += local_counts[axis][bin];
+                bin_bounds[axis][bin].grow(local_bounds[axis][bin]);
+            }
+    }
+
+    /* Find the split plane with the smallest SAH cost. */
+    float best_cost = std::numeric_limits<float>::max();
+    int best_axis = -1, best_bin = 0;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (scale[axis] == 0.0f)
+            continue;
+
+        float right_areas[BVH_NUM_BINS];
+        std::size_t right_counts[BVH_NUM_BINS];
+        AABB right;
+        std::size_t right_count = 0;
+        for (int bin = BVH_NUM_BINS - 1; bin > 0; --bin)
+        {
+            right.grow(bin_bounds[axis][bin]);
+            right_count += bin_counts[axis][bin];
+            right_areas[bin] = right.surface_area();
+            right_counts[bin] = right_count;
+        }
+
+        AABB left;
+        std::size_t left_count = 0;
+        for (int bin = 1; bin < BVH_NUM_BINS; ++bin)
+        {
+            left.grow(bin_bounds[axis][bin - 1]);
+            left_count += bin_counts[axis][bin - 1];
+            if (left_count == 0 || right_counts[bin] == 0)
+                continue;
+            float const cost = left.surface_area() * left_count
+                + right_areas[bin] * right_counts[bin];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = bin;
+            }
+        }
+    }
+
+    float const area = bounds.surface_area();
+    float const leaf_cost = static_cast<float>(num);
+    if (best_axis >= 0 && area > 0.0f)
+        best_cost = BVH_TRAVERSAL_COST + best_cost / area;
+
+    if (best_axis < 0)
+    {
+        /* All centroids coincide, split in the middle if too large. */
+        if (num <= BVH_MAX_LEAF_SIZE)
+            return false;
+        *mid = range.begin + num / 2;
+        return true;
+    }
+
+    if (num <= BVH_MAX_LEAF_SIZE && best_cost >= leaf_cost)
+        return false;
+
+    float const split_min = cbounds.min[best_axis];
+    float const split_scale = scale[best_axis];
+    std::vector<math::Vec3f> const& centroids = data->centroids;
+    unsigned int* pivot = std::partition(indices, indices + num,
+        [&](unsigned int id)
+        {
+            int const bin = std::min(BVH_NUM_BINS - 1, static_cast<int>(
+                (centroids[id][best_axis] - split_min) * split_scale));
+            return bin < best_bin;
+        });
+    *mid = range.begin + (pivot - indices);
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+MeshBVH::build_subtree (BuildData* data, BuildRange const& range,
+    std::vector<Node>* nodes) const
+{
+    nodes->clear();
+    nodes->resize(1);
+    std::vector<BuildRange> stack(1, range);
+    stack.back().node = 0;
+    while (!stack.empty())
+    {
+        BuildRange const current = stack.back();
+        stack.pop_back();
+
+        Node node;
+        std::size_t mid;
+        if (!this->split_node(data, current, &node, &mid))
+        {
+            nodes->at(current.node) = node;
+            continue;
+        }
+
+        node.first = static_cast<unsigned int>(nodes->size());
+        node.count = 0;
+        nodes->at(current.node) = node;
+        nodes->resize(nodes->size() + 2);
+        BuildRange left = { node.first, current.begin, mid,
+            current.depth + 1 };
+        BuildRange right = { node.first + 1, mid, current.end,
+            current.depth + 1 };
+        stack.push_back(right);
+        stack.push_back(left);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+MeshBVH::intersect_triangle (std::size_t tri, Ray const& ray,
+    float tmax, Hit* hit) const
+{
+    /* Moeller-Trumbore ray-triangle intersection. */
+    math::Vec3f const& v0 = this->tri_verts[tri * 3 + 0];
+    math::Vec3f const e1 = this->tri_verts[tri * 3 + 1] - v0;
+    math::Vec3f const e2 = this->tri_verts[tri * 3 + 2] - v0;
+    math::Vec3f const p = ray.dir.cross(e2);
+    float const det = e1.dot(p);
+    if (det == 0.0f)
+        return false;
+
+    float const inv_det = 1.0f / det;
+    math::Vec3f const s = ray.origin - v0;
+    float const u = s.dot(p) * inv_det;
+    if (u < 0.0f || u > 1.0f)
+        return false;
+    math::Vec3f const q = s.cross(e1);
+    float const v = ray.dir.dot(q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f)
+        return false;
+    float const t = e2.dot(q) * inv_det;
+    if (t < ray.tmin || t >= tmax)
+        return false;
+
+    hit->face_id = this->tri_faces[tri];
+    hit->t = t;
+    hit->bary = math::Vec3f(1.0f - u - v, u, v);
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+MeshBVH::intersect (Ray const& ray, Hit* hit) const
+{
+    *hit = Hit();
+    if (this->nodes.empty())
+        return false;
+
+    math::Vec3f const inv_dir(1.0f / ray.dir[0], 1.0f / ray.dir[1],
+        1.0f / ray.dir[2]);
+    float tmax = ray.tmax;
+    float tnear;
+    if (!ray_box_test(this->nodes[0].aabb_min, this->nodes[0].aabb_max,
+        ray.origin, inv_dir, ray.tmin, tmax, &tnear))
+        return false;
+
+    unsigned int stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        Node const& node = this->nodes[stack[--stack_size]];
+        if (node.count > 0)
+        {
+            for (std::size_t i = node.first; i < node.first + node.count; ++i)
+                if (this->intersect_triangle(i, ray, tmax, hit))
+                    tmax = hit->t;
+            continue;
+        }
+
+        /* Visit the nearer child first. */
+        float tnear1, tnear2;
+        Node const& child1 = this->nodes[node.first];
+        Node const& child2 = this->nodes[node.first + 1];
+        bool const hit1 = ray_box_test(child1.aabb_min, child1.aabb_max,
+            ray.origin, inv_dir, ray.tmin, tmax, &tnear1);
+        bool const hit2 = ray_box_test(child2.aabb_min, child2.aabb_max,
+            ray.origin, inv_dir, ray.tmin, tmax, &tnear2);
+        if (hit1 && hit2)
+        {
+            bool const first_near = tnear1 <= tnear2;
+            stack[stack_size++] = node.first + (first_near ? 1 : 0);
+            stack[stack_size++] = node.first + (first_near ? 0 : 1);
+        }
+        else if (hit1)
+            stack[stack_size++] = node.first;
+        else if (hit2)
+            stack[stack_size++] = node.first + 1;
+    }
+
+    return hit->face_id != MATH_MAX_SIZE_T;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+MeshBVH::occluded (Ray const& ray) const
+{
+    if (this->nodes.empty())
+        return false;
+
+    math::Vec3f const inv_dir(1.0f / ray.dir[0], 1.0f / ray.dir[1],
+        1.0f / ray.dir[2]);
+    Hit hit;
+    unsigned int stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        Node const& node = this->nodes[stack[--stack_size]];
+        float tnear;
+        if (!ray_box_test(node.aabb_min, node.aabb_max, ray.origin,
+            inv_dir, ray.tmin, ray.tmax, &tnear))
+            continue;
+
+        if (node.count == 0)
+        {
+            stack[stack_size++] = node.first + 1;
+            stack[stack_size++] = node.first;
+            continue;
+        }
+
+        for (std::size_t i = node.first; i < node.first + node.count; ++i)
+            if (this->intersect_triangle(i, ray, ray.tmax, &hit))
+                return true;
+    }
+    return false;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+MeshBVH::intersect (std::vector<Ray> const& rays,
+    std::vector<Hit>* hits) const
+{
+    hits->clear();
+    hits->resize(rays.size());
+    std::size_t const num_packets
+        = (rays.size() + BVH_PACKET_SIZE - 1) / BVH_PACKET_SIZE;
+
+#pragma omp parallel for schedule(dynamic, 64)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_packets; ++i)
+#else
+    for (int64_t i = 0; i < num_packets; ++i)
+#endif
+    {
+        std::size_t const offset = i * BVH_PACKET_SIZE;
+        std::size_t const num = std::min<std::size_t>(BVH_PACKET_SIZE,
+            rays.size() - offset);
+        this->intersect_packet(&rays[offset], num, &hits->at(offset));
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+MeshBVH::intersect_packet (Ray const* rays, std::size_t num_rays,
+    Hit* hits) const
+{
+    if (this->nodes.empty())
+        return;
+
+    /*
+     * The rays are stored as structure of arrays, and all loops over the
+     * rays of the packet are branch-free such that they can be vectorized.
+     * Unused slots get an empty interval.
+     */
+    float org[3][BVH_PACKET_SIZE], dir[3][BVH_PACKET_SIZE];
+    float inv[3][BVH_PACKET_SIZE];
+    float tmin[BVH_PACKET_SIZE], tmax[BVH_PACKET_SIZE];
+    float hit_u[BVH_PACKET_SIZE], hit_v[BVH_PACKET_SIZE];
+    unsigned int hit_tri[BVH_PACKET_SIZE];
+    for (int i = 0; i < BVH_PACKET_SIZE; ++i)
+    {
+        Ray const& ray = rays[std::min<std::size_t>(i, num_rays - 1)];
+        for (int j = 0; j < 3; ++j)
+        {
+            org[j][i] = ray.origin[j];
+            dir[j][i] = ray.dir[j];
+            inv[j][i] = 1.0f / ray.dir[j];
+        }
+        tmin[i] = ray.tmin;
+        tmax[i] = static_cast<std::size_t>(i) < num_rays ? ray.tmax : -1.0f;
+        hit_u[i] = hit_v[i] = 0.0f;
+        hit_tri[i] = MATH_MAX_UINT;
+    }
+
+    unsigned int stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+        Node const& node = this->nodes[stack[--stack_size]];
+
+        /* Skip the node if no ray intersects its box. */
+        int any_hit = 0;
+        for (int i = 0; i < BVH_PACKET_SIZE; ++i)
+        {
+            float t0 = tmin[i], t1 = tmax[i];
+            for (int j = 0; j < 3; ++j)
+            {
+                float const a = (node.aabb_min[j] - org[j][i]) * inv[j][i];
+                float const b = (node.aabb_max[j] - org[j][i]) * inv[j][i];
+                t0 = std::max(t0, std::min(a, b));
+                t1 = std::min(t1, std::max(a, b));
+            }
+            any_hit |= (t0 <= t1) ? 1 : 0;
+        }
+        if (!any_hit)
+            continue;
+
+        if (node.count == 0)
+        {
+            /* Visit the child first that is nearer along the first ray. */
+            Node const& child1 = this->nodes[node.first];
+            Node const& child2 = this->nodes[node.first + 1];
+            math::Vec3f const d(dir[0][0], dir[1][0], dir[2][0]);
+            bool const first_near = d.dot(child1.aabb_min + child1.aabb_max)
+                <= d.dot(child2.aabb_min + child2.aabb_max);
+            stack[stack_size++] = node.first + (first_near ? 1 : 0);
+            stack[stack_size++] = node.first + (first_near ? 0 : 1);
+            continue;
+        }
+
+        for (unsigned int tri = node.first; tri < node.first + node.count;
+            ++tri)
+        {
+            math::Vec3f const& v0 = this->tri_verts[tri * 3 + 0];
+            math::Vec3f const e1 = this->tri_verts[tri * 3 + 1] - v0;
+            math::Vec3f const e2 = this->tri_verts[tri * 3 + 2] - v0;
+            for (int i = 0; i < BVH_PACKET_SIZE; ++i)
+            {
+                float const px = dir[1][i] * e2[2] - dir[2][i] * e2[1];
+                float const py = dir[2][i] * e2[0] - dir[0][i] * e2[2];
+                float const pz = dir[0][i] * e2[1] - dir[1][i] * e2[0];
+                float const inv_det
+                    = 1.0f / (e1[0] * px + e1[1] * py + e1[2] * pz);
+                float const sx = org[0][i] - v0[0];
+                float const sy = org[1][i] - v0[1];
+                float const sz = org[2][i] - v0[2];
+                float const u = (sx * px + sy * py + sz * pz) * inv_det;
+                float const qx = sy * e1[2] - sz * e1[1];
+                float const qy = sz * e1[0] - sx * e1[2];
+                float const qz = sx * e1[1] - sy * e1[0];
+                float const v = (dir[0][i] * qx + dir[1][i] * qy
+                    + dir[2][i] * qz) * inv_det;
+                float const t = (e2[0] * qx + e2[1] * qy + e2[2] * qz)
+                    * inv_det;
+                /* Degenerate triangles yield NaN, which fails all tests. */
+                bool const valid = u >= 0.0f && v >= 0.0f && u + v <= 1.0f
+                    && t >= tmin[i] && t < tmax[i];
+                tmax[i] = valid ? t : tmax[i];
+                hit_u[i] = valid ? u : hit_u[i];
+                hit_v[i] = valid ? v : hit_v[i];
+                hit_tri[i] = valid ? tri : hit_tri[i];
+            }
+        }
+    }
+
+    for (std::size_t i = 0; i < num_rays; ++i)
+    {
+        hits[i] = Hit();
+        if (hit_tri[i] == MATH_MAX_UINT)
+            continue;
+        hits[i].face_id = this->tri_faces[hit_tri[i]];
+        hits[i].t = tmax[i];
+        hits[i].bary = math::Vec3f(1.0f - hit_u[i] - hit_v[i],
+            hit_u[i], hit_v[i]);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+MeshBVH::closest_point (math::Vec3f const& point, Hit* hit,
+    float max_dist) const
+{
+    *hit = Hit();
+    if (this->nodes.empty())
+        return false;
+
+    float best_dist = max_dist < std::sqrt(std::numeric_limits<float>::max())
+        ? max_dist * max_dist : std::numeric_limits<float>::max();
+    std::size_t best_tri = MATH_MAX_SIZE_T;
+
+    std::pair<float, unsigned int> stack[BVH_MAX_DEPTH + 2];
+    int stack_size = 0;
+    stack[stack_size++] = std::make_pair(point_box_square_distance(
+        this->nodes[0].aabb_min, this->nodes[0].aabb_max, point), 0u);
+    while (stack_size > 0)
+    {
+        std::pair<float, unsigned int> const entry = stack[--stack_size];
+        if (entry.first >= best_dist)
+            continue;
+
+        Node const& node = this->nodes[entry.second];
+        if (node.count > 0)
+        {
+            for (std::size_t i = node.first; i < node.first + node.count; ++i)
+            {
+                math::Vec3f const* v = &this->tri_verts[i * 3];
+                math::Vec3f const bary = closest_point_on_triangle(point,
+                    v[0], v[1], v[2]);
+                math::Vec3f const pos = v[0] * bary[0] + v[1] * bary[1]
+                    + v[2] * bary[2];
+                float const dist = (pos - point).square_norm();
+                if (dist < best_dist)
+                {
+                    best_dist = dist;
+                    best_tri = i;
+                    hit->bary = bary;
+                }
+            }
+            continue;
+        }
+
+        /* Visit the nearer child first. */
+        Node const& child1 = this->nodes[node.first];
+        Node const& child2 = this->nodes[node.first + 1];
+        float const dist1 = point_box_square_distance(child1.aabb_min,
+            child1.aabb_max, point);
+        float const dist2 = point_box_square_distance(child2.aabb_min,
+            child2.aabb_max, point);
+        if (dist1 <= dist2)
+        {
+            stack[stack_size++] = std::make_pair(dist2, node.first + 1);
+            stack[stack_size++] = std::make_pair(dist1, node.first);
+        }
+        else
+        {
+            stack[stack_size++] = std::make_pair(dist1, node.first);
+            stack[stack_size++] = std::make_pair(dist2, node.first + 1);
+        }
+    }
+
+    if (best_tri == MATH_MAX_SIZE_T)
+        return false;
+
+    hit->face_id = this->tri_faces[best_tri];
+    hit->t = std::sqrt(best_dist);
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+math::Vec3f
+MeshBVH::get_position (Hit const& hit) const
+{
+    if (hit.face_id >= this->face_tris.size())
+        throw std::invalid_argument("Invalid face ID");
+    math::Vec3f const* v = &this->tri_verts[this->face_tris[hit.face_id] * 3];
+    return v[0] * hit.bary[0] + v[1] * hit.bary[1] + v[2] * hit.bary[2];
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+MeshBVH::get_aabb (math::Vec3f* aabb_min, math::Vec3f* aabb_max) const
+{
+    if (this->nodes.empty())
+    {
+        *aabb_min = math::Vec3f(0.0f);
+        *aabb_max = math::Vec3f(0.0f);
+        return;
+    }
+    *aabb_min = this->nodes[0].aabb_min;
+    *aabb_max = this->nodes[0].aabb_max;
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_MESH_BVH_HEADER
+#define MVE_MESH_BVH_HEADER
+
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "math/defines.h"
+#include "math/vector.h"
+#include "mve/defines.h"
+#include "mve/mesh.h"
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+/**
+ * Bounding volume hierarchy over the faces of a triangle mesh for ray
+ * casting and closest point queries. The hierarchy is built top-down with
+ * the binned surface area heuristic (SAH). The upper levels are split
+ * sequentially until there are enough subtrees, which are then built in
+ * parallel. The triangle vertices are copied in leaf order, so the mesh
+ * is not referenced after construction.
+ *
+ * Single rays are traversed front to back. Batches of rays are traversed
+ * in parallel packets of consecutive rays, which share the traversal of
+ * the hierarchy. Packets are efficient for coherent rays, e.g., rays
+ * through neighboring pixels.
+ */
+class MeshBVH
+{
+public:
+    typedef std::shared_ptr<MeshBVH> Ptr;
+    typedef std::shared_ptr<MeshBVH const> ConstPtr;
+
+    /** Ray with origin, direction and parameter interval [tmin, tmax). */
+    struct Ray
+    {
+        math::Vec3f origin;
+        math::Vec3f dir;
+        float tmin = 0.0f;
+        float tmax = std::numeric_limits<float>::max();
+    };
+
+    /** Intersection with a face, or the closest point on a face. */
+    struct Hit
+    {
+        /** Face index or MATH_MAX_SIZE_T if there is no hit. */
+        std::size_t face_id = MATH_MAX_SIZE_T;
+        /** Ray parameter or distance to the query point. */
+        float t = std::numeric_limits<float>::max();
+        /** Barycentric coordinates with respect to the face vertices. */
+        math::Vec3f bary;
+    };
+
+public:
+    /** Builds the hierarchy over the faces of the mesh. */
+    static Ptr create (TriangleMesh::ConstPtr mesh);
+
+    /** Returns the closest intersection of the ray with the mesh. */
+    bool intersect (Ray const& ray, Hit* hit) const;
+
+    /** Returns the closest intersections for a batch of rays. */
+    void intersect (std::vector<Ray> const& rays,
+        std::vector<Hit>* hits) const;
+
+    /** Returns true if the ray intersects any face, e.g., for shadows. */
+    bool occluded (Ray const& ray) const;
+
+    /**
+     * Returns the closest point on the mesh to the given point that is
+     * closer than 'max_dist', or false if there is no such point.
+     */
+    bool closest_point (math::Vec3f const& point, Hit* hit,
+        float max_dist = std::numeric_limits<float>::max()) const;
+
+    /** Returns the 3D position of the hit using the barycentric coords. */
+    math::Vec3f get_position (Hit const& hit) const;
+
+    /** Returns the axis-aligned bounding box of the mesh. */
+    void get_aabb (math::Vec3f* aabb_min, math::Vec3f* aabb_max) const;
+
+    /** Returns the number of nodes in the hierarchy. */
+    std::size_t get_num_nodes (void) const;
+
+protected:
+    MeshBVH (TriangleMesh::ConstPtr mesh);
+
+private:
+    /*
+     * Inner nodes have a zero count, and the children are located at
+     * 'first' and 'first + 1'. Leaves reference 'count' triangles.
+     */
+    struct Node
+    {
+        math::Vec3f aabb_min;
+        unsigned int first;
+        math::Vec3f aabb_max;
+        unsigned int count;
+    };
+
+    struct BuildRange
+    {
+        std::size_t node;
+        std::size_t begin;
+        std::size_t end;
+        std::size_t depth;
+    };
+
+    struct BuildData;
+
+private:
+    bool split_node (BuildData* data, BuildRange const& range,
+        Node* node, std::size_t* mid) const;
+    void build_subtree (BuildData* data, BuildRange const& range,
+        std::vector<Node>* nodes) const;
+    void intersect_packet (Ray const* rays, std::size_t num_rays,
+        Hit* hits) const;
+    bool intersect_triangle (std::size_t tri, Ray const& ray,
+        float tmax, Hit* hit) const;
+
+private:
+    std::vector<Node> nodes;
+    std::vector<math::Vec3f> tri_verts;
+    std::vector<unsigned int> tri_faces;
+    std::vector<unsigned int> face_tris;
+};
+
+/* ------------------------- Implementation ---------------------------- */
+
+inline MeshBVH::Ptr
+MeshBVH::create (TriangleMesh::ConstPtr mesh)
+{
+    return Ptr(new MeshBVH(mesh));
+}
+
+inline std::size_t
+MeshBVH::get_num_nodes (void) const
+{
+    return this->nodes.size();
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
+
+#endif /* MVE_MESH_BVH_HEADER */
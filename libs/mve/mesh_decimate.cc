@@ -0,0 +1,612 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "math/algo.h"
+#include "math/matrix.h"
+#include "math/matrix_tools.h"
+#include "math/vector.h"
+#include "mve/mesh_info.h"
+#include "mve/mesh_decimate.h"
+
+/* Minimum cosine between a face normal before and after a collapse. */
+#define DECIMATE_MIN_NORMAL_COS 0.25f
+/* Minimum relative determinant to use the optimal collapse position. */
+#define DECIMATE_MIN_DETERMINANT 1e-8
+/* Maximum rounds of selecting independent collapses in every pass. */
+#define DECIMATE_MAX_SELECT_ROUNDS 16
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+namespace
+{
+    /* Symmetric 4x4 error quadric, upper triangle stored row by row. */
+    struct Quadric
+    {
+        double q[10];
+
+        Quadric (void);
+        void add_plane (math::Vec3d const& n, double d, double weight);
+        Quadric& operator+= (Quadric const& other);
+        double evaluate (math::Vec3d const& p) const;
+        bool minimize (math::Vec3d* p) const;
+    };
+
+    Quadric::Quadric (void)
+    {
+        std::fill(this->q, this->q + 10, 0.0);
+    }
+
+    void
+    Quadric::add_plane (math::Vec3d const& n, double d, double weight)
+    {
+        double const plane[4] = { n[0], n[1], n[2], d };
+        for (int i = 0, k = 0; i < 4; ++i)
+            for (int j = i; j < 4; ++j, ++k)
+                this->q[k] += weight * plane[i] * plane[j];
+    }
+
+    Quadric&
+    Quadric::operator+= (Quadric const& other)
+    {
+        for (int i = 0; i < 10; ++i)
+            this->q[i] += other.q[i];
+        return *this;
+    }
+
+    double
+    Quadric::evaluate (math::Vec3d const& p) const
+    {
+        double const x = p[0], y = p[1], z = p[2];
+        return this->q[0] * x * x + this->q[4] * y * y + this->q[7] * z * z
+            + 2.0 * (this->q[1] * x * y + this->q[2] * x * z
+            + this->q[5] * y * z + this->q[3] * x + this->q[6] * y
+            + this->q[8] * z) + this->q[9];
+    }
+
+    bool
+    Quadric::minimize (math::Vec3d* p) const
+    {
+        math::Matrix3d mat;
+        mat(0, 0) = this->q[0]; mat(0, 1) = this->q[1]; mat(0, 2) = this->q[2];
+        mat(1, 0) = this->q[1]; mat(1, 1) = this->q[4]; mat(1, 2) = this->q[5];
+        mat(2, 0) = this->q[2]; mat(2, 1) = this->q[5]; mat(2, 2) = this->q[7];
+        double const det = math::matrix_determinant(mat);
+        double const trace = this->q[0] + this->q[4] + this->q[7];
+        if (!(std::abs(det) > DECIMATE_MIN_DETERMINANT * trace * trace * trace))
+            return false;
+        math::Vec3d const b(this->q[3], this->q[6], this->q[8]);
+        *p = -math::matrix_inverse(mat, det).mult(b);
+        return true;
+    }
+
+    /* ---------------------------------------------------------------- */
+
+    /* Edge between two vertices with the collapse position and error. */
+    struct DecimateEdge
+    {
+        unsigned int v1;
+        unsigned int v2;
+        bool valid;
+        float cost;
+        math::Vec3f pos;
+    };
+
+    typedef CompactMeshInfo::IndexRange IndexRange;
+
+    bool
+    contains (IndexRange const& range, unsigned int id)
+    {
+        return std::find(range.begin(), range.end(), id) != range.end();
+    }
+
+    math::Vec3d
+    face_normal (TriangleMesh::VertexList const& verts,
+        TriangleMesh::FaceList const& faces, std::size_t face_id)
+    {
+        math::Vec3d const p0(verts[faces[face_id * 3 + 0]]);
+        math::Vec3d const p1(verts[faces[face_id * 3 + 1]]);
+        math::Vec3d const p2(verts[faces[face_id * 3 + 2]]);
+        return (p1 - p0).cross(p2 - p0);
+    }
+
+    /* Adds the plane through the boundary edge perpendicular to the face. */
+    void
+    add_boundary_plane (math::Vec3d const& p1, math::Vec3d const& p2,
+        math::Vec3d const& normal, double weight, Quadric* quadric)
+    {
+        math::Vec3d const edge = p2 - p1;
+        math::Vec3d plane_normal = edge.cross(normal);
+        double const len = plane_normal.norm();
+        if (len == 0.0)
+            return;
+        plane_normal /= len;
+        quadric->add_plane(plane_normal, -plane_normal.dot(p1),
+            weight * edge.square_norm());
+    }
+
+    /*
+     * Computes the area-weighted quadrics of the faces around every
+     * vertex, and adds boundary quadrics for the two boundary edges of
+     * border vertices.
+     */
+    void
+    compute_quadrics (TriangleMesh::ConstPtr mesh, double boundary_weight,
+        std::vector<Quadric>* quadrics)
+    {
+        TriangleMesh::VertexList const& verts = mesh->get_vertices();
+        TriangleMesh::FaceList const& faces = mesh->get_faces();
+        CompactMeshInfo info(mesh);
+
+        quadrics->clear();
+        quadrics->resize(verts.size());
+#pragma omp parallel for schedule(dynamic, 1024)
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < verts.size(); ++i)
+#else
+        for (int64_t i = 0; i < verts.size(); ++i)
+#endif
+        {
+            CompactMeshInfo::VertexInfo const vinfo = info[i];
+            Quadric& quadric = quadrics->at(i);
+            for (std::size_t j = 0; j < vinfo.faces.size(); ++j)
+            {
+                math::Vec3d normal = face_normal(verts, faces, vinfo.faces[j]);
+                double const len = normal.norm();
+                if (len == 0.0)
+                    continue;
+                normal /= len;
+                quadric.add_plane(normal, -normal.dot(math::Vec3d(verts[i])),
+                    len / 2.0);
+            }
+
+            if (vinfo.vclass != MeshInfo::VERTEX_CLASS_BORDER)
+                continue;
+            std::size_t const last_vert = vinfo.verts.size() - 1;
+            std::size_t const last_face = vinfo.faces.size() - 1;
+            math::Vec3d const pos(verts[i]);
+            add_boundary_plane(pos, math::Vec3d(verts[vinfo.verts[0]]),
+                face_normal(verts, faces, vinfo.faces[0]),
+                boundary_weight, &quadric);
+            add_boundary_plane(pos, math::Vec3d(verts[vinfo.verts[last_vert]]),
+                face_normal(verts, faces, vinfo.faces[last_face]),
+                boundary_weight, &quadric);
+        }
+    }
+
+    /* Checks if moving the vertices of the edge flips one of the faces. */
+    bool
+    collapse_flips_faces (TriangleMesh::VertexList const& verts,
+        TriangleMesh::FaceList const& faces, IndexRange const& vertex_faces,
+        unsigned int v1, unsigned int v2, math::Vec3f const& pos)
+    {
+        for (std::size_t i = 0; i < vertex_faces.size(); ++i)
+        {
+            unsigned int const* face = &faces[vertex_faces[i] * 3];
+            math::Vec3f p[3];
+            int num_moved = 0;
+            for (int j = 0; j < 3; ++j)
+            {
+                bool const moved = face[j] == v1 || face[j] == v2;
+                p[j] = moved ? pos : verts[face[j]];
+                num_moved += moved ? 1 : 0;
+            }
+
+            /* Faces that contain the edge are removed. */
+            if (num_moved > 1)
+                continue;
+
+            math::Vec3f const before = (verts[face[1]] - verts[face[0]])
+                .cross(verts[face[2]] - verts[face[0]]);
+            math::Vec3f const after = (p[1] - p[0]).cross(p[2] - p[0]);
+            float const norm = before.norm() * after.norm();
+            if (norm == 0.0f
+                || before.dot(after) < DECIMATE_MIN_NORMAL_COS * norm)
+                return true;
+        }
+        return false;
+    }
+
+    /* Computes the collapse position and error, and checks the topology. */
+    void
+    evaluate_edge (TriangleMesh::VertexList const& verts,
+        CompactMeshInfo const& info, std::vector<Quadric> const& quadrics,
+        double max_error, DecimateEdge* edge)
+    {
+        edge->valid = false;
+        CompactMeshInfo::VertexInfo const vinfo1 = info[edge->v1];
+        CompactMeshInfo::VertexInfo const vinfo2 = info[edge->v2];
+        if (vinfo1.vclass == MeshInfo::VERTEX_CLASS_COMPLEX
+            || vinfo2.vclass == MeshInfo::VERTEX_CLASS_COMPLEX)
+            return;
+
+        /* Interior edges between two border vertices pinch the mesh. */
+        std::size_t num_shared = 0;
+        for (std::size_t i = 0; i < vinfo1.faces.size(); ++i)
+            if (contains(vinfo2.faces, vinfo1.faces[i]))
+                num_shared += 1;
+        if (num_shared == 2 && vinfo1.vclass == MeshInfo::VERTEX_CLASS_BORDER
+            && vinfo2.vclass == MeshInfo::VERTEX_CLASS_BORDER)
+            return;
+
+        /* Link condition: Common neighbors are the shared face corners. */
+        std::size_t num_common = 0;
+        for (std::size_t i = 0; i < vinfo1.verts.size(); ++i)
+            if (contains(vinfo2.verts, vinfo1.verts[i]))
+                num_common += 1;
+        if (num_common != num_shared)
+            return;
+        if (vinfo1.verts.size() + vinfo2.verts.size() < num_common + 5)
+            return;
+
+        /* Find the optimal position, or the best of endpoints and middle. */
+        Quadric quadric = quadrics[edge->v1];
+        quadric += quadrics[edge->v2];
+        math::Vec3d const p1(verts[edge->v1]);
+        math::Vec3d const p2(verts[edge->v2]);
+        math::Vec3d const middle = (p1 + p2) / 2.0;
+        math::Vec3d pos;
+        double cost;
+        if (quadric.minimize(&pos)
+            && (pos - middle).square_norm() <= (p2 - p1).square_norm())
+        {
+            cost = quadric.evaluate(pos);
+        }
+        else
+        {
+            math::Vec3d const candidates[3] = { middle, p1, p2 };
+            pos = candidates[0];
+            cost = quadric.evaluate(pos);
+            for (int i = 1; i < 3; ++i)
+            {
+                double const c = quadric.evaluate(candidates[i]);
+                if (c < cost)
+                {
+                    cost = c;
+                    pos = candidates[i];
+                }
+            }
+        }
+
+        cost = std::max(0.0, cost);
+        if (!(cost <= max_error))
+            return;
+
+        edge->pos = math::Vec3f(pos);
+        edge->cost = static_cast<float>(cost);
+        edge->valid = true;
+    }
+
+    /* Sort key of an edge: Cost first, edge index for ties. */
+    uint64_t
+    edge_key (float cost, std::size_t edge_id)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &cost, sizeof(float));
+        return (static_cast<uint64_t>(bits) << 32)
+            | static_cast<uint64_t>(edge_id);
+    }
+
+    void
+    atomic_min (std::atomic<uint64_t>* value, uint64_t key)
+    {
+        uint64_t current = value->load(std::memory_order_relaxed);
+        while (key < current && !value->compare_exchange_weak(current, key))
+            continue;
+    }
+
+    template <typename T>
+    void
+    interpolate_attribute (std::vector<T>* values, std::size_t num_verts,
+        unsigned int v1, unsigned int v2, float t)
+    {
+        if (values->size() != num_verts)
+            return;
+        values->at(v1) = values->at(v1) * (1.0f - t) + values->at(v2) * t;
+    }
+
+    /*
+     * Selects collapses with disjoint face neighborhoods: Each candidate
+     * claims the faces around its vertices, and candidates that own all
+     * their faces are selected. Their faces are locked, and the remaining
+     * candidates compete again until no further collapse can be selected.
+     * The cheapest candidate always wins, which makes the selection
+     * deterministic.
+     */
+    void
+    select_collapses (CompactMeshInfo const& info,
+        std::vector<DecimateEdge> const& edges,
+        std::vector<uint64_t> const& candidates, std::size_t num_faces,
+        std::vector<char>* selected)
+    {
+        enum { ACTIVE, SELECTED, BLOCKED };
+        std::vector<char>& state = *selected;
+        state.assign(candidates.size(), ACTIVE);
+        std::vector<char> face_locked(num_faces, 0);
+        std::vector<std::atomic<uint64_t> > claims(num_faces);
+
+        for (int round = 0; round < DECIMATE_MAX_SELECT_ROUNDS; ++round)
+        {
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+            for (std::size_t i = 0; i < num_faces; ++i)
+#else
+            for (int64_t i = 0; i < num_faces; ++i)
+#endif
+                claims[i].store(UINT64_MAX, std::memory_order_relaxed);
+
+            /* Block candidates at locked faces, the others claim faces. */
+#pragma omp parallel for schedule(dynamic, 256)
+#if !defined(_MSC_VER)
+            for (std::size_t i = 0; i < candidates.size(); ++i)
+#else
+            for (int64_t i = 0; i < candidates.size(); ++i)
+#endif
+            {
+                if (state[i] != ACTIVE)
+                    continue;
+                DecimateEdge const& edge = edges[candidates[i] & 0xffffffff];
+                IndexRange const faces[2]
+                    = { info[edge.v1].faces, info[edge.v2].faces };
+                for (int j = 0; state[i] == ACTIVE && j < 2; ++j)
+                    for (std::size_t k = 0; k < faces[j].size(); ++k)
+                        if (face_locked[faces[j][k]])
+                        {
+                            state[i] = BLOCKED;
+                            break;
+                        }
+                for (int j = 0; state[i] == ACTIVE && j < 2; ++j)
+                    for (std::size_t k = 0; k < faces[j].size(); ++k)
+                        atomic_min(&claims[faces[j][k]], candidates[i]);
+            }
+
+            /* Select candidates that own all their faces and lock them. */
+            std::size_t num_selected = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:num_selected)
+#if !defined(_MSC_VER)
+            for (std::size_t i = 0; i < candidates.size(); ++i)
+#else
+            for (int64_t i = 0; i < candidates.size(); ++i)
+#endif
+            {
+                if (state[i] != ACTIVE)
+                    continue;
+                DecimateEdge const& edge = edges[candidates[i] & 0xffffffff];
+                IndexRange const faces[2]
+                    = { info[edge.v1].faces, info[edge.v2].faces };
+                bool owned = true;
+                for (int j = 0; owned && j < 2; ++j)
+                    for (std::size_t k = 0; owned && k < faces[j].size(); ++k)
+                        owned = claims[faces[j][k]].load() == candidates[i];
+                if (!owned)
+                    continue;
+                state[i] = SELECTED;
+                for (int j = 0; j < 2; ++j)
+                    for (std::size_t k = 0; k < faces[j].size(); ++k)
+                        face_locked[faces[j][k]] = 1;
+                num_selected += 1;
+            }
+
+            if (num_selected == 0)
+                break;
+        }
+
+        for (std::size_t i = 0; i < state.size(); ++i)
+            state[i] = state[i] == SELECTED ? 1 : 0;
+    }
+
+    /* Runs one pass of parallel collapses. Returns the number of collapses. */
+    std::size_t
+    decimate_pass (TriangleMesh::Ptr mesh, MeshDecimateOptions const& options,
+        std::vector<Quadric>* quadrics)
+    {
+        TriangleMesh::VertexList& verts = mesh->get_vertices();
+        TriangleMesh::FaceList& faces = mesh->get_faces();
+        std::size_t const num_verts = verts.size();
+        std::size_t const num_faces = faces.size() / 3;
+        CompactMeshInfo info(mesh);
+
+        /* Collect every edge once, from its smaller vertex. */
+        std::vector<std::size_t> edge_offsets(num_verts + 1, 0);
+        for (std::size_t i = 0; i < num_verts; ++i)
+        {
+            IndexRange const adj_verts = info[i].verts;
+            std::size_t num_edges = 0;
+            for (std::size_t j = 0; j < adj_verts.size(); ++j)
+                if (i < adj_verts[j])
+                    num_edges += 1;
+            edge_offsets[i + 1] = edge_offsets[i] + num_edges;
+        }
+
+        std::vector<DecimateEdge> edges(edge_offsets.back());
+#pragma omp parallel for schedule(dynamic, 1024)
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < num_verts; ++i)
+#else
+        for (int64_t i = 0; i < num_verts; ++i)
+#endif
+        {
+            IndexRange const adj_verts = info[i].verts;
+            std::size_t edge_id = edge_offsets[i];
+            for (std::size_t j = 0; j < adj_verts.size(); ++j)
+            {
+                if (adj_verts[j] <= i)
+                    continue;
+                DecimateEdge& edge = edges[edge_id++];
+                edge.v1 = static_cast<unsigned int>(i);
+                edge.v2 = adj_verts[j];
+                evaluate_edge(verts, info, *quadrics, options.max_error,
+                    &edge);
+            }
+        }
+
+        /* Collect the valid edges within the error bound. */
+        std::vector<uint64_t> keys;
+        for (std::size_t i = 0; i < edges.size(); ++i)
+            if (edges[i].valid)
+                keys.push_back(edge_key(edges[i].cost, i));
+
+        /*
+         * Take the cheapest edges, but not more than required. Only these
+         * are checked for flipped faces, and further edges are taken if
+         * all of them are rejected.
+         */
+        std::size_t const num_required
+            = (num_faces - options.target_faces + 1) / 2;
+        std::size_t num_candidates = static_cast<std::size_t>(std::ceil(
+            options.batch_fraction * static_cast<float>(keys.size())));
+        num_candidates = std::max<std::size_t>(1,
+            std::min(num_candidates, num_required));
+
+        std::vector<uint64_t> candidates;
+        while (candidates.empty() && !keys.empty())
+        {
+            num_candidates = std::min(num_candidates, keys.size());
+            std::nth_element(keys.begin(), keys.begin() + num_candidates - 1,
+                keys.end());
+            std::vector<char> flips(num_candidates, 0);
+#pragma omp parallel for schedule(dynamic, 256)
+#if !defined(_MSC_VER)
+            for (std::size_t i = 0; i < num_candidates; ++i)
+#else
+            for (int64_t i = 0; i < num_candidates; ++i)
+#endif
+            {
+                DecimateEdge const& edge = edges[keys[i] & 0xffffffff];
+                flips[i] = collapse_flips_faces(verts, faces,
+                    info[edge.v1].faces, edge.v1, edge.v2, edge.pos)
+                    || collapse_flips_faces(verts, faces,
+                    info[edge.v2].faces, edge.v1, edge.v2, edge.pos);
+            }
+            for (std::size_t i = 0; i < num_candidates; ++i)
+                if (!flips[i])
+                    candidates.push_back(keys[i]);
+            keys.erase(keys.begin(), keys.begin() + num_candidates);
+        }
+        if (candidates.empty())
+            return 0;
+
+        std::vector<char> selected;
+        select_collapses(info, edges, candidates, num_faces, &selected);
+
+        /* Apply the independent collapses, and mark removed elements. */
+        std::vector<char> vertex_deleted(num_verts, 0);
+        std::vector<char> face_deleted(num_faces, 0);
+        std::size_t num_collapses = 0;
+#pragma omp parallel for schedule(dynamic, 256) reduction(+:num_collapses)
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < candidates.size(); ++i)
+#else
+        for (int64_t i = 0; i < candidates.size(); ++i)
+#endif
+        {
+            if (!selected[i])
+                continue;
+            DecimateEdge const& edge = edges[candidates[i] & 0xffffffff];
+            IndexRange const faces2 = info[edge.v2].faces;
+
+            /* Interpolate the attributes at the projected position. */
+            math::Vec3f const dir = verts[edge.v2] - verts[edge.v1];
+            float t = dir.dot(edge.pos - verts[edge.v1]) / dir.square_norm();
+            t = std::isfinite(t) ? std::min(1.0f, std::max(0.0f, t)) : 0.5f;
+            interpolate_attribute(&mesh->get_vertex_colors(),
+                num_verts, edge.v1, edge.v2, t);
+            interpolate_attribute(&mesh->get_vertex_confidences(),
+                num_verts, edge.v1, edge.v2, t);
+            interpolate_attribute(&mesh->get_vertex_values(),
+                num_verts, edge.v1, edge.v2, t);
+            interpolate_attribute(&mesh->get_vertex_texcoords(),
+                num_verts, edge.v1, edge.v2, t);
+            verts[edge.v1] = edge.pos;
+            quadrics->at(edge.v1) += quadrics->at(edge.v2);
+
+            /* Reconnect the faces of the second vertex to the first. */
+            for (std::size_t j = 0; j < faces2.size(); ++j)
+            {
+                unsigned int* face = &faces[faces2[j] * 3];
+                if (face[0] == edge.v1 || face[1] == edge.v1
+                    || face[2] == edge.v1)
+                    face_deleted[faces2[j]] = 1;
+                else
+                    std::replace(face, face + 3, edge.v2, edge.v1);
+            }
+            vertex_deleted[edge.v2] = 1;
+            num_collapses += 1;
+        }
+
+        /* Remove collapsed faces and vertices. */
+        TriangleMesh::DeleteList face_dlist(num_faces * 3, false);
+        for (std::size_t i = 0; i < num_faces * 3; ++i)
+            face_dlist[i] = face_deleted[i / 3] != 0;
+        math::algo::vector_clean(face_dlist, &faces);
+        TriangleMesh::ColorList& face_colors = mesh->get_face_colors();
+        if (face_colors.size() == num_faces)
+        {
+            TriangleMesh::DeleteList color_dlist(face_deleted.begin(),
+                face_deleted.end());
+            math::algo::vector_clean(color_dlist, &face_colors);
+        }
+
+        TriangleMesh::DeleteList vertex_dlist(vertex_deleted.begin(),
+            vertex_deleted.end());
+        mesh->delete_vertices_fix_faces(vertex_dlist);
+        math::algo::vector_clean(vertex_dlist, quadrics);
+
+        return num_collapses;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+std::size_t
+mesh_decimate (TriangleMesh::Ptr mesh, MeshDecimateOptions const& options)
+{
+    if (mesh == nullptr)
+        throw std::invalid_argument("Null mesh given");
+    if (options.batch_fraction <= 0.0f || options.batch_fraction > 1.0f)
+        throw std::invalid_argument("Invalid batch fraction");
+
+    TriangleMesh::FaceList& faces = mesh->get_faces();
+    if (faces.size() / 3 <= options.target_faces)
+        return 0;
+
+    /* Normals are recomputed after decimation. */
+    bool const face_normals = mesh->has_face_normals();
+    bool const vertex_normals = mesh->has_vertex_normals();
+    mesh->clear_normals();
+
+    std::vector<Quadric> quadrics;
+    compute_quadrics(mesh, options.boundary_weight, &quadrics);
+
+    std::size_t num_collapses = 0;
+    while (faces.size() / 3 > options.target_faces)
+    {
+        std::size_t const pass_collapses
+            = decimate_pass(mesh, options, &quadrics);
+        if (pass_collapses == 0)
+            break;
+        num_collapses += pass_collapses;
+    }
+
+    if (face_normals || vertex_normals)
+        mesh->recalc_normals(face_normals, vertex_normals);
+
+    return num_collapses;
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
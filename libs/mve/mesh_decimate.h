@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_MESH_DECIMATE_HEADER
+#define MVE_MESH_DECIMATE_HEADER
+
+#include <cstddef>
+#include <limits>
+
+#include "mve/defines.h"
+#include "mve/mesh.h"
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+/**
+ * Options for the mesh decimation.
+ */
+struct MeshDecimateOptions
+{
+    /** Decimation stops once the mesh has at most this many faces. */
+    std::size_t target_faces = 0;
+    /** Only edges with at most this quadric error (squared distance). */
+    double max_error = std::numeric_limits<double>::max();
+    /** Weight of the quadrics that keep the mesh boundary in place. */
+    double boundary_weight = 1000.0;
+    /** Fraction of the cheapest edges considered in every pass. */
+    float batch_fraction = 0.2f;
+};
+
+/**
+ * Decimates the mesh by collapsing edges with the smallest quadric error
+ * (Garland and Heckbert, 1997). Collapses are done in passes: In every
+ * pass, the cheapest edges are collected, and a set of collapses with
+ * disjoint neighborhoods is selected and applied in parallel. The result
+ * is independent of the number of threads.
+ *
+ * Edges at complex vertices are never collapsed, and collapses that flip
+ * faces or change the topology are rejected. The vertex attributes are
+ * interpolated along the edge, and normals are recomputed. Returns the
+ * number of collapses.
+ */
+std::size_t
+mesh_decimate (TriangleMesh::Ptr mesh, MeshDecimateOptions const& options);
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
+
+#endif /* MVE_MESH_DECIMATE_HEADER */
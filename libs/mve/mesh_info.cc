@@ -8,13 +8,136 @@
  */
 
 #include <algorithm>
-#include <list>
-#include <set>
 
 #include "mve/mesh_info.h"
 
 MVE_NAMESPACE_BEGIN
 
+namespace
+{
+    /* Adjacent face representation for the ordering algorithm. */
+    struct AdjacentFace
+    {
+        std::size_t face_id;
+        std::size_t first;
+        std::size_t second;
+    };
+
+    typedef std::vector<AdjacentFace> AdjacentFaceList;
+
+    /*
+     * Sorts the faces adjacent to a vertex by chaining them. If not all
+     * faces can be chained, the vertex is complex and the remaining faces
+     * are appended. Returns the vertex classification.
+     */
+    template <typename T>
+    MeshInfo::VertexClass
+    order_adjacent_faces (TriangleMesh::FaceList const& faces,
+        std::size_t vertex_id, T const* face_ids, std::size_t num_faces,
+        AdjacentFaceList* adj_sorted, AdjacentFaceList* adj_temp)
+    {
+        /* Build new, temporary adjacent faces representation for ordering. */
+        adj_sorted->clear();
+        adj_temp->clear();
+        for (std::size_t i = 0; i < num_faces; ++i)
+        {
+            std::size_t face_off = face_ids[i] * 3;
+            for (std::size_t j = 0; j < 3; ++j)
+                if (faces[face_off + j] == vertex_id)
+                {
+                    AdjacentFace face;
+                    face.face_id = face_ids[i];
+                    face.first = faces[face_off + (j + 1) % 3];
+                    face.second = faces[face_off + (j + 2) % 3];
+                    adj_temp->push_back(face);
+                    break;
+                }
+        }
+
+        /* If there are no adjacent faces, the vertex is unreferenced. */
+        if (adj_temp->empty())
+            return MeshInfo::VERTEX_CLASS_UNREF;
+
+        /* Sort adjacent faces by chaining them. */
+        adj_sorted->push_back(adj_temp->front());
+        adj_temp->erase(adj_temp->begin());
+        while (!adj_temp->empty())
+        {
+            std::size_t const front_id = adj_sorted->front().first;
+            std::size_t const back_id = adj_sorted->back().second;
+
+            /* Find a faces that fits the back or front of sorted list. */
+            bool found_face = false;
+            for (AdjacentFaceList::iterator iter = adj_temp->begin();
+                iter != adj_temp->end(); ++iter)
+            {
+                if (front_id == iter->second)
+                {
+                    adj_sorted->insert(adj_sorted->begin(), *iter);
+                    adj_temp->erase(iter);
+                    found_face = true;
+                    break;
+                }
+                if (back_id == iter->first)
+                {
+                    adj_sorted->push_back(*iter);
+                    adj_temp->erase(iter);
+                    found_face = true;
+                    break;
+                }
+            }
+
+            /* If there is no next face, the vertex is complex. */
+            if (!found_face)
+                break;
+        }
+
+        /* If the vertex is complex, transfer remaining adjacent faces. */
+        if (!adj_temp->empty())
+        {
+            adj_sorted->insert(adj_sorted->end(),
+                adj_temp->begin(), adj_temp->end());
+            adj_temp->clear();
+            return MeshInfo::VERTEX_CLASS_COMPLEX;
+        }
+
+        /* If the vertex is not on the mesh boundary, the list is circular. */
+        if (adj_sorted->front().first == adj_sorted->back().second)
+            return MeshInfo::VERTEX_CLASS_SIMPLE;
+        else
+            return MeshInfo::VERTEX_CLASS_BORDER;
+    }
+
+    /* Appends the vertices adjacent to the ordered faces. */
+    template <typename T>
+    void
+    append_adjacent_vertices (AdjacentFaceList const& adj_sorted,
+        MeshInfo::VertexClass vclass, std::vector<T>* verts)
+    {
+        /* Complex vertices get a sorted, unique list of all vertices. */
+        if (vclass == MeshInfo::VERTEX_CLASS_COMPLEX)
+        {
+            std::size_t const offset = verts->size();
+            for (std::size_t i = 0; i < adj_sorted.size(); ++i)
+            {
+                verts->push_back(adj_sorted[i].first);
+                verts->push_back(adj_sorted[i].second);
+            }
+            std::sort(verts->begin() + offset, verts->end());
+            verts->erase(std::unique(verts->begin() + offset, verts->end()),
+                verts->end());
+            return;
+        }
+
+        for (std::size_t i = 0; i < adj_sorted.size(); ++i)
+            verts->push_back(adj_sorted[i].first);
+        if (vclass == MeshInfo::VERTEX_CLASS_BORDER)
+            verts->push_back(adj_sorted.back().second);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
 void
 MeshInfo::initialize (TriangleMesh::ConstPtr mesh)
 {
@@ -25,136 +148,63 @@ MeshInfo::initialize (TriangleMesh::ConstPtr mesh)
     this->vertex_info.clear();
     this->vertex_info.resize(verts.size());
 
+    /* Count adjacent faces to allocate the lists only once. */
+    std::vector<std::size_t> num_faces(verts.size(), 0);
+    for (std::size_t i = 0; i < face_amount * 3; ++i)
+        num_faces[faces[i]] += 1;
+    for (std::size_t i = 0; i < verts.size(); ++i)
+        this->vertex_info[i].faces.reserve(num_faces[i]);
+
     /* Add faces to their three vertices. */
     for (std::size_t i = 0, i3 = 0; i < face_amount; ++i)
         for (std::size_t j = 0; j < 3; ++j, ++i3)
             this->vertex_info[faces[i3]].faces.push_back(i);
 
     /* Classify each vertex and compute adjacenty info. */
+#pragma omp parallel for schedule(dynamic, 1024)
+#if !defined(_MSC_VER)
     for (std::size_t i = 0; i < this->vertex_info.size(); ++i)
+#else
+    for (int64_t i = 0; i < this->vertex_info.size(); ++i)
+#endif
         this->update_vertex(*mesh, i);
 }
 
 /* ---------------------------------------------------------------- */
 
-namespace
-{
-    /* Adjacent face representation for the ordering algorithm. */
-    struct AdjacentFace
-    {
-        std::size_t face_id;
-        std::size_t first;
-        std::size_t second;
-    };
-
-    typedef std::list<AdjacentFace> AdjacentFaceList;
-}
-
-/* ---------------------------------------------------------------- */
-
 void
 MeshInfo::update_vertex (TriangleMesh const& mesh, std::size_t vertex_id)
 {
-    TriangleMesh::FaceList const& faces = mesh.get_faces();
     VertexInfo& vinfo = this->vertex_info[vertex_id];
 
-    /* Build new, temporary adjacent faces representation for ordering. */
-    AdjacentFaceList adj_temp;
-    for (std::size_t i = 0; i < vinfo.faces.size(); ++i)
-    {
-        std::size_t face_off = vinfo.faces[i] * 3;
-        for (std::size_t j = 0; j < 3; ++j)
-            if (faces[face_off + j] == vertex_id)
-            {
-                adj_temp.push_back(AdjacentFace());
-                adj_temp.back().face_id = vinfo.faces[i];
-                adj_temp.back().first = faces[face_off + (j + 1) % 3];
-                adj_temp.back().second = faces[face_off + (j + 2) % 3];
-                break;
-            }
-    }
+    AdjacentFaceList adj_sorted, adj_temp;
+    VertexClass const vclass = order_adjacent_faces(mesh.get_faces(),
+        vertex_id, vinfo.faces.data(), vinfo.faces.size(),
+        &adj_sorted, &adj_temp);
 
     /* If there are no adjacent faces, the vertex is unreferenced. */
-    if (adj_temp.empty())
+    if (vclass == VERTEX_CLASS_UNREF)
     {
         vinfo = VertexInfo();
         vinfo.vclass = VERTEX_CLASS_UNREF;
         return;
     }
 
-    /* Sort adjacent faces by chaining them. */
-    AdjacentFaceList adj_sorted;
-    adj_sorted.push_back(adj_temp.front());
-    adj_temp.pop_front();
-    while (!adj_temp.empty())
-    {
-        std::size_t const front_id = adj_sorted.front().first;
-        std::size_t const back_id = adj_sorted.back().second;
-
-        /* Find a faces that fits the back or front of sorted list. */
-        bool found_face = false;
-        for (AdjacentFaceList::iterator iter = adj_temp.begin();
-            iter != adj_temp.end(); ++iter)
-        {
-            if (front_id == iter->second)
-            {
-                adj_sorted.push_front(*iter);
-                adj_temp.erase(iter);
-                found_face = true;
-                break;
-            }
-            if (back_id == iter->first)
-            {
-                adj_sorted.push_back(*iter);
-                adj_temp.erase(iter);
-                found_face = true;
-                break;
-            }
-        }
-
-        /* If there is no next face, the vertex is complex. */
-        if (!found_face)
-            break;
-    }
-
     /* If the vertex is complex, add unsorted adjacency information. */
-    if (!adj_temp.empty())
+    vinfo.vclass = vclass;
+    if (vclass == VERTEX_CLASS_COMPLEX)
     {
-        /* Transfer remaining adjacent faces. */
-        adj_sorted.insert(adj_sorted.end(), adj_temp.begin(), adj_temp.end());
-        adj_temp.clear();
-
-        /* Create unique list of all adjacent vertices. */
-        std::set<std::size_t> vset;
-        for (AdjacentFaceList::iterator iter = adj_sorted.begin();
-            iter != adj_sorted.end(); ++iter)
-        {
-            vset.insert(iter->first);
-            vset.insert(iter->second);
-        }
-        vinfo.verts.insert(vinfo.verts.end(), vset.begin(), vset.end());
-        vinfo.vclass = VERTEX_CLASS_COMPLEX;
+        append_adjacent_vertices(adj_sorted, vclass, &vinfo.verts);
         return;
     }
 
-    /* If the vertex is not on the mesh boundary, the list is circular. */
-    if (adj_sorted.front().first == adj_sorted.back().second)
-        vinfo.vclass = VERTEX_CLASS_SIMPLE;
-    else
-        vinfo.vclass = VERTEX_CLASS_BORDER;
-
     /* Insert the face IDs in the adjacent faces list. */
     vinfo.faces.clear();
-    for (AdjacentFaceList::iterator iter = adj_sorted.begin();
-        iter != adj_sorted.end(); ++iter)
-        vinfo.faces.push_back(iter->face_id);
+    for (std::size_t i = 0; i < adj_sorted.size(); ++i)
+        vinfo.faces.push_back(adj_sorted[i].face_id);
 
     /* Insert vertex IDs in adjacent vertex list. */
-    for (AdjacentFaceList::const_iterator iter = adj_sorted.begin();
-        iter != adj_sorted.end(); ++iter)
-        vinfo.verts.push_back(iter->first);
-    if (vinfo.vclass == VERTEX_CLASS_BORDER)
-        vinfo.verts.push_back(adj_sorted.back().second);
+    append_adjacent_vertices(adj_sorted, vclass, &vinfo.verts);
 }
 
 /* ---------------------------------------------------------------- */
@@ -174,9 +224,116 @@ MeshInfo::get_faces_for_edge (std::size_t v1, std::size_t v2,
 {
     AdjacentFaces const& faces1 = this->vertex_info[v1].faces;
     AdjacentFaces const& faces2 = this->vertex_info[v2].faces;
-    std::set<std::size_t> faces2_set(faces2.begin(), faces2.end());
     for (std::size_t i = 0; i < faces1.size(); ++i)
-        if (faces2_set.find(faces1[i]) != faces2_set.end())
+        if (std::find(faces2.begin(), faces2.end(), faces1[i]) != faces2.end())
+            adjacent_faces->push_back(faces1[i]);
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+CompactMeshInfo::initialize (TriangleMesh::ConstPtr mesh)
+{
+    TriangleMesh::FaceList const& faces = mesh->get_faces();
+    std::size_t const num_verts = mesh->get_vertices().size();
+    std::size_t const num_indices = faces.size() / 3 * 3;
+
+    /* Sort the faces by their vertices using counting sort. */
+    this->face_offsets.assign(num_verts + 1, 0);
+    for (std::size_t i = 0; i < num_indices; ++i)
+        this->face_offsets[faces[i] + 1] += 1;
+    for (std::size_t i = 0; i < num_verts; ++i)
+        this->face_offsets[i + 1] += this->face_offsets[i];
+
+    this->face_ids.resize(num_indices);
+    {
+        std::vector<std::size_t> pos(this->face_offsets.begin(),
+            this->face_offsets.end() - 1);
+        for (std::size_t i = 0; i < num_indices; ++i)
+            this->face_ids[pos[faces[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    /*
+     * Order the faces of every vertex in place and collect the adjacent
+     * vertices. A vertex has at most twice as many adjacent vertices as
+     * faces, which is reserved in a temporary array to work in parallel.
+     */
+    this->vertex_class.resize(num_verts);
+    std::vector<unsigned int> temp_ids(2 * num_indices);
+    std::vector<std::size_t> num_adjacent(num_verts, 0);
+#pragma omp parallel
+    {
+        AdjacentFaceList adj_sorted, adj_temp;
+        std::vector<unsigned int> verts;
+
+#pragma omp for schedule(dynamic, 1024)
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < num_verts; ++i)
+#else
+        for (int64_t i = 0; i < num_verts; ++i)
+#endif
+        {
+            std::size_t const offset = this->face_offsets[i];
+            std::size_t const num_faces = this->face_offsets[i + 1] - offset;
+            VertexClass const vclass = order_adjacent_faces(faces, i,
+                this->face_ids.data() + offset, num_faces,
+                &adj_sorted, &adj_temp);
+            this->vertex_class[i] = vclass;
+            if (vclass == MeshInfo::VERTEX_CLASS_UNREF)
+                continue;
+
+            /* Complex vertices keep the unordered faces. */
+            if (vclass != MeshInfo::VERTEX_CLASS_COMPLEX)
+                for (std::size_t j = 0; j < num_faces; ++j)
+                    this->face_ids[offset + j] = static_cast<unsigned int>(
+                        adj_sorted[j].face_id);
+
+            verts.clear();
+            append_adjacent_vertices(adj_sorted, vclass, &verts);
+            std::copy(verts.begin(), verts.end(),
+                temp_ids.begin() + 2 * offset);
+            num_adjacent[i] = verts.size();
+        }
+    }
+
+    /* Compact the adjacent vertices. */
+    this->vert_offsets.assign(num_verts + 1, 0);
+    for (std::size_t i = 0; i < num_verts; ++i)
+        this->vert_offsets[i + 1] = this->vert_offsets[i] + num_adjacent[i];
+    this->vert_ids.resize(this->vert_offsets.back());
+#pragma omp parallel for schedule(dynamic, 1024)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_verts; ++i)
+#else
+    for (int64_t i = 0; i < num_verts; ++i)
+#endif
+    {
+        std::vector<unsigned int>::const_iterator first
+            = temp_ids.begin() + 2 * this->face_offsets[i];
+        std::copy(first, first + num_adjacent[i],
+            this->vert_ids.begin() + this->vert_offsets[i]);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+CompactMeshInfo::is_mesh_edge (std::size_t v1, std::size_t v2) const
+{
+    IndexRange const verts = this->operator[](v1).verts;
+    return std::find(verts.begin(), verts.end(), v2) != verts.end();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+CompactMeshInfo::get_faces_for_edge (std::size_t v1, std::size_t v2,
+    std::vector<std::size_t>* adjacent_faces) const
+{
+    IndexRange const faces1 = this->operator[](v1).faces;
+    IndexRange const faces2 = this->operator[](v2).faces;
+    for (std::size_t i = 0; i < faces1.size(); ++i)
+        if (std::find(faces2.begin(), faces2.end(), faces1[i]) != faces2.end())
             adjacent_faces->push_back(faces1[i]);
 }
 
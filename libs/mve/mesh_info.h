@@ -87,6 +87,76 @@ private:
     std::vector<VertexInfo> vertex_info;
 };
 
+/* ---------------------------------------------------------------- */
+
+/**
+ * Read-only vertex adjacency with the same queries as MeshInfo, but all
+ * adjacent faces and vertices are stored in two compressed (CSR) arrays
+ * with per-vertex offsets. This avoids two allocations per vertex, and
+ * the structure is built in parallel. The classification and the order
+ * of adjacent faces and vertices are identical to MeshInfo. Use MeshInfo
+ * if the adjacency needs to be updated while the mesh is modified.
+ */
+class CompactMeshInfo
+{
+public:
+    typedef MeshInfo::VertexClass VertexClass;
+
+    /** Read-only view of a contiguous list of vertex or face IDs. */
+    class IndexRange
+    {
+    public:
+        IndexRange (unsigned int const* begin, unsigned int const* end);
+        unsigned int const* begin (void) const;
+        unsigned int const* end (void) const;
+        unsigned int operator[] (std::size_t id) const;
+        std::size_t size (void) const;
+        bool empty (void) const;
+
+    private:
+        unsigned int const* first;
+        unsigned int const* last;
+    };
+
+    /** Per-vertex classification and adjacency information. */
+    struct VertexInfo
+    {
+        VertexClass vclass;
+        IndexRange verts;
+        IndexRange faces;
+    };
+
+public:
+    /** Constructor without initialization. */
+    CompactMeshInfo (void);
+
+    /** Constructor with initialization for the given mesh. */
+    CompactMeshInfo (TriangleMesh::ConstPtr mesh);
+
+    /** Initializes the data structure for the given mesh. */
+    void initialize (TriangleMesh::ConstPtr mesh);
+
+    /** Checks for the existence of an edge between the given vertices. */
+    bool is_mesh_edge (std::size_t v1, std::size_t v2) const;
+
+    /** Returns faces adjacent to both vertices. */
+    void get_faces_for_edge (std::size_t v1, std::size_t v2,
+        std::vector<std::size_t>* adjacent_faces) const;
+
+public:
+    VertexInfo operator[] (std::size_t id) const;
+    VertexInfo at (std::size_t id) const;
+    std::size_t size (void) const;
+    void clear (void);
+
+private:
+    std::vector<VertexClass> vertex_class;
+    std::vector<std::size_t> vert_offsets;
+    std::vector<unsigned int> vert_ids;
+    std::vector<std::size_t> face_offsets;
+    std::vector<unsigned int> face_ids;
+};
+
 /* ------------------------- Implementation ----------------------- */
 
 inline
@@ -164,6 +234,92 @@ MeshInfo::VertexInfo::replace_adjacent_vertex (std::size_t old_id,
     std::replace(this->verts.begin(), this->verts.end(), old_id, new_id);
 }
 
+/* ---------------------------------------------------------------- */
+
+inline
+CompactMeshInfo::IndexRange::IndexRange (unsigned int const* begin,
+    unsigned int const* end)
+    : first(begin)
+    , last(end)
+{
+}
+
+inline unsigned int const*
+CompactMeshInfo::IndexRange::begin (void) const
+{
+    return this->first;
+}
+
+inline unsigned int const*
+CompactMeshInfo::IndexRange::end (void) const
+{
+    return this->last;
+}
+
+inline unsigned int
+CompactMeshInfo::IndexRange::operator[] (std::size_t id) const
+{
+    return this->first[id];
+}
+
+inline std::size_t
+CompactMeshInfo::IndexRange::size (void) const
+{
+    return this->last - this->first;
+}
+
+inline bool
+CompactMeshInfo::IndexRange::empty (void) const
+{
+    return this->first == this->last;
+}
+
+inline
+CompactMeshInfo::CompactMeshInfo (void)
+{
+}
+
+inline
+CompactMeshInfo::CompactMeshInfo (TriangleMesh::ConstPtr mesh)
+{
+    this->initialize(mesh);
+}
+
+inline CompactMeshInfo::VertexInfo
+CompactMeshInfo::operator[] (std::size_t id) const
+{
+    unsigned int const* verts = this->vert_ids.data();
+    unsigned int const* faces = this->face_ids.data();
+    VertexInfo info = { this->vertex_class[id],
+        IndexRange(verts + this->vert_offsets[id],
+            verts + this->vert_offsets[id + 1]),
+        IndexRange(faces + this->face_offsets[id],
+            faces + this->face_offsets[id + 1]) };
+    return info;
+}
+
+inline CompactMeshInfo::VertexInfo
+CompactMeshInfo::at (std::size_t id) const
+{
+    return this->operator[](id);
+}
+
+inline std::size_t
+CompactMeshInfo::size (void) const
+{
+    return this->vertex_class.size();
+}
+
+inline void
+CompactMeshInfo::clear (void)
+{
+    std::vector<VertexClass>().swap(this->vertex_class);
+    std::vector<std::size_t>().swap(this->vert_offsets);
+    std::vector<unsigned int>().swap(this->vert_ids);
+    std::vector<std::size_t>().swap(this->face_offsets);
+    std::vector<unsigned int>().swap(this->face_ids);
+}
+
 MVE_NAMESPACE_END
 
 #endif /* MVE_VERTEX_INFO_HEADER */
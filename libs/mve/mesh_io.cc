@@ -18,6 +18,7 @@
 #include "mve/mesh_io_pbrt.h"
 #include "mve/mesh_io_smf.h"
 #include "mve/mesh_io_obj.h"
+#include "mve/mesh_io_mvem.h"
 
 MVE_NAMESPACE_BEGIN
 MVE_GEOM_NAMESPACE_BEGIN
@@ -37,6 +38,8 @@ load_mesh (std::string const& filename)
         return load_smf_mesh(filename);
     else if (util::string::right(filename, 4) == ".obj")
         return load_obj_mesh(filename);
+    else if (util::string::right(filename, 5) == ".mvem")
+        return load_mvem_mesh(filename);
     else
         throw std::runtime_error("Extension not recognized");
 }
@@ -60,6 +63,8 @@ save_mesh (TriangleMesh::ConstPtr mesh, std::string const& filename)
         save_smf_mesh(mesh, filename);
     else if (util::string::right(filename, 4) == ".obj")
         save_obj_mesh(mesh, filename);
+    else if (util::string::right(filename, 5) == ".mvem")
+        save_mvem_mesh(mesh, filename);
     else
         throw std::runtime_error("Extension not recognized");
 }
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#   include <new>
+#else // Linux, OSX, ...
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "util/exception.h"
+#include "mve/mesh_io_mvem.h"
+
+#define MVEM_FILE_SIGNATURE "\211MVE_MESH\n\0\0\0\0\0"
+#define MVEM_FILE_SIGNATURE_LEN 16
+#define MVEM_FILE_VERSION 1
+#define MVEM_NUM_ARRAYS 9
+#define MVEM_ALIGNMENT 64
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+namespace
+{
+    /* The attribute arrays in the order they are stored in the file. */
+    enum MeshArray
+    {
+        ARRAY_VERTICES,
+        ARRAY_VERTEX_NORMALS,
+        ARRAY_VERTEX_COLORS,
+        ARRAY_VERTEX_CONFIDENCES,
+        ARRAY_VERTEX_VALUES,
+        ARRAY_VERTEX_TEXCOORDS,
+        ARRAY_FACES,
+        ARRAY_FACE_NORMALS,
+        ARRAY_FACE_COLORS
+    };
+
+    std::size_t const array_element_sizes[MVEM_NUM_ARRAYS] = {
+        sizeof(math::Vec3f), sizeof(math::Vec3f), sizeof(math::Vec4f),
+        sizeof(float), sizeof(float), sizeof(math::Vec2f),
+        sizeof(unsigned int), sizeof(math::Vec3f), sizeof(math::Vec4f)
+    };
+
+    std::size_t const header_size = MVEM_FILE_SIGNATURE_LEN
+        + 2 * sizeof(uint32_t) + MVEM_NUM_ARRAYS * 2 * sizeof(uint64_t);
+
+    std::size_t
+    align_offset (std::size_t offset)
+    {
+        return (offset + MVEM_ALIGNMENT - 1) / MVEM_ALIGNMENT * MVEM_ALIGNMENT;
+    }
+
+    template <typename T>
+    void
+    read_value (char const* data, std::size_t* pos, T* value)
+    {
+        std::memcpy(value, data + *pos, sizeof(T));
+        *pos += sizeof(T);
+    }
+
+    template <typename T>
+    void
+    write_value (std::ostream& out, T const& value)
+    {
+        out.write(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+MappedMesh::MappedMesh (std::string const& filename)
+    : filename(filename)
+    , data(nullptr)
+    , size(0)
+    , mapped(false)
+{
+    if (filename.empty())
+        throw std::invalid_argument("No filename given");
+
+#if defined(_WIN32)
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    if (!in.good())
+        throw util::FileException(filename, std::strerror(errno));
+    in.seekg(0, std::ios::end);
+    this->size = static_cast<std::size_t>(in.tellg());
+    in.seekg(0, std::ios::beg);
+    this->data = new char[std::max<std::size_t>(1, this->size)];
+    in.read(this->data, this->size);
+    if (!in.good())
+    {
+        delete [] this->data;
+        throw util::FileException(filename, std::strerror(errno));
+    }
+#else
+    int const fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw util::FileException(filename, std::strerror(errno));
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0)
+    {
+        ::close(fd);
+        throw util::FileException(filename, std::strerror(errno));
+    }
+    this->size = static_cast<std::size_t>(st.st_size);
+    if (this->size < header_size)
+    {
+        ::close(fd);
+        throw util::FileException(filename, "Truncated mesh file");
+    }
+
+    void* ptr = ::mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED)
+        throw util::FileException(filename, std::strerror(errno));
+    this->data = static_cast<char*>(ptr);
+    this->mapped = true;
+#endif
+
+    try
+    {
+        if (this->size < header_size)
+            throw util::Exception("Truncated mesh file");
+        if (!std::equal(this->data, this->data + MVEM_FILE_SIGNATURE_LEN,
+            MVEM_FILE_SIGNATURE))
+            throw util::Exception("Invalid file signature");
+
+        std::size_t pos = MVEM_FILE_SIGNATURE_LEN;
+        uint32_t version, num_arrays;
+        read_value(this->data, &pos, &version);
+        read_value(this->data, &pos, &num_arrays);
+        if (version != MVEM_FILE_VERSION || num_arrays != MVEM_NUM_ARRAYS)
+            throw util::Exception("Unsupported mesh file version");
+
+        for (int i = 0; i < MVEM_NUM_ARRAYS; ++i)
+        {
+            uint64_t offset, count;
+            read_value(this->data, &pos, &offset);
+            read_value(this->data, &pos, &count);
+            if (count > 0 && (offset % MVEM_ALIGNMENT != 0
+                || offset > this->size
+                || count > (this->size - offset) / array_element_sizes[i]))
+                throw util::Exception("Invalid array in mesh file");
+            this->offsets[i] = static_cast<std::size_t>(offset);
+            this->counts[i] = static_cast<std::size_t>(count);
+        }
+
+        if (this->counts[ARRAY_FACES] % 3 != 0)
+            throw util::Exception("Invalid amount of face indices");
+    }
+    catch (util::Exception& e)
+    {
+#if defined(_WIN32)
+        delete [] this->data;
+#else
+        ::munmap(this->data, this->size);
+#endif
+        throw util::FileException(filename, e);
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+MappedMesh::~MappedMesh (void)
+{
+#if defined(_WIN32)
+    delete [] this->data;
+#else
+    if (this->mapped)
+        ::munmap(this->data, this->size);
+#endif
+}
+
+/* ---------------------------------------------------------------- */
+
+template <typename T>
+MappedMesh::ArrayView<T>
+MappedMesh::get_array (int array) const
+{
+    if (this->counts[array] == 0)
+        return ArrayView<T>(nullptr, 0);
+    return ArrayView<T>(reinterpret_cast<T const*>(
+        this->data + this->offsets[array]), this->counts[array]);
+}
+
+MappedMesh::ArrayView<math::Vec3f>
+MappedMesh::get_vertices (void) const
+{
+    return this->get_array<math::Vec3f>(ARRAY_VERTICES);
+}
+
+MappedMesh::ArrayView<math::Vec3f>
+MappedMesh::get_vertex_normals (void) const
+{
+    return this->get_array<math::Vec3f>(ARRAY_VERTEX_NORMALS);
+}
+
+MappedMesh::ArrayView<math::Vec4f>
+MappedMesh::get_vertex_colors (void) const
+{
+    return this->get_array<math::Vec4f>(ARRAY_VERTEX_COLORS);
+}
+
+MappedMesh::ArrayView<float>
+MappedMesh::get_vertex_confidences (void) const
+{
+    return this->get_array<float>(ARRAY_VERTEX_CONFIDENCES);
+}
+
+MappedMesh::ArrayView<float>
+MappedMesh::get_vertex_values (void) const
+{
+    return this->get_array<float>(ARRAY_VERTEX_VALUES);
+}
+
+MappedMesh::ArrayView<math::Vec2f>
+MappedMesh::get_vertex_texcoords (void) const
+{
+    return this->get_array<math::Vec2f>(ARRAY_VERTEX_TEXCOORDS);
+}
+
+MappedMesh::ArrayView<unsigned int>
+MappedMesh::get_faces (void) const
+{
+    return this->get_array<unsigned int>(ARRAY_FACES);
+}
+
+MappedMesh::ArrayView<math::Vec3f>
+MappedMesh::get_face_normals (void) const
+{
+    return this->get_array<math::Vec3f>(ARRAY_FACE_NORMALS);
+}
+
+MappedMesh::ArrayView<math::Vec4f>
+MappedMesh::get_face_colors (void) const
+{
+    return this->get_array<math::Vec4f>(ARRAY_FACE_COLORS);
+}
+
+/* ---------------------------------------------------------------- */
+
+TriangleMesh::Ptr
+MappedMesh::get_mesh (void) const
+{
+    TriangleMesh::Ptr mesh = TriangleMesh::create();
+
+#define MVEM_COPY_ARRAY(getter) \
+    { auto const view = this->getter(); \
+      mesh->getter().assign(view.begin(), view.end()); }
+
+    MVEM_COPY_ARRAY(get_vertices)
+    MVEM_COPY_ARRAY(get_vertex_normals)
+    MVEM_COPY_ARRAY(get_vertex_colors)
+    MVEM_COPY_ARRAY(get_vertex_confidences)
+    MVEM_COPY_ARRAY(get_vertex_values)
+    MVEM_COPY_ARRAY(get_vertex_texcoords)
+    MVEM_COPY_ARRAY(get_faces)
+    MVEM_COPY_ARRAY(get_face_normals)
+    MVEM_COPY_ARRAY(get_face_colors)
+
+#undef MVEM_COPY_ARRAY
+
+    return mesh;
+}
+
+/* ---------------------------------------------------------------- */
+
+TriangleMesh::Ptr
+load_mvem_mesh (std::string const& filename)
+{
+    return MappedMesh::create(filename)->get_mesh();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+save_mvem_mesh (TriangleMesh::ConstPtr mesh, std::string const& filename)
+{
+    if (mesh == nullptr)
+        throw std::invalid_argument("Null mesh given");
+    if (filename.empty())
+        throw std::invalid_argument("No filename given");
+    if (mesh->get_faces().size() % 3 != 0)
+        throw std::invalid_argument("Invalid amount of face indices");
+
+    char const* arrays[MVEM_NUM_ARRAYS] = {
+        reinterpret_cast<char const*>(mesh->get_vertices().data()),
+        reinterpret_cast<char const*>(mesh->get_vertex_normals().data()),
+        reinterpret_cast<char const*>(mesh->get_vertex_colors().data()),
+        reinterpret_cast<char const*>(mesh->get_vertex_confidences().data()),
+        reinterpret_cast<char const*>(mesh->get_vertex_values().data()),
+        reinterpret_cast<char const*>(mesh->get_vertex_texcoords().data()),
+        reinterpret_cast<char const*>(mesh->get_faces().data()),
+        reinterpret_cast<char const*>(mesh->get_face_normals().data()),
+        reinterpret_cast<char const*>(mesh->get_face_colors().data())
+    };
+    uint64_t const counts[MVEM_NUM_ARRAYS] = {
+        mesh->get_vertices().size(),
+        mesh->get_vertex_normals().size(),
+        mesh->get_vertex_colors().size(),
+        mesh->get_vertex_confidences().size(),
+        mesh->get_vertex_values().size(),
+        mesh->get_vertex_texcoords().size(),
+        mesh->get_faces().size(),
+        mesh->get_face_normals().size(),
+        mesh->get_face_colors().size()
+    };
+
+    /* Place the arrays at aligned offsets after the header. */
+    uint64_t offsets[MVEM_NUM_ARRAYS];
+    std::size_t pos = align_offset(header_size);
+    for (int i = 0; i < MVEM_NUM_ARRAYS; ++i)
+    {
+        offsets[i] = counts[i] > 0 ? pos : 0;
+        pos = align_offset(pos + counts[i] * array_element_sizes[i]);
+    }
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    out.write(MVEM_FILE_SIGNATURE, MVEM_FILE_SIGNATURE_LEN);
+    write_value(out, static_cast<uint32_t>(MVEM_FILE_VERSION));
+    write_value(out, static_cast<uint32_t>(MVEM_NUM_ARRAYS));
+    for (int i = 0; i < MVEM_NUM_ARRAYS; ++i)
+    {
+        write_value(out, offsets[i]);
+        write_value(out, counts[i]);
+    }
+
+    char const padding[MVEM_ALIGNMENT] = { 0 };
+    pos = header_size;
+    for (int i = 0; i < MVEM_NUM_ARRAYS; ++i)
+    {
+        if (counts[i] == 0)
+            continue;
+        out.write(padding, offsets[i] - pos);
+        std::size_t const bytes = counts[i] * array_element_sizes[i];
+        out.write(arrays[i], bytes);
+        pos = offsets[i] + bytes;
+    }
+    out.write(padding, align_offset(pos) - pos);
+
+    out.close();
+    if (!out.good())
+        throw util::FileException(filename, std::strerror(errno));
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
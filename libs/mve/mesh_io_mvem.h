@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_MESH_IO_MVEM_HEADER
+#define MVE_MESH_IO_MVEM_HEADER
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "math/vector.h"
+#include "mve/defines.h"
+#include "mve/mesh.h"
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+/**
+ * Read-only view of a mesh in the native MVE mesh format (.mvem).
+ *
+ * The format stores the mesh attributes as raw arrays in native byte order,
+ * each aligned to 64 bytes. On POSIX systems the file is memory-mapped and
+ * the arrays are accessed in place without copying or parsing, so opening
+ * even huge meshes is instant and pages are loaded on demand. On other
+ * systems the file is read into memory.
+ */
+class MappedMesh
+{
+public:
+    typedef std::shared_ptr<MappedMesh> Ptr;
+    typedef std::shared_ptr<MappedMesh const> ConstPtr;
+
+    /** Range of elements of an attribute array in the file. */
+    template <typename T>
+    class ArrayView
+    {
+    public:
+        ArrayView (T const* data, std::size_t size);
+        T const* begin (void) const;
+        T const* end (void) const;
+        T const& operator[] (std::size_t index) const;
+        std::size_t size (void) const;
+        bool empty (void) const;
+
+    private:
+        T const* data;
+        std::size_t num;
+    };
+
+public:
+    /** Opens the given file, throws on error. */
+    static Ptr create (std::string const& filename);
+    ~MappedMesh (void);
+
+    ArrayView<math::Vec3f> get_vertices (void) const;
+    ArrayView<math::Vec3f> get_vertex_normals (void) const;
+    ArrayView<math::Vec4f> get_vertex_colors (void) const;
+    ArrayView<float> get_vertex_confidences (void) const;
+    ArrayView<float> get_vertex_values (void) const;
+    ArrayView<math::Vec2f> get_vertex_texcoords (void) const;
+    /** Returns the vertex indices, three per face. */
+    ArrayView<unsigned int> get_faces (void) const;
+    ArrayView<math::Vec3f> get_face_normals (void) const;
+    ArrayView<math::Vec4f> get_face_colors (void) const;
+
+    /** Copies the arrays into a new triangle mesh. */
+    TriangleMesh::Ptr get_mesh (void) const;
+
+private:
+    MappedMesh (std::string const& filename);
+    MappedMesh (MappedMesh const& other) = delete;
+    MappedMesh& operator= (MappedMesh const& other) = delete;
+
+    template <typename T>
+    ArrayView<T> get_array (int array) const;
+
+private:
+    std::string filename;
+    char* data;
+    std::size_t size;
+    bool mapped;
+    std::size_t offsets[9];
+    std::size_t counts[9];
+};
+
+/**
+ * Loads a mesh in the native MVE mesh format. The attribute arrays are
+ * copied in bulk from the memory-mapped file.
+ */
+TriangleMesh::Ptr
+load_mvem_mesh (std::string const& filename);
+
+/**
+ * Saves a mesh in the native MVE mesh format.
+ */
+void
+save_mvem_mesh (TriangleMesh::ConstPtr mesh, std::string const& filename);
+
+/* ------------------------- Implementation ----------------------- */
+
+template <typename T>
+inline
+MappedMesh::ArrayView<T>::ArrayView (T const* data, std::size_t size)
+    : data(data)
+    , num(size)
+{
+}
+
+template <typename T>
+inline T const*
+MappedMesh::ArrayView<T>::begin (void) const
+{
+    return this->data;
+}
+
+template <typename T>
+inline T const*
+MappedMesh::ArrayView<T>::end (void) const
+{
+    return this->data + this->num;
+}
+
+template <typename T>
+inline T const&
+MappedMesh::ArrayView<T>::operator[] (std::size_t index) const
+{
+    return this->data[index];
+}
+
+template <typename T>
+inline std::size_t
+MappedMesh::ArrayView<T>::size (void) const
+{
+    return this->num;
+}
+
+template <typename T>
+inline bool
+MappedMesh::ArrayView<T>::empty (void) const
+{
+    return this->num == 0;
+}
+
+inline MappedMesh::Ptr
+MappedMesh::create (std::string const& filename)
+{
+    return Ptr(new MappedMesh(filename));
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
+
+#endif /* MVE_MESH_IO_MVEM_HEADER */
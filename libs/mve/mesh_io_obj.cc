@@ -7,11 +7,17 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <unordered_map>
 #include <cerrno>
+#include <cfloat>
+#include <cstdint>
+#include <cstdlib>
 #include <cstring>
-#include <map>
 
 #include "util/string.h"
 #include "util/tokenizer.h"
@@ -19,6 +25,11 @@
 #include "util/file_system.h"
 #include "mve/mesh_io_obj.h"
 
+/* Size of the file segments that are read at once. */
+#define OBJ_SEGMENT_SIZE (64 << 20)
+/* Number of chunks per segment that are parsed in parallel. */
+#define OBJ_NUM_CHUNKS 64
+
 MVE_NAMESPACE_BEGIN
 MVE_GEOM_NAMESPACE_BEGIN
 
@@ -31,7 +42,7 @@ namespace
         unsigned int normal_id;
 
         ObjVertex (void);
-        bool operator< (ObjVertex const & other) const;
+        bool operator== (ObjVertex const& other) const;
     };
 
     inline
@@ -43,10 +54,411 @@ namespace
     }
 
     inline bool
-    ObjVertex::operator< (ObjVertex const & other) const
+    ObjVertex::operator== (ObjVertex const& other) const
+    {
+        return vertex_id == other.vertex_id
+            && texcoord_id == other.texcoord_id
+            && normal_id == other.normal_id;
+    }
+
+    struct ObjVertexHash
     {
-        return std::lexicographical_compare(&vertex_id, &normal_id + 1,
-            &other.vertex_id, &other.normal_id + 1);
+        std::size_t operator() (ObjVertex const& v) const
+        {
+            uint64_t hash = v.vertex_id;
+            hash = hash * 0x9e3779b97f4a7c15ULL + v.texcoord_id;
+            hash = hash * 0x9e3779b97f4a7c15ULL + v.normal_id;
+            return static_cast<std::size_t>(hash ^ (hash >> 32));
+        }
+    };
+
+    /* Statements that are evaluated in file order when merging chunks. */
+    struct ObjStatement
+    {
+        enum Type
+        {
+            OBJ_COMMENT,
+            OBJ_USEMTL,
+            OBJ_MTLLIB,
+            OBJ_UNSUPPORTED
+        };
+
+        Type type;
+        /* Amount of face vertices in the chunk before the statement. */
+        std::size_t face_pos;
+        std::string argument;
+    };
+
+    /*
+     * The records parsed from a newline-aligned chunk of the OBJ file.
+     * Face indices are global, but may refer to elements of previous
+     * chunks. For each element type, the largest such reference beyond
+     * the elements of the chunk is kept to validate the indices.
+     */
+    struct ObjChunk
+    {
+        std::vector<math::Vec3f> vertices;
+        std::vector<math::Vec2f> texcoords;
+        std::vector<math::Vec3f> normals;
+        std::vector<ObjVertex> face_vertices;
+        std::vector<ObjStatement> statements;
+        unsigned int required[3];
+        char const* required_line[3];
+        std::string error;
+
+        void clear (void);
+    };
+
+    void
+    ObjChunk::clear (void)
+    {
+        this->vertices.clear();
+        this->texcoords.clear();
+        this->normals.clear();
+        this->face_vertices.clear();
+        this->statements.clear();
+        std::fill(this->required, this->required + 3, 0);
+        std::fill(this->required_line, this->required_line + 3, nullptr);
+        this->error.clear();
+    }
+
+    inline bool
+    obj_is_space (char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    /* Returns the token starting at 'pos' and advances 'pos'. */
+    inline bool
+    obj_next_token (char const** pos, char const* end,
+        char const** token_begin, char const** token_end)
+    {
+        char const* p = *pos;
+        while (p != end && obj_is_space(*p))
+            ++p;
+        if (p == end)
+        {
+            *pos = p;
+            return false;
+        }
+        *token_begin = p;
+        while (p != end && !obj_is_space(*p))
+            ++p;
+        *token_end = p;
+        *pos = p;
+        return true;
+    }
+
+    /*
+     * Parses a float without allocations. Decimal numbers with at most 19
+     * significant digits and small exponents are converted in double
+     * precision, which is exact, and then rounded to float. The rare cases
+     * where this is not guaranteed to match the correctly rounded result
+     * are handled by strtof.
+     */
+    bool
+    obj_parse_float (char const* begin, char const* end, float* value)
+    {
+        static double const powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        char const* p = begin;
+        bool const negative = p != end && *p == '-';
+        if (p != end && (*p == '-' || *p == '+'))
+            ++p;
+
+        uint64_t mantissa = 0;
+        int num_digits = 0;
+        int exponent = 0;
+        bool valid = false;
+        for (; p != end && *p >= '0' && *p <= '9'; ++p, valid = true)
+        {
+            if (num_digits < 19)
+                mantissa = mantissa * 10 + (*p - '0');
+            else
+                exponent += 1;
+            num_digits += mantissa > 0;
+        }
+        if (p != end && *p == '.')
+        {
+            for (++p; p != end && *p >= '0' && *p <= '9'; ++p, valid = true)
+            {
+                if (num_digits >= 19)
+                    continue;
+                mantissa = mantissa * 10 + (*p - '0');
+                num_digits += mantissa > 0;
+                exponent -= 1;
+            }
+        }
+        if (valid && p != end && (*p == 'e' || *p == 'E'))
+        {
+            ++p;
+            bool const exp_negative = p != end && *p == '-';
+            if (p != end && (*p == '-' || *p == '+'))
+                ++p;
+            int exp_value = 0;
+            valid = p != end && *p >= '0' && *p <= '9';
+            for (; p != end && *p >= '0' && *p <= '9'; ++p)
+                exp_value = std::min(exp_value * 10 + (*p - '0'), 10000);
+            exponent += exp_negative ? -exp_value : exp_value;
+        }
+
+        if (valid && p == end && mantissa < (uint64_t(1) << 53)
+            && exponent >= -22 && exponent <= 22)
+        {
+            double result = static_cast<double>(mantissa);
+            if (exponent < 0)
+                result /= powers[-exponent];
+            else
+                result *= powers[exponent];
+
+            /*
+             * Rounding the double to float is correct unless the double
+             * is exactly halfway between two floats, or out of range.
+             */
+            uint64_t bits;
+            std::memcpy(&bits, &result, sizeof(double));
+            if (result == 0.0 || (result >= FLT_MIN && result <= FLT_MAX
+                && (bits & 0x1fffffffULL) != 0x10000000ULL))
+            {
+                *value = static_cast<float>(negative ? -result : result);
+                return true;
+            }
+        }
+
+        /* Fall back to strtof on a null-terminated copy of the token. */
+        char buffer[64];
+        std::size_t const length = end - begin;
+        if (length == 0 || length >= sizeof(buffer))
+            return false;
+        std::copy(begin, end, buffer);
+        buffer[length] = '\0';
+        char* parse_end = nullptr;
+        errno = 0;
+        *value = std::strtof(buffer, &parse_end);
+        return parse_end == buffer + length && errno != ERANGE;
+    }
+
+    /* Parses a non-negative index, an empty token yields zero. */
+    bool
+    obj_parse_index (char const* begin, char const* end, unsigned int* index)
+    {
+        uint64_t value = 0;
+        for (char const* p = begin; p != end; ++p)
+        {
+            if (*p < '0' || *p > '9')
+                return false;
+            value = value * 10 + (*p - '0');
+            if (value > std::numeric_limits<unsigned int>::max())
+                return false;
+        }
+        *index = static_cast<unsigned int>(value);
+        return true;
+    }
+
+    /* Parses a face vertex in one of the forms v, v/vt, v//vn or v/vt/vn. */
+    bool
+    obj_parse_face_vertex (char const* begin, char const* end, ObjVertex* v)
+    {
+        char const* parts[4] = { begin, end, end, end };
+        int num_parts = 1;
+        for (char const* p = begin; p != end; ++p)
+        {
+            if (*p != '/')
+                continue;
+            if (num_parts == 3)
+                return false;
+            parts[num_parts] = p;
+            num_parts += 1;
+        }
+        parts[num_parts] = end;
+
+        if (!obj_parse_index(parts[0], parts[1], &v->vertex_id)
+            || v->vertex_id == 0)
+            return false;
+        if (num_parts > 1 && !obj_parse_index(parts[1] + 1, parts[2],
+            &v->texcoord_id))
+            return false;
+        if (num_parts > 2 && !obj_parse_index(parts[2] + 1, parts[3],
+            &v->normal_id))
+            return false;
+        return true;
+    }
+
+    /* Parses up to 'max_values' floats, returns the amount of values. */
+    int
+    obj_parse_values (char const* pos, char const* end,
+        float* values, int max_values)
+    {
+        int num_values = 0;
+        char const* token_begin;
+        char const* token_end;
+        while (obj_next_token(&pos, end, &token_begin, &token_end))
+        {
+            if (num_values == max_values)
+                return -1;
+            if (!obj_parse_float(token_begin, token_end, values + num_values))
+                return -1;
+            num_values += 1;
+        }
+        return num_values;
+    }
+
+    /* Updates the largest reference to elements of previous chunks. */
+    inline void
+    obj_require (ObjChunk* chunk, int type, unsigned int id,
+        std::size_t num_local, char const* line)
+    {
+        if (id <= num_local)
+            return;
+        unsigned int const required = id - num_local;
+        if (required <= chunk->required[type])
+            return;
+        chunk->required[type] = required;
+        chunk->required_line[type] = line;
+    }
+
+    /* Parses a single line, returns an error message on failure. */
+    char const*
+    obj_parse_line (char const* line, char const* end, ObjChunk* chunk)
+    {
+        char const* pos = line;
+        char const* key_begin;
+        char const* key_end;
+        if (!obj_next_token(&pos, end, &key_begin, &key_end))
+            return nullptr;
+
+        std::size_t const key_length = key_end - key_begin;
+        if (*key_begin == '#')
+        {
+            ObjStatement statement;
+            statement.type = ObjStatement::OBJ_COMMENT;
+            statement.face_pos = chunk->face_vertices.size();
+            while (end != key_begin && obj_is_space(end[-1]))
+                --end;
+            statement.argument.assign(key_begin, end);
+            chunk->statements.push_back(statement);
+        }
+        else if (key_length == 1 && *key_begin == 'v')
+        {
+            float values[4];
+            int const num_values = obj_parse_values(pos, end, values, 4);
+            if (num_values != 3 && num_values != 4)
+                return "Invalid vertex coordinate specification";
+
+            math::Vec3f vertex(values);
+            /* Convert homogeneous coordinates. */
+            if (num_values == 4)
+                vertex /= values[3];
+            chunk->vertices.push_back(vertex);
+        }
+        else if (key_length == 2 && key_begin[0] == 'v' && key_begin[1] == 't')
+        {
+            float values[3];
+            int const num_values = obj_parse_values(pos, end, values, 3);
+            if (num_values != 2 && num_values != 3)
+                return "Invalid texture coords specification";
+
+            math::Vec2f texcoord(values);
+            /* Convert homogeneous coordinates. */
+            if (num_values == 3)
+                texcoord /= values[2];
+            /* Invert y coordinate */
+            texcoord[1] = 1.0f - texcoord[1];
+            chunk->texcoords.push_back(texcoord);
+        }
+        else if (key_length == 2 && key_begin[0] == 'v' && key_begin[1] == 'n')
+        {
+            float values[4];
+            int const num_values = obj_parse_values(pos, end, values, 4);
+            if (num_values != 3 && num_values != 4)
+                return "Invalid vertex normal specification";
+
+            math::Vec3f normal(values);
+            /* Convert homogeneous coordinates. */
+            if (num_values == 4)
+                normal /= values[3];
+            chunk->normals.push_back(normal);
+        }
+        else if (key_length == 1 && *key_begin == 'f')
+        {
+            ObjVertex face[3];
+            char const* token_begin;
+            char const* token_end;
+            int num_verts = 0;
+            while (obj_next_token(&pos, end, &token_begin, &token_end))
+            {
+                if (num_verts == 3)
+                    return "Only triangles supported";
+                if (!obj_parse_face_vertex(token_begin, token_end,
+                    face + num_verts))
+                    return "Invalid face specification";
+                num_verts += 1;
+            }
+            if (num_verts != 3)
+                return "Only triangles supported";
+
+            for (int i = 0; i < 3; ++i)
+            {
+                obj_require(chunk, 0, face[i].vertex_id,
+                    chunk->vertices.size(), line);
+                obj_require(chunk, 1, face[i].texcoord_id,
+                    chunk->texcoords.size(), line);
+                obj_require(chunk, 2, face[i].normal_id,
+                    chunk->normals.size(), line);
+                chunk->face_vertices.push_back(face[i]);
+            }
+        }
+        else
+        {
+            ObjStatement statement;
+            statement.type = ObjStatement::OBJ_UNSUPPORTED;
+            statement.face_pos = chunk->face_vertices.size();
+            statement.argument.assign(key_begin, key_end);
+
+            char const* arg_begin;
+            char const* arg_end;
+            bool const usemtl = statement.argument == "usemtl";
+            bool const mtllib = statement.argument == "mtllib";
+            if (usemtl || mtllib)
+            {
+                if (!obj_next_token(&pos, end, &arg_begin, &arg_end)
+                    || obj_next_token(&pos, end, &key_begin, &key_end))
+                {
+                    return usemtl
+                        ? "Invalid usemtl specification"
+                        : "Invalid material library specification";
+                }
+                statement.type = usemtl
+                    ? ObjStatement::OBJ_USEMTL
+                    : ObjStatement::OBJ_MTLLIB;
+                statement.argument.assign(arg_begin, arg_end);
+            }
+            chunk->statements.push_back(statement);
+        }
+
+        return nullptr;
+    }
+
+    /* Parses all lines of a chunk that starts and ends at line boundaries. */
+    void
+    obj_parse_chunk (char const* begin, char const* end, ObjChunk* chunk)
+    {
+        chunk->clear();
+        while (begin != end)
+        {
+            char const* line_end = std::find(begin, end, '\n');
+            char const* error = obj_parse_line(begin, line_end, chunk);
+            if (error != nullptr)
+            {
+                chunk->error = std::string(error) + " in: "
+                    + std::string(begin, line_end);
+                return;
+            }
+            begin = line_end == end ? end : line_end + 1;
+        }
     }
 }
 
@@ -114,6 +526,36 @@ load_mtl_file (std::string const& filename,
     input.close();
 }
 
+/* Moves the mesh into a new model part, if the mesh is not empty. */
+void
+obj_add_model_part (mve::TriangleMesh::Ptr mesh,
+    std::string const& texture_filename,
+    std::vector<ObjModelPart>* obj_model_parts)
+{
+    mve::TriangleMesh::VertexList& vertices = mesh->get_vertices();
+    mve::TriangleMesh::NormalList& normals = mesh->get_vertex_normals();
+    mve::TriangleMesh::TexCoordList& texcoords = mesh->get_vertex_texcoords();
+
+    if (!texcoords.empty() && texcoords.size() != vertices.size())
+        throw util::Exception("Invalid number of texture coords");
+    if (!normals.empty() && normals.size() != vertices.size())
+        throw util::Exception("Invalid number of vertex normals");
+
+    if (!vertices.empty())
+    {
+        ObjModelPart obj_model_part;
+        obj_model_part.mesh = mve::TriangleMesh::create();
+        std::swap(vertices, obj_model_part.mesh->get_vertices());
+        std::swap(texcoords, obj_model_part.mesh->get_vertex_texcoords());
+        std::swap(normals, obj_model_part.mesh->get_vertex_normals());
+        std::swap(mesh->get_faces(), obj_model_part.mesh->get_faces());
+        obj_model_part.texture_filename = texture_filename;
+        obj_model_parts->push_back(obj_model_part);
+    }
+
+    mesh->clear();
+}
+
 mve::TriangleMesh::Ptr
 load_obj_mesh (std::string const& filename)
 {
@@ -150,169 +592,159 @@ load_obj_mesh (std::string const& filename,
     mve::TriangleMesh::TexCoordList& texcoords = mesh->get_vertex_texcoords();
     mve::TriangleMesh::FaceList& faces = mesh->get_faces();
 
-    typedef std::map<ObjVertex, unsigned int> VertexIndexMap;
+    typedef std::unordered_map<ObjVertex, unsigned int, ObjVertexHash>
+        VertexIndexMap;
     VertexIndexMap vertex_map;
     std::string material_name;
-    std::string new_material_name;
-    std::string buffer;
-    while (input.good())
-    {
-        std::getline(input, buffer);
-        util::string::clip_newlines(&buffer);
-        util::string::clip_whitespaces(&buffer);
-
-        if (input.eof() || !new_material_name.empty())
-        {
-            if (!texcoords.empty() && texcoords.size() != vertices.size())
-                throw util::Exception("Invalid number of texture coords");
-            if (!normals.empty() && normals.size() != vertices.size())
-                throw util::Exception("Invalid number of vertex normals");
-
-            if (!vertices.empty())
-            {
-                ObjModelPart obj_model_part;
-                obj_model_part.mesh = mve::TriangleMesh::create();
-                std::swap(vertices, obj_model_part.mesh->get_vertices());
-                std::swap(texcoords, obj_model_part.mesh->get_vertex_texcoords());
-                std::swap(normals, obj_model_part.mesh->get_vertex_normals());
-                std::swap(faces, obj_model_part.mesh->get_faces());
-                obj_model_part.texture_filename = materials[material_name];
-                obj_model_parts->push_back(obj_model_part);
-            }
-
-            mesh->clear();
-            vertex_map.clear();
-
-            material_name.swap(new_material_name);
-            new_material_name.clear();
-        }
-
-        if (buffer.empty())
-            continue;
-        if (input.eof())
-            break;
 
-        if (buffer[0] == '#')
+    /*
+     * The file is read in segments, which are split into newline-aligned
+     * chunks and parsed in parallel. The chunks are then merged in file
+     * order, which assigns the mesh vertices and creates the model parts.
+     */
+    input.seekg(0, std::ios::end);
+    std::size_t remaining = input.tellg();
+    input.seekg(0, std::ios::beg);
+
+    std::vector<char> text;
+    std::vector<ObjChunk> chunks(OBJ_NUM_CHUNKS);
+    bool eof = false;
+    while (!eof)
+    {
+        std::size_t const leftover = text.size();
+        std::size_t const read_size = std::min(remaining,
+            std::size_t(OBJ_SEGMENT_SIZE));
+        text.resize(leftover + read_size);
+        input.read(text.data() + leftover, read_size);
+        if (static_cast<std::size_t>(input.gcount()) != read_size)
+            throw util::FileException(filename, "Error reading file");
+        remaining -= read_size;
+        eof = remaining == 0;
+
+        /* Keep the incomplete last line for the next segment. */
+        std::size_t segment_size = text.size();
+        if (!eof)
         {
-            /* Print all comments to STDOUT and forget data. */
-            std::cout << "OBJ Loader: " << buffer << std::endl;
-            continue;
+            std::vector<char>::reverse_iterator iter
+                = std::find(text.rbegin(), text.rend(), '\n');
+            if (iter == text.rend())
+                continue;
+            segment_size = text.rend() - iter;
         }
 
-        util::Tokenizer line;
-        line.split(buffer);
-
-        if (line[0] == "v")
+        std::vector<std::size_t> bounds(OBJ_NUM_CHUNKS + 1, segment_size);
+        bounds[0] = 0;
+        for (std::size_t i = 1; i < OBJ_NUM_CHUNKS; ++i)
         {
-            if (line.size() != 4 && line.size() != 5)
-                throw util::Exception("Invalid vertex coordinate specification");
-
-            math::Vec3f vertex(0.0f);
-            for (int i = 0; i < 3; ++i)
-                vertex[i] = util::string::convert<float>(line[1 + i]);
-
-            /* Convert homogeneous coordinates. */
-            if (line.size() == 5)
-                vertex /= util::string::convert<float>(line[4]);
-
-            global_vertices.push_back(vertex);
+            std::size_t pos = std::max(bounds[i - 1],
+                i * segment_size / OBJ_NUM_CHUNKS);
+            while (pos > bounds[i - 1] && pos < segment_size
+                && text[pos - 1] != '\n')
+                pos += 1;
+            bounds[i] = pos;
         }
-        else if (line[0] == "vt")
-        {
-            if (line.size() != 3 && line.size() != 4)
-                throw util::Exception("Invalid texture coords specification");
 
-            math::Vec2f texcoord(0.0f);
-            for (int i = 0; i < 2; ++i)
-                texcoord[i] = util::string::convert<float>(line[1 + i]);
+#pragma omp parallel for schedule(dynamic)
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+#else
+        for (int64_t i = 0; i < chunks.size(); ++i)
+#endif
+            obj_parse_chunk(text.data() + bounds[i],
+                text.data() + bounds[i + 1], &chunks[i]);
 
-            /* Convert homogeneous coordinates. */
-            if (line.size() == 4)
-                texcoord /= util::string::convert<float>(line[3]);
-
-            /* Invert y coordinate */
-            texcoord[1] = 1.0f - texcoord[1];
-
-            global_texcoords.push_back(texcoord);
-        }
-        else if (line[0] == "vn")
+        for (std::size_t i = 0; i < chunks.size(); ++i)
         {
-            if (line.size() != 4 && line.size() != 5)
-                util::Exception("Invalid vertex normal specification");
-
-            math::Vec3f normal(0.0f);
-            for (int i = 0; i < 3; ++i)
-                normal[i] = util::string::convert<float>(line[1 + i]);
+            ObjChunk const& chunk = chunks[i];
+            if (!chunk.error.empty())
+                throw util::Exception(chunk.error);
+
+            /* Check references to elements of previous chunks. */
+            std::size_t const num_global[3] = { global_vertices.size(),
+                global_texcoords.size(), global_normals.size() };
+            for (int j = 0; j < 3; ++j)
+            {
+                if (chunk.required[j] <= num_global[j])
+                    continue;
+                char const* line_begin = chunk.required_line[j];
+                char const* text_end = text.data() + segment_size;
+                char const* line_end = std::find(line_begin, text_end, '\n');
+                throw util::Exception("Invalid index in: "
+                    + std::string(line_begin, line_end));
+            }
 
-            /* Convert homogeneous coordinates. */
-            if (line.size() == 5)
-                normal /= util::string::convert<float>(line[4]);
+            global_vertices.insert(global_vertices.end(),
+                chunk.vertices.begin(), chunk.vertices.end());
+            global_texcoords.insert(global_texcoords.end(),
+                chunk.texcoords.begin(), chunk.texcoords.end());
+            global_normals.insert(global_normals.end(),
+                chunk.normals.begin(), chunk.normals.end());
 
-            global_normals.push_back(normal);
-        }
-        else if (line[0] == "f")
-        {
-            if (line.size() != 4)
-                throw util::Exception("Only triangles supported");
-
-            for (int i = 0; i < 3; ++i)
+            std::size_t face_pos = 0;
+            for (std::size_t j = 0; j <= chunk.statements.size(); ++j)
             {
-                util::Tokenizer tok;
-                tok.split(line[1 + i], '/');
-
-                if (tok.size() > 3)
-                    throw util::Exception("Invalid face specification");
-
-                ObjVertex v;
-                v.vertex_id = util::string::convert<unsigned int>(tok[0]);
-                if (tok.size() > 2 && !tok[1].empty())
-                    v.texcoord_id = util::string::convert<unsigned int>(tok[1]);
-                if (tok.size() == 3 && !tok[2].empty())
-                    v.normal_id = util::string::convert<unsigned int>(tok[2]);
-
-                if (v.vertex_id > global_vertices.size()
-                    || v.texcoord_id > global_texcoords.size()
-                    || v.normal_id > global_normals.size())
-                    throw util::Exception("Invalid index in: " + buffer);
-
-                VertexIndexMap::const_iterator iter = vertex_map.find(v);
-                if (iter != vertex_map.end())
+                /* Add the faces up to the next statement. */
+                std::size_t const face_end = j < chunk.statements.size()
+                    ? chunk.statements[j].face_pos
+                    : chunk.face_vertices.size();
+                for (; face_pos < face_end; ++face_pos)
                 {
-                    faces.push_back(iter->second);
+                    ObjVertex const& v = chunk.face_vertices[face_pos];
+                    std::pair<VertexIndexMap::iterator, bool> result
+                        = vertex_map.insert(std::make_pair(v,
+                        static_cast<unsigned int>(vertices.size())));
+                    if (result.second)
+                    {
+                        vertices.push_back(global_vertices[v.vertex_id - 1]);
+                        if (v.texcoord_id != 0)
+                            texcoords.push_back(
+                                global_texcoords[v.texcoord_id - 1]);
+                        if (v.normal_id != 0)
+                            normals.push_back(global_normals[v.normal_id - 1]);
+                    }
+                    faces.push_back(result.first->second);
                 }
-                else
+
+                if (j == chunk.statements.size())
+                    break;
+
+                ObjStatement const& statement = chunk.statements[j];
+                switch (statement.type)
                 {
-                    vertices.push_back(global_vertices[v.vertex_id - 1]);
-                    if (v.texcoord_id != 0)
-                        texcoords.push_back(global_texcoords[v.texcoord_id - 1]);
-                    if (v.normal_id != 0)
-                        normals.push_back(global_normals[v.normal_id - 1]);
-                    faces.push_back(vertices.size() - 1);
-                    vertex_map[v] = vertices.size() - 1;
+                    case ObjStatement::OBJ_COMMENT:
+                        /* Print all comments to STDOUT and forget data. */
+                        std::cout << "OBJ Loader: "
+                            << statement.argument << std::endl;
+                        break;
+
+                    case ObjStatement::OBJ_USEMTL:
+                        obj_add_model_part(mesh, materials[material_name],
+                            obj_model_parts);
+                        vertex_map.clear();
+                        material_name = statement.argument;
+                        break;
+
+                    case ObjStatement::OBJ_MTLLIB:
+                    {
+                        std::string dir = util::fs::dirname(filename);
+                        load_mtl_file(util::fs::join_path(dir,
+                            statement.argument), &materials);
+                        break;
+                    }
+
+                    default:
+                        std::cout << "OBJ Loader: Skipping unsupported "
+                            "element: " << statement.argument << std::endl;
+                        break;
                 }
             }
         }
-        else if (line[0] == "usemtl")
-        {
-            if (line.size() != 2)
-                throw util::Exception("Invalid usemtl specification");
-            new_material_name = line[1];
-        }
-        else if (line[0] == "mtllib")
-        {
-            if (line.size() != 2)
-                throw util::Exception("Invalid material library specification");
 
-            std::string dir = util::fs::dirname(filename);
-            load_mtl_file(util::fs::join_path(dir, line[1]), &materials);
-        }
-        else
-        {
-            std::cout << "OBJ Loader: Skipping unsupported element: "
-                << line[0] << std::endl;
-        }
+        text.erase(text.begin(), text.begin() + segment_size);
     }
 
+    obj_add_model_part(mesh, materials[material_name], obj_model_parts);
+
     /* Close the file stream. */
     input.close();
 }
@@ -7,9 +7,11 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <stdexcept>
+#include <vector>
 #include <cstring>
 #include <cerrno>
 
@@ -20,6 +22,11 @@
 #include "mve/depthmap.h"
 #include "mve/mesh_io_ply.h"
 
+/* Number of vertices or faces per block in binary PLY files. */
+#define PLY_BLOCK_SIZE 65536
+/* Minimum size of the read buffer for binary PLY files. */
+#define PLY_BUFFER_SIZE (1 << 20)
+
 MVE_NAMESPACE_BEGIN
 MVE_GEOM_NAMESPACE_BEGIN
 
@@ -117,6 +124,408 @@ ply_color_convert (float const* src, unsigned char* dest, int num = 3)
     }
 }
 
+/* ---------------------------------------------------------------- */
+
+/* Decodes a binary value from memory given the PLY format. */
+template <typename T>
+inline T
+ply_decode_value (char const* data, PLYFormat format)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return format == PLY_BINARY_BE
+        ? util::system::betoh(value)
+        : util::system::letoh(value);
+}
+
+/*
+ * Buffered reader for the data section of binary PLY files. The data is
+ * read from the stream in large blocks, and records are decoded directly
+ * from the buffer instead of reading every value from the stream.
+ */
+class PLYBlockReader
+{
+public:
+    PLYBlockReader (std::istream& input);
+
+    /* Makes 'size' bytes available, returns false if EOF is reached. */
+    bool request (std::size_t size);
+    /* Returns a pointer to the current position in the buffer. */
+    char const* data (void) const;
+    /* Advances the current position in the buffer. */
+    void consume (std::size_t size);
+    /* Returns the number of bytes available in the buffer. */
+    std::size_t available (void) const;
+    /* Positions the stream after the consumed data. */
+    void release (void);
+
+private:
+    bool fill (std::size_t size);
+
+private:
+    std::istream& input;
+    std::streampos start;
+    std::streamoff offset;
+    std::vector<char> buffer;
+    std::size_t pos;
+    std::size_t end;
+};
+
+PLYBlockReader::PLYBlockReader (std::istream& input)
+    : input(input)
+    , start(input.tellg())
+    , offset(0)
+    , pos(0)
+    , end(0)
+{
+}
+
+inline bool
+PLYBlockReader::request (std::size_t size)
+{
+    return this->end - this->pos >= size || this->fill(size);
+}
+
+inline char const*
+PLYBlockReader::data (void) const
+{
+    return this->buffer.data() + this->pos;
+}
+
+inline void
+PLYBlockReader::consume (std::size_t size)
+{
+    this->pos += size;
+}
+
+inline std::size_t
+PLYBlockReader::available (void) const
+{
+    return this->end - this->pos;
+}
+
+bool
+PLYBlockReader::fill (std::size_t size)
+{
+    /* Move the remaining data to the front and read the next block. */
+    std::copy(this->buffer.begin() + this->pos,
+        this->buffer.begin() + this->end, this->buffer.begin());
+    this->offset += this->pos;
+    this->end -= this->pos;
+    this->pos = 0;
+
+    if (this->buffer.size() < std::max(size, std::size_t(PLY_BUFFER_SIZE)))
+        this->buffer.resize(std::max(size, std::size_t(PLY_BUFFER_SIZE)));
+    if (this->input.good())
+    {
+        this->input.read(this->buffer.data() + this->end,
+            this->buffer.size() - this->end);
+        this->end += this->input.gcount();
+    }
+    return this->end >= size;
+}
+
+void
+PLYBlockReader::release (void)
+{
+    this->input.clear();
+    this->input.seekg(this->start + this->offset
+        + static_cast<std::streamoff>(this->pos));
+}
+
+/* ---------------------------------------------------------------- */
+
+/* Byte offsets of the handled properties in binary PLY vertex records. */
+struct PLYVertexLayout
+{
+    PLYVertexLayout (std::vector<PLYVertexProperty> const& v_format);
+
+    std::size_t size;
+    int pos[3];
+    bool pos_double[3];
+    int normal[3];
+    int color[3];
+    bool color_uint8[3];
+    int texcoord[2];
+    int confidence;
+    int value;
+};
+
+PLYVertexLayout::PLYVertexLayout
+    (std::vector<PLYVertexProperty> const& v_format)
+    : size(0)
+    , confidence(-1)
+    , value(-1)
+{
+    std::fill(this->pos, this->pos + 3, -1);
+    std::fill(this->pos_double, this->pos_double + 3, false);
+    std::fill(this->normal, this->normal + 3, -1);
+    std::fill(this->color, this->color + 3, -1);
+    std::fill(this->color_uint8, this->color_uint8 + 3, false);
+    std::fill(this->texcoord, this->texcoord + 2, -1);
+
+    for (std::size_t i = 0; i < v_format.size(); ++i)
+    {
+        int const offset = static_cast<int>(this->size);
+        PLYVertexProperty const elem = v_format[i];
+        switch (elem)
+        {
+            case PLY_V_FLOAT_X:
+            case PLY_V_FLOAT_Y:
+            case PLY_V_FLOAT_Z:
+                this->pos[elem - PLY_V_FLOAT_X] = offset;
+                this->pos_double[elem - PLY_V_FLOAT_X] = false;
+                this->size += sizeof(float);
+                break;
+
+            case PLY_V_DOUBLE_X:
+            case PLY_V_DOUBLE_Y:
+            case PLY_V_DOUBLE_Z:
+                this->pos[elem - PLY_V_DOUBLE_X] = offset;
+                this->pos_double[elem - PLY_V_DOUBLE_X] = true;
+                this->size += sizeof(double);
+                break;
+
+            case PLY_V_FLOAT_NX:
+            case PLY_V_FLOAT_NY:
+            case PLY_V_FLOAT_NZ:
+                this->normal[elem - PLY_V_FLOAT_NX] = offset;
+                this->size += sizeof(float);
+                break;
+
+            case PLY_V_UINT8_R:
+            case PLY_V_UINT8_G:
+            case PLY_V_UINT8_B:
+                this->color[elem - PLY_V_UINT8_R] = offset;
+                this->color_uint8[elem - PLY_V_UINT8_R] = true;
+                this->size += sizeof(unsigned char);
+                break;
+
+            case PLY_V_FLOAT_R:
+            case PLY_V_FLOAT_G:
+            case PLY_V_FLOAT_B:
+                this->color[elem - PLY_V_FLOAT_R] = offset;
+                this->color_uint8[elem - PLY_V_FLOAT_R] = false;
+                this->size += sizeof(float);
+                break;
+
+            case PLY_V_FLOAT_U:
+            case PLY_V_FLOAT_V:
+                this->texcoord[elem - PLY_V_FLOAT_U] = offset;
+                this->size += sizeof(float);
+                break;
+
+            case PLY_V_FLOAT_CONF:
+                this->confidence = offset;
+                this->size += sizeof(float);
+                break;
+
+            case PLY_V_FLOAT_VALUE:
+                this->value = offset;
+                this->size += sizeof(float);
+                break;
+
+            case PLY_V_IGNORE_FLOAT:
+            case PLY_V_IGNORE_UINT32:
+                this->size += 4;
+                break;
+
+            case PLY_V_IGNORE_DOUBLE:
+                this->size += 8;
+                break;
+
+            case PLY_V_IGNORE_UINT8:
+                this->size += 1;
+                break;
+
+            default:
+                throw std::runtime_error("Unhandled PLY vertex property");
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+/*
+ * Reads the vertices of a binary PLY file in blocks of records, which are
+ * decoded in parallel into the attribute lists of the mesh. Returns false
+ * on premature EOF; the lists then contain the complete records only.
+ */
+bool
+ply_read_binary_vertices (PLYBlockReader* reader, PLYFormat format,
+    std::vector<PLYVertexProperty> const& v_format,
+    std::size_t num_vertices, TriangleMesh::Ptr mesh)
+{
+    PLYVertexLayout const layout(v_format);
+    bool const want_vnormals = layout.normal[0] >= 0
+        || layout.normal[1] >= 0 || layout.normal[2] >= 0;
+    bool const want_colors = layout.color[0] >= 0
+        || layout.color[1] >= 0 || layout.color[2] >= 0;
+    bool const want_tex_coords = layout.texcoord[0] >= 0
+        || layout.texcoord[1] >= 0;
+
+    TriangleMesh::VertexList& vertices = mesh->get_vertices();
+    TriangleMesh::NormalList& vnormals = mesh->get_vertex_normals();
+    TriangleMesh::ColorList& vcolors = mesh->get_vertex_colors();
+    TriangleMesh::TexCoordList& tcoords = mesh->get_vertex_texcoords();
+    TriangleMesh::ConfidenceList& vconfs = mesh->get_vertex_confidences();
+    TriangleMesh::ValueList& vvalues = mesh->get_vertex_values();
+
+    vertices.resize(num_vertices, math::Vec3f(0.0f));
+    if (want_vnormals)
+        vnormals.resize(num_vertices, math::Vec3f(0.0f));
+    if (want_colors) // Make it ugly by default
+        vcolors.resize(num_vertices, math::Vec4f(1.0f, 0.5f, 0.5f, 1.0f));
+    if (want_tex_coords)
+        tcoords.resize(num_vertices, math::Vec2f(0.0f));
+    if (layout.confidence >= 0)
+        vconfs.resize(num_vertices);
+    if (layout.value >= 0)
+        vvalues.resize(num_vertices);
+
+    std::size_t num_read = 0;
+    while (num_read < num_vertices)
+    {
+        std::size_t block_size = std::min(std::size_t(PLY_BLOCK_SIZE),
+            num_vertices - num_read);
+        if (!reader->request(block_size * layout.size))
+            block_size = reader->available() / std::max(layout.size,
+                std::size_t(1));
+        if (block_size == 0)
+            break;
+
+        char const* block = reader->data();
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < block_size; ++i)
+#else
+        for (int64_t i = 0; i < block_size; ++i)
+#endif
+        {
+            char const* record = block + i * layout.size;
+            std::size_t const vid = num_read + i;
+            for (int j = 0; j < 3; ++j)
+            {
+                if (layout.pos[j] < 0)
+                    continue;
+                vertices[vid][j] = layout.pos_double[j]
+                    ? static_cast<float>(ply_decode_value<double>(
+                        record + layout.pos[j], format))
+                    : ply_decode_value<float>(record + layout.pos[j], format);
+            }
+            for (int j = 0; j < 3; ++j)
+            {
+                if (layout.normal[j] >= 0)
+                    vnormals[vid][j] = ply_decode_value<float>(
+                        record + layout.normal[j], format);
+                if (layout.color[j] < 0)
+                    continue;
+                vcolors[vid][j] = layout.color_uint8[j]
+                    ? static_cast<float>(static_cast<unsigned char>(
+                        record[layout.color[j]])) * (1.0f / 255.0f)
+                    : ply_decode_value<float>(record + layout.color[j], format);
+            }
+            for (int j = 0; j < 2; ++j)
+                if (layout.texcoord[j] >= 0)
+                    tcoords[vid][j] = ply_decode_value<float>(
+                        record + layout.texcoord[j], format);
+            if (layout.confidence >= 0)
+                vconfs[vid] = ply_decode_value<float>(
+                    record + layout.confidence, format);
+            if (layout.value >= 0)
+                vvalues[vid] = ply_decode_value<float>(
+                    record + layout.value, format);
+        }
+
+        reader->consume(block_size * layout.size);
+        num_read += block_size;
+    }
+
+    if (num_read == num_vertices)
+        return true;
+
+    /* Remove the vertices that have not been read. */
+    vertices.resize(num_read);
+    if (want_vnormals)
+        vnormals.resize(num_read);
+    if (want_colors)
+        vcolors.resize(num_read);
+    if (want_tex_coords)
+        tcoords.resize(num_read);
+    if (layout.confidence >= 0)
+        vconfs.resize(num_read);
+    if (layout.value >= 0)
+        vvalues.resize(num_read);
+    return false;
+}
+
+/* ---------------------------------------------------------------- */
+
+/*
+ * Reads the faces of a binary PLY file from the buffered reader.
+ * Returns false on premature EOF.
+ */
+bool
+ply_read_binary_faces (PLYBlockReader* reader, PLYFormat format,
+    std::vector<PLYFaceProperty> const& f_format,
+    std::size_t num_faces, TriangleMesh::FaceList* faces)
+{
+    for (std::size_t i = 0; i < num_faces; ++i)
+    {
+        for (std::size_t n = 0; n < f_format.size(); ++n)
+        {
+            switch (f_format[n])
+            {
+                case PLY_F_VERTEX_INDICES:
+                {
+                    /* Read the amount of vertex indices for the face. */
+                    if (!reader->request(1))
+                        return false;
+                    unsigned char const n_verts = reader->data()[0];
+                    std::size_t const list_size
+                        = n_verts * sizeof(unsigned int);
+                    if (!reader->request(1 + list_size))
+                        return false;
+
+                    char const* list = reader->data() + 1;
+                    if (n_verts == 3 || n_verts == 4)
+                    {
+                        /* Process 3-vertex faces and tetrahedra. */
+                        for (int j = 0; j < n_verts; ++j)
+                            faces->push_back(ply_decode_value<unsigned int>(
+                                list + j * sizeof(unsigned int), format));
+                    }
+                    else
+                    {
+                        std::cout << "PLY Loader: Ignoring face with "
+                            << static_cast<int>(n_verts)
+                            << " vertices!" << std::endl;
+                    }
+                    reader->consume(1 + list_size);
+                    break;
+                }
+
+                case PLY_F_IGNORE_UINT32:
+                case PLY_F_IGNORE_FLOAT:
+                    if (!reader->request(4))
+                        return false;
+                    reader->consume(4);
+                    break;
+
+                case PLY_F_IGNORE_UINT8:
+                    if (!reader->request(1))
+                        return false;
+                    reader->consume(1);
+                    break;
+
+                default:
+                    throw std::runtime_error("Unhandled PLY face property");
+            }
+        }
+    }
+    return true;
+}
+
 /* ---------------------------------------------------------------- */
 // TODO check token amount to prevent undefined access
 
@@ -420,14 +829,25 @@ load_ply_mesh (std::string const& filename)
     /* Start reading the vertex data. */
     std::cout << "Reading PLY: " << num_vertices << " verts..." << std::flush;
 
-    vertices.reserve(num_vertices);
-    if (want_colors)
-        vcolors.reserve(num_vertices);
-    if (want_vnormals)
-        vnormals.reserve(num_vertices);
-
+    /* Binary data is read in blocks and decoded from memory. */
+    PLYBlockReader reader(input);
+    bool const binary = ply_format != PLY_ASCII;
     bool eof = false;
-    for (std::size_t i = 0; !eof && i < num_vertices; ++i)
+    if (binary)
+    {
+        eof = !ply_read_binary_vertices(&reader, ply_format,
+            v_format, num_vertices, mesh);
+    }
+    else
+    {
+        vertices.reserve(num_vertices);
+        if (want_colors)
+            vcolors.reserve(num_vertices);
+        if (want_vnormals)
+            vnormals.reserve(num_vertices);
+    }
+
+    for (std::size_t i = 0; !binary && !eof && i < num_vertices; ++i)
     {
         math::Vec3f vertex(0.0f, 0.0f, 0.0f);
         math::Vec3f vnormal(0.0f, 0.0f, 0.0f);
@@ -525,7 +945,14 @@ load_ply_mesh (std::string const& filename)
     if (num_faces > 0)
         std::cout << " " << num_faces << " faces..." << std::flush;
     faces.reserve(num_faces * 3);
-    for (std::size_t i = 0; !eof && i < num_faces; ++i)
+    if (binary && !eof)
+    {
+        eof = !ply_read_binary_faces(&reader, ply_format,
+            f_format, num_faces, &faces);
+        reader.release();
+    }
+
+    for (std::size_t i = 0; !binary && !eof && i < num_faces; ++i)
     {
         for (std::size_t n = 0; n < f_format.size(); ++n)
         {
@@ -794,38 +1221,77 @@ save_ply_mesh (TriangleMesh::ConstPtr mesh, std::string const& filename,
 
     if (options.format_binary)
     {
-        /* Output data in BINARY format. */
-        for (std::size_t i = 0; i < verts.size(); ++i)
+        /* Output data in BINARY format, encoded in blocks of records. */
+        std::size_t vertex_size = 3 * sizeof(float);
+        vertex_size += write_vnormals ? 3 * sizeof(float) : 0;
+        vertex_size += write_vcolors ? 3 : 0;
+        vertex_size += write_vconfidences ? sizeof(float) : 0;
+        vertex_size += write_vvalues ? sizeof(float) : 0;
+
+        std::vector<char> block;
+        for (std::size_t i = 0; i < verts.size(); i += PLY_BLOCK_SIZE)
         {
-            out.write((char const*)*verts[i], 3 * sizeof(float));
-            if (write_vnormals)
-                out.write((char const*)*vnormals[i], 3 * sizeof(float));
-            if (write_vcolors)
+            std::size_t const block_size = std::min(std::size_t(PLY_BLOCK_SIZE),
+                verts.size() - i);
+            block.resize(block_size * vertex_size);
+            char* ptr = block.data();
+            for (std::size_t j = i; j < i + block_size; ++j)
             {
-                unsigned char color[3];
-                ply_color_convert(*vcolors[i], color);
-                out.write((char const*)color, 3);
+                std::memcpy(ptr, *verts[j], 3 * sizeof(float));
+                ptr += 3 * sizeof(float);
+                if (write_vnormals)
+                {
+                    std::memcpy(ptr, *vnormals[j], 3 * sizeof(float));
+                    ptr += 3 * sizeof(float);
+                }
+                if (write_vcolors)
+                {
+                    ply_color_convert(*vcolors[j], (unsigned char*)ptr);
+                    ptr += 3;
+                }
+                if (write_vconfidences)
+                {
+                    std::memcpy(ptr, &conf[j], sizeof(float));
+                    ptr += sizeof(float);
+                }
+                if (write_vvalues)
+                {
+                    std::memcpy(ptr, &vvalues[j], sizeof(float));
+                    ptr += sizeof(float);
+                }
             }
-            if (write_vconfidences)
-                out.write((char const*)&conf[i], sizeof(float));
-            if (write_vvalues)
-                out.write((char const*)&vvalues[i], sizeof(float));
+            out.write(block.data(), block.size());
         }
 
-        unsigned char verts_per_simplex_uchar = options.verts_per_simplex;
-        for (std::size_t i = 0; i < face_amount; ++i)
+        unsigned int const vps = options.verts_per_simplex;
+        std::size_t face_size = 1 + vps * sizeof(unsigned int);
+        face_size += write_fnormals ? 3 * sizeof(float) : 0;
+        face_size += write_fcolors ? 3 : 0;
+
+        for (std::size_t i = 0; i < face_amount; i += PLY_BLOCK_SIZE)
         {
-            out.write((char const*)&verts_per_simplex_uchar, 1);
-            out.write((char const*)&faces[i * options.verts_per_simplex],
-                options.verts_per_simplex * sizeof(unsigned int));
-            if (write_fnormals)
-                out.write((char const*)*fnormals[i], 3 * sizeof(float));
-            if (write_fcolors)
+            std::size_t const block_size = std::min(std::size_t(PLY_BLOCK_SIZE),
+                face_amount - i);
+            block.resize(block_size * face_size);
+            char* ptr = block.data();
+            for (std::size_t j = i; j < i + block_size; ++j)
             {
-                unsigned char color[3];
-                ply_color_convert(*fcolors[i], color);
-                out.write((char const*)color, 3);
+                *ptr = static_cast<char>(vps);
+                ptr += 1;
+                std::memcpy(ptr, &faces[j * vps], vps * sizeof(unsigned int));
+                ptr += vps * sizeof(unsigned int);
+                if (write_fnormals)
+                {
+                    std::memcpy(ptr, *fnormals[j], 3 * sizeof(float));
+                    ptr += 3 * sizeof(float);
+                }
+                if (write_fcolors)
+                {
+                    ply_color_convert(*fcolors[j], (unsigned char*)ptr);
+                    ptr += 3;
+                }
             }
+            out.write(block.data(), block.size());
         }
     }
     else
@@ -7,10 +7,10 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <atomic>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
-#include <list>
 #include <limits>
 #include <fstream>
 #include <cerrno>
@@ -124,49 +124,148 @@ mesh_merge (TriangleMesh::ConstPtr mesh1, TriangleMesh::Ptr mesh2)
 
 /* ---------------------------------------------------------------- */
 
-void
-mesh_components (TriangleMesh::Ptr mesh, std::size_t vertex_threshold)
+namespace
 {
-    MeshInfo mesh_info(mesh);
-    std::size_t const num_vertices = mesh->get_vertices().size();
-    std::vector<int> component_per_vertex(num_vertices, -1);
-    int current_component = 0;
-    for (std::size_t i = 0; i < num_vertices; ++i)
+    /*
+     * Lock-free union-find on vertex IDs. Roots are always linked to the
+     * smaller root, so parents never have larger IDs than their children
+     * and the root of a set is its smallest vertex ID. Concurrent path
+     * halving only shortcuts to ancestors, which keeps the sets intact.
+     */
+    class ConcurrentUnionFind
     {
-        /* Start with a vertex that has no component yet. */
-        if (component_per_vertex[i] >= 0)
-            continue;
-
-        /* Starting from this face, collect faces and assign component ID. */
-        std::list<std::size_t> queue;
-        queue.push_back(i);
-        while (!queue.empty())
-        {
-            std::size_t vid = queue.front();
-            queue.pop_front();
+    public:
+        ConcurrentUnionFind (std::size_t size);
+        unsigned int find (unsigned int id);
+        void unite (unsigned int id1, unsigned int id2);
 
-            /* Skip vertices with a componenet already assigned. */
-            if (component_per_vertex[vid] >= 0)
-                continue;
-            component_per_vertex[vid] = current_component;
+    private:
+        std::vector<std::atomic<unsigned int> > parent;
+    };
 
-            /* Add all adjacent vertices to queue. */
-            MeshInfo::AdjacentVertices const& adj_verts = mesh_info[vid].verts;
-            queue.insert(queue.end(), adj_verts.begin(), adj_verts.end());
+    ConcurrentUnionFind::ConcurrentUnionFind (std::size_t size)
+        : parent(size)
+    {
+#pragma omp parallel for
+#if !defined(_MSC_VER)
+        for (std::size_t i = 0; i < size; ++i)
+#else
+        for (int64_t i = 0; i < size; ++i)
+#endif
+            this->parent[i].store(static_cast<unsigned int>(i),
+                std::memory_order_relaxed);
+    }
+
+    unsigned int
+    ConcurrentUnionFind::find (unsigned int id)
+    {
+        while (true)
+        {
+            unsigned int p = this->parent[id].load(std::memory_order_relaxed);
+            if (p == id)
+                return id;
+            unsigned int const gp
+                = this->parent[p].load(std::memory_order_relaxed);
+            if (p != gp)
+                this->parent[id].compare_exchange_weak(p, gp,
+                    std::memory_order_relaxed);
+            id = gp;
         }
-        current_component += 1;
     }
-    mesh_info.clear();
 
-    /* Create a list of components and count vertices per component. */
-    std::vector<std::size_t> components_size(current_component, 0);
-    for (std::size_t i = 0; i < component_per_vertex.size(); ++i)
-        components_size[component_per_vertex[i]] += 1;
+    void
+    ConcurrentUnionFind::unite (unsigned int id1, unsigned int id2)
+    {
+        while (true)
+        {
+            id1 = this->find(id1);
+            id2 = this->find(id2);
+            if (id1 == id2)
+                return;
+            if (id1 < id2)
+                std::swap(id1, id2);
+
+            /* Link the larger root, retry if it is no longer a root. */
+            unsigned int expected = id1;
+            if (this->parent[id1].compare_exchange_strong(expected, id2))
+                return;
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+std::size_t
+mesh_components_label (TriangleMesh::ConstPtr mesh,
+    std::vector<std::size_t>* vertex_components,
+    std::vector<MeshComponentInfo>* components)
+{
+    if (mesh == nullptr)
+        throw std::invalid_argument("Null mesh given");
+    if (vertex_components == nullptr)
+        throw std::invalid_argument("Null component list given");
+
+    std::size_t const num_vertices = mesh->get_vertices().size();
+    TriangleMesh::FaceList const& faces = mesh->get_faces();
+    std::size_t const num_faces = faces.size() / 3;
+
+    /* Join the vertices of every face. */
+    ConcurrentUnionFind sets(num_vertices);
+#pragma omp parallel for schedule(static, 4096)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_faces; ++i)
+#else
+    for (int64_t i = 0; i < num_faces; ++i)
+#endif
+    {
+        sets.unite(faces[i * 3 + 0], faces[i * 3 + 1]);
+        sets.unite(faces[i * 3 + 0], faces[i * 3 + 2]);
+    }
+
+    /* Resolve the roots, which also fully compresses all paths. */
+    std::vector<std::size_t>& labels = *vertex_components;
+    labels.resize(num_vertices);
+#pragma omp parallel for schedule(static, 4096)
+#if !defined(_MSC_VER)
+    for (std::size_t i = 0; i < num_vertices; ++i)
+#else
+    for (int64_t i = 0; i < num_vertices; ++i)
+#endif
+        labels[i] = sets.find(static_cast<unsigned int>(i));
+
+    /* Number components in order; roots precede the other vertices. */
+    std::size_t num_components = 0;
+    for (std::size_t i = 0; i < num_vertices; ++i)
+        labels[i] = labels[i] == i ? num_components++ : labels[labels[i]];
+
+    if (components == nullptr)
+        return num_components;
+
+    components->clear();
+    components->resize(num_components, MeshComponentInfo());
+    for (std::size_t i = 0; i < num_vertices; ++i)
+        components->at(labels[i]).num_vertices += 1;
+    for (std::size_t i = 0; i < num_faces; ++i)
+        components->at(labels[faces[i * 3]]).num_faces += 1;
+
+    return num_components;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+mesh_components (TriangleMesh::Ptr mesh, std::size_t vertex_threshold)
+{
+    std::vector<std::size_t> component_per_vertex;
+    std::vector<MeshComponentInfo> components;
+    mesh_components_label(mesh, &component_per_vertex, &components);
 
     /* Mark vertices to be deleted if part of a small component. */
+    std::size_t const num_vertices = component_per_vertex.size();
     TriangleMesh::DeleteList delete_list(num_vertices, false);
-    for (std::size_t i = 0; i < component_per_vertex.size(); ++i)
-        if (components_size[component_per_vertex[i]] <= vertex_threshold)
+    for (std::size_t i = 0; i < num_vertices; ++i)
+        if (components[component_per_vertex[i]].num_vertices
+            <= vertex_threshold)
             delete_list[i] = true;
 
     /* Delete vertices and faces indexing deleted vertices. */
@@ -268,7 +367,7 @@ mesh_delete_unreferenced (TriangleMesh::Ptr mesh)
     if (mesh == nullptr)
         throw std::invalid_argument("Null mesh given");
 
-    MeshInfo mesh_info(mesh);
+    CompactMeshInfo mesh_info(mesh);
     TriangleMesh::DeleteList dlist(mesh_info.size(), false);
     std::size_t num_deleted = 0;
     for (std::size_t i = 0; i < mesh_info.size(); ++i)
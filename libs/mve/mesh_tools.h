@@ -10,6 +10,8 @@
 #ifndef MVE_MESH_TOOLS_HEADER
 #define MVE_MESH_TOOLS_HEADER
 
+#include <vector>
+
 #include "math/vector.h"
 #include "math/matrix.h"
 #include "mve/defines.h"
@@ -43,6 +45,26 @@ mesh_transform (TriangleMesh::Ptr mesh, math::Matrix4f const& trans);
 void
 mesh_merge (TriangleMesh::ConstPtr mesh1, TriangleMesh::Ptr mesh2);
 
+/** Vertex and face count of a connected mesh component. */
+struct MeshComponentInfo
+{
+    std::size_t num_vertices;
+    std::size_t num_faces;
+};
+
+/**
+ * Labels the connected components of the mesh, i.e., vertices connected by
+ * faces, using a parallel union-find over the face list. Components are
+ * numbered in the order of their smallest vertex ID, and every unreferenced
+ * vertex forms a component of its own. The component ID of every vertex is
+ * stored in 'vertex_components', and the vertex and face count of every
+ * component in 'components' (if not null). Returns the number of components.
+ */
+std::size_t
+mesh_components_label (TriangleMesh::ConstPtr mesh,
+    std::vector<std::size_t>* vertex_components,
+    std::vector<MeshComponentInfo>* components = nullptr);
+
 /**
  * Discards isolated components with a vertex count below a threshold.
  * Passing 0 does nothing. Passing 1 or 2 deletes isolated vertices.
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "util/exception.h"
+#include "util/string.h"
+#include "mve/point_set_writer.h"
+
+/* Amount of decimal digits reserved for the vertex count in the header. */
+#define MAX_COUNT_DIGITS 20
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+namespace
+{
+    void
+    append_raw (void const* data, std::size_t size, std::string* buffer)
+    {
+        buffer->append(static_cast<char const*>(data), size);
+    }
+
+    void
+    append_color (math::Vec4f const& color, std::string* buffer)
+    {
+        for (int c = 0; c < 3; ++c)
+        {
+            float value = color[c] * 255.0f;
+            value = std::min(255.0f, std::max(0.0f, value));
+            buffer->push_back(static_cast<char>(
+                static_cast<unsigned char>(value + 0.5f)));
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+PointSetWriter::PointSetWriter (std::string const& filename,
+    Options const& options)
+    : filename(filename)
+    , opts(options)
+    , header_size(0)
+    , num_points(0)
+{
+    if (util::string::right(filename, 4) == ".ply")
+        this->format = FORMAT_PLY;
+    else if (util::string::right(filename, 5) == ".npts")
+        this->format = FORMAT_NPTS_ASCII;
+    else if (util::string::right(filename, 6) == ".bnpts")
+        this->format = FORMAT_NPTS_BINARY;
+    else
+        throw std::invalid_argument("Extension not recognized");
+
+    if (this->format != FORMAT_PLY)
+    {
+        this->opts.write_normals = true;
+        this->opts.write_colors = false;
+        this->opts.write_confidences = false;
+        this->opts.write_values = false;
+    }
+
+    this->out.open(filename.c_str(), std::ios::binary);
+    if (!this->out.good())
+        throw util::FileException(filename, std::strerror(errno));
+
+    if (this->format == FORMAT_PLY)
+    {
+        std::string const header = this->get_ply_header(0,
+            MAX_COUNT_DIGITS - 1);
+        this->header_size = header.size();
+        this->out.write(header.data(), header.size());
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+PointSetWriter::~PointSetWriter (void)
+{
+    if (!this->out.is_open())
+        return;
+
+    try
+    {
+        this->close();
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "Error closing " << this->filename
+            << ": " << e.what() << std::endl;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+PointSetWriter::write (TriangleMesh::ConstPtr points)
+{
+    if (points == nullptr)
+        throw std::invalid_argument("Null point set given");
+
+    TriangleMesh::VertexList const& verts = points->get_vertices();
+    if (this->opts.write_normals
+        && points->get_vertex_normals().size() != verts.size())
+        throw std::invalid_argument("No vertex normals given");
+
+    /* Encode the points without holding the lock. */
+    std::string buffer;
+    if (this->format == FORMAT_NPTS_ASCII)
+        this->encode_ascii(points, &buffer);
+    else
+        this->encode_binary(points, &buffer);
+
+    std::lock_guard<std::mutex> lock(this->out_mutex);
+    if (!this->out.is_open())
+        throw std::logic_error("Point set file already closed");
+    this->out.write(buffer.data(), buffer.size());
+    if (!this->out.good())
+        throw util::FileException(this->filename, std::strerror(errno));
+    this->num_points += verts.size();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+PointSetWriter::close (void)
+{
+    std::lock_guard<std::mutex> lock(this->out_mutex);
+    if (!this->out.is_open())
+        return;
+
+    if (this->format == FORMAT_PLY)
+    {
+        /* Pad the header to the reserved size to keep the data in place. */
+        std::string header = this->get_ply_header(this->num_points, 0);
+        header = this->get_ply_header(this->num_points,
+            this->header_size - header.size());
+        this->out.seekp(0);
+        this->out.write(header.data(), header.size());
+    }
+
+    bool const good = this->out.good();
+    this->out.close();
+    if (!good)
+        throw util::FileException(this->filename, std::strerror(errno));
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+PointSetWriter::is_supported (std::string const& filename)
+{
+    return util::string::right(filename, 4) == ".ply"
+        || util::string::right(filename, 5) == ".npts"
+        || util::string::right(filename, 6) == ".bnpts";
+}
+
+/* ---------------------------------------------------------------- */
+
+std::string
+PointSetWriter::get_ply_header (std::size_t num_points,
+    std::size_t padding) const
+{
+    std::stringstream ss;
+    ss << "ply" << std::endl;
+    ss << "format binary_little_endian 1.0" << std::endl;
+    ss << "comment Export generated by libmve"
+        << std::string(padding, ' ') << std::endl;
+    ss << "element vertex " << num_points << std::endl;
+    ss << "property float x" << std::endl;
+    ss << "property float y" << std::endl;
+    ss << "property float z" << std::endl;
+    if (this->opts.write_normals)
+    {
+        ss << "property float nx" << std::endl;
+        ss << "property float ny" << std::endl;
+        ss << "property float nz" << std::endl;
+    }
+    if (this->opts.write_colors)
+    {
+        ss << "property uchar red" << std::endl;
+        ss << "property uchar green" << std::endl;
+        ss << "property uchar blue" << std::endl;
+    }
+    if (this->opts.write_confidences)
+        ss << "property float confidence" << std::endl;
+    if (this->opts.write_values)
+        ss << "property float value" << std::endl;
+    ss << "end_header" << std::endl;
+    return ss.str();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+PointSetWriter::encode_binary (TriangleMesh::ConstPtr points,
+    std::string* buffer) const
+{
+    TriangleMesh::VertexList const& verts = points->get_vertices();
+    TriangleMesh::NormalList const& vnormals = points->get_vertex_normals();
+    TriangleMesh::ColorList const& vcolors = points->get_vertex_colors();
+    TriangleMesh::ConfidenceList const& vconfs
+        = points->get_vertex_confidences();
+    TriangleMesh::ValueList const& vvalues = points->get_vertex_values();
+
+    bool const has_colors = vcolors.size() == verts.size();
+    bool const has_confs = vconfs.size() == verts.size();
+    bool const has_values = vvalues.size() == verts.size();
+
+    std::size_t record_size = 3 * sizeof(float);
+    if (this->opts.write_normals)
+        record_size += 3 * sizeof(float);
+    if (this->opts.write_colors)
+        record_size += 3;
+    if (this->opts.write_confidences)
+        record_size += sizeof(float);
+    if (this->opts.write_values)
+        record_size += sizeof(float);
+    buffer->reserve(verts.size() * record_size);
+
+    for (std::size_t i = 0; i < verts.size(); ++i)
+    {
+        append_raw(*verts[i], 3 * sizeof(float), buffer);
+        if (this->opts.write_normals)
+            append_raw(*vnormals[i], 3 * sizeof(float), buffer);
+        if (this->opts.write_colors)
+            append_color(has_colors ? vcolors[i]
+                : math::Vec4f(0.0f, 0.0f, 0.0f, 1.0f), buffer);
+        if (this->opts.write_confidences)
+        {
+            float const conf = has_confs ? vconfs[i] : 1.0f;
+            append_raw(&conf, sizeof(float), buffer);
+        }
+        if (this->opts.write_values)
+        {
+            float const value = has_values ? vvalues[i] : 0.0f;
+            append_raw(&value, sizeof(float), buffer);
+        }
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+PointSetWriter::encode_ascii (TriangleMesh::ConstPtr points,
+    std::string* buffer) const
+{
+    TriangleMesh::VertexList const& verts = points->get_vertices();
+    TriangleMesh::NormalList const& vnormals = points->get_vertex_normals();
+
+    std::stringstream ss;
+    for (std::size_t i = 0; i < verts.size(); ++i)
+    {
+        math::Vec3f const& v = verts[i];
+        math::Vec3f const& n = vnormals[i];
+        ss << v[0] << " " << v[1] << " " << v[2] << " "
+            << n[0] << " " << n[1] << " " << n[2] << std::endl;
+    }
+    *buffer = ss.str();
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_POINT_SET_WRITER_HEADER
+#define MVE_POINT_SET_WRITER_HEADER
+
+#include <fstream>
+#include <mutex>
+#include <string>
+
+#include "mve/defines.h"
+#include "mve/mesh.h"
+
+MVE_NAMESPACE_BEGIN
+MVE_GEOM_NAMESPACE_BEGIN
+
+/**
+ * Writes a point set incrementally to a file without keeping all points
+ * in memory. Points are appended in batches, i.e., the vertices of a
+ * triangle mesh (faces are ignored). The batches are encoded into a
+ * buffer by the calling thread, and only appending the buffer to the
+ * file is serialized. Batches can thus be written from multiple threads
+ * concurrently, and writing overlaps with computing other batches.
+ *
+ * The format is selected by the file extension: Binary PLY (".ply"),
+ * ASCII NPTS (".npts") and binary NPTS (".bnpts"). For PLY files, the
+ * header reserves space for the vertex count, which is patched when the
+ * file is closed. NPTS files always contain normals and no other
+ * attributes.
+ */
+class PointSetWriter
+{
+public:
+    /** Options for the vertex attributes written to PLY files. */
+    struct Options
+    {
+        bool write_normals = false;
+        bool write_colors = true;
+        bool write_confidences = false;
+        bool write_values = false;
+    };
+
+public:
+    /** Creates the file and writes the header. */
+    PointSetWriter (std::string const& filename, Options const& options);
+    /** Closes the file if it has not been closed. */
+    ~PointSetWriter (void);
+
+    /**
+     * Appends the vertices and the requested attributes. Missing colors
+     * are written as black, missing confidences as one and missing values
+     * as zero. Missing normals are an error. This is thread-safe.
+     */
+    void write (TriangleMesh::ConstPtr points);
+
+    /** Patches the vertex count into the header and closes the file. */
+    void close (void);
+
+    /** Returns the number of points written so far. */
+    std::size_t get_num_points (void) const;
+
+    /** Returns true if the file extension is supported by the writer. */
+    static bool is_supported (std::string const& filename);
+
+private:
+    enum Format
+    {
+        FORMAT_PLY,
+        FORMAT_NPTS_ASCII,
+        FORMAT_NPTS_BINARY
+    };
+
+private:
+    std::string get_ply_header (std::size_t num_points,
+        std::size_t padding) const;
+    void encode_binary (TriangleMesh::ConstPtr points,
+        std::string* buffer) const;
+    void encode_ascii (TriangleMesh::ConstPtr points,
+        std::string* buffer) const;
+
+private:
+    std::string filename;
+    Options opts;
+    Format format;
+    std::ofstream out;
+    std::size_t header_size;
+    std::size_t num_points;
+    std::mutex out_mutex;
+};
+
+/* ------------------------- Implementation ---------------------------- */
+
+inline std::size_t
+PointSetWriter::get_num_points (void) const
+{
+    return this->num_points;
+}
+
+MVE_GEOM_NAMESPACE_END
+MVE_NAMESPACE_END
+
+#endif /* MVE_POINT_SET_WRITER_HEADER */
@@ -9,6 +9,11 @@
 
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <sstream>
 
 #include "util/exception.h"
 #include "util/timer.h"
@@ -16,15 +21,18 @@
 #include "mve/scene.h"
 #include "mve/bundle_io.h"
 
+/* Saving views is I/O bound, more threads do not help. */
+#define SCENE_SAVE_MAX_THREADS 8
+
 MVE_NAMESPACE_BEGIN
 
 void
-Scene::load_scene (std::string const& base_path)
+Scene::load_scene (std::string const& base_path, bool use_index)
 {
     if (base_path.empty())
         throw util::Exception("Invalid file name given");
     this->basedir = base_path;
-    this->init_views();
+    this->init_views(use_index);
 }
 
 /* ---------------------------------------------------------------- */
@@ -54,9 +62,77 @@ void
 Scene::save_views (void)
 {
     std::cout << "Saving views to MVE files..." << std::flush;
+
+    ViewList dirty_views;
     for (std::size_t i = 0; i < this->views.size(); ++i)
         if (this->views[i] != nullptr && this->views[i]->is_dirty())
-            this->views[i]->save_view();
+            dirty_views.push_back(this->views[i]);
+
+    /*
+     * Views are saved in parallel in the three phases of View::save_view().
+     * Instead of syncing every file, the file system is synced once after
+     * the temporary files and once after the journals have been written.
+     * The view directories are synced after the files have been moved,
+     * before the journals are removed. Views that fail in a phase are
+     * skipped in the following phases, and the first error is reported
+     * after all other views have been saved.
+     */
+    int const num_views = static_cast<int>(dirty_views.size());
+    int const num_threads = std::max(1, std::min(num_views,
+        SCENE_SAVE_MAX_THREADS));
+    std::vector<std::exception_ptr> errors(dirty_views.size());
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+    for (int i = 0; i < num_views; ++i)
+    {
+        try
+        {
+            dirty_views[i]->save_view_prepare();
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }
+
+    bool const sync_files = this->archive == nullptr && num_views > 0
+        && !util::fs::sync_file_system(this->basedir.c_str());
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+    for (int i = 0; i < num_views; ++i)
+    {
+        if (errors[i] != nullptr)
+            continue;
+        try
+        {
+            dirty_views[i]->save_view_journal(sync_files);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }
+
+    if (this->archive == nullptr && num_views > 0 && !sync_files)
+        util::fs::sync_file_system(this->basedir.c_str());
+#pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+    for (int i = 0; i < num_views; ++i)
+    {
+        if (errors[i] != nullptr)
+            continue;
+        try
+        {
+            dirty_views[i]->save_view_commit(this->archive == nullptr);
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
+    }
+
+    if (this->archive != nullptr)
+        this->archive->flush();
+    for (std::size_t i = 0; i < errors.size(); ++i)
+        if (errors[i] != nullptr)
+            std::rethrow_exception(errors[i]);
     std::cout << " done." << std::endl;
 }
 
@@ -77,6 +153,16 @@ Scene::is_dirty (void) const
 
 /* ---------------------------------------------------------------- */
 
+void
+Scene::set_mvei_compression (bool enable)
+{
+    for (std::size_t i = 0; i < this->views.size(); ++i)
+        if (this->views[i] != nullptr)
+            this->views[i]->set_mvei_compression(enable);
+}
+
+/* ---------------------------------------------------------------- */
+
 void
 Scene::cache_cleanup (void)
 {
@@ -137,44 +223,259 @@ Scene::get_bundle_mem_usage (void)
 
 /* ---------------------------------------------------------------- */
 
+#define SCENE_INDEX_SIGNATURE "MVE_SCENE_INDEX 2"
+
+/*
+ * Views modified within the timestamp resolution of the file system may
+ * be modified again without changing the timestamps. Such views are not
+ * trusted by the index. Windows only reports modification times with a
+ * resolution of seconds (or two seconds on FAT).
+ */
+#ifdef _WIN32
+#   define SCENE_INDEX_MTIME_SLACK 2000000000
+#else
+#   define SCENE_INDEX_MTIME_SLACK 50000000
+#endif
+
+namespace
+{
+    /*
+     * Cached view information, valid while the modification times and
+     * the size of meta.ini match.
+     */
+    struct IndexEntry
+    {
+        int64_t dir_mtime = -1;
+        int64_t meta_mtime = -1;
+        int64_t meta_size = -1;
+        View::MetaData::KeyValueMap data;
+        std::vector<std::string> filenames;
+    };
+
+    typedef std::map<std::string, IndexEntry> SceneIndex;
+
+    /* Returns an empty index if the file is missing or invalid. */
+    SceneIndex
+    load_scene_index (std::string const& filename)
+    {
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        std::string line;
+        if (!std::getline(in, line) || line != SCENE_INDEX_SIGNATURE)
+            return SceneIndex();
+
+        SceneIndex index;
+        std::string dirname;
+        while (std::getline(in, dirname) && std::getline(in, line))
+        {
+            IndexEntry entry;
+            std::size_t num_values = 0, num_files = 0;
+            std::stringstream ss(line);
+            ss >> entry.dir_mtime >> entry.meta_mtime >> entry.meta_size
+                >> num_values >> num_files;
+            if (ss.fail())
+                return SceneIndex();
+
+            for (std::size_t i = 0; i < num_values; ++i)
+            {
+                if (!std::getline(in, line))
+                    return SceneIndex();
+                std::size_t const pos = line.find('=');
+                if (pos == std::string::npos)
+                    return SceneIndex();
+                entry.data[line.substr(0, pos)] = line.substr(pos + 1);
+            }
+            for (std::size_t i = 0; i < num_files; ++i)
+            {
+                if (!std::getline(in, line))
+                    return SceneIndex();
+                entry.filenames.push_back(line);
+            }
+            index[dirname] = entry;
+        }
+        return index;
+    }
+
+    /* Writes the index to a temporary file and moves it in place. */
+    void
+    save_scene_index (SceneIndex const& index, std::string const& filename)
+    {
+        std::string const fname_new = filename + ".new";
+        std::ofstream out(fname_new.c_str(), std::ios::binary);
+        out << SCENE_INDEX_SIGNATURE << "\n";
+        for (SceneIndex::const_iterator iter = index.begin();
+            iter != index.end(); ++iter)
+        {
+            IndexEntry const& entry = iter->second;
+            out << iter->first << "\n" << entry.dir_mtime << " "
+                << entry.meta_mtime << " " << entry.meta_size << " "
+                << entry.data.size() << " " << entry.filenames.size() << "\n";
+            for (View::MetaData::KeyValueMap::const_iterator value
+                = entry.data.begin(); value != entry.data.end(); ++value)
+                out << value->first << "=" << value->second << "\n";
+            for (std::size_t i = 0; i < entry.filenames.size(); ++i)
+                out << entry.filenames[i] << "\n";
+        }
+        out.close();
+
+        if (!out.good() || !util::fs::rename(fname_new.c_str(),
+            filename.c_str()))
+        {
+            util::fs::unlink(fname_new.c_str());
+            std::cerr << "Warning: Cannot write scene index "
+                << filename << std::endl;
+        }
+    }
+}
+
 void
-Scene::init_views (void)
+Scene::init_views (bool use_index)
 {
     util::WallTimer timer;
 
     /* Iterate over all mve files and create view. */
     std::string views_path = util::fs::join_path(this->basedir,
         MVE_SCENE_VIEWS_DIR);
-    util::fs::Directory views_dir;
-    try
+    std::string const archive_filename = util::fs::join_path(this->basedir,
+        MVE_SCENE_ARCHIVE_FILE);
+    std::vector<std::string> names;
+    if (util::fs::file_exists(archive_filename.c_str()))
     {
-        views_dir.scan(views_path);
+        /* Packed scenes are indexed by the archive itself. */
+        this->archive = SceneArchive::open(archive_filename);
+        names = this->archive->get_directories();
+        use_index = false;
+    }
+    else
+    {
+        this->archive.reset();
+        util::fs::Directory views_dir;
+        try
+        {
+            views_dir.scan(views_path);
+        }
+        catch (util::Exception& e)
+        {
+            throw util::Exception(views_path + ": ", e.what());
+        }
+        std::sort(views_dir.begin(), views_dir.end());
+        for (std::size_t i = 0; i < views_dir.size(); ++i)
+            names.push_back(views_dir[i].name);
     }
-    catch (util::Exception& e)
+
+    std::vector<std::string> view_names;
+    for (std::size_t i = 0; i < names.size(); ++i)
     {
-        throw util::Exception(views_path + ": ", e.what());
+        if (names[i].size() < 4)
+            continue;
+        if (util::string::right(names[i], 4) != ".mve")
+            continue;
+        view_names.push_back(names[i]);
     }
-    std::sort(views_dir.begin(), views_dir.end());
 
     /* Give some feedback... */
-    std::cout << "Initializing scene with " << views_dir.size()
+    std::cout << "Initializing scene with " << view_names.size()
         << " views..." << std::endl;
 
-    /* Load views in a temp list. */
-    ViewList temp_list;
-    int max_id = 0;
-    for (std::size_t i = 0; i < views_dir.size(); ++i)
+    std::string const index_filename = util::fs::join_path(this->basedir,
+        MVE_SCENE_INDEX_FILE);
+    SceneIndex index;
+    if (use_index)
+        index = load_scene_index(index_filename);
+    int64_t const now = std::chrono::duration_cast<std::chrono::nanoseconds>
+        (std::chrono::system_clock::now().time_since_epoch()).count();
+
+    /*
+     * Load views in a temp list. Views are initialized in parallel, and
+     * the first error in directory order is reported after the loop.
+     */
+    ViewList temp_list(view_names.size());
+    std::vector<IndexEntry> entries(use_index ? view_names.size() : 0);
+    std::vector<std::exception_ptr> errors(view_names.size());
+    int num_indexed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:num_indexed)
+    for (int i = 0; i < static_cast<int>(view_names.size()); ++i)
     {
-        if (views_dir[i].name.size() < 4)
-            continue;
-        if (util::string::right(views_dir[i].name, 4) != ".mve")
-            continue;
-        View::Ptr view = View::create();
-        view->load_view(views_dir[i].get_absolute_name());
-        temp_list.push_back(view);
-        max_id = std::max(max_id, view->get_id());
+        try
+        {
+            std::string const view_path = util::fs::join_path(views_path,
+                view_names[i]);
+            View::Ptr view = View::create();
+            if (this->archive != nullptr)
+            {
+                view->load_view(this->archive, view_names[i]);
+                temp_list[i] = view;
+                continue;
+            }
+            if (!use_index)
+            {
+                view->load_view(view_path);
+                temp_list[i] = view;
+                continue;
+            }
+
+            /* Take the modification times before reading the view. */
+            IndexEntry& entry = entries[i];
+            std::string const meta_path
+                = util::fs::join_path(view_path, "meta.ini");
+            entry.dir_mtime = util::fs::get_mtime(view_path.c_str());
+            entry.meta_mtime = util::fs::get_mtime(meta_path.c_str());
+            entry.meta_size = util::fs::get_file_size(meta_path.c_str());
+
+            SceneIndex::const_iterator iter = index.find(view_names[i]);
+            if (iter != index.end()
+                && entry.dir_mtime == iter->second.dir_mtime
+                && entry.meta_mtime == iter->second.meta_mtime
+                && entry.meta_size == iter->second.meta_size
+                && entry.dir_mtime != -1 && entry.meta_mtime != -1)
+            {
+                view->load_view_from_index(util::fs::abspath(
+                    util::fs::sanitize_path(view_path)),
+                    iter->second.data, iter->second.filenames);
+                entry = iter->second;
+                num_indexed += 1;
+            }
+            else
+            {
+                view->load_view(view_path);
+                entry.data = view->get_meta_data().data;
+                View::ImageProxies const& images = view->get_images();
+                for (std::size_t j = 0; j < images.size(); ++j)
+                    entry.filenames.push_back(images[j].filename);
+                View::BlobProxies const& blobs = view->get_blobs();
+                for (std::size_t j = 0; j < blobs.size(); ++j)
+                    entry.filenames.push_back(blobs[j].filename);
+
+                /* Recently modified views are not trusted. */
+                if (now - std::max(entry.dir_mtime, entry.meta_mtime)
+                    < SCENE_INDEX_MTIME_SLACK)
+                    entry.dir_mtime = -1;
+            }
+            temp_list[i] = view;
+        }
+        catch (...)
+        {
+            errors[i] = std::current_exception();
+        }
     }
 
+    for (std::size_t i = 0; i < errors.size(); ++i)
+        if (errors[i] != nullptr)
+            std::rethrow_exception(errors[i]);
+
+    /* Rewrite the index if any view was not found or outdated. */
+    if (use_index && (num_indexed != static_cast<int>(view_names.size())
+        || index.size() != view_names.size()))
+    {
+        SceneIndex new_index;
+        for (std::size_t i = 0; i < view_names.size(); ++i)
+            new_index[view_names[i]] = entries[i];
+        save_scene_index(new_index, index_filename);
+    }
+
+    int max_id = 0;
+    for (std::size_t i = 0; i < temp_list.size(); ++i)
+        max_id = std::max(max_id, temp_list[i]->get_id());
+
     if (max_id > 5000 && max_id > 2 * (int)temp_list.size())
         throw util::Exception("Spurious view IDs");
 
@@ -202,6 +503,9 @@ Scene::init_views (void)
     std::cout << "Initialized " << temp_list.size()
         << " views (max ID is " << max_id << "), took "
         << timer.get_elapsed() << "ms." << std::endl;
+    if (use_index)
+        std::cout << "  " << num_indexed << " views were read from the "
+            << "scene index." << std::endl;
 }
 
 /* ---------------------------------------------------------------- */
@@ -20,6 +20,8 @@
 
 #define MVE_SCENE_VIEWS_DIR "views/"
 #define MVE_SCENE_BUNDLE_FILE "synth_0.out"
+#define MVE_SCENE_INDEX_FILE "views.index"
+#define MVE_SCENE_ARCHIVE_FILE "views.pack"
 
 MVE_NAMESPACE_BEGIN
 
@@ -30,6 +32,10 @@ MVE_NAMESPACE_BEGIN
  *
  * - directory "views": contains the views in the scene.
  * - file "synth_0.out": bundle file that contains key points.
+ * - file "views.index": optional cache of the view meta data.
+ * - file "views.pack": optional scene archive with all views. If present,
+ *   the views are loaded from and saved to the archive instead of the
+ *   "views" directory, see SceneArchive.
  */
 class Scene
 {
@@ -39,13 +45,24 @@ public:
 
 public:
     /** Constructs and loads a scene from the given directory. */
-    static Scene::Ptr create (std::string const& path);
+    static Scene::Ptr create (std::string const& path,
+        bool use_index = false);
 
     Scene(const Scene&) = delete;
     Scene& operator=(const Scene&) = delete;
 
-    /** Loads the scene from the given directory. */
-    void load_scene (std::string const& base_path);
+    /**
+     * Loads the scene from the given directory. Views are initialized in
+     * parallel. If 'use_index' is true, the meta data and the embedding
+     * names of all views are cached in the scene index file. Views whose
+     * directory and meta.ini modification times and meta.ini size match
+     * the index are then initialized without reading the view directory.
+     * Views modified very recently are not indexed, because they may
+     * change again within the timestamp resolution. The index is
+     * rewritten if it is missing or outdated. The index is not used for
+     * packed scenes, which are indexed by the archive.
+     */
+    void load_scene (std::string const& base_path, bool use_index = false);
 
     /** Returns the list of views. */
     ViewList const& get_views (void) const;
@@ -69,6 +86,8 @@ public:
     void save_bundle (void);
     /** Forces rewriting of all views. Can take a long time. */
     void rewrite_all_views (void);
+    /** Enables compressed MVEI images for all views, see View. */
+    void set_mvei_compression (bool enable);
 
     /** Returns true if one of the views or the bundle file is dirty. */
     bool is_dirty (void) const;
@@ -91,12 +110,13 @@ protected:
 
 private:
     std::string basedir;
+    SceneArchive::Ptr archive;
     ViewList views;
     Bundle::Ptr bundle;
     bool bundle_dirty;
 
 private:
-    void init_views (void);
+    void init_views (bool use_index);
 };
 
 /* ---------------------------------------------------------------- */
@@ -108,10 +128,10 @@ Scene::Scene (void)
 }
 
 inline Scene::Ptr
-Scene::create (std::string const& path)
+Scene::create (std::string const& path, bool use_index)
 {
     Scene::Ptr scene(new Scene);
-    scene->load_scene(path);
+    scene->load_scene(path, use_index);
     return scene;
 }
 
@@ -0,0 +1,605 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#   define NOMINMAX
+#   include <fcntl.h>
+#   include <io.h>
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <unistd.h>
+#endif
+
+#include "util/exception.h"
+#include "util/file_system.h"
+#include "mve/scene_archive.h"
+
+/*
+ * The archive starts with a header of 64 bytes: the signature, padded with
+ * zeros to 16 bytes, and the version as 32 bit integer. The header is
+ * followed by records, which start at multiples of 64 bytes. A record
+ * consists of the record magic, the type (uint32), the payload size
+ * (uint64), the length of the path (uint32), a reserved field (uint32),
+ * and the path. The payload follows, aligned to 64 bytes, and is padded
+ * to 64 bytes.
+ */
+#define MVE_ARCHIVE_SIGNATURE "\211MVE_PACK\n"
+#define MVE_ARCHIVE_SIGNATURE_LEN 10
+#define MVE_ARCHIVE_VERSION 1
+#define MVE_ARCHIVE_ALIGNMENT 64
+#define MVE_ARCHIVE_RECORD_MAGIC "MVER"
+#define MVE_ARCHIVE_RECORD_HEADER_LEN 24
+#define MVE_ARCHIVE_MAX_PATH_LEN 4096
+
+MVE_NAMESPACE_BEGIN
+
+namespace
+{
+    enum RecordType
+    {
+        /* Payload is the file data. */
+        RECORD_FILE = 1,
+        /* Removes the file, no payload. */
+        RECORD_REMOVE = 2,
+        /* Payload is the number of files, and per file the offset and
+         * size of the data, the path length and the path. */
+        RECORD_INDEX = 3,
+        /* Payload is the offset of the index record. The trailer is
+         * always the last record of an archive with a valid index. */
+        RECORD_TRAILER = 4,
+        /* Covers incomplete records after a crash, no meaning. */
+        RECORD_PADDING = 5,
+        /* Payload is the file data, not visible until committed. */
+        RECORD_STAGED = 6,
+        /* Payload is the number of files, and per file the offset and
+         * size of the staged data, the path length and the path. */
+        RECORD_COMMIT = 7
+    };
+
+    /* Size of a record with empty path and an 8 byte payload. */
+    uint64_t const TRAILER_SIZE = 2 * MVE_ARCHIVE_ALIGNMENT;
+
+    uint64_t
+    align_offset (uint64_t offset)
+    {
+        return (offset + MVE_ARCHIVE_ALIGNMENT - 1)
+            / MVE_ARCHIVE_ALIGNMENT * MVE_ARCHIVE_ALIGNMENT;
+    }
+
+    template <typename T>
+    void
+    append_value (std::string* buffer, T const& value)
+    {
+        buffer->append(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    void
+    append_entry (std::string* buffer, std::string const& path,
+        uint64_t offset, uint64_t size)
+    {
+        append_value<uint64_t>(buffer, offset);
+        append_value<uint64_t>(buffer, size);
+        append_value<uint32_t>(buffer, static_cast<uint32_t>(path.size()));
+        buffer->append(path);
+    }
+
+    template <typename T>
+    bool
+    parse_value (char const** ptr, char const* end, T* value)
+    {
+        if (end - *ptr < static_cast<std::ptrdiff_t>(sizeof(T)))
+            return false;
+        std::memcpy(value, *ptr, sizeof(T));
+        *ptr += sizeof(T);
+        return true;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+SceneArchive::Ptr
+SceneArchive::open (std::string const& filename)
+{
+    return Ptr(new SceneArchive(filename));
+}
+
+/* ---------------------------------------------------------------- */
+
+SceneArchive::SceneArchive (std::string const& filename)
+    : filename(filename)
+    , read_fd(-1)
+    , file_size(0)
+    , end_offset(0)
+    , read_only(false)
+    , dirty(false)
+{
+    if (!util::fs::file_exists(filename.c_str()))
+    {
+        std::string header(MVE_ARCHIVE_SIGNATURE);
+        header.resize(16, '\0');
+        append_value<uint32_t>(&header, MVE_ARCHIVE_VERSION);
+        header.resize(MVE_ARCHIVE_ALIGNMENT, '\0');
+        util::fs::write_string_to_file(header, filename);
+    }
+
+    this->file.open(filename.c_str(),
+        std::ios::in | std::ios::out | std::ios::binary);
+    if (!this->file.is_open())
+    {
+        this->read_only = true;
+        this->file.clear();
+        this->file.open(filename.c_str(), std::ios::in | std::ios::binary);
+    }
+    if (!this->file.is_open())
+        throw util::FileException(filename, std::strerror(errno));
+
+    char header[MVE_ARCHIVE_ALIGNMENT];
+    uint32_t version = 0;
+    this->file.read(header, MVE_ARCHIVE_ALIGNMENT);
+    std::memcpy(&version, header + 16, sizeof(uint32_t));
+    if (!this->file || std::memcmp(header, MVE_ARCHIVE_SIGNATURE,
+        MVE_ARCHIVE_SIGNATURE_LEN))
+        throw util::FileException(filename, "Invalid archive signature");
+    if (version != MVE_ARCHIVE_VERSION)
+        throw util::FileException(filename, "Unsupported archive version");
+
+    /* A separate descriptor for reading by offset without the lock. */
+#ifdef _WIN32
+    this->read_fd = ::_open(filename.c_str(), _O_RDONLY | _O_BINARY);
+#else
+    this->read_fd = ::open(filename.c_str(), O_RDONLY);
+#endif
+    if (this->read_fd < 0)
+        throw util::FileException(filename, std::strerror(errno));
+
+    this->file.seekg(0, std::ios::end);
+    this->file_size = this->file.tellg();
+    if (!this->read_index())
+        this->scan_log();
+}
+
+/* ---------------------------------------------------------------- */
+
+SceneArchive::~SceneArchive (void)
+{
+    try
+    {
+        this->flush();
+    }
+    catch (...)
+    {
+    }
+#ifdef _WIN32
+    ::_close(this->read_fd);
+#else
+    ::close(this->read_fd);
+#endif
+}
+
+/* ---------------------------------------------------------------- */
+
+std::vector<std::string>
+SceneArchive::get_directories (void)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::vector<std::string> result;
+    for (EntryMap::const_iterator iter = this->entries.begin();
+        iter != this->entries.end(); iter++)
+    {
+        std::size_t const pos = iter->first.find('/');
+        if (pos == std::string::npos)
+            continue;
+        std::string const directory = iter->first.substr(0, pos);
+        if (result.empty() || result.back() != directory)
+            result.push_back(directory);
+    }
+    return result;
+}
+
+/* ---------------------------------------------------------------- */
+
+std::vector<std::string>
+SceneArchive::get_files (std::string const& directory)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::string const prefix = directory + "/";
+    std::vector<std::string> result;
+    for (EntryMap::const_iterator iter = this->entries.lower_bound(prefix);
+        iter != this->entries.end(); iter++)
+    {
+        if (iter->first.compare(0, prefix.size(), prefix) != 0)
+            break;
+        std::string const name = iter->first.substr(prefix.size());
+        if (name.find('/') == std::string::npos)
+            result.push_back(name);
+    }
+    return result;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+SceneArchive::has_file (std::string const& path)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    return this->entries.find(path) != this->entries.end();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::read_file (std::string const& path, std::string* data)
+{
+    /* Records are never overwritten, the data is read without the lock. */
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        EntryMap::const_iterator iter = this->entries.find(path);
+        if (iter == this->entries.end())
+            throw util::FileException(path, "No such file in archive");
+        entry = iter->second;
+    }
+
+    data->resize(entry.size);
+    if (entry.size > 0
+        && !this->read_at(entry.offset, entry.size, &(*data)[0]))
+        throw util::FileException(this->filename, "Error reading archive");
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::write_file (std::string const& path, std::string const& data)
+{
+    if (path.empty() || path.size() > MVE_ARCHIVE_MAX_PATH_LEN)
+        throw std::invalid_argument("Invalid path: " + path);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    Entry entry;
+    entry.offset = this->append_record(RECORD_FILE, path,
+        data.data(), data.size());
+    entry.size = data.size();
+    this->entries[path] = entry;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::remove_file (std::string const& path)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    if (this->entries.find(path) == this->entries.end())
+        return;
+    this->append_record(RECORD_REMOVE, path, nullptr, 0);
+    this->entries.erase(path);
+}
+
+/* ---------------------------------------------------------------- */
+
+SceneArchive::StagedFile
+SceneArchive::stage_file (std::string const& path, std::string const& data)
+{
+    if (path.empty() || path.size() > MVE_ARCHIVE_MAX_PATH_LEN)
+        throw std::invalid_argument("Invalid path: " + path);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    StagedFile staged;
+    staged.path = path;
+    staged.offset = this->append_record(RECORD_STAGED, path,
+        data.data(), data.size());
+    staged.size = data.size();
+    return staged;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::commit_files (StagedFiles const& files)
+{
+    if (files.empty())
+        return;
+
+    std::string commit;
+    append_value<uint64_t>(&commit, files.size());
+    for (std::size_t i = 0; i < files.size(); ++i)
+        append_entry(&commit, files[i].path, files[i].offset, files[i].size);
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->append_record(RECORD_COMMIT, "", commit.data(), commit.size());
+    for (std::size_t i = 0; i < files.size(); ++i)
+    {
+        Entry entry;
+        entry.offset = files[i].offset;
+        entry.size = files[i].size;
+        this->entries[files[i].path] = entry;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::flush (void)
+{
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->flush_intern();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+SceneArchive::read_record (uint64_t offset, Record* record)
+{
+    char header[MVE_ARCHIVE_RECORD_HEADER_LEN];
+    if (offset + MVE_ARCHIVE_ALIGNMENT > this->file_size)
+        return false;
+    this->file.clear();
+    this->file.seekg(offset);
+    this->file.read(header, MVE_ARCHIVE_RECORD_HEADER_LEN);
+    if (!this->file || std::memcmp(header, MVE_ARCHIVE_RECORD_MAGIC, 4))
+        return false;
+
+    uint32_t path_len;
+    std::memcpy(&record->type, header + 4, sizeof(uint32_t));
+    std::memcpy(&record->size, header + 8, sizeof(uint64_t));
+    std::memcpy(&path_len, header + 16, sizeof(uint32_t));
+    if (record->type < RECORD_FILE || record->type > RECORD_COMMIT
+        || path_len > MVE_ARCHIVE_MAX_PATH_LEN
+        || record->size > this->file_size)
+        return false;
+
+    record->payload_offset = offset
+        + align_offset(MVE_ARCHIVE_RECORD_HEADER_LEN + path_len);
+    record->next_offset = record->payload_offset
+        + align_offset(record->size);
+    if (record->next_offset > this->file_size)
+        return false;
+
+    record->path.resize(path_len);
+    this->file.read(&record->path[0], path_len);
+    return !this->file.fail();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+SceneArchive::read_payload (uint64_t offset, uint64_t size,
+    std::string* data)
+{
+    data->resize(size);
+    this->file.clear();
+    this->file.seekg(offset);
+    this->file.read(&(*data)[0], size);
+    return !this->file.fail();
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+SceneArchive::read_at (uint64_t offset, uint64_t size, char* data)
+{
+    /* Reads by offset do not change the file position, no lock needed. */
+    while (size > 0)
+    {
+        std::size_t const chunk = static_cast<std::size_t>(
+            std::min<uint64_t>(size, 1u << 30));
+#ifdef _WIN32
+        HANDLE handle = reinterpret_cast<HANDLE>(
+            ::_get_osfhandle(this->read_fd));
+        OVERLAPPED overlapped;
+        std::memset(&overlapped, 0, sizeof(OVERLAPPED));
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD num_read = 0;
+        if (!::ReadFile(handle, data, static_cast<DWORD>(chunk),
+            &num_read, &overlapped) || num_read == 0)
+            return false;
+#else
+        ssize_t const num_read = ::pread(this->read_fd, data, chunk,
+            static_cast<off_t>(offset));
+        if (num_read < 0 && errno == EINTR)
+            continue;
+        if (num_read <= 0)
+            return false;
+#endif
+        offset += num_read;
+        size -= num_read;
+        data += num_read;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+SceneArchive::parse_entries (std::string const& data, uint64_t max_offset,
+    EntryMap* entries)
+{
+    char const* ptr = data.data();
+    char const* end = ptr + data.size();
+    uint64_t num_entries;
+    if (!parse_value(&ptr, end, &num_entries))
+        return false;
+    for (uint64_t i = 0; i < num_entries; ++i)
+    {
+        Entry entry;
+        uint32_t path_len;
+        if (!parse_value(&ptr, end, &entry.offset)
+            || !parse_value(&ptr, end, &entry.size)
+            || !parse_value(&ptr, end, &path_len)
+            || end - ptr < static_cast<std::ptrdiff_t>(path_len)
+            || entry.offset + entry.size > max_offset)
+            return false;
+        (*entries)[std::string(ptr, path_len)] = entry;
+        ptr += path_len;
+    }
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+SceneArchive::read_index (void)
+{
+    if (this->file_size < MVE_ARCHIVE_ALIGNMENT + TRAILER_SIZE)
+        return false;
+
+    Record record;
+    std::string data;
+    uint64_t index_offset;
+    if (!this->read_record(this->file_size - TRAILER_SIZE, &record)
+        || record.type != RECORD_TRAILER
+        || record.size != sizeof(uint64_t)
+        || !this->read_payload(record.payload_offset, record.size, &data))
+        return false;
+    std::memcpy(&index_offset, data.data(), sizeof(uint64_t));
+    if (index_offset % MVE_ARCHIVE_ALIGNMENT != 0
+        || !this->read_record(index_offset, &record)
+        || record.type != RECORD_INDEX
+        || !this->read_payload(record.payload_offset, record.size, &data))
+        return false;
+
+    if (!parse_entries(data, index_offset, &this->entries))
+    {
+        this->entries.clear();
+        return false;
+    }
+
+    this->end_offset = this->file_size;
+    return true;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::scan_log (void)
+{
+    /*
+     * The log is replayed up to the first invalid record. Records after
+     * that have not been completely written and are lost.
+     */
+    Record record;
+    uint64_t offset = MVE_ARCHIVE_ALIGNMENT;
+    while (this->read_record(offset, &record))
+    {
+        if (record.type == RECORD_FILE)
+        {
+            Entry entry;
+            entry.offset = record.payload_offset;
+            entry.size = record.size;
+            this->entries[record.path] = entry;
+        }
+        else if (record.type == RECORD_REMOVE)
+            this->entries.erase(record.path);
+        else if (record.type == RECORD_COMMIT)
+        {
+            /* Commits only refer to staged data before the commit. */
+            std::string data;
+            EntryMap committed;
+            if (!this->read_payload(record.payload_offset, record.size,
+                &data) || !parse_entries(data, offset, &committed))
+                break;
+            for (EntryMap::const_iterator iter = committed.begin();
+                iter != committed.end(); ++iter)
+                this->entries[iter->first] = iter->second;
+        }
+        offset = record.next_offset;
+    }
+    this->end_offset = offset;
+    this->dirty = true;
+}
+
+/* ---------------------------------------------------------------- */
+
+uint64_t
+SceneArchive::append_record (uint32_t type, std::string const& path,
+    char const* data, uint64_t size)
+{
+    if (this->read_only)
+        throw util::FileException(this->filename, "Archive is read-only");
+
+    /*
+     * After a crash, the file may end with an incomplete record. This is
+     * overwritten with a padding record such that the end of the file is
+     * again the end of the last record.
+     */
+    std::string buffer;
+    if (this->end_offset < this->file_size)
+    {
+        uint64_t const padded_end = align_offset(this->file_size);
+        buffer.append(MVE_ARCHIVE_RECORD_MAGIC, 4);
+        append_value<uint32_t>(&buffer, RECORD_PADDING);
+        append_value<uint64_t>(&buffer, padded_end - this->end_offset
+            - MVE_ARCHIVE_ALIGNMENT);
+        append_value<uint32_t>(&buffer, 0);
+        append_value<uint32_t>(&buffer, 0);
+        buffer.resize(padded_end - this->end_offset, '\0');
+    }
+
+    buffer.append(MVE_ARCHIVE_RECORD_MAGIC, 4);
+    append_value<uint32_t>(&buffer, type);
+    append_value<uint64_t>(&buffer, size);
+    append_value<uint32_t>(&buffer, static_cast<uint32_t>(path.size()));
+    append_value<uint32_t>(&buffer, 0);
+    buffer.append(path);
+    buffer.resize(align_offset(buffer.size()), '\0');
+
+    uint64_t const payload_offset = this->end_offset + buffer.size();
+    uint64_t const padding = align_offset(size) - size;
+    this->file.clear();
+    this->file.seekp(this->end_offset);
+    this->file.write(buffer.data(), buffer.size());
+    this->file.write(data, size);
+    this->file.write(std::string(padding, '\0').data(), padding);
+    /* Flush for the reads with the separate descriptor. */
+    this->file.flush();
+    if (!this->file.good())
+        throw util::FileException(this->filename, "Error writing archive");
+
+    this->end_offset = payload_offset + size + padding;
+    this->file_size = std::max(this->file_size, this->end_offset);
+    this->dirty = true;
+    return payload_offset;
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+SceneArchive::flush_intern (void)
+{
+    if (!this->dirty || this->read_only)
+        return;
+
+    std::string index;
+    append_value<uint64_t>(&index, this->entries.size());
+    for (EntryMap::const_iterator iter = this->entries.begin();
+        iter != this->entries.end(); iter++)
+    {
+        append_entry(&index, iter->first, iter->second.offset,
+            iter->second.size);
+    }
+
+    uint64_t const index_offset = this->append_record(RECORD_INDEX, "",
+        index.data(), index.size()) - MVE_ARCHIVE_ALIGNMENT;
+    std::string trailer;
+    append_value<uint64_t>(&trailer, index_offset);
+    this->append_record(RECORD_TRAILER, "", trailer.data(), trailer.size());
+
+    this->file.flush();
+    if (!this->file.good())
+        throw util::FileException(this->filename, "Error writing archive");
+    this->dirty = false;
+}
+
+MVE_NAMESPACE_END
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_SCENE_ARCHIVE_HEADER
+#define MVE_SCENE_ARCHIVE_HEADER
+
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "mve/defines.h"
+
+MVE_NAMESPACE_BEGIN
+
+/**
+ * Single-file container for the views of a scene. The archive stores
+ * files by path, such as "view_0000.mve/meta.ini", in an append-only log
+ * of records. Writing a file appends a new record, removing a file
+ * appends a removal record, and the previous data becomes unused space.
+ * A central index of all files is appended by flush(), and a trailer at
+ * the end of the file locates the latest index. If the trailer is
+ * missing, for example after a crash, the index is rebuilt by scanning
+ * the log, and incomplete records at the end are discarded.
+ *
+ * Files can also be staged, which appends the data without making it
+ * visible, and committed later with a single record. Staged files that
+ * are never committed become unused space, also after a crash.
+ *
+ * File payloads start at multiples of 64 bytes. Uncompressed data can
+ * therefore be memory-mapped directly. All operations are thread-safe.
+ * Files are read by offset without holding the archive lock, so reads
+ * do not wait for other reads or writes.
+ */
+class SceneArchive
+{
+public:
+    typedef std::shared_ptr<SceneArchive> Ptr;
+
+    /** File data written by stage_file(). */
+    struct StagedFile
+    {
+        std::string path;
+        uint64_t offset;
+        uint64_t size;
+    };
+    typedef std::vector<StagedFile> StagedFiles;
+
+public:
+    /**
+     * Opens the archive, or creates an empty archive if missing. Archives
+     * without write permission are opened read-only.
+     * May throw util::FileException.
+     */
+    static Ptr open (std::string const& filename);
+
+    /** Flushes the index, errors are ignored. */
+    ~SceneArchive (void);
+
+    SceneArchive (SceneArchive const&) = delete;
+    SceneArchive& operator= (SceneArchive const&) = delete;
+
+    /** Returns the file name of the archive. */
+    std::string const& get_filename (void) const;
+
+    /** Returns the sorted list of top-level directories. */
+    std::vector<std::string> get_directories (void);
+    /** Returns the sorted names of the files in the directory. */
+    std::vector<std::string> get_files (std::string const& directory);
+    /** Returns true if the file exists. */
+    bool has_file (std::string const& path);
+
+    /** Reads the file, throws util::FileException if missing. */
+    void read_file (std::string const& path, std::string* data);
+    /**
+     * Appends the file to the archive, replacing an existing file.
+     * May throw util::FileException.
+     */
+    void write_file (std::string const& path, std::string const& data);
+    /** Removes the file from the archive if it exists. */
+    void remove_file (std::string const& path);
+
+    /**
+     * Appends the file data to the archive without making it visible.
+     * May throw util::FileException.
+     */
+    StagedFile stage_file (std::string const& path, std::string const& data);
+    /**
+     * Makes the staged files visible, replacing existing files.
+     * May throw util::FileException.
+     */
+    void commit_files (StagedFiles const& files);
+
+    /** Writes the index if files have been written or removed. */
+    void flush (void);
+
+private:
+    struct Entry
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+    typedef std::map<std::string, Entry> EntryMap;
+
+    struct Record
+    {
+        uint32_t type;
+        uint64_t size;
+        std::string path;
+        uint64_t payload_offset;
+        uint64_t next_offset;
+    };
+
+private:
+    SceneArchive (std::string const& filename);
+    bool read_record (uint64_t offset, Record* record);
+    bool read_payload (uint64_t offset, uint64_t size, std::string* data);
+    bool read_at (uint64_t offset, uint64_t size, char* data);
+    static bool parse_entries (std::string const& data,
+        uint64_t max_offset, EntryMap* entries);
+    bool read_index (void);
+    void scan_log (void);
+    uint64_t append_record (uint32_t type, std::string const& path,
+        char const* data, uint64_t size);
+    void flush_intern (void);
+
+private:
+    std::string filename;
+    std::fstream file;
+    int read_fd;
+    EntryMap entries;
+    uint64_t file_size;
+    uint64_t end_offset;
+    bool read_only;
+    bool dirty;
+    std::mutex mutex;
+};
+
+/* ------------------------- Implementation ----------------------- */
+
+inline std::string const&
+SceneArchive::get_filename (void) const
+{
+    return this->filename;
+}
+
+MVE_NAMESPACE_END
+
+#endif /* MVE_SCENE_ARCHIVE_HEADER */
@@ -7,8 +7,10 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <cstring>
 #include <cerrno>
 
@@ -22,6 +24,8 @@
 #define VIEW_IO_META_FILE "meta.ini"
 #define VIEW_IO_BLOB_SIGNATURE "\211MVE_BLOB\n"
 #define VIEW_IO_BLOB_SIGNATURE_LEN 10
+#define VIEW_IO_JOURNAL_FILE "save.journal"
+#define VIEW_IO_JOURNAL_SIGNATURE "MVE_VIEW_JOURNAL"
 
 /* The signature to identify deprecated MVE files. */
 #define VIEW_MVE_FILE_SIGNATURE "\211MVE\n"
@@ -35,6 +39,7 @@ View::load_view (std::string const& user_path)
     std::string safe_path = util::fs::sanitize_path(user_path);
     safe_path = util::fs::abspath(safe_path);
     this->deprecated_format_check(safe_path);
+    this->recover_journal(safe_path);
 
     /* Open meta.ini and populate images and blobs. */
     //std::cout << "View: Loading view: " << path << std::endl;
@@ -52,6 +57,49 @@ View::load_view (std::string const& user_path)
     }
 }
 
+void
+View::load_view (SceneArchive::Ptr archive, std::string const& name)
+{
+    if (archive == nullptr || name.empty())
+        throw std::invalid_argument("Invalid archive or view name");
+
+    this->clear();
+    try
+    {
+        this->archive = archive;
+        this->load_meta_data(name);
+        this->populate_images_and_blobs(name);
+        this->path = name;
+    }
+    catch (...)
+    {
+        this->clear();
+        throw;
+    }
+}
+
+void
+View::load_view_from_index (std::string const& path,
+    MetaData::KeyValueMap const& data,
+    std::vector<std::string> const& filenames)
+{
+    this->clear();
+    this->meta_data.data = data;
+    this->meta_data.is_dirty = false;
+    try
+    {
+        this->load_camera_from_meta_data();
+        for (std::size_t i = 0; i < filenames.size(); ++i)
+            this->add_file_proxy(filenames[i]);
+        this->path = path;
+    }
+    catch (...)
+    {
+        this->clear();
+        throw;
+    }
+}
+
 void
 View::load_view_from_mve_file  (std::string const& filename)
 {
@@ -182,6 +230,13 @@ View::reload_view (void)
 {
     if (this->path.empty())
         throw std::runtime_error("View not initialized");
+    if (this->archive != nullptr)
+    {
+        SceneArchive::Ptr archive = this->archive;
+        std::string const name = this->path;
+        this->load_view(archive, name);
+        return;
+    }
     this->load_view(this->path);
 }
 
@@ -199,69 +254,178 @@ View::save_view_as (std::string const& user_path)
         if (!util::fs::mkdir(safe_path.c_str()))
             throw util::FileException(safe_path, std::strerror(errno));
 
-    /* Load all images and BLOBS. */
-    for (std::size_t i = 0; i < this->images.size(); ++i)
-    {
-        /* Image references will be copied on save. No need to load it here. */
-        if (!util::fs::is_absolute(this->images[i].filename))
-            this->load_image(&this->images[i], false);
-        this->images[i].is_dirty = true;
-    }
-    for (std::size_t i = 0; i < this->blobs.size(); ++i)
-    {
-        this->load_blob(&this->blobs[i], false);
-        this->blobs[i].is_dirty = true;
-    }
-
     /* Save meta data, images and BLOBS, and free memory. */
+    this->load_all_embeddings();
+    this->archive.reset();
     this->save_meta_data(safe_path);
     this->path = safe_path;
     this->save_view();
     this->cache_cleanup();
 }
 
+void
+View::save_view_as (SceneArchive::Ptr archive, std::string const& name)
+{
+    if (archive == nullptr || name.empty())
+        throw std::invalid_argument("Invalid archive or view name");
+
+    /* Save meta data, images and BLOBS, and free memory. */
+    this->load_all_embeddings();
+    this->archive = archive;
+    this->save_meta_data(name);
+    this->path = name;
+    this->save_view();
+    this->cache_cleanup();
+}
+
 int
 View::save_view (void)
+{
+    int const saved = this->save_view_prepare();
+    this->save_view_journal(false);
+    this->save_view_commit(false);
+    return saved;
+}
+
+int
+View::save_view_prepare (void)
 {
     if (this->path.empty())
         throw std::runtime_error("View not initialized");
 
-    /* Save meta data. */
-    int saved = 0;
-    if (this->meta_data.is_dirty)
-    {
-        this->save_meta_data(this->path);
-        saved += 1;
-    }
+    /*
+     * Saved items are marked clean right away. If saving fails, the state
+     * is restored, the temporary files are removed and data staged in
+     * the archive is discarded, so that the view stays dirty and can be
+     * saved again.
+     */
+    bool const meta_dirty = this->meta_data.is_dirty;
+    ImageProxies const images_orig = this->images;
+    BlobProxies const blobs_orig = this->blobs;
+    std::size_t const num_replace = this->to_replace.size();
+    std::size_t const num_delete = this->to_delete.size();
+    std::size_t const num_staged = this->archive_staged.size();
 
-    /* Save dirty images. */
-    for (std::size_t i = 0; i < this->images.size(); ++i)
+    int saved = 0;
+    try
     {
-        if (this->images[i].is_dirty)
+        /* Save meta data. */
+        if (this->meta_data.is_dirty)
         {
-            this->save_image_intern(&this->images[i]);
+            this->save_meta_data(this->path);
             saved += 1;
         }
+
+        /* Save dirty images. */
+        for (std::size_t i = 0; i < this->images.size(); ++i)
+        {
+            if (this->images[i].is_dirty)
+            {
+                this->save_image_intern(&this->images[i]);
+                saved += 1;
+            }
+        }
+
+        /* Save dirty BLOBS. */
+        for (std::size_t i = 0; i < this->blobs.size(); ++i)
+        {
+            if (this->blobs[i].is_dirty)
+            {
+                this->save_blob_intern(&this->blobs[i]);
+                saved += 1;
+            }
+        }
+    }
+    catch (...)
+    {
+        for (std::size_t i = num_replace; i < this->to_replace.size(); ++i)
+            if (this->archive == nullptr)
+                util::fs::unlink(util::fs::join_path(this->path,
+                    this->to_replace[i] + ".new").c_str());
+        this->to_replace.resize(num_replace);
+        this->to_delete.resize(num_delete);
+        this->archive_staged.resize(num_staged);
+        this->meta_data.is_dirty = meta_dirty;
+        this->images = images_orig;
+        this->blobs = blobs_orig;
+        throw;
     }
 
-    /* Save dirty BLOBS. */
-    for (std::size_t i = 0; i < this->blobs.size(); ++i)
+    return saved;
+}
+
+void
+View::save_view_journal (bool sync_files)
+{
+    if (this->archive != nullptr)
+        return;
+    if (this->to_replace.empty() && this->to_delete.empty())
+        return;
+
+    if (sync_files)
     {
-        if (this->blobs[i].is_dirty)
+        for (std::size_t i = 0; i < this->to_replace.size(); ++i)
         {
-            this->save_blob_intern(&this->blobs[i]);
-            saved += 1;
+            std::string fname = util::fs::join_path(this->path,
+                this->to_replace[i] + ".new");
+            if (!util::fs::sync_file(fname.c_str()))
+                throw util::FileException(fname, std::strerror(errno));
         }
     }
 
+    /*
+     * Files that are replaced are not deleted, otherwise replaying the
+     * journal could delete the new file after it has been moved in place.
+     */
+    std::string const fname = util::fs::join_path(this->path,
+        VIEW_IO_JOURNAL_FILE);
+    std::ofstream out(fname.c_str(), std::ios::binary);
+    if (!out.good())
+        throw util::FileException(fname, std::strerror(errno));
+    out << VIEW_IO_JOURNAL_SIGNATURE << "\n";
+    for (std::size_t i = 0; i < this->to_delete.size(); ++i)
+        if (!this->to_delete[i].empty() && std::find(this->to_replace.begin(),
+            this->to_replace.end(), this->to_delete[i])
+            == this->to_replace.end())
+            out << "delete " << this->to_delete[i] << "\n";
+    for (std::size_t i = 0; i < this->to_replace.size(); ++i)
+        out << "replace " << this->to_replace[i] << "\n";
+    out << "end\n";
+    out.close();
+    if (!out.good())
+        throw util::FileException(fname, "Error writing journal");
+
+    if (sync_files && !util::fs::sync_file(fname.c_str()))
+        throw util::FileException(fname, std::strerror(errno));
+
+    /* Sync the directory entry of the journal. */
+    if (sync_files && !util::fs::sync_file(this->path.c_str()))
+        throw util::FileException(this->path, std::strerror(errno));
+}
+
+void
+View::save_view_commit (bool sync_files)
+{
+    /* Make the files written to the archive visible. */
+    if (this->archive != nullptr)
+        this->archive->commit_files(this->archive_staged);
+    this->archive_staged.clear();
+
     /* Delete files of removed images and BLOBs. */
     for (std::size_t i = 0; i < this->to_delete.size(); ++i)
     {
         //std::cout << "View: Deleting file: "
         //    << this->to_delete[i] << std::endl;
 
+        if (this->to_delete[i].empty() || std::find(this->to_replace.begin(),
+            this->to_replace.end(), this->to_delete[i])
+            != this->to_replace.end())
+            continue;
+
         std::string fname = util::fs::join_path(this->path, this->to_delete[i]);
-        if (util::fs::file_exists(fname.c_str())
+        if (this->archive != nullptr)
+            this->archive->remove_file(fname);
+        else if (util::fs::file_exists(fname.c_str())
             && !util::fs::unlink(fname.c_str()))
         {
             std::cerr << "View: Error deleting " << fname
@@ -271,17 +435,39 @@ View::save_view (void)
     }
     this->to_delete.clear();
 
-    return saved;
+    /* Move the new files in place and remove the journal. */
+    if (this->archive == nullptr && !this->to_replace.empty())
+    {
+        for (std::size_t i = 0; i < this->to_replace.size(); ++i)
+        {
+            std::string fname = util::fs::join_path(this->path,
+                this->to_replace[i]);
+            this->replace_file(fname, fname + ".new");
+        }
+
+        /* The renames must be on disk before the journal is removed. */
+        if (sync_files && !util::fs::sync_file(this->path.c_str()))
+            throw util::FileException(this->path, std::strerror(errno));
+    }
+    this->to_replace.clear();
+
+    std::string const fname = util::fs::join_path(this->path,
+        VIEW_IO_JOURNAL_FILE);
+    if (this->archive == nullptr && util::fs::file_exists(fname.c_str()))
+        util::fs::unlink(fname.c_str());
 }
 
 void
 View::clear (void)
 {
     this->path.clear();
+    this->archive.reset();
     this->meta_data = MetaData();
     this->images.clear();
     this->blobs.clear();
     this->to_delete.clear();
+    this->to_replace.clear();
+    this->archive_staged.clear();
 }
 
 bool
@@ -408,6 +594,144 @@ View::get_image (std::string const& name, ImageType type)
     return ImageBase::Ptr();
 }
 
+namespace
+{
+    /*
+     * Input stream buffer on memory, such as files read from an archive.
+     * Unlike std::istringstream, the data is not copied.
+     */
+    class MemoryStreamBuf : public std::streambuf
+    {
+    public:
+        MemoryStreamBuf (std::string const& data)
+        {
+            char* begin = const_cast<char*>(data.data());
+            this->setg(begin, begin, begin + data.size());
+        }
+
+    protected:
+        pos_type
+        seekoff (off_type off, std::ios_base::seekdir dir,
+            std::ios_base::openmode /*which*/) override
+        {
+            off_type pos = off;
+            if (dir == std::ios_base::cur)
+                pos += this->gptr() - this->eback();
+            else if (dir == std::ios_base::end)
+                pos += this->egptr() - this->eback();
+            if (pos < 0 || pos > this->egptr() - this->eback())
+                return pos_type(off_type(-1));
+            this->setg(this->eback(), this->eback() + pos, this->egptr());
+            return pos_type(pos);
+        }
+
+        pos_type
+        seekpos (pos_type pos, std::ios_base::openmode which) override
+        {
+            return this->seekoff(off_type(pos), std::ios_base::beg, which);
+        }
+    };
+
+    std::string
+    get_file_extension (std::string const& filename)
+    {
+        std::size_t pos = filename.find_last_of('.');
+        if (pos == std::string::npos)
+            return std::string();
+        return util::string::lowercase(filename.substr(pos));
+    }
+
+    image::ImageHeaders
+    load_image_headers_from_stream (std::istream& in,
+        std::string const& filename)
+    {
+        std::string const ext = get_file_extension(filename);
+        if (ext == ".png")
+            return image::load_png_file_headers(in);
+        if (ext == ".jpg" || ext == ".jpeg")
+            return image::load_jpg_file_headers(in);
+        if (ext == ".mvei")
+            return image::load_mvei_file_headers(in);
+        throw std::runtime_error("Unexpected image type");
+    }
+
+    ImageBase::Ptr
+    load_image_from_stream (std::istream& in, std::string const& filename)
+    {
+        std::string const ext = get_file_extension(filename);
+        if (ext == ".png")
+            return image::load_png_file(in);
+        if (ext == ".jpg" || ext == ".jpeg")
+            return image::load_jpg_file(in);
+        if (ext == ".mvei")
+            return image::load_mvei_file(in);
+        throw std::runtime_error("Unexpected image type");
+    }
+
+    ImageBase::Ptr
+    crop_image_region (ImageBase::ConstPtr image,
+        int x, int y, int width, int height)
+    {
+        ImageBase::Ptr region = image::create_for_type(image->get_type(),
+            width, height, image->channels());
+        std::size_t const num_pixels
+            = static_cast<std::size_t>(image->width()) * image->height();
+        if (num_pixels == 0)
+            return region;
+        std::size_t const pixel_size = image->get_byte_size() / num_pixels;
+        std::size_t const row_size = width * pixel_size;
+        for (int i = 0; i < height; ++i)
+        {
+            char const* src = image->get_byte_pointer() + pixel_size
+                * (static_cast<std::size_t>(y + i) * image->width() + x);
+            std::copy(src, src + row_size,
+                region->get_byte_pointer() + i * row_size);
+        }
+        return region;
+    }
+}
+
+ImageBase::Ptr
+View::get_image_region (std::string const& name,
+    int x, int y, int width, int height)
+{
+    View::ImageProxy* proxy = this->find_image_intern(name);
+    if (proxy == nullptr)
+        return ImageBase::Ptr();
+
+    this->initialize_image(proxy, false);
+    if (x < 0 || y < 0 || width < 0 || height < 0
+        || x + width > proxy->width || y + height > proxy->height)
+        throw std::invalid_argument("Region exceeds image dimensions");
+
+    if (proxy->image != nullptr)
+        return crop_image_region(proxy->image, x, y, width, height);
+
+    /* If the file name is absolute, it indicates an image reference. */
+    std::string filename;
+    if (util::fs::is_absolute(proxy->filename))
+        filename = proxy->filename;
+    else
+        filename = util::fs::join_path(this->path, proxy->filename);
+
+    if (this->archive != nullptr && !util::fs::is_absolute(proxy->filename))
+    {
+        std::string data;
+        this->archive->read_file(filename, &data);
+        MemoryStreamBuf buffer(data);
+        std::istream in(&buffer);
+        ImageBase::Ptr image = load_image_from_stream(in, proxy->filename);
+        return crop_image_region(image, x, y, width, height);
+    }
+
+    std::string ext5 = util::string::right(proxy->filename, 5);
+    if (util::string::lowercase(ext5) == ".mvei")
+        return image::load_mvei_file_region(filename, x, y, width, height);
+
+    ImageBase::Ptr image = image::load_file(filename);
+    return crop_image_region(image, x, y, width, height);
+}
+
 View::ImageProxy const*
 View::get_image_proxy (std::string const& name, ImageType type)
 {
@@ -577,19 +901,100 @@ View::deprecated_format_check (std::string const& path)
     }
 }
 
+void
+View::recover_journal (std::string const& path)
+{
+    std::string const fname = util::fs::join_path(path, VIEW_IO_JOURNAL_FILE);
+    if (!util::fs::file_exists(fname.c_str()))
+        return;
+
+    /*
+     * An incomplete journal indicates that the save was interrupted before
+     * any file was replaced, the temporary files are removed. Otherwise,
+     * the save is completed. Replaying is idempotent, files that have
+     * already been moved are skipped.
+     */
+    FilenameList deletes, replaces;
+    bool complete = false;
+    std::ifstream in(fname.c_str(), std::ios::binary);
+    std::string line;
+    std::getline(in, line);
+    bool const valid = (line == VIEW_IO_JOURNAL_SIGNATURE);
+    while (valid && std::getline(in, line))
+    {
+        if (line == "end")
+        {
+            complete = true;
+            break;
+        }
+        else if (line.compare(0, 7, "delete ") == 0)
+            deletes.push_back(line.substr(7));
+        else if (line.compare(0, 8, "replace ") == 0)
+            replaces.push_back(line.substr(8));
+        else
+            break;
+    }
+    in.close();
+
+    if (complete)
+    {
+        std::cerr << "View: Completing interrupted save of "
+            << path << std::endl;
+        for (std::size_t i = 0; i < deletes.size(); ++i)
+        {
+            std::string fn = util::fs::join_path(path, deletes[i]);
+            if (util::fs::file_exists(fn.c_str()))
+                util::fs::unlink(fn.c_str());
+        }
+        for (std::size_t i = 0; i < replaces.size(); ++i)
+        {
+            std::string fn = util::fs::join_path(path, replaces[i]);
+            if (util::fs::file_exists((fn + ".new").c_str()))
+                this->replace_file(fn, fn + ".new");
+        }
+    }
+    else
+    {
+        for (std::size_t i = 0; i < replaces.size(); ++i)
+        {
+            std::string fn = util::fs::join_path(path, replaces[i] + ".new");
+            if (util::fs::file_exists(fn.c_str()))
+                util::fs::unlink(fn.c_str());
+        }
+    }
+    util::fs::unlink(fname.c_str());
+}
+
 void
 View::load_meta_data (std::string const& path)
 {
     std::string const fname = util::fs::join_path(path, VIEW_IO_META_FILE);
 
     /* Open file and read key/value pairs. */
-    std::ifstream in(fname.c_str());
-    if (!in.good())
-        throw util::FileException(fname, "Error opening");
-    util::parse_ini(in, &this->meta_data.data);
+    if (this->archive != nullptr)
+    {
+        std::string data;
+        this->archive->read_file(fname, &data);
+        MemoryStreamBuf buffer(data);
+        std::istream in(&buffer);
+        util::parse_ini(in, &this->meta_data.data);
+    }
+    else
+    {
+        std::ifstream in(fname.c_str());
+        if (!in.good())
+            throw util::FileException(fname, "Error opening");
+        util::parse_ini(in, &this->meta_data.data);
+        in.close();
+    }
     this->meta_data.is_dirty = false;
-    in.close();
 
+    this->load_camera_from_meta_data();
+}
+
+void
+View::load_camera_from_meta_data (void)
+{
     /* Get camera data from key/value pairs. */
     std::string cam_fl = this->get_value("camera.focal_length");
     std::string cam_pa = this->get_value("camera.pixel_aspect");
@@ -621,6 +1026,19 @@ View::save_meta_data (std::string const& path)
     std::string const fname = util::fs::join_path(path, VIEW_IO_META_FILE);
     std::string const fname_new = fname + ".new";
 
+    if (this->archive != nullptr)
+    {
+        std::ostringstream out;
+        out << "# MVE view meta data is stored in INI-file syntax.\n";
+        out << "# This file is generated, formatting will get lost.\n";
+        util::write_ini(this->meta_data.data, out);
+        this->archive_staged.push_back(
+            this->archive->stage_file(fname, out.str()));
+        this->to_replace.push_back(VIEW_IO_META_FILE);
+        this->meta_data.is_dirty = false;
+        return;
+    }
+
     std::ofstream out(fname_new.c_str(), std::ios::binary);
     if (!out.good())
         throw util::FileException(fname_new, std::strerror(errno));
@@ -640,79 +1058,112 @@ View::save_meta_data (std::string const& path)
         throw;
     }
 
-    /* On succesfull write, move the new file in place. */
-    this->replace_file(fname, fname_new);
+    /* On succesfull write, the new file is moved in place on commit. */
+    this->to_replace.push_back(VIEW_IO_META_FILE);
     this->meta_data.is_dirty = false;
 }
 
 void
 View::populate_images_and_blobs (std::string const& path)
 {
+    if (this->archive != nullptr)
+    {
+        std::vector<std::string> files = this->archive->get_files(path);
+        for (std::size_t i = 0; i < files.size(); ++i)
+            if (files[i] != VIEW_IO_META_FILE)
+                this->add_file_proxy(files[i]);
+        return;
+    }
+
     util::fs::Directory dir(path);
     for (std::size_t i = 0; i < dir.size(); ++i)
     {
-        util::fs::File const& file = dir[i];
-        if (file.name == VIEW_IO_META_FILE)
+        if (dir[i].name == VIEW_IO_META_FILE
+            || dir[i].name == VIEW_IO_JOURNAL_FILE)
             continue;
+        this->add_file_proxy(dir[i].name);
+    }
+}
 
-        std::string ext4 = util::string::right(file.name, 4);
-        std::string ext5 = util::string::right(file.name, 5);
-        ext4 = util::string::lowercase(ext4);
-        ext5 = util::string::lowercase(ext5);
-
-        std::string name = file.name.substr(0, file.name.find_last_of('.'));
-        if (name.empty())
-        {
-            std::cerr << "View: Invalid file name "
-                << file.name << ", skipping." << std::endl;
-            continue;
-        }
-
-        /* Load image. */
-        if (ext4 == ".png" || ext4 == ".jpg" ||
-            ext5 == ".jpeg" || ext5 == ".mvei")
-        {
-            //std::cout << "View: Adding image proxy: "
-            //    << file.name << std::endl;
+void
+View::add_file_proxy (std::string const& filename)
+{
+    std::string ext4 = util::string::right(filename, 4);
+    std::string ext5 = util::string::right(filename, 5);
+    ext4 = util::string::lowercase(ext4);
+    ext5 = util::string::lowercase(ext5);
 
-            ImageProxy proxy;
-            proxy.is_dirty = false;
-            proxy.filename = file.name;
-            proxy.name = name;
-            this->images.push_back(proxy);
-        }
-        else if (ext5 == ".blob")
-        {
-            //std::cout << "View: Adding BLOB proxy: "
-            //    << file.name << std::endl;
+    std::string name = filename.substr(0, filename.find_last_of('.'));
+    if (name.empty())
+    {
+        std::cerr << "View: Invalid file name "
+            << filename << ", skipping." << std::endl;
+        return;
+    }
 
-            BlobProxy proxy;
-            proxy.is_dirty = false;
-            proxy.filename = file.name;
-            proxy.name = name;
-            this->blobs.push_back(proxy);
-        }
-        else
-        {
-            std::cerr << "View: Unrecognized extension "
-                << file.name << ", skipping." << std::endl;
-        }
+    /* Load image. */
+    if (ext4 == ".png" || ext4 == ".jpg" ||
+        ext5 == ".jpeg" || ext5 == ".mvei")
+    {
+        //std::cout << "View: Adding image proxy: "
+        //    << filename << std::endl;
+
+        ImageProxy proxy;
+        proxy.is_dirty = false;
+        proxy.filename = filename;
+        proxy.name = name;
+        this->images.push_back(proxy);
+    }
+    else if (ext5 == ".blob")
+    {
+        //std::cout << "View: Adding BLOB proxy: "
+        //    << filename << std::endl;
+
+        BlobProxy proxy;
+        proxy.is_dirty = false;
+        proxy.filename = filename;
+        proxy.name = name;
+        this->blobs.push_back(proxy);
+    }
+    else
+    {
+        std::cerr << "View: Unrecognized extension "
+            << filename << ", skipping." << std::endl;
     }
 }
 
 void
 View::replace_file (std::string const& old_fn, std::string const& new_fn)
 {
-    /* Delete old file. */
+    /* Rename new file, which atomically replaces the old file on POSIX. */
+    if (util::fs::rename(new_fn.c_str(), old_fn.c_str()))
+        return;
+
+    /* On Windows, the old file must be deleted first. */
     if (util::fs::file_exists(old_fn.c_str()))
         if (!util::fs::unlink(old_fn.c_str()))
             throw util::FileException(old_fn, std::strerror(errno));
-
-    /* Rename new file. */
     if (!util::fs::rename(new_fn.c_str(), old_fn.c_str()))
         throw util::FileException(new_fn, std::strerror(errno));
 }
 
+void
+View::load_all_embeddings (void)
+{
+    for (std::size_t i = 0; i < this->images.size(); ++i)
+    {
+        /* Image references will be copied on save. No need to load it here. */
+        if (!util::fs::is_absolute(this->images[i].filename))
+            this->load_image(&this->images[i], false);
+        this->images[i].is_dirty = true;
+    }
+    for (std::size_t i = 0; i < this->blobs.size(); ++i)
+    {
+        this->load_blob(&this->blobs[i], false);
+        this->blobs[i].is_dirty = true;
+    }
+}
+
 /* ---------------------------------------------------------------- */
 
 View::ImageProxy*
@@ -758,10 +1209,21 @@ View::load_image_intern (ImageProxy* proxy, bool init_only)
     else
         filename = util::fs::join_path(this->path, proxy->filename);
 
+    /* Images inside a scene archive are decoded from memory. */
+    bool const from_archive = this->archive != nullptr
+        && !util::fs::is_absolute(proxy->filename);
+    std::string data;
+    if (from_archive)
+        this->archive->read_file(filename, &data);
+    MemoryStreamBuf buffer(data);
+    std::istream in(&buffer);
+
     if (init_only)
     {
         //std::cout << "View: Initializing image " << filename << std::endl;
-        image::ImageHeaders headers = image::load_file_headers(filename);
+        image::ImageHeaders headers = from_archive
+            ? load_image_headers_from_stream(in, proxy->filename)
+            : image::load_file_headers(filename);
         proxy->is_dirty = false;
         proxy->width = headers.width;
         proxy->height = headers.height;
@@ -772,16 +1234,21 @@ View::load_image_intern (ImageProxy* proxy, bool init_only)
     }
 
     //std::cout << "View: Loading image " << filename << std::endl;
-    std::string ext4 = util::string::right(proxy->filename, 4);
-    std::string ext5 = util::string::right(proxy->filename, 5);
-    ext4 = util::string::lowercase(ext4);
-    ext5 = util::string::lowercase(ext5);
-    if (ext4 == ".png" || ext4 == ".jpg" || ext5 == ".jpeg")
-        proxy->image = image::load_file(filename);
-    else if (ext5 == ".mvei")
-        proxy->image = image::load_mvei_file(filename);
+    if (from_archive)
+        proxy->image = load_image_from_stream(in, proxy->filename);
     else
-        throw std::runtime_error("Unexpected image type");
+    {
+        std::string ext4 = util::string::right(proxy->filename, 4);
+        std::string ext5 = util::string::right(proxy->filename, 5);
+        ext4 = util::string::lowercase(ext4);
+        ext5 = util::string::lowercase(ext5);
+        if (ext4 == ".png" || ext4 == ".jpg" || ext5 == ".jpeg")
+            proxy->image = image::load_file(filename);
+        else if (ext5 == ".mvei")
+            proxy->image = image::load_mvei_file(filename);
+        else
+            throw std::runtime_error("Unexpected image type");
+    }
 
     proxy->is_dirty = false;
     proxy->width = proxy->image->width();
@@ -791,18 +1258,6 @@ View::load_image_intern (ImageProxy* proxy, bool init_only)
     proxy->is_initialized = true;
 }
 
-namespace
-{
-    std::string
-    get_file_extension (std::string const& filename)
-    {
-        std::size_t pos = filename.find_last_of('.');
-        if (pos == std::string::npos)
-            return std::string();
-        return util::string::lowercase(filename.substr(pos));
-    }
-}
-
 void
 View::save_image_intern (ImageProxy* proxy)
 {
@@ -818,7 +1273,27 @@ View::save_image_intern (ImageProxy* proxy)
         std::string fname = proxy->name + ext;
         std::string pname = util::fs::join_path(this->path, fname);
         //std::cout << "View: Copying image: " << fname << std::endl;
-        util::fs::copy_file(proxy->filename.c_str(), pname.c_str());
+        if (this->archive != nullptr)
+        {
+            std::string data;
+            util::fs::read_file_to_string(proxy->filename, &data);
+            this->archive_staged.push_back(
+                this->archive->stage_file(pname, data));
+        }
+        else
+        {
+            try
+            {
+                util::fs::copy_file(proxy->filename.c_str(),
+                    (pname + ".new").c_str());
+            }
+            catch (...)
+            {
+                util::fs::unlink((pname + ".new").c_str());
+                throw;
+            }
+        }
+        this->to_replace.push_back(fname);
         proxy->filename = fname;
         proxy->is_dirty = false;
         return;
@@ -843,23 +1318,46 @@ View::save_image_intern (ImageProxy* proxy)
 
     /* Save the new image. */
     //std::cout << "View: Saving image: " << filename << std::endl;
-    if (use_png_format)
-        image::save_png_file(
-            std::dynamic_pointer_cast<ByteImage>(proxy->image), fname_new);
+    if (this->archive != nullptr)
+    {
+        std::ostringstream out;
+        if (use_png_format)
+            image::save_png_file(
+                std::dynamic_pointer_cast<ByteImage>(proxy->image), out);
+        else if (this->mvei_compression)
+            image::save_mvei_file(proxy->image, out,
+                image::MVEI_COMPRESSION_DEFLATE);
+        else
+            image::save_mvei_file(proxy->image, out);
+        this->archive_staged.push_back(
+            this->archive->stage_file(fname_save, out.str()));
+    }
     else
-        image::save_mvei_file(proxy->image, fname_new);
+    {
+        try
+        {
+            if (use_png_format)
+                image::save_png_file(std::dynamic_pointer_cast<ByteImage>
+                    (proxy->image), fname_new);
+            else if (this->mvei_compression)
+                image::save_mvei_file(proxy->image, fname_new,
+                    image::MVEI_COMPRESSION_DEFLATE);
+            else
+                image::save_mvei_file(proxy->image, fname_new);
+        }
+        catch (...)
+        {
+            util::fs::unlink(fname_new.c_str());
+            throw;
+        }
+    }
 
-    /* On succesfull write, move the new file in place. */
-    this->replace_file(fname_save, fname_new);
+    /* On succesfull write, the new file is moved in place on commit. */
+    this->to_replace.push_back(filename);
 
     /* If the original file was different (e.g. JPG to lossless), remove it. */
     if (!proxy->filename.empty() && fname_save != fname_orig)
-    {
-        //std::cout << "View: Deleting file: " << fname_orig << std::endl;
-        if (util::fs::file_exists(fname_orig.c_str())
-            && !util::fs::unlink(fname_orig.c_str()))
-            throw util::FileException(fname_orig, std::strerror(errno));
-    }
+        this->to_delete.push_back(proxy->filename);
 
     /* Fully update the proxy. */
     proxy->is_dirty = false;
@@ -909,7 +1407,15 @@ View::load_blob_intern (BlobProxy* proxy, bool init_only)
 
     /* Load blob and update meta data. */
     std::string filename = util::fs::join_path(this->path, proxy->filename);
-    std::ifstream in(filename.c_str(), std::ios::binary);
+    std::string data;
+    if (this->archive != nullptr)
+        this->archive->read_file(filename, &data);
+    MemoryStreamBuf data_buffer(data);
+    std::istream buffer(&data_buffer);
+    std::ifstream file;
+    if (this->archive == nullptr)
+        file.open(filename.c_str(), std::ios::binary);
+    std::istream& in = this->archive != nullptr ? buffer : file;
     if (!in.good())
         throw util::FileException(filename, std::strerror(errno));
 
@@ -965,6 +1471,21 @@ View::save_blob_intern (BlobProxy* proxy)
     std::string fname_orig = util::fs::join_path(this->path, proxy->filename);
     std::string fname_new = fname_orig + ".new";
 
+    if (this->archive != nullptr)
+    {
+        std::string data(VIEW_IO_BLOB_SIGNATURE, VIEW_IO_BLOB_SIGNATURE_LEN);
+        data.append(reinterpret_cast<char const*>(&proxy->size),
+            sizeof(uint64_t));
+        data.append(proxy->blob->get_byte_pointer(),
+            proxy->blob->get_byte_size());
+        this->archive_staged.push_back(
+            this->archive->stage_file(fname_orig, data));
+        this->to_replace.push_back(proxy->filename);
+        proxy->is_dirty = false;
+        proxy->is_initialized = true;
+        return;
+    }
+
     // Check if file exists? Create unique temp name?
     //std::cout << "View: Saving BLOB " << proxy->filename << std::endl;
     std::ofstream out(fname_new.c_str(), std::ios::binary);
@@ -975,11 +1496,16 @@ View::save_blob_intern (BlobProxy* proxy)
     out.write(reinterpret_cast<char const*>(&proxy->size), sizeof(uint64_t));
     out.write(proxy->blob->get_byte_pointer(), proxy->blob->get_byte_size());
     if (!out.good())
-        throw util::FileException(fname_new, std::strerror(errno));
+    {
+        std::string const error = std::strerror(errno);
+        out.close();
+        util::fs::unlink(fname_new.c_str());
+        throw util::FileException(fname_new, error);
+    }
     out.close();
 
-    /* On succesfull write, move the new file in place. */
-    this->replace_file(fname_orig, fname_new);
+    /* On succesfull write, the new file is moved in place on commit. */
+    this->to_replace.push_back(proxy->filename);
 
     /* Fully update the proxy. */
     proxy->is_dirty = false;
@@ -36,6 +36,10 @@
  * always use a lossless format (PNG or MVEI), and the lossy file is deleted.
  * PNG is chosen for 1, 2, 3 and 4 channel images, MVEI for all others.
  *
+ * Alternatively, views can be stored in a scene archive (see SceneArchive),
+ * which contains the same files for all views in a single file. The view
+ * directory is then the name of the view inside the archive.
+ *
  * TODO: File locks?
  */
 
@@ -52,6 +56,7 @@
 #include "mve/camera.h"
 #include "mve/image_base.h"
 #include "mve/image.h"
+#include "mve/scene_archive.h"
 
 MVE_NAMESPACE_BEGIN
 
@@ -147,6 +152,18 @@ public:
     /** Initializes the view from a directory. */
     void load_view (std::string const& path);
 
+    /** Initializes the view from a directory inside a scene archive. */
+    void load_view (SceneArchive::Ptr archive, std::string const& name);
+
+    /**
+     * Initializes the view from previously read meta data and the file
+     * names of the embeddings, without accessing the view directory.
+     * This is used by the scene index, see Scene::load_scene().
+     */
+    void load_view_from_index (std::string const& path,
+        MetaData::KeyValueMap const& data,
+        std::vector<std::string> const& filenames);
+
     /** Initializes the view from a deprecated .mve file. */
     void load_view_from_mve_file (std::string const& filename);
 
@@ -156,12 +173,40 @@ public:
     /** Writes the view to an MVE directory. */
     void save_view_as (std::string const& path);
 
-    /** Saves dirty meta data, images and blobs, returns the amount saved. */
+    /** Writes the view to a directory inside a scene archive. */
+    void save_view_as (SceneArchive::Ptr archive, std::string const& name);
+
+    /**
+     * Saves dirty meta data, images and blobs, returns the amount saved.
+     * An interrupted save is completed or discarded when the view is
+     * loaded again, but the files are not synced to stable storage.
+     * Use Scene::save_views() to save many views durably.
+     */
     int save_view (void);
 
+    /**
+     * The phases of save_view(), which allow saving many views with few
+     * file system syncs, see Scene::save_views(). The first phase writes
+     * dirty data to temporary files and returns the amount saved. The
+     * second phase writes a journal of the files to replace and delete,
+     * and syncs the temporary files, the journal and the view directory
+     * if 'sync_files' is true. Otherwise, the file system must be synced
+     * after each of the first two phases for a durable save. The last
+     * phase moves the files in place, syncs the view directory if
+     * 'sync_files' is true, and removes the journal. A save that is
+     * interrupted after the journal has been written is completed when
+     * the view is loaded again, otherwise the temporary files are removed.
+     */
+    int save_view_prepare (void);
+    void save_view_journal (bool sync_files);
+    void save_view_commit (bool sync_files);
+
     /** Returns the directory name the view is connected with. */
     std::string const& get_directory (void) const;
 
+    /** Returns the scene archive of the view, or null for directories. */
+    SceneArchive::Ptr get_archive (void) const;
+
     /** Clears everything, discards potentially unsaved data. */
     void clear (void);
 
@@ -174,6 +219,13 @@ public:
     /** Returns the memory consumption in bytes. */
     std::size_t get_byte_size (void) const;
 
+    /**
+     * Enables saving MVEI images in the compressed, tiled format. This is
+     * disabled by default because older readers only support the plain
+     * format. Affects images saved afterwards only.
+     */
+    void set_mvei_compression (bool enable);
+
     /* ---------------------- View Meta Data ---------------------- */
 
     /** Returns a value from the meta information. */
@@ -210,6 +262,17 @@ public:
     ImageBase::Ptr get_image (std::string const& name,
         ImageType type = IMAGE_TYPE_UNKNOWN);
 
+    /**
+     * Returns a rectangular region of the image without loading the
+     * whole image. The region is cropped from the cached image if it
+     * is loaded, read from the file for MVEI images, and otherwise
+     * cropped from an uncached full load. Returns a null pointer if no
+     * image by that name exists, and throws std::invalid_argument if
+     * the region exceeds the image dimensions.
+     */
+    ImageBase::Ptr get_image_region (std::string const& name,
+        int x, int y, int width, int height);
+
     /** Returns an initialized image proxy by name. */
     ImageProxy const* get_image_proxy (std::string const& name,
         ImageType type = IMAGE_TYPE_UNKNOWN);
@@ -283,10 +346,14 @@ protected:
 
 private:
     void deprecated_format_check (std::string const& path);
+    void recover_journal (std::string const& path);
     void load_meta_data (std::string const& path);
+    void load_camera_from_meta_data (void);
     void save_meta_data (std::string const& path);
     void populate_images_and_blobs (std::string const& path);
+    void add_file_proxy (std::string const& filename);
     void replace_file (std::string const& old_fn, std::string const& new_fn);
+    void load_all_embeddings (void);
 
     ImageProxy* find_image_intern (std::string const& name);
     void initialize_image (ImageProxy* proxy, bool update);
@@ -305,10 +372,14 @@ protected:
 
 protected:
     std::string path;
+    SceneArchive::Ptr archive;
     MetaData meta_data;
     ImageProxies images;
     BlobProxies blobs;
     FilenameList to_delete;
+    FilenameList to_replace;
+    SceneArchive::StagedFiles archive_staged;
+    bool mvei_compression = false;
 };
 
 /* ---------------------------------------------------------------- */
@@ -342,6 +413,18 @@ View::get_directory (void) const
     return this->path;
 }
 
+inline SceneArchive::Ptr
+View::get_archive (void) const
+{
+    return this->archive;
+}
+
+inline void
+View::set_mvei_compression (bool enable)
+{
+    this->mvei_compression = enable;
+}
+
 inline View::MetaData const&
 View::get_meta_data (void) const
 {
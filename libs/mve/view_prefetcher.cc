@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "mve/view_prefetcher.h"
+
+MVE_NAMESPACE_BEGIN
+
+ViewPrefetcher::ViewPrefetcher (Scene::ViewList const& views,
+    std::vector<std::string> const& embeddings,
+    int num_threads, int max_ahead)
+    : views(views)
+    , embeddings(embeddings)
+    , max_ahead(std::max(1, max_ahead))
+    , states(views.size(), VIEW_IDLE)
+    , num_ahead(0)
+    , stop(false)
+{
+    if (num_threads < 1)
+        throw std::invalid_argument("Invalid number of threads");
+
+    for (int i = 0; i < num_threads; ++i)
+        this->threads.push_back(std::thread(&ViewPrefetcher::worker_main,
+            this));
+}
+
+/* ---------------------------------------------------------------- */
+
+ViewPrefetcher::~ViewPrefetcher (void)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stop = true;
+        this->queue.clear();
+    }
+    this->work_cond.notify_all();
+    for (std::size_t i = 0; i < this->threads.size(); ++i)
+        this->threads[i].join();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+ViewPrefetcher::prefetch (std::size_t view_id)
+{
+    if (view_id >= this->views.size() || this->views[view_id] == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->states[view_id] != VIEW_IDLE)
+            return;
+        this->states[view_id] = VIEW_QUEUED;
+        this->queue.push_back(view_id);
+    }
+    this->work_cond.notify_one();
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+ViewPrefetcher::prefetch_all (void)
+{
+    for (std::size_t i = 0; i < this->views.size(); ++i)
+        this->prefetch(i);
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+ViewPrefetcher::release (std::size_t view_id)
+{
+    if (view_id >= this->views.size())
+        return;
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->done_cond.wait(lock, [this, view_id] (void)
+        { return this->states[view_id] != VIEW_LOADING; });
+
+    switch (this->states[view_id])
+    {
+        case VIEW_QUEUED:
+            this->queue.erase(std::find(this->queue.begin(),
+                this->queue.end(), view_id));
+            break;
+
+        case VIEW_LOADED:
+            this->num_ahead -= 1;
+            this->work_cond.notify_one();
+            break;
+
+        default:
+            break;
+    }
+    this->states[view_id] = VIEW_IDLE;
+}
+
+/* ---------------------------------------------------------------- */
+
+ImageBase::Ptr
+ViewPrefetcher::get_image (std::size_t view_id, std::string const& name,
+    ImageType type)
+{
+    if (view_id >= this->views.size() || this->views[view_id] == nullptr)
+        return ImageBase::Ptr();
+
+    this->release(view_id);
+    return this->views[view_id]->get_image(name, type);
+}
+
+/* ---------------------------------------------------------------- */
+
+void
+ViewPrefetcher::worker_main (void)
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    while (true)
+    {
+        this->work_cond.wait(lock, [this] (void)
+            { return this->stop || (!this->queue.empty()
+                && this->num_ahead < this->max_ahead); });
+        if (this->stop)
+            break;
+
+        std::size_t const view_id = this->queue.front();
+        this->queue.pop_front();
+        this->states[view_id] = VIEW_LOADING;
+        this->num_ahead += 1;
+        lock.unlock();
+
+        /*
+         * Errors are ignored here. The image is then not cached and the
+         * error is reported when the caller loads the image.
+         */
+        View::Ptr view = this->views[view_id];
+        for (std::size_t i = 0; i < this->embeddings.size(); ++i)
+        {
+            try
+            {
+                view->get_image(this->embeddings[i]);
+            }
+            catch (...)
+            {
+            }
+        }
+
+        lock.lock();
+        this->states[view_id] = VIEW_LOADED;
+        this->done_cond.notify_all();
+    }
+}
+
+MVE_NAMESPACE_END
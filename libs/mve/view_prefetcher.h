@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2015, Simon Fuhrmann
+ * TU Darmstadt - Graphics, Capture and Massively Parallel Computing
+ * All rights reserved.
+ *
+ * This software may be modified and distributed under the terms
+ * of the BSD 3-Clause license. See the LICENSE.txt file for details.
+ */
+
+#ifndef MVE_VIEW_PREFETCHER_HEADER
+#define MVE_VIEW_PREFETCHER_HEADER
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mve/defines.h"
+#include "mve/image.h"
+#include "mve/scene.h"
+#include "mve/view.h"
+
+MVE_NAMESPACE_BEGIN
+
+/**
+ * Loads images of upcoming views in background threads. Views are
+ * identified by their index in the view list. The caller schedules views
+ * in the order they are processed, and the I/O threads load the given
+ * image embeddings into the view cache, at most 'max_ahead' views ahead
+ * of the caller. Computation thus overlaps with disk access and image
+ * decoding.
+ *
+ * Views are not thread-safe. A scheduled view must not be accessed
+ * until it is handed back with get_image() or release(), which wait
+ * for a running load or take the view from the queue. Views that are
+ * scheduled but skipped by the caller should be released, otherwise
+ * they count towards 'max_ahead'.
+ */
+class ViewPrefetcher
+{
+public:
+    ViewPrefetcher (Scene::ViewList const& views,
+        std::vector<std::string> const& embeddings,
+        int num_threads = 2, int max_ahead = 4);
+
+    /** Cancels scheduled views and waits for the I/O threads. */
+    ~ViewPrefetcher (void);
+
+    ViewPrefetcher (ViewPrefetcher const&) = delete;
+    ViewPrefetcher& operator= (ViewPrefetcher const&) = delete;
+
+    /** Schedules loading of the embeddings of the view. */
+    void prefetch (std::size_t view_id);
+
+    /** Schedules all views in order. */
+    void prefetch_all (void);
+
+    /** Hands the view back to the caller, see get_image(). */
+    void release (std::size_t view_id);
+
+    /**
+     * Releases the view and returns the image from the view. The image
+     * is returned from the cache if it has been prefetched, or else it is
+     * loaded in the calling thread.
+     */
+    ImageBase::Ptr get_image (std::size_t view_id, std::string const& name,
+        ImageType type = IMAGE_TYPE_UNKNOWN);
+    /** Returns an image of type IMAGE_TYPE_UINT8, see get_image(). */
+    ByteImage::Ptr get_byte_image (std::size_t view_id,
+        std::string const& name);
+    /** Returns an image of type IMAGE_TYPE_FLOAT, see get_image(). */
+    FloatImage::Ptr get_float_image (std::size_t view_id,
+        std::string const& name);
+
+private:
+    enum ViewState
+    {
+        VIEW_IDLE,
+        VIEW_QUEUED,
+        VIEW_LOADING,
+        VIEW_LOADED
+    };
+
+private:
+    void worker_main (void);
+
+private:
+    Scene::ViewList views;
+    std::vector<std::string> embeddings;
+    int max_ahead;
+
+    std::vector<ViewState> states;
+    std::deque<std::size_t> queue;
+    int num_ahead;
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable work_cond;
+    std::condition_variable done_cond;
+    std::vector<std::thread> threads;
+};
+
+/* ------------------------- Implementation ----------------------- */
+
+inline ByteImage::Ptr
+ViewPrefetcher::get_byte_image (std::size_t view_id, std::string const& name)
+{
+    return std::dynamic_pointer_cast<ByteImage>
+        (this->get_image(view_id, name, IMAGE_TYPE_UINT8));
+}
+
+inline FloatImage::Ptr
+ViewPrefetcher::get_float_image (std::size_t view_id, std::string const& name)
+{
+    return std::dynamic_pointer_cast<FloatImage>
+        (this->get_image(view_id, name, IMAGE_TYPE_FLOAT));
+}
+
+MVE_NAMESPACE_END
+
+#endif /* MVE_VIEW_PREFETCHER_HEADER */
@@ -7,11 +7,24 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "math/defines.h"
+#include "math/functions.h"
 #include "math/vector.h"
 #include "mve/marching_tets.h"
 #include "mve/marching_cubes.h"
+#include "mve/mesh.h"
 #include "mve/volume.h"
 
+/* Number of cube layers in a slab of the parallel polygonization. */
+#define VOLUME_SLAB_LAYERS 16
+/* Marks vertex IDs that reference the slab below. */
+#define VOLUME_BOUNDARY_ID 0x80000000u
+
 MVE_NAMESPACE_BEGIN
 
 VolumeMTAccessor::VolumeMTAccessor (void)
@@ -49,6 +62,14 @@ VolumeMTAccessor::next (void)
 
 /* ---------------------------------------------------------------- */
 
+bool
+VolumeMTAccessor::has_colors (void) const
+{
+    return false;
+}
+
+/* ---------------------------------------------------------------- */
+
 void
 VolumeMTAccessor::load_new_cube (void)
 {
@@ -141,4 +162,543 @@ VolumeMCAccessor::has_colors (void) const
     return false;
 }
 
+/* ---------------------------------------------------------------- */
+
+namespace
+{
+    /* Voxel offsets of the cube corners, see marching_cubes.h. */
+    int const cube_corners[8][3] = {
+        { 0, 0, 0 }, { 1, 0, 0 }, { 1, 0, 1 }, { 0, 0, 1 },
+        { 0, 1, 0 }, { 1, 1, 0 }, { 1, 1, 1 }, { 0, 1, 1 }
+    };
+
+    /* Vertex IDs in a plane or layer of voxels, reset in O(touched). */
+    struct IdCache
+    {
+        std::vector<unsigned int> ids;
+        std::vector<std::size_t> touched;
+
+        void set (std::size_t index, unsigned int id);
+        void reset (void);
+    };
+
+    void
+    IdCache::set (std::size_t index, unsigned int id)
+    {
+        this->ids[index] = id;
+        this->touched.push_back(index);
+    }
+
+    void
+    IdCache::reset (void)
+    {
+        for (std::size_t i = 0; i < this->touched.size(); ++i)
+            this->ids[this->touched[i]] = MATH_MAX_UINT;
+        this->touched.clear();
+    }
+
+    /*
+     * Polygonization of a slab of cube layers. Vertices are numbered
+     * locally. References to vertices on the bottom plane that are owned
+     * by the slab below are marked with VOLUME_BOUNDARY_ID and index into
+     * 'pending', which holds the keys of these vertices. The vertices on
+     * the top plane are stored as sorted (key, ID) pairs.
+     */
+    struct VolumeSlab
+    {
+        int z_begin;
+        int z_end;
+        TriangleMesh::VertexList verts;
+        TriangleMesh::FaceList faces;
+        std::vector<std::size_t> pending;
+        std::vector<std::pair<std::size_t, unsigned int> > top;
+        /* Bottom plane voxels snapped by the slab below (tetrahedra). */
+        std::vector<std::size_t> snapped;
+    };
+
+    /*
+     * Polygonizes a float volume with marching cubes or marching tetrahedra
+     * in parallel slabs. Vertices on cell edges are keyed by the voxel with
+     * the smaller index and the direction of the edge. Vertices are created
+     * in the same order as with the sequential accessor-based algorithms.
+     */
+    class VolumeMarcher
+    {
+    public:
+        VolumeMarcher (FloatVolume const& volume, bool tetrahedra);
+        TriangleMesh::Ptr extract (void);
+
+    private:
+        struct Cube
+        {
+            int x, y, z;
+            float sdf[8];
+            std::size_t voxel[8];
+            math::Vec3f pos[8];
+        };
+
+        struct SlabState
+        {
+            VolumeSlab* slab;
+            IdCache planes[2];
+            IdCache layer;
+        };
+
+        int add_direction (int const* dir);
+        void find_snapped (int z, std::vector<std::size_t>* snapped) const;
+        void process_slab (VolumeSlab* slab) const;
+        void load_cube (int x, int y, int z, Cube* cube) const;
+        void compute_configs (float const* plane1, float const* plane2,
+            int y, unsigned char* configs) const;
+        unsigned int edge_vertex (SlabState* state, Cube const& cube,
+            int c1, int c2) const;
+        unsigned int voxel_vertex (SlabState* state, Cube const& cube,
+            int c) const;
+        int snap_corner (Cube const& cube, int c1, int c2) const;
+
+    private:
+        FloatVolume const& volume;
+        bool tetrahedra;
+        int width, height, depth;
+        std::size_t plane_size;
+        float spacing;
+
+        /* Edge directions; in-plane directions first, then the voxels. */
+        std::vector<math::Vector<int, 3> > plane_dirs;
+        std::vector<math::Vector<int, 3> > layer_dirs;
+        int plane_slots;
+        /* Per corner pair: the lower corner and the direction slot. */
+        int edge_lower[8][8];
+        int edge_slot[8][8];
+    };
+
+    VolumeMarcher::VolumeMarcher (FloatVolume const& volume, bool tetrahedra)
+        : volume(volume)
+        , tetrahedra(tetrahedra)
+        , width(volume.width())
+        , height(volume.height())
+        , depth(volume.depth())
+        , plane_size(static_cast<std::size_t>(volume.width())
+            * static_cast<std::size_t>(volume.height()))
+        , spacing(1.0f / (float)(volume.width() - 1))
+    {
+        /* Collect the edge directions of the cells. */
+        std::vector<std::pair<int, int> > edges;
+        if (tetrahedra)
+        {
+            for (int i = 0; i < 6; ++i)
+                for (int j = 0; j < 6; ++j)
+                    edges.push_back(std::make_pair(
+                        geom::mt_freudenthal[i][geom::mt_edge_order[j][0]],
+                        geom::mt_freudenthal[i][geom::mt_edge_order[j][1]]));
+        }
+        else
+        {
+            for (int i = 0; i < 12; ++i)
+                edges.push_back(std::make_pair(geom::mc_edge_order[i][0],
+                    geom::mc_edge_order[i][1]));
+        }
+
+        std::vector<std::pair<int, int> > dirs;
+        for (std::size_t i = 0; i < edges.size(); ++i)
+        {
+            int c1 = edges[i].first;
+            int c2 = edges[i].second;
+            int const* o1 = cube_corners[c1];
+            int const* o2 = cube_corners[c2];
+            /* The lower corner has the smaller voxel index. */
+            if (std::make_pair(o1[2], std::make_pair(o1[1], o1[0]))
+                > std::make_pair(o2[2], std::make_pair(o2[1], o2[0])))
+            {
+                std::swap(c1, c2);
+                std::swap(o1, o2);
+            }
+            int const dir[3] = { o2[0] - o1[0], o2[1] - o1[1], o2[2] - o1[2] };
+            int const slot = this->add_direction(dir);
+            this->edge_lower[c1][c2] = this->edge_lower[c2][c1] = c1;
+            this->edge_slot[c1][c2] = this->edge_slot[c2][c1] = slot;
+        }
+
+        /* Slots for the voxels follow the in-plane directions. */
+        this->plane_slots = static_cast<int>(this->plane_dirs.size())
+            + (tetrahedra ? 1 : 0);
+    }
+
+    int
+    VolumeMarcher::add_direction (int const* dir)
+    {
+        math::Vector<int, 3> const d(dir);
+        std::vector<math::Vector<int, 3> >& dirs
+            = d[2] == 0 ? this->plane_dirs : this->layer_dirs;
+        std::size_t slot = std::find(dirs.begin(), dirs.end(), d)
+            - dirs.begin();
+        if (slot == dirs.size())
+            dirs.push_back(d);
+        /* Layer slots are encoded as negative numbers. */
+        return d[2] == 0 ? static_cast<int>(slot) : -1 - static_cast<int>(slot);
+    }
+
+    void
+    VolumeMarcher::load_cube (int x, int y, int z, Cube* cube) const
+    {
+        FloatVolume::Voxels const& data = this->volume.get_data();
+        std::size_t const base = static_cast<std::size_t>(z) * this->plane_size
+            + static_cast<std::size_t>(y) * this->width + x;
+        math::Vec3f const basepos(x * this->spacing - 0.5f,
+            y * this->spacing - 0.5f, z * this->spacing - 0.5f);
+        cube->x = x;
+        cube->y = y;
+        cube->z = z;
+        for (int i = 0; i < 8; ++i)
+        {
+            int const* o = cube_corners[i];
+            cube->voxel[i] = base + o[0] + o[1] * this->width
+                + o[2] * this->plane_size;
+            cube->sdf[i] = data[cube->voxel[i]];
+            cube->pos[i] = basepos + math::Vec3f(o[0] ? this->spacing : 0.0f,
+                o[1] ? this->spacing : 0.0f, o[2] ? this->spacing : 0.0f);
+        }
+    }
+
+    void
+    VolumeMarcher::compute_configs (float const* plane1, float const* plane2,
+        int y, unsigned char* configs) const
+    {
+        /* Branch-free sign classification of a row of cubes. */
+        float const* r1 = plane1 + y * this->width;
+        float const* r2 = r1 + this->width;
+        float const* r3 = plane2 + y * this->width;
+        float const* r4 = r3 + this->width;
+        for (int x = 0; x < this->width - 1; ++x)
+            configs[x] = static_cast<unsigned char>((r1[x] < 0.0f)
+                | (r1[x + 1] < 0.0f) << 1 | (r3[x + 1] < 0.0f) << 2
+                | (r3[x] < 0.0f) << 3 | (r2[x] < 0.0f) << 4
+                | (r2[x + 1] < 0.0f) << 5 | (r4[x + 1] < 0.0f) << 6
+                | (r4[x] < 0.0f) << 7);
+    }
+
+    int
+    VolumeMarcher::snap_corner (Cube const& cube, int c1, int c2) const
+    {
+        if (!this->tetrahedra)
+            return -1;
+        if (cube.sdf[c1] == 0.0f)
+            return c1;
+        if (cube.sdf[c2] == 0.0f)
+            return c2;
+        return -1;
+    }
+
+    unsigned int
+    VolumeMarcher::voxel_vertex (SlabState* state, Cube const& cube,
+        int c) const
+    {
+        int const oz = cube_corners[c][2];
+        std::size_t const key = (cube.voxel[c] % this->plane_size)
+            * this->plane_slots + this->plane_slots - 1;
+        IdCache& cache = state->planes[oz];
+        if (cache.ids[key] != MATH_MAX_UINT)
+            return cache.ids[key];
+
+        VolumeSlab* slab = state->slab;
+        unsigned int id;
+        if (cube.z + oz == slab->z_begin && std::binary_search(
+            slab->snapped.begin(), slab->snapped.end(),
+            cube.voxel[c] % this->plane_size))
+        {
+            id = VOLUME_BOUNDARY_ID
+                | static_cast<unsigned int>(slab->pending.size());
+            slab->pending.push_back(key);
+        }
+        else
+        {
+            id = static_cast<unsigned int>(slab->verts.size());
+            slab->verts.push_back(cube.pos[c]);
+        }
+        cache.set(key, id);
+        return id;
+    }
+
+    unsigned int
+    VolumeMarcher::edge_vertex (SlabState* state, Cube const& cube,
+        int c1, int c2) const
+    {
+        int const snap = this->snap_corner(cube, c1, c2);
+        if (snap >= 0)
+            return this->voxel_vertex(state, cube, snap);
+
+        int const lower = this->edge_lower[c1][c2];
+        int const slot = this->edge_slot[c1][c2];
+        int const oz = cube_corners[lower][2];
+        std::size_t const voxel = cube.voxel[lower] % this->plane_size;
+        IdCache& cache = slot >= 0 ? state->planes[oz] : state->layer;
+        std::size_t const key = slot >= 0
+            ? voxel * this->plane_slots + slot
+            : voxel * this->layer_dirs.size() + (-1 - slot);
+        if (cache.ids[key] != MATH_MAX_UINT)
+            return cache.ids[key];
+
+        VolumeSlab* slab = state->slab;
+        unsigned int id;
+        if (slot >= 0 && cube.z + oz == slab->z_begin && slab->z_begin > 0)
+        {
+            /* Edges in the bottom plane are owned by the slab below. */
+            id = VOLUME_BOUNDARY_ID
+                | static_cast<unsigned int>(slab->pending.size());
+            slab->pending.push_back(key);
+        }
+        else
+        {
+            float const d[2] = { cube.sdf[c1], cube.sdf[c2] };
+            float const w[2] = { d[1] / (d[1] - d[0]), -d[0] / (d[1] - d[0]) };
+            id = static_cast<unsigned int>(slab->verts.size());
+            slab->verts.push_back(math::interpolate(cube.pos[c1],
+                cube.pos[c2], w[0], w[1]));
+        }
+        cache.set(key, id);
+        return id;
+    }
+
+    void
+    VolumeMarcher::find_snapped (int z, std::vector<std::size_t>* snapped) const
+    {
+        /* Finds voxels in plane z + 1 snapped by the cubes in layer z. */
+        float const* data = &this->volume.get_data()[0];
+        std::vector<unsigned char> configs(this->width - 1);
+        Cube cube;
+        for (int y = 0; y < this->height - 1; ++y)
+        {
+            this->compute_configs(data + z * this->plane_size,
+                data + (z + 1) * this->plane_size, y, &configs[0]);
+            for (int x = 0; x < this->width - 1; ++x)
+            {
+                if (configs[x] == 0x00 || configs[x] == 0xff)
+                    continue;
+                this->load_cube(x, y, z, &cube);
+                for (int t = 0; t < 6; ++t)
+                {
+                    int const* tet = geom::mt_freudenthal[t];
+                    int tetconfig = 0;
+                    for (int i = 0; i < 4; ++i)
+                        if (cube.sdf[tet[i]] < 0.0f)
+                            tetconfig |= (1 << i);
+                    int const edgeconfig = geom::mt_edge_table[tetconfig];
+                    for (int i = 0; i < 6; ++i)
+                    {
+                        if (!(edgeconfig & (1 << i)))
+                            continue;
+                        int const snap = this->snap_corner(cube,
+                            tet[geom::mt_edge_order[i][0]],
+                            tet[geom::mt_edge_order[i][1]]);
+                        if (snap >= 0 && cube_corners[snap][2] == 1)
+                            snapped->push_back(
+                                cube.voxel[snap] % this->plane_size);
+                    }
+                }
+            }
+        }
+        std::sort(snapped->begin(), snapped->end());
+        snapped->erase(std::unique(snapped->begin(), snapped->end()),
+            snapped->end());
+    }
+
+    void
+    VolumeMarcher::process_slab (VolumeSlab* slab) const
+    {
+        SlabState state;
+        state.slab = slab;
+        for (int i = 0; i < 2; ++i)
+            state.planes[i].ids.resize(this->plane_size * this->plane_slots,
+                MATH_MAX_UINT);
+        state.layer.ids.resize(this->plane_size * this->layer_dirs.size(),
+            MATH_MAX_UINT);
+
+        float const* data = &this->volume.get_data()[0];
+        std::vector<unsigned char> configs(this->width - 1);
+        Cube cube;
+        for (int z = slab->z_begin; z < slab->z_end; ++z)
+        {
+            if (z > slab->z_begin)
+            {
+                std::swap(state.planes[0], state.planes[1]);
+                state.planes[1].reset();
+                state.layer.reset();
+            }
+
+            for (int y = 0; y < this->height - 1; ++y)
+            {
+                this->compute_configs(data + z * this->plane_size,
+                    data + (z + 1) * this->plane_size, y, &configs[0]);
+                for (int x = 0; x < this->width - 1; ++x)
+                {
+                    int const cubeconfig = configs[x];
+                    if (cubeconfig == 0x00 || cubeconfig == 0xff)
+                        continue;
+                    this->load_cube(x, y, z, &cube);
+
+                    if (!this->tetrahedra)
+                    {
+                        int const edgeconfig = geom::mc_edge_table[cubeconfig];
+                        unsigned int vid[12];
+                        for (int i = 0; i < 12; ++i)
+                            if (edgeconfig & (1 << i))
+                                vid[i] = this->edge_vertex(&state, cube,
+                                    geom::mc_edge_order[i][0],
+                                    geom::mc_edge_order[i][1]);
+                        int const* tris = geom::mc_tri_table[cubeconfig];
+                        for (int j = 0; tris[j] != -1; ++j)
+                            slab->faces.push_back(vid[tris[j]]);
+                        continue;
+                    }
+
+                    for (int t = 0; t < 6; ++t)
+                    {
+                        int const* tet = geom::mt_freudenthal[t];
+                        int tetconfig = 0;
+                        for (int i = 0; i < 4; ++i)
+                            if (cube.sdf[tet[i]] < 0.0f)
+                                tetconfig |= (1 << i);
+                        if (tetconfig == 0x0 || tetconfig == 0xf)
+                            continue;
+
+                        int const edgeconfig = geom::mt_edge_table[tetconfig];
+                        unsigned int vid[6];
+                        for (int i = 0; i < 6; ++i)
+                            if (edgeconfig & (1 << i))
+                                vid[i] = this->edge_vertex(&state, cube,
+                                    tet[geom::mt_edge_order[i][0]],
+                                    tet[geom::mt_edge_order[i][1]]);
+
+                        int const* tris = geom::mt_tri_table[tetconfig];
+                        for (int j = 0; tris[j] != -1; j += 3)
+                        {
+                            unsigned int const v[3] = { vid[tris[j]],
+                                vid[tris[j + 1]], vid[tris[j + 2]] };
+                            if (v[0] != v[1] && v[1] != v[2] && v[2] != v[0])
+                                slab->faces.insert(slab->faces.end(), v, v + 3);
+                        }
+                    }
+                }
+            }
+        }
+
+        /* Keep the vertices on the top plane for the slab above. */
+        IdCache const& top = state.planes[1];
+        for (std::size_t i = 0; i < top.touched.size(); ++i)
+            slab->top.push_back(std::make_pair(top.touched[i],
+                top.ids[top.touched[i]]));
+        std::sort(slab->top.begin(), slab->top.end());
+    }
+
+    TriangleMesh::Ptr
+    VolumeMarcher::extract (void)
+    {
+        TriangleMesh::Ptr mesh = TriangleMesh::create();
+        if (this->width < 2 || this->height < 2 || this->depth < 2)
+            return mesh;
+
+        int const layers = this->depth - 1;
+        int const num_slabs = (layers + VOLUME_SLAB_LAYERS - 1)
+            / VOLUME_SLAB_LAYERS;
+        std::vector<VolumeSlab> slabs(num_slabs);
+        for (int i = 0; i < num_slabs; ++i)
+        {
+            slabs[i].z_begin = i * VOLUME_SLAB_LAYERS;
+            slabs[i].z_end = std::min(layers, slabs[i].z_begin
+                + VOLUME_SLAB_LAYERS);
+        }
+
+        /* Voxels snapped by the slab below belong to that slab. */
+        if (this->tetrahedra)
+        {
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 1; i < num_slabs; ++i)
+                this->find_snapped(slabs[i].z_begin - 1, &slabs[i].snapped);
+        }
+
+#pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < num_slabs; ++i)
+            this->process_slab(&slabs[i]);
+
+        /* Merge the slabs and resolve references to the slabs below. */
+        std::vector<std::size_t> vert_offsets(num_slabs + 1, 0);
+        std::vector<std::size_t> face_offsets(num_slabs + 1, 0);
+        for (int i = 0; i < num_slabs; ++i)
+        {
+            vert_offsets[i + 1] = vert_offsets[i] + slabs[i].verts.size();
+            face_offsets[i + 1] = face_offsets[i] + slabs[i].faces.size();
+        }
+        if (vert_offsets.back() >= VOLUME_BOUNDARY_ID)
+            throw std::runtime_error("Too many vertices");
+
+        TriangleMesh::VertexList& verts = mesh->get_vertices();
+        TriangleMesh::FaceList& faces = mesh->get_faces();
+        verts.resize(vert_offsets.back());
+        faces.resize(face_offsets.back());
+        bool missing = false;
+#pragma omp parallel for schedule(dynamic) reduction(||:missing)
+        for (int i = 0; i < num_slabs; ++i)
+        {
+            VolumeSlab& slab = slabs[i];
+            std::copy(slab.verts.begin(), slab.verts.end(),
+                verts.begin() + vert_offsets[i]);
+
+            std::vector<unsigned int> resolved(slab.pending.size());
+            for (std::size_t j = 0; j < slab.pending.size(); ++j)
+            {
+                std::vector<std::pair<std::size_t, unsigned int> > const&
+                    below = slabs[i - 1].top;
+                std::vector<std::pair<std::size_t, unsigned int> >
+                    ::const_iterator iter = std::lower_bound(below.begin(),
+                    below.end(), std::make_pair(slab.pending[j], 0u));
+                if (iter == below.end() || iter->first != slab.pending[j])
+                {
+                    missing = true;
+                    continue;
+                }
+                resolved[j] = iter->second + vert_offsets[i - 1];
+            }
+
+            for (std::size_t j = 0; j < slab.faces.size(); ++j)
+            {
+                unsigned int const id = slab.faces[j];
+                faces[face_offsets[i] + j] = (id & VOLUME_BOUNDARY_ID)
+                    ? resolved[id & ~VOLUME_BOUNDARY_ID]
+                    : id + static_cast<unsigned int>(vert_offsets[i]);
+            }
+
+            TriangleMesh::VertexList().swap(slab.verts);
+            TriangleMesh::FaceList().swap(slab.faces);
+        }
+
+        if (missing)
+            throw std::runtime_error("Unresolved slab boundary vertex");
+
+        return mesh;
+    }
+}
+
+/* ---------------------------------------------------------------- */
+
+MVE_GEOM_NAMESPACE_BEGIN
+
+TriangleMesh::Ptr
+volume_marching_cubes (FloatVolume::ConstPtr volume)
+{
+    if (volume == nullptr)
+        throw std::invalid_argument("Null volume given");
+    return VolumeMarcher(*volume, false).extract();
+}
+
+/* ---------------------------------------------------------------- */
+
+TriangleMesh::Ptr
+volume_marching_tetrahedra (FloatVolume::ConstPtr volume)
+{
+    if (volume == nullptr)
+        throw std::invalid_argument("Null volume given");
+    return VolumeMarcher(*volume, true).extract();
+}
+
+MVE_GEOM_NAMESPACE_END
 MVE_NAMESPACE_END
@@ -94,10 +94,12 @@ public:
     float sdf[4];
     std::size_t vid[4];
     math::Vec3f pos[4];
+    math::Vec3f color[4];
 
 public:
     VolumeMTAccessor (void);
     bool next (void);
+    bool has_colors (void) const;
     void load_new_cube (void);
 };
 
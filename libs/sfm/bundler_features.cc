@@ -11,6 +11,7 @@
 #include "mve/image.h"
 #include "mve/image_exif.h"
 #include "mve/image_tools.h"
+#include "mve/view_prefetcher.h"
 #include "sfm/bundler_common.h"
 #include "sfm/extract_focal_length.h"
 #include "sfm/bundler_features.h"
@@ -36,6 +37,11 @@ Features::compute (mve::Scene::Ptr scene, ViewportList* viewports)
     std::size_t num_done = 0;
     std::size_t total_features = 0;
 
+    /* Load the images in the background. */
+    mve::ViewPrefetcher prefetcher(views,
+        std::vector<std::string>(1, this->opts.image_embedding));
+    prefetcher.prefetch_all();
+
     /* Iterate the scene and compute features. */
 #pragma omp parallel for schedule(dynamic,1)
 #ifdef _MSC_VER
@@ -56,8 +62,8 @@ Features::compute (mve::Scene::Ptr scene, ViewportList* viewports)
             continue;
 
         mve::View::Ptr view = views[i];
-        mve::ByteImage::Ptr image = view->get_byte_image
-            (this->opts.image_embedding);
+        mve::ByteImage::Ptr image = prefetcher.get_byte_image
+            (i, this->opts.image_embedding);
         if (image == nullptr)
             continue;
 
@@ -7,7 +7,9 @@
  * of the BSD 3-Clause license. See the LICENSE.txt file for details.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 #include "util/timer.h"
 #include "math/functions.h"
@@ -20,6 +22,12 @@
 #include "sfm/defines.h"
 #include "sfm/surf.h"
 
+#define ENABLE_SSE2_SURF_RESPONSE 1
+
+#if ENABLE_SSE2_SURF_RESPONSE && defined(__SSE2__)
+#   include <emmintrin.h> // SSE2
+#endif
+
 SFM_NAMESPACE_BEGIN
 
 namespace
@@ -32,6 +40,39 @@ namespace
         {  9, 17, 25, 33 },  // 27  51  75  99
         { 17, 33, 49, 65 }   // 51  99 147 195
     };
+
+    /* Computes the box sum p[a] + p[b] - p[c] - p[d] from the SAT. */
+    inline int64_t
+    box_sum (int64_t const* p, int a, int b, int c, int d)
+    {
+        return p[a] + p[b] - p[c] - p[d];
+    }
+
+#if ENABLE_SSE2_SURF_RESPONSE && defined(__SSE2__)
+    /* Computes the box sums for two consecutive samples, see above. */
+    inline __m128i
+    box_sum_sse2 (int64_t const* p, int a, int b, int c, int d)
+    {
+        __m128i const va = _mm_loadu_si128((__m128i const*)(p + a));
+        __m128i const vb = _mm_loadu_si128((__m128i const*)(p + b));
+        __m128i const vc = _mm_loadu_si128((__m128i const*)(p + c));
+        __m128i const vd = _mm_loadu_si128((__m128i const*)(p + d));
+        return _mm_sub_epi64(_mm_add_epi64(va, vb), _mm_add_epi64(vc, vd));
+    }
+
+    /*
+     * Converts two pairs of 64 bit filter responses to four floats. The
+     * responses of byte images are well within the 32 bit range, and the
+     * lower halves are converted.
+     */
+    inline __m128
+    to_float_sse2 (__m128i lo, __m128i hi)
+    {
+        lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 0, 2, 0));
+        hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 0, 2, 0));
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi64(lo, hi));
+    }
+#endif
 }  // namespace
 
 /* ---------------------------------------------------------------- */
@@ -142,21 +183,93 @@ Surf::set_image (mve::ByteImage::ConstPtr image)
 void
 Surf::create_octaves (void)
 {
-    /* Prepare octaves. */
+    /* Prepare octaves. Octave dimensions are halved in every octave. */
+    int ow = this->sat->width();
+    int oh = this->sat->height();
     this->octaves.resize(4);
-    for (int i = 0; i < 4; ++i)
-        this->octaves[i].imgs.resize(4);
+    for (int o = 0; o < 4; ++o)
+    {
+        this->octaves[o].imgs.resize(4);
+        for (int k = 0; k < 4; ++k)
+            this->octaves[o].imgs[k] = Octave::RespImage::create(ow, oh, 1);
+        ow = (ow + 1) >> 1;
+        oh = (oh + 1) >> 1;
+    }
+
+    /*
+     * Create octaves. All response maps of all octaves are divided into
+     * bands of rows, which are processed in parallel. Larger octaves
+     * are divided into more bands, which balances the load.
+     */
+    struct Band
+    {
+        int octave;
+        int sample;
+        int row_begin;
+        int row_end;
+    };
+
+    int const band_rows = 32;
+    std::vector<Band> bands;
+    for (int o = 0; o < 4; ++o)
+        for (int k = 0; k < 4; ++k)
+        {
+            int const rows = this->octaves[o].imgs[k]->height();
+            for (int y = 0; y < rows; y += band_rows)
+            {
+                Band band = { o, k, y, std::min(y + band_rows, rows) };
+                bands.push_back(band);
+            }
+        }
+
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < static_cast<int>(bands.size()); ++i)
+    {
+        Band const& band = bands[i];
+        this->create_response_map(band.octave, band.sample,
+            band.row_begin, band.row_end);
+    }
+}
+
+/* ---------------------------------------------------------------- */
 
-    /* Create octaves. */
-    for (int octave = 0; octave < 4; ++octave)
-        for (int sample = 0; sample < 4; ++sample)
-            this->create_response_map(octave, sample);
+void
+Surf::create_response_map (int o, int k, int row_begin, int row_end)
+{
+    /* Filter size. The actual kernel side length is 3 * fs. */
+    int const fs = kernel_sizes[o][k];
+    /* The sample spacing for the octaves. */
+    int const step = math::fastpow(2, o);
+
+    /*
+     * The response is zero where the filters exceed the image, i.e.,
+     * within 'border' pixels from the image boundary. The response map
+     * is initialized with zero, only the inner region is computed.
+     */
+    int const w = this->sat->width();
+    int const h = this->sat->height();
+    int const border = fs + fs / 2 + 1;
+    int const x_begin = (border + step - 1) / step;
+    int const x_end = std::max(0, (w - border + step - 1) / step);
+    if (x_begin >= x_end)
+        return;
+
+    Octave::RespImage::Ptr img = this->octaves[o].imgs[k];
+    for (int oy = row_begin; oy < row_end; ++oy)
+    {
+        int const y = oy * step;
+        if (y < border || y + border >= h)
+            continue;
+        this->create_response_row(fs, y, step, x_begin, x_end,
+            &img->at(0, oy, 0));
+    }
 }
 
 /* ---------------------------------------------------------------- */
 
 void
-Surf::create_response_map (int o, int k)
+Surf::create_response_row (int fs, int y, int step,
+    int x_begin, int x_end, Octave::RespType* row)
 {
     /*
      * In order to create the Hessian response map for filter size 'fs',
@@ -166,54 +279,120 @@ Surf::create_response_map (int o, int k)
      * So we need to compute Dxx, Dyy and Dxy with filter size 'fs'.
      * Note: filter size 'fs' is defined as filter width / 3.
      * For details, see SURF 3.2.
+     *
+     * This computes the same values as filter_dxx(), filter_dyy() and
+     * filter_dxy() for the samples 'x_begin' to 'x_end' in the row, but
+     * the SAT row offsets are determined only once per row. The sample
+     * with index 'i' is located at pixel x = i * step.
      */
     typedef Octave::RespType RespType;
 
-    /* Filter size. The actual kernel side length is 3 * fs. */
-    int const fs = kernel_sizes[o][k];
-    /* The sample spacing for the octaves. */
-    int const step = math::fastpow(2, o);
     /* Weight to balance between real gaussian kernel and approximated one. */
     RespType const weight = 0.912;  // See SURF 3.3 (4).
     /* NormalizationKernel width is 3 * fs, height is 2 * fs - 1. */
     RespType const inv_karea = 1.0 / (fs * (2 * fs - 1));
 
-    /* Original dimensions and octave dimensions. */
     int const w = this->sat->width();
-    int const h = this->sat->height();
-    int ow = w;
-    int oh = h;
-    for (int i = 0; i < o; ++i)
+    int const fs2 = fs / 2;
+    SatType const* sat = this->sat->get_data_pointer();
+
+    /* The SAT row offsets for Dxx, shifted to the left filter boundary. */
+    int const xx1 = w * (y - fs) - fs - fs2 - 1;
+    int const xx2 = xx1 + w * (fs + fs - 1);
+    /* The SAT row offsets for Dyy, shifted to the left filter boundary. */
+    int const yy1 = w * (y - fs - fs2 - 1) - fs;
+    int const yy2 = yy1 + w * fs;
+    int const yy3 = yy2 + w * fs;
+    int const yy4 = yy3 + w * fs;
+    /* The SAT row offsets for Dxy, shifted to the left filter boundary. */
+    int const xy1 = w * (y - fs - 1) - fs - 1;
+    int const xy2 = xy1 + w * fs;
+    int const xy3 = xy2 + w;
+    int const xy4 = xy3 + w * fs;
+
+    /* Column offsets of the filter boxes. */
+    int const c1 = fs;
+    int const c2 = fs + fs;
+    int const c3 = fs + fs + fs;
+    int const d1 = fs + 1;
+    int const d2 = fs + fs + 1;
+    int const e1 = fs + fs - 1;
+
+    int i = x_begin;
+#if ENABLE_SSE2_SURF_RESPONSE && defined(__SSE2__)
+    /*
+     * In the first octave, consecutive samples are consecutive in the SAT,
+     * and four responses are computed at once. This yields exactly the
+     * same results as the scalar code below.
+     */
+    if (step == 1)
     {
-        ow = (ow + 1) >> 1;
-        oh = (oh + 1) >> 1;
-    }
-
-    /* Generate the response maps. */
-    Octave::RespImage::Ptr img = Octave::RespImage::create(ow, oh, 1);
-    int const border = fs + fs / 2 + 1;
-    for (int y = 0, i = 0; y < h; y += step)
-        for (int x = 0; x < w; x += step, ++i)
+        __m128 const weight_sse = _mm_set1_ps(weight);
+        __m128 const inv_karea_sse = _mm_set1_ps(inv_karea);
+        for (; i + 4 <= x_end; i += 4)
         {
-            if (x < border || x + border >= w || y < border || y + border >= h)
+            __m128i dxx[2], dyy[2], dxy[2];
+            for (int j = 0; j < 2; ++j)
             {
-                img->at(i) = 0.0f;
-                continue;
+                SatType const* p = sat + i + 2 * j;
+                __m128i xx_a = box_sum_sse2(p, xx2 + c1, xx1, xx2, xx1 + c1);
+                __m128i xx_b = box_sum_sse2(p, xx2 + c2, xx1 + c1,
+                    xx2 + c1, xx1 + c2);
+                __m128i xx_c = box_sum_sse2(p, xx2 + c3, xx1 + c2,
+                    xx2 + c2, xx1 + c3);
+                dxx[j] = _mm_sub_epi64(_mm_add_epi64(xx_a, xx_c),
+                    _mm_add_epi64(xx_b, xx_b));
+
+                __m128i yy_a = box_sum_sse2(p, yy2 + e1, yy1, yy2, yy1 + e1);
+                __m128i yy_b = box_sum_sse2(p, yy3 + e1, yy2, yy3, yy2 + e1);
+                __m128i yy_c = box_sum_sse2(p, yy4 + e1, yy3, yy4, yy3 + e1);
+                dyy[j] = _mm_sub_epi64(_mm_add_epi64(yy_a, yy_c),
+                    _mm_add_epi64(yy_b, yy_b));
+
+                __m128i xy_a = box_sum_sse2(p, xy2 + c1, xy1, xy2, xy1 + c1);
+                __m128i xy_b = box_sum_sse2(p, xy2 + d2, xy1 + d1,
+                    xy2 + d1, xy1 + d2);
+                __m128i xy_c = box_sum_sse2(p, xy4 + c1, xy3, xy4, xy3 + c1);
+                __m128i xy_d = box_sum_sse2(p, xy4 + d2, xy3 + d1,
+                    xy4 + d1, xy3 + d2);
+                dxy[j] = _mm_sub_epi64(_mm_add_epi64(xy_a, xy_d),
+                    _mm_add_epi64(xy_b, xy_c));
             }
 
-            SatType dxx = this->filter_dxx(fs, x, y);
-            SatType dyy = this->filter_dyy(fs, x, y);
-            SatType dxy = this->filter_dxy(fs, x, y);
-            RespType dxx_t = static_cast<RespType>(dxx) * inv_karea;
-            RespType dyy_t = static_cast<RespType>(dyy) * inv_karea;
-            RespType dxy_t = static_cast<RespType>(dxy) * inv_karea;
-            /* Compute the determinant of the hessian. */
-            img->at(i) = dxx_t * dyy_t - weight * dxy_t * dxy_t;
-            /* The laplacian can be computed as dxx_t + dyy_t. */
-            // float laplacian = dxx_t + dyy_t;
+            __m128 const dxx_t = _mm_mul_ps(to_float_sse2(dxx[0], dxx[1]),
+                inv_karea_sse);
+            __m128 const dyy_t = _mm_mul_ps(to_float_sse2(dyy[0], dyy[1]),
+                inv_karea_sse);
+            __m128 const dxy_t = _mm_mul_ps(to_float_sse2(dxy[0], dxy[1]),
+                inv_karea_sse);
+            _mm_storeu_ps(row + i, _mm_sub_ps(_mm_mul_ps(dxx_t, dyy_t),
+                _mm_mul_ps(_mm_mul_ps(weight_sse, dxy_t), dxy_t)));
         }
+    }
+#endif
 
-    this->octaves[o].imgs[k] = img;
+    for (int x = i * step; i < x_end; ++i, x += step)
+    {
+        SatType const* p = sat + x;
+        SatType const dxx = box_sum(p, xx2 + c1, xx1, xx2, xx1 + c1)
+            - 2 * box_sum(p, xx2 + c2, xx1 + c1, xx2 + c1, xx1 + c2)
+            + box_sum(p, xx2 + c3, xx1 + c2, xx2 + c2, xx1 + c3);
+        SatType const dyy = box_sum(p, yy2 + e1, yy1, yy2, yy1 + e1)
+            - 2 * box_sum(p, yy3 + e1, yy2, yy3, yy2 + e1)
+            + box_sum(p, yy4 + e1, yy3, yy4, yy3 + e1);
+        SatType const dxy = box_sum(p, xy2 + c1, xy1, xy2, xy1 + c1)
+            - box_sum(p, xy2 + d2, xy1 + d1, xy2 + d1, xy1 + d2)
+            - box_sum(p, xy4 + c1, xy3, xy4, xy3 + c1)
+            + box_sum(p, xy4 + d2, xy3 + d1, xy4 + d1, xy3 + d2);
+
+        RespType dxx_t = static_cast<RespType>(dxx) * inv_karea;
+        RespType dyy_t = static_cast<RespType>(dyy) * inv_karea;
+        RespType dxy_t = static_cast<RespType>(dxy) * inv_karea;
+        /* Compute the determinant of the hessian. */
+        row[i] = dxx_t * dyy_t - weight * dxy_t * dxy_t;
+        /* The laplacian can be computed as dxx_t + dyy_t. */
+        // float laplacian = dxx_t + dyy_t;
+    }
 }
 
 /* ---------------------------------------------------------------- */
@@ -132,7 +132,9 @@ protected:
 protected:
     void create_octaves (void);
 
-    void create_response_map (int o, int k);
+    void create_response_map (int o, int k, int row_begin, int row_end);
+    void create_response_row (int fs, int y, int step,
+        int x_begin, int x_end, Octave::RespType* row);
     SatType filter_dxx (int fs, int x, int y);
     SatType filter_dyy (int fs, int x, int y);
     SatType filter_dxy (int fs, int x, int y);
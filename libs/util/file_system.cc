@@ -18,12 +18,14 @@
 
 #if defined(_WIN32)
 #   include <direct.h>
+#   include <fcntl.h>
 #   include <io.h>
 #   include <shlobj.h>
 #   include <sys/stat.h>
 #   include <sys/types.h>
 #else // Linux, OSX, ...
 #   include <dirent.h>
+#   include <fcntl.h>
 #   include <unistd.h>
 #   include <sys/stat.h>
 #   include <sys/types.h>
@@ -115,6 +117,47 @@ file_exists (char const* pathname)
 
 /* ---------------------------------------------------------------- */
 
+int64_t
+get_mtime (char const* pathname)
+{
+#ifdef _WIN32
+    struct _stat statbuf;
+    if (::_stat(pathname, &statbuf) < 0)
+        return -1;
+    return static_cast<int64_t>(statbuf.st_mtime) * 1000000000;
+#else // _WIN32
+    struct stat statbuf;
+    if (::stat(pathname, &statbuf) < 0)
+        return -1;
+#   if defined(__APPLE__)
+    return static_cast<int64_t>(statbuf.st_mtimespec.tv_sec) * 1000000000
+        + statbuf.st_mtimespec.tv_nsec;
+#   else
+    return static_cast<int64_t>(statbuf.st_mtim.tv_sec) * 1000000000
+        + statbuf.st_mtim.tv_nsec;
+#   endif
+#endif // _WIN32
+}
+
+/* ---------------------------------------------------------------- */
+
+int64_t
+get_file_size (char const* pathname)
+{
+#ifdef _WIN32
+    struct _stat64 statbuf;
+    if (::_stat64(pathname, &statbuf) < 0)
+        return -1;
+#else // _WIN32
+    struct stat statbuf;
+    if (::stat(pathname, &statbuf) < 0)
+        return -1;
+#endif // _WIN32
+    return static_cast<int64_t>(statbuf.st_size);
+}
+
+/* ---------------------------------------------------------------- */
+
 char*
 get_cwd (char* buf, size_t size)
 {
@@ -178,6 +221,53 @@ unlink (char const* pathname)
 
 /* ---------------------------------------------------------------- */
 
+bool
+sync_file (char const* pathname)
+{
+#ifdef _WIN32
+    /* Directories cannot be opened and need not be synced on Windows. */
+    if (dir_exists(pathname))
+        return true;
+    int fd = ::_open(pathname, _O_RDWR | _O_BINARY);
+    if (fd < 0)
+        return false;
+    bool const success = ::_commit(fd) >= 0;
+    ::_close(fd);
+    return success;
+#else // _WIN32
+    int fd = ::open(pathname, O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool const success = ::fsync(fd) >= 0;
+    ::close(fd);
+    return success;
+#endif // _WIN32
+}
+
+/* ---------------------------------------------------------------- */
+
+bool
+sync_file_system (char const* pathname)
+{
+#if defined(_WIN32)
+    (void)pathname;
+    return false;
+#elif defined(__linux__)
+    int fd = ::open(pathname, O_RDONLY);
+    if (fd < 0)
+        return false;
+    bool const success = ::syncfs(fd) >= 0;
+    ::close(fd);
+    return success;
+#else
+    (void)pathname;
+    ::sync();
+    return true;
+#endif
+}
+
+/* ---------------------------------------------------------------- */
+
 char const*
 get_app_data_dir (void)
 {
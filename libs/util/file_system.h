@@ -10,6 +10,7 @@
 #ifndef UTIL_FS_HEADER
 #define UTIL_FS_HEADER
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -31,6 +32,16 @@ bool dir_exists (char const* pathname);
 /** Determines if the given path is a file. */
 bool file_exists (char const* pathname);
 
+/**
+ * Returns the modification time of the given path in nanoseconds since
+ * the epoch, or -1 if the path does not exist. The resolution depends on
+ * the platform and file system.
+ */
+int64_t get_mtime (char const* pathname);
+
+/** Returns the size of the given file in bytes, or -1 on error. */
+int64_t get_file_size (char const* pathname);
+
 /** Determines the current user's path for application data. */
 char const* get_app_data_dir (void);
 
@@ -67,6 +78,16 @@ bool rename (char const* from, char const* to);
 /** Copies a file from 'src' to 'dst', throws FileException on error. */
 void copy_file (char const* src, char const* dst);
 
+/** Flushes the file or directory to stable storage (fsync). */
+bool sync_file (char const* pathname);
+
+/**
+ * Flushes all data of the file system containing the path to stable
+ * storage, which is cheaper than syncing many files individually. Returns
+ * false if this is not supported, files must then be synced individually.
+ */
+bool sync_file_system (char const* pathname);
+
 /*
  * ----------------------------- File IO  ----------------------------
  */
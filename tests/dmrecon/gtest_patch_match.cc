@@ -0,0 +1,299 @@
+// Test cases for the PatchMatch depth estimation.
+// Written by Simon Fuhrmann.
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "math/vector.h"
+#include "mve/bundle.h"
+#include "mve/bundle_io.h"
+#include "mve/camera.h"
+#include "mve/image.h"
+#include "mve/scene.h"
+#include "mve/view.h"
+#include "util/file_system.h"
+#include "dmrecon/dmrecon.h"
+#include "dmrecon/patch_match.h"
+#include "dmrecon/progress.h"
+#include "dmrecon/settings.h"
+#include "dmrecon/single_view.h"
+
+namespace
+{
+    int const IMAGE_WIDTH = 80;
+    int const IMAGE_HEIGHT = 60;
+    /* Distance of the fronto-parallel plane to the first camera. */
+    float const PLANE_DEPTH = 5.0f;
+    /* Horizontal baseline between the two cameras. */
+    float const BASELINE = 1.0f;
+
+    /* Removes the scene directory on destruction. */
+    class SceneDirectory
+    {
+    public:
+        SceneDirectory (void);
+        ~SceneDirectory (void);
+        std::string const& get_path (void) const;
+
+    private:
+        void remove_recursive (std::string const& path);
+
+    private:
+        std::string path;
+    };
+
+    SceneDirectory::SceneDirectory (void)
+    {
+        this->path = std::string(std::tmpnam(nullptr)) + "_patchmatch";
+        util::fs::mkdir(this->path.c_str());
+        util::fs::mkdir(util::fs::join_path(this->path, "views").c_str());
+    }
+
+    SceneDirectory::~SceneDirectory (void)
+    {
+        this->remove_recursive(this->path);
+    }
+
+    std::string const&
+    SceneDirectory::get_path (void) const
+    {
+        return this->path;
+    }
+
+    void
+    SceneDirectory::remove_recursive (std::string const& path)
+    {
+        if (util::fs::file_exists(path.c_str()))
+        {
+            util::fs::unlink(path.c_str());
+            return;
+        }
+        if (!util::fs::dir_exists(path.c_str()))
+            return;
+
+        util::fs::Directory dir(path);
+        for (std::size_t i = 0; i < dir.size(); ++i)
+            this->remove_recursive(dir[i].get_absolute_name());
+        util::fs::rmdir(path.c_str());
+    }
+
+    /* Smooth random texture on the plane, bilinear value noise. */
+    float
+    plane_texture (float x, float y)
+    {
+        float const spacing = 0.2f;
+        float const fx = x / spacing + 1000.0f;
+        float const fy = y / spacing + 1000.0f;
+        int const ix = static_cast<int>(fx);
+        int const iy = static_cast<int>(fy);
+        float const wx = fx - static_cast<float>(ix);
+        float const wy = fy - static_cast<float>(iy);
+
+        float values[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            unsigned int h = static_cast<unsigned int>(ix + i % 2) * 73856093u
+                ^ static_cast<unsigned int>(iy + i / 2) * 19349663u;
+            h ^= h >> 13;
+            h *= 0x5bd1e995u;
+            h ^= h >> 15;
+            values[i] = static_cast<float>(h % 256u) / 255.0f;
+        }
+
+        return (1.0f - wy) * ((1.0f - wx) * values[0] + wx * values[1])
+            + wy * ((1.0f - wx) * values[2] + wx * values[3]);
+    }
+
+    mve::CameraInfo
+    make_camera (float pos_x)
+    {
+        mve::CameraInfo cam;
+        cam.flen = 1.0f;
+        cam.trans[0] = -pos_x;
+        return cam;
+    }
+
+    /* Direction of the ray through the pixel center, camera coordinates. */
+    math::Vec3f
+    pixel_ray (float x, float y)
+    {
+        float const flen = static_cast<float>(IMAGE_WIDTH);
+        return math::Vec3f((x + 0.5f - 0.5f * IMAGE_WIDTH) / flen,
+            (y + 0.5f - 0.5f * IMAGE_HEIGHT) / flen, 1.0f);
+    }
+
+    /* Renders the textured plane with 2x2 supersampling. */
+    mve::ByteImage::Ptr
+    render_plane (float pos_x)
+    {
+        mve::ByteImage::Ptr image = mve::ByteImage::create(IMAGE_WIDTH,
+            IMAGE_HEIGHT, 3);
+        for (int y = 0; y < IMAGE_HEIGHT; ++y)
+            for (int x = 0; x < IMAGE_WIDTH; ++x)
+            {
+                float value = 0.0f;
+                for (int s = 0; s < 4; ++s)
+                {
+                    math::Vec3f ray = pixel_ray(x - 0.25f + 0.5f * (s % 2),
+                        y - 0.25f + 0.5f * (s / 2));
+                    math::Vec3f pos = ray * PLANE_DEPTH;
+                    value += plane_texture(pos[0] + pos_x, pos[1]) / 4.0f;
+                }
+                unsigned char const intensity = static_cast<unsigned char>
+                    (30.0f + 195.0f * value + 0.5f);
+                for (int c = 0; c < 3; ++c)
+                    image->at(x, y, c) = intensity;
+            }
+        return image;
+    }
+
+    /*
+     * Creates a scene with two cameras looking at a textured plane and a
+     * grid of SfM features on the plane. If 'with_features' is false,
+     * the bundle contains the cameras only.
+     */
+    mve::Scene::Ptr
+    create_two_view_scene (std::string const& path, bool with_features)
+    {
+        mve::Bundle::Ptr bundle = mve::Bundle::create();
+        for (int i = 0; i < 2; ++i)
+        {
+            float const pos_x = static_cast<float>(i) * BASELINE;
+            mve::CameraInfo cam = make_camera(pos_x);
+            bundle->get_cameras().push_back(cam);
+
+            std::stringstream view_path;
+            view_path << util::fs::join_path(path, "views/view_")
+                << std::setw(4) << std::setfill('0') << i << ".mve";
+            util::fs::mkdir(view_path.str().c_str());
+
+            mve::View::Ptr view = mve::View::create();
+            view->set_id(i);
+            view->set_name("view" + std::to_string(i));
+            view->set_camera(cam);
+            view->set_image(render_plane(pos_x), "undistorted");
+            view->save_view_as(view_path.str());
+        }
+
+        for (int y = -2; with_features && y <= 2; ++y)
+            for (int x = -2; x <= 4; ++x)
+            {
+                mve::Bundle::Feature3D feature;
+                feature.pos[0] = 0.4f * static_cast<float>(x);
+                feature.pos[1] = 0.4f * static_cast<float>(y);
+                feature.pos[2] = PLANE_DEPTH;
+                std::fill(feature.color, feature.color + 3, 0.5f);
+                for (int i = 0; i < 2; ++i)
+                {
+                    mve::Bundle::Feature2D ref;
+                    ref.view_id = i;
+                    ref.feature_id = static_cast<int>(bundle->get_features()
+                        .size());
+                    ref.pos[0] = 0.0f;
+                    ref.pos[1] = 0.0f;
+                    feature.refs.push_back(ref);
+                }
+                bundle->get_features().push_back(feature);
+            }
+
+        mve::save_mve_bundle(bundle, util::fs::join_path(path, "synth_0.out"));
+        return mve::Scene::create(path);
+    }
+
+    mvs::Settings
+    patch_match_settings (void)
+    {
+        mvs::Settings settings;
+        settings.refViewNr = 0;
+        settings.scale = 0;
+        settings.usePatchMatch = true;
+        settings.keepConfidenceMap = true;
+        settings.quiet = true;
+        return settings;
+    }
+}
+
+TEST(PatchMatchTest, TwoViewPlaneDepthAndConfidence)
+{
+    SceneDirectory dir;
+    mve::Scene::Ptr scene = create_two_view_scene(dir.get_path(), true);
+    mvs::Settings settings = patch_match_settings();
+
+    mvs::DMRecon recon(scene, settings);
+    recon.start();
+    EXPECT_EQ(mvs::RECON_IDLE, recon.getProgress().status);
+
+    mve::View::Ptr view = scene->get_view_by_id(0);
+    ASSERT_TRUE(view != nullptr);
+    mve::FloatImage::Ptr depth = view->get_float_image("depth-L0");
+    mve::FloatImage::Ptr conf = view->get_float_image("conf-L0");
+    ASSERT_TRUE(depth != nullptr);
+    ASSERT_TRUE(conf != nullptr);
+    EXPECT_EQ(IMAGE_WIDTH, depth->width());
+    EXPECT_EQ(IMAGE_HEIGHT, depth->height());
+    EXPECT_EQ(IMAGE_WIDTH, conf->width());
+    EXPECT_EQ(IMAGE_HEIGHT, conf->height());
+
+    /*
+     * The left part of the reference view is not visible in the second
+     * view, the remainder should be mostly reconstructed. Depth is the
+     * distance along the viewing ray.
+     */
+    int filled = 0;
+    int accurate = 0;
+    for (int y = 0; y < IMAGE_HEIGHT; ++y)
+        for (int x = 0; x < IMAGE_WIDTH; ++x)
+        {
+            float const d = depth->at(x, y, 0);
+            float const c = conf->at(x, y, 0);
+            if (c <= 0.0f)
+            {
+                EXPECT_EQ(0.0f, d);
+                continue;
+            }
+            EXPECT_LE(c, 1.0f + 1e-5f);
+            math::Vec3f ray = pixel_ray(x, y);
+            float const expected = PLANE_DEPTH * ray.norm() / ray[2];
+            filled += 1;
+            if (std::abs(d - expected) < 0.02f * expected)
+                accurate += 1;
+        }
+
+    EXPECT_GT(filled, IMAGE_WIDTH * IMAGE_HEIGHT / 2);
+    EXPECT_GT(accurate, filled * 9 / 10);
+}
+
+TEST(PatchMatchTest, NoFeaturesFailsCleanly)
+{
+    SceneDirectory dir;
+    mve::Scene::Ptr scene = create_two_view_scene(dir.get_path(), false);
+    mvs::Settings settings = patch_match_settings();
+
+    std::vector<mvs::SingleView::Ptr> views;
+    for (std::size_t i = 0; i < scene->get_views().size(); ++i)
+        views.push_back(mvs::SingleView::create(scene,
+            scene->get_views()[i], settings.imageEmbedding));
+    views[0]->loadColorImage(0);
+    views[0]->prepareMasterView(0);
+
+    mvs::IndexSet neighbors;
+    neighbors.insert(1);
+    mve::Bundle::Features features;
+    mvs::Progress progress;
+    mvs::PatchMatch patch_match(views, settings, neighbors,
+        features, &progress);
+    EXPECT_THROW(patch_match.compute(), std::runtime_error);
+
+    /* The reference view is left untouched. */
+    mve::FloatImage::Ptr depth = views[0]->depthImg;
+    for (int i = 0; i < depth->get_value_amount(); ++i)
+        EXPECT_EQ(0.0f, depth->at(i));
+}
@@ -0,0 +1,186 @@
+// Test cases for the out-of-core surface reconstruction.
+// Written by Simon Fuhrmann.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "math/defines.h"
+#include "math/vector.h"
+#include "util/file_system.h"
+#include "mve/mesh.h"
+#include "mve/mesh_io_ply.h"
+#include "fssr/chunked_reconstruction.h"
+
+namespace
+{
+    struct TempFile : public std::string
+    {
+        TempFile (std::string const& postfix)
+            : std::string(std::tmpnam(nullptr))
+        {
+            this->append(postfix);
+        }
+
+        ~TempFile (void)
+        {
+            util::fs::unlink(this->c_str());
+        }
+    };
+
+    /* Samples on the unit sphere, evenly distributed on a spiral. */
+    mve::TriangleMesh::Ptr
+    create_sphere_samples (std::size_t num_points, float scale)
+    {
+        float const golden_angle = MATH_PI * (3.0f - std::sqrt(5.0f));
+        mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+        for (std::size_t i = 0; i < num_points; ++i)
+        {
+            float const z = 1.0f - (2.0f * i + 1.0f) / num_points;
+            float const r = std::sqrt(1.0f - z * z);
+            float const phi = golden_angle * static_cast<float>(i);
+            math::Vec3f pos(r * std::cos(phi), r * std::sin(phi), z);
+            mesh->get_vertices().push_back(pos);
+            mesh->get_vertex_normals().push_back(pos);
+            mesh->get_vertex_values().push_back(scale);
+            mesh->get_vertex_confidences().push_back(1.0f);
+            mesh->get_vertex_colors().push_back(math::Vec4f(
+                0.5f + 0.5f * pos[0], 0.5f, 0.5f - 0.5f * pos[2], 1.0f));
+        }
+        return mesh;
+    }
+
+    mve::TriangleMesh::Ptr
+    reconstruct (std::string const& filename, std::size_t max_memory,
+        std::string const& temp_dir)
+    {
+        fssr::ChunkedReconstruction::Options opts;
+        opts.max_memory = max_memory;
+        opts.temp_dir = temp_dir;
+        fssr::ChunkedReconstruction recon(opts);
+        mve::TriangleMesh::Ptr mesh = recon.reconstruct(
+            std::vector<std::string>(1, filename));
+
+        /* Surfaces between voxels with zero confidence are ghosts. */
+        mve::TriangleMesh::ConfidenceList const& confidences
+            = mesh->get_vertex_confidences();
+        mve::TriangleMesh::DeleteList delete_verts(confidences.size(), false);
+        for (std::size_t i = 0; i < confidences.size(); ++i)
+            delete_verts[i] = (confidences[i] == 0.0f);
+        mesh->delete_vertices_fix_faces(delete_verts);
+        return mesh;
+    }
+
+    struct VertexLess
+    {
+        mve::TriangleMesh::VertexList const* verts;
+
+        bool operator() (std::size_t a, std::size_t b) const
+        {
+            return std::lexicographical_compare(
+                (*verts)[a].begin(), (*verts)[a].end(),
+                (*verts)[b].begin(), (*verts)[b].end());
+        }
+    };
+
+    /*
+     * Returns the vertex indices in the order of their positions, and
+     * the faces in terms of these ranks, each starting with the smallest
+     * rank (keeping the orientation) and sorted.
+     */
+    void
+    canonical_mesh (mve::TriangleMesh::ConstPtr mesh,
+        std::vector<std::size_t>* order,
+        std::vector<math::Vec3ui>* faces)
+    {
+        mve::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+        order->resize(verts.size());
+        for (std::size_t i = 0; i < verts.size(); ++i)
+            order->at(i) = i;
+        VertexLess less;
+        less.verts = &verts;
+        std::sort(order->begin(), order->end(), less);
+
+        std::vector<std::size_t> rank(verts.size());
+        for (std::size_t i = 0; i < order->size(); ++i)
+            rank[order->at(i)] = i;
+
+        mve::TriangleMesh::FaceList const& mesh_faces = mesh->get_faces();
+        faces->clear();
+        for (std::size_t i = 0; i < mesh_faces.size(); i += 3)
+        {
+            math::Vec3ui face(rank[mesh_faces[i + 0]],
+                rank[mesh_faces[i + 1]], rank[mesh_faces[i + 2]]);
+            while (face[0] > face[1] || face[0] > face[2])
+                face = math::Vec3ui(face[1], face[2], face[0]);
+            faces->push_back(face);
+        }
+        std::sort(faces->begin(), faces->end(),
+            [](math::Vec3ui const& a, math::Vec3ui const& b)
+            {
+                return std::lexicographical_compare(a.begin(), a.end(),
+                    b.begin(), b.end());
+            });
+    }
+}
+
+TEST(ChunkedReconstructionTest, ChunksMatchInMemoryReconstruction)
+{
+    TempFile filename("_chunked_samples.ply");
+    TempFile temp_dir("_chunks");
+    ASSERT_TRUE(util::fs::mkdir(temp_dir.c_str()));
+
+    mve::geom::SavePLYOptions ply_opts;
+    ply_opts.write_vertex_normals = true;
+    ply_opts.write_vertex_values = true;
+    ply_opts.write_vertex_confidences = true;
+    ply_opts.write_vertex_colors = true;
+    mve::geom::save_ply_mesh(create_sphere_samples(2000, 0.15f),
+        filename, ply_opts);
+
+    /*
+     * The large budget reconstructs all samples in memory as a single chunk,
+     * the small budget splits the samples into the eight octants.
+     */
+    mve::TriangleMesh::Ptr reference = reconstruct(filename, 1 << 30, "");
+    mve::TriangleMesh::Ptr chunked = reconstruct(filename, 1 << 19, temp_dir);
+
+    /* The chunk files are removed after the reconstruction. */
+    EXPECT_TRUE(util::fs::Directory(temp_dir).empty());
+    util::fs::rmdir(temp_dir.c_str());
+
+    ASSERT_FALSE(reference->get_vertices().empty());
+    ASSERT_EQ(reference->get_vertices().size(),
+        chunked->get_vertices().size());
+    ASSERT_EQ(reference->get_faces().size(), chunked->get_faces().size());
+    EXPECT_EQ(chunked->get_vertices().size(),
+        chunked->get_vertex_colors().size());
+    EXPECT_EQ(chunked->get_vertices().size(),
+        chunked->get_vertex_values().size());
+    EXPECT_EQ(chunked->get_vertices().size(),
+        chunked->get_vertex_confidences().size());
+
+    std::vector<std::size_t> ref_order, chunked_order;
+    std::vector<math::Vec3ui> ref_faces, chunked_faces;
+    canonical_mesh(reference, &ref_order, &ref_faces);
+    canonical_mesh(chunked, &chunked_order, &chunked_faces);
+
+    /* Vertices along the seams are neither duplicated nor missing. */
+    mve::TriangleMesh::VertexList const& ref_verts = reference->get_vertices();
+    mve::TriangleMesh::VertexList const& verts = chunked->get_vertices();
+    for (std::size_t i = 0; i < chunked_order.size(); ++i)
+    {
+        math::Vec3f const& v = verts[chunked_order[i]];
+        if (i > 0)
+            EXPECT_NE(verts[chunked_order[i - 1]], v);
+        for (int j = 0; j < 3; ++j)
+            EXPECT_NEAR(ref_verts[ref_order[i]][j], v[j], 1e-5f);
+    }
+
+    /* Both meshes have the same connectivity. */
+    for (std::size_t i = 0; i < ref_faces.size(); ++i)
+        EXPECT_EQ(ref_faces[i], chunked_faces[i]);
+}
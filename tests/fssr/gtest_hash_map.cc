@@ -0,0 +1,96 @@
+// Test cases for the open addressing hash map.
+// Written by Simon Fuhrmann.
+
+#include <cstdint>
+#include <limits>
+#include <gtest/gtest.h>
+
+#include "fssr/hash_map.h"
+
+namespace
+{
+    struct IdentityHash
+    {
+        uint64_t operator() (uint64_t key) const
+        {
+            return key;
+        }
+    };
+
+    struct MixHash
+    {
+        uint64_t operator() (uint64_t key) const
+        {
+            return fssr::hash_mix(key);
+        }
+    };
+
+    uint64_t const EMPTY_KEY = std::numeric_limits<uint64_t>::max();
+}
+
+TEST(HashMapTest, EmptyMap)
+{
+    fssr::HashMap<uint64_t, int, MixHash> map(EMPTY_KEY);
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(0, map.size());
+    EXPECT_EQ(nullptr, map.find(0));
+    EXPECT_EQ(nullptr, map.find(12345));
+}
+
+TEST(HashMapTest, InsertAndFind)
+{
+    fssr::HashMap<uint64_t, int, MixHash> map(EMPTY_KEY);
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::pair<int*, bool> result = map.insert(i * 7, i);
+        EXPECT_TRUE(result.second);
+        EXPECT_EQ(i, *result.first);
+    }
+    EXPECT_EQ(1000, map.size());
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        int const* value = map.find(i * 7);
+        ASSERT_NE(nullptr, value);
+        EXPECT_EQ(i, *value);
+        EXPECT_EQ(nullptr, map.find(i * 7 + 1));
+    }
+}
+
+TEST(HashMapTest, InsertExistingKeepsValue)
+{
+    fssr::HashMap<uint64_t, int, MixHash> map(EMPTY_KEY);
+    EXPECT_TRUE(map.insert(42, 1).second);
+    std::pair<int*, bool> result = map.insert(42, 2);
+    EXPECT_FALSE(result.second);
+    EXPECT_EQ(1, *result.first);
+    EXPECT_EQ(1, map.size());
+}
+
+TEST(HashMapTest, CollidingKeys)
+{
+    /* All keys map to the same slot modulo the capacity. */
+    fssr::HashMap<uint64_t, int, IdentityHash> map(EMPTY_KEY);
+    map.reserve(100);
+    for (int i = 0; i < 50; ++i)
+        EXPECT_TRUE(map.insert(uint64_t(i) << 32, i).second);
+    for (int i = 0; i < 50; ++i)
+    {
+        int const* value = map.find(uint64_t(i) << 32);
+        ASSERT_NE(nullptr, value);
+        EXPECT_EQ(i, *value);
+    }
+    EXPECT_EQ(nullptr, map.find(uint64_t(50) << 32));
+}
+
+TEST(HashMapTest, ClearMap)
+{
+    fssr::HashMap<uint64_t, int, MixHash> map(EMPTY_KEY);
+    map.insert(1, 1);
+    map.insert(2, 2);
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(nullptr, map.find(1));
+    EXPECT_TRUE(map.insert(1, 3).second);
+    EXPECT_EQ(3, *map.find(1));
+}
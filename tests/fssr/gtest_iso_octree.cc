@@ -62,3 +62,19 @@ TEST(IsoOctreeTest, Temp2Test)
     std::cout << index2.index << std::endl;
 }
 #endif
+
+TEST(IsoOctreeTest, VoxelsUniqueAndSorted)
+{
+    /* Two uniform levels and one subdivided node on the third level. */
+    fssr::IsoOctree octree;
+    octree.set_root_node(math::Vec3d(0.0), 1.0);
+    octree.refine_octree();
+    octree.refine_octree();
+    octree.create_node(3, 0);
+    octree.compute_voxels();
+
+    fssr::IsoOctree::VoxelVector const& voxels = octree.get_voxels();
+    ASSERT_EQ(5 * 5 * 5 + 27 - 8, voxels.size());
+    for (std::size_t i = 1; i < voxels.size(); ++i)
+        EXPECT_LT(voxels[i - 1].first.index, voxels[i].first.index);
+}
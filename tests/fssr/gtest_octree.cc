@@ -2,6 +2,7 @@
 // Written by Simon Fuhrmann.
 
 #include <sstream>
+#include <stdexcept>
 #include <gtest/gtest.h>
 
 #include "fssr/octree.h"
@@ -113,3 +114,44 @@ TEST(OctreeTest, TestInsertIntoOctants)
     EXPECT_EQ(9, octree.get_num_samples());
     EXPECT_EQ(9, octree.get_num_nodes());
 }
+
+TEST(OctreeTest, TestSetRootNode)
+{
+    fssr::Octree octree;
+    octree.set_root_node(math::Vec3d(1.0, 2.0, 3.0), 4.0);
+    EXPECT_EQ(1, octree.get_num_nodes());
+    EXPECT_EQ(math::Vec3d(1.0, 2.0, 3.0), octree.get_root_node_center());
+    EXPECT_EQ(4.0, octree.get_root_node_size());
+    EXPECT_THROW(octree.set_root_node(math::Vec3d(0.0), 1.0),
+        std::logic_error);
+
+    /* Samples inside the root do not expand the octree. */
+    fssr::Sample s;
+    s.pos = math::Vec3f(2.5f, 3.5f, 4.5f);
+    s.scale = 1.0f;
+    octree.insert_sample(s);
+    EXPECT_EQ(4.0, octree.get_root_node_size());
+    EXPECT_EQ(3, octree.get_num_levels());
+    EXPECT_EQ(17, octree.get_num_nodes());
+}
+
+TEST(OctreeTest, TestCreateNode)
+{
+    fssr::Octree octree;
+    EXPECT_THROW(octree.create_node(1, 0), std::logic_error);
+
+    octree.set_root_node(math::Vec3d(0.0), 1.0);
+    octree.create_node(2, (3 << 3) | 5);
+    EXPECT_EQ(3, octree.get_num_levels());
+    EXPECT_EQ(17, octree.get_num_nodes());
+
+    /* Existing nodes are not created again. */
+    octree.create_node(1, 3);
+    octree.create_node(2, (3 << 3) | 1);
+    EXPECT_EQ(17, octree.get_num_nodes());
+
+    fssr::Octree::Iterator iter = octree.get_iterator_for_root();
+    iter = iter.descend(2, (3 << 3) | 5);
+    EXPECT_NE(nullptr, iter.current);
+    EXPECT_EQ(nullptr, iter.current->children);
+}
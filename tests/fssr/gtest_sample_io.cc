@@ -0,0 +1,188 @@
+// Test cases for the sample reader.
+// Written by Simon Fuhrmann.
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "util/endian.h"
+#include "util/exception.h"
+#include "util/file_system.h"
+#include "mve/mesh.h"
+#include "mve/mesh_io_ply.h"
+#include "fssr/sample.h"
+#include "fssr/sample_io.h"
+
+namespace
+{
+    struct TempFile : public std::string
+    {
+        TempFile (std::string const& postfix)
+            : std::string(std::tmpnam(nullptr))
+        {
+            this->append(postfix);
+        }
+
+        ~TempFile (void)
+        {
+            util::fs::unlink(this->c_str());
+        }
+    };
+
+    /* Creates a point set with more samples than one block of records. */
+    mve::TriangleMesh::Ptr
+    create_point_set (std::size_t num_points)
+    {
+        mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+        for (std::size_t i = 0; i < num_points; ++i)
+        {
+            float const f = static_cast<float>(i);
+            mesh->get_vertices().push_back(math::Vec3f(f, -f, 0.5f * f));
+            mesh->get_vertex_normals().push_back(math::Vec3f(0.0f, 0.0f,
+                i % 2 ? 1.0f : 2.0f));
+            mesh->get_vertex_values().push_back(1.0f + (i % 7));
+            mesh->get_vertex_confidences().push_back(i % 100 ? 1.0f : 0.0f);
+            mesh->get_vertex_colors().push_back(math::Vec4f(
+                (i % 256) / 255.0f, 0.0f, 1.0f, 1.0f));
+        }
+        return mesh;
+    }
+
+    void
+    expect_samples (mve::TriangleMesh::ConstPtr mesh,
+        fssr::SampleList const& samples)
+    {
+        /* Samples with zero confidence are skipped. */
+        ASSERT_EQ(mesh->get_vertices().size()
+            - (mesh->get_vertices().size() + 99) / 100, samples.size());
+        for (std::size_t i = 0, j = 0; i < mesh->get_vertices().size(); ++i)
+        {
+            if (mesh->get_vertex_confidences()[i] == 0.0f)
+                continue;
+            fssr::Sample const& s = samples[j++];
+            for (int k = 0; k < 3; ++k)
+            {
+                EXPECT_FLOAT_EQ(mesh->get_vertices()[i][k], s.pos[k]);
+                EXPECT_NEAR(mesh->get_vertex_colors()[i][k], s.color[k],
+                    1e-6f);
+            }
+            EXPECT_EQ(math::Vec3f(0.0f, 0.0f, 1.0f), s.normal);
+            EXPECT_EQ(mesh->get_vertex_values()[i], s.scale);
+            EXPECT_EQ(1.0f, s.confidence);
+        }
+    }
+}
+
+TEST(SampleIOTest, ReadBinaryFile)
+{
+    mve::TriangleMesh::Ptr mesh = create_point_set(70000);
+    TempFile filename("sample_io_binary.ply");
+    mve::geom::SavePLYOptions opts;
+    opts.write_vertex_normals = true;
+    mve::geom::save_ply_mesh(mesh, filename, opts);
+
+    fssr::SampleList samples;
+    fssr::SampleIO loader((fssr::SampleIO::Options()));
+    loader.read_file(filename, &samples);
+    expect_samples(mesh, samples);
+}
+
+TEST(SampleIOTest, StreamBinaryFile)
+{
+    mve::TriangleMesh::Ptr mesh = create_point_set(70000);
+    TempFile filename("sample_io_stream.ply");
+    mve::geom::SavePLYOptions opts;
+    opts.write_vertex_normals = true;
+    mve::geom::save_ply_mesh(mesh, filename, opts);
+
+    fssr::SampleList samples;
+    fssr::SampleIO loader((fssr::SampleIO::Options()));
+    loader.open_file(filename);
+    fssr::Sample sample;
+    while (loader.next_sample(&sample))
+        samples.push_back(sample);
+    expect_samples(mesh, samples);
+}
+
+TEST(SampleIOTest, StreamAsciiFile)
+{
+    mve::TriangleMesh::Ptr mesh = create_point_set(1000);
+    TempFile filename("sample_io_ascii.ply");
+    mve::geom::SavePLYOptions opts;
+    opts.format_binary = false;
+    opts.write_vertex_normals = true;
+    mve::geom::save_ply_mesh(mesh, filename, opts);
+
+    fssr::SampleList samples;
+    fssr::SampleIO loader((fssr::SampleIO::Options()));
+    loader.open_file(filename);
+    fssr::Sample sample;
+    while (loader.next_sample(&sample))
+        samples.push_back(sample);
+    expect_samples(mesh, samples);
+}
+
+TEST(SampleIOTest, TruncatedBinaryFile)
+{
+    mve::TriangleMesh::Ptr mesh = create_point_set(100);
+    TempFile filename("sample_io_truncated.ply");
+    mve::geom::SavePLYOptions opts;
+    opts.write_vertex_normals = true;
+    mve::geom::save_ply_mesh(mesh, filename, opts);
+
+    std::string data;
+    util::fs::read_file_to_string(filename, &data);
+    data.resize(data.size() - 10);
+    util::fs::write_string_to_file(data, filename);
+
+    fssr::SampleList samples;
+    fssr::SampleIO loader((fssr::SampleIO::Options()));
+    EXPECT_THROW(loader.read_file(filename, &samples), util::FileException);
+}
+
+TEST(SampleIOTest, ReadDoubleBinaryFile)
+{
+    /* Double coordinates are read with the generic PLY parser. */
+    std::size_t const num_points = 100;
+    std::ostringstream out;
+    out << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << num_points << "\n"
+        << "property double x\nproperty double y\nproperty double z\n"
+        << "property float32 nx\nproperty float32 ny\nproperty float32 nz\n"
+        << "property float value\nproperty uint8 red\n"
+        << "end_header\n";
+    for (std::size_t i = 0; i < num_points; ++i)
+    {
+        double const pos[3] = { 0.5 * i, -1.0 * i, 2.0 };
+        float const values[4] = { 0.0f, 1.0f, 0.0f, 1.0f + i };
+        for (int j = 0; j < 3; ++j)
+        {
+            double const value = util::system::letoh(pos[j]);
+            out.write(reinterpret_cast<char const*>(&value), sizeof(double));
+        }
+        for (int j = 0; j < 4; ++j)
+        {
+            float const value = util::system::letoh(values[j]);
+            out.write(reinterpret_cast<char const*>(&value), sizeof(float));
+        }
+        out.put(static_cast<char>(i));
+    }
+    TempFile filename("sample_io_double.ply");
+    util::fs::write_string_to_file(out.str(), filename);
+
+    fssr::SampleList samples;
+    fssr::SampleIO loader((fssr::SampleIO::Options()));
+    loader.read_file(filename, &samples);
+    ASSERT_EQ(num_points, samples.size());
+    for (std::size_t i = 0; i < num_points; ++i)
+    {
+        EXPECT_EQ(math::Vec3f(0.5f * i, -1.0f * i, 2.0f), samples[i].pos);
+        EXPECT_EQ(math::Vec3f(0.0f, 1.0f, 0.0f), samples[i].normal);
+        EXPECT_EQ(1.0f + i, samples[i].scale);
+        EXPECT_FLOAT_EQ(i / 255.0f, samples[i].color[0]);
+    }
+
+    /* The streaming reader does not support double coordinates. */
+    EXPECT_THROW(loader.open_file(filename), util::Exception);
+}
@@ -0,0 +1,109 @@
+// Test cases for the depth map triangulation.
+// Written by Simon Fuhrmann.
+
+#include <gtest/gtest.h>
+
+#include "math/matrix.h"
+#include "mve/camera.h"
+#include "mve/depthmap.h"
+
+namespace
+{
+    math::Matrix3f
+    get_invproj (int width, int height)
+    {
+        mve::CameraInfo cam;
+        cam.flen = 1.0f;
+        math::Matrix3f invproj;
+        cam.fill_inverse_calibration(*invproj, width, height);
+        return invproj;
+    }
+}
+
+TEST(DepthmapTest, TriangulateFull)
+{
+    mve::FloatImage::Ptr dm = mve::FloatImage::create(5, 4, 1);
+    dm->fill(2.0f);
+    math::Matrix3f const invproj = get_invproj(5, 4);
+    mve::TriangleMesh::Ptr mesh
+        = mve::geom::depthmap_triangulate(dm, invproj, 0.0f);
+    EXPECT_EQ(20, mesh->get_vertices().size());
+    EXPECT_EQ(4 * 3 * 2 * 3, mesh->get_faces().size());
+
+    /* Vertices are numbered in the order they are referenced. */
+    EXPECT_EQ(0, mesh->get_faces()[0]);
+    EXPECT_NEAR(0.0f, (mesh->get_vertices()[0]
+        - mve::geom::pixel_3dpos(0, 0, 2.0f, invproj)).norm(), 1e-6f);
+}
+
+TEST(DepthmapTest, TriangulateTooSmall)
+{
+    mve::FloatImage::Ptr dm = mve::FloatImage::create(1, 10, 1);
+    dm->fill(1.0f);
+    mve::Image<unsigned int> vids;
+    mve::TriangleMesh::Ptr mesh = mve::geom::depthmap_triangulate(dm,
+        get_invproj(1, 10), 5.0f, &vids);
+    EXPECT_TRUE(mesh->get_vertices().empty());
+    EXPECT_TRUE(mesh->get_faces().empty());
+    EXPECT_EQ(10, vids.get_pixel_amount());
+    EXPECT_EQ(MATH_MAX_UINT, vids.at(0));
+}
+
+TEST(DepthmapTest, TriangulateVertexIDs)
+{
+    /* Use enough rows for several bands, with holes and depth jumps. */
+    int const width = 37, height = 101;
+    mve::FloatImage::Ptr dm = mve::FloatImage::create(width, height, 1);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float depth = 3.0f + 0.01f * x;
+            if ((x * 7 + y * 13) % 11 == 0)
+                depth = 0.0f;
+            if (y > 60)
+                depth *= 2.0f;
+            dm->at(x, y, 0) = depth;
+        }
+
+    math::Matrix3f const invproj = get_invproj(width, height);
+    mve::Image<unsigned int> vids;
+    mve::TriangleMesh::Ptr mesh = mve::geom::depthmap_triangulate(dm,
+        invproj, 5.0f, &vids);
+    mve::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+    mve::TriangleMesh::FaceList const& faces = mesh->get_faces();
+    ASSERT_FALSE(faces.empty());
+
+    /* Every vertex is generated by exactly one pixel. */
+    std::vector<bool> seen(verts.size(), false);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            unsigned int const id = vids.at(x, y, 0);
+            if (id == MATH_MAX_UINT)
+                continue;
+            ASSERT_LT(id, verts.size());
+            EXPECT_FALSE(seen[id]);
+            seen[id] = true;
+            math::Vec3f const pos = mve::geom::pixel_3dpos(x, y,
+                dm->at(x, y, 0), invproj);
+            EXPECT_EQ(pos, verts[id]);
+        }
+
+    /* Vertex IDs appear in increasing order in the face list. */
+    unsigned int next_id = 0;
+    for (std::size_t i = 0; i < faces.size(); ++i)
+    {
+        ASSERT_LE(faces[i], next_id);
+        if (faces[i] == next_id)
+            next_id += 1;
+    }
+    EXPECT_EQ(verts.size(), next_id);
+
+    /* No triangle spans the depth jump. */
+    for (std::size_t i = 0; i < faces.size(); i += 3)
+    {
+        bool const far = verts[faces[i]][2] > 5.0f;
+        EXPECT_EQ(far, verts[faces[i + 1]][2] > 5.0f);
+        EXPECT_EQ(far, verts[faces[i + 2]][2] > 5.0f);
+    }
+}
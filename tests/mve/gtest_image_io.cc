@@ -3,9 +3,13 @@
 
 #include <fstream>
 #include <cstdio>
+#include <cstring>
+#include <limits>
+#include <sstream>
 #include <string>
 #include <gtest/gtest.h>
 
+#include "util/exception.h"
 #include "util/file_system.h"
 #include "mve/image.h"
 #include "mve/image_io.h"
@@ -112,6 +116,38 @@ TEST(ImageFileTest, JPEGSaveLoad)
     EXPECT_TRUE(compare_jpeg(img1, img2));
 }
 
+TEST(ImageFileTest, JPEGLoadReduced)
+{
+    TempFile filename("jpegtest3");
+    mve::ByteImage::Ptr img1 = make_byte_image(255, 101, 3);
+    mve::image::save_jpg_file(img1, filename, 90);
+
+    /* The size matches repeated half-sizing of the image. */
+    mve::ByteImage::Ptr img2
+        = mve::image::load_jpg_file_scaled(filename, 255 * 101);
+    EXPECT_EQ(255, img2->width());
+    EXPECT_EQ(101, img2->height());
+    img2 = mve::image::load_jpg_file_scaled(filename, 255 * 101 - 1);
+    EXPECT_EQ(128, img2->width());
+    EXPECT_EQ(51, img2->height());
+    EXPECT_EQ(3, img2->channels());
+    img2 = mve::image::load_jpg_file_scaled(filename, 64 * 26);
+    EXPECT_EQ(64, img2->width());
+    EXPECT_EQ(26, img2->height());
+
+    /* The image is not reduced by more than a factor of 8. */
+    mve::image::ImageHeaders headers;
+    img2 = mve::image::load_jpg_file_scaled(filename, 1, nullptr, &headers);
+    EXPECT_EQ(32, img2->width());
+    EXPECT_EQ(13, img2->height());
+
+    /* The headers describe the original image. */
+    EXPECT_EQ(255, headers.width);
+    EXPECT_EQ(101, headers.height);
+    EXPECT_EQ(3, headers.channels);
+    EXPECT_EQ(mve::IMAGE_TYPE_UINT8, headers.type);
+}
+
 TEST(ImageFileTest, JPEGLoadHeaders)
 {
     TempFile filename("jpegtest2");
@@ -342,3 +378,158 @@ TEST(ImageFileTest, MVEILoadHeaders)
     EXPECT_EQ(img1->channels(), headers.channels);
     EXPECT_EQ(img1->get_type(), headers.type);
 }
+
+TEST(ImageFileTest, MVEISaveLoadTiledFloatImage)
+{
+    TempFile filename("mveitesttiled");
+    mve::FloatImage::Ptr img1, img2;
+
+    img1 = make_float_image(199, 99, 3);
+    mve::image::save_mvei_file(img1, filename,
+        mve::image::MVEI_COMPRESSION_DEFLATE, 32);
+    img2 = std::dynamic_pointer_cast<mve::FloatImage>
+        (mve::image::load_mvei_file(filename));
+    EXPECT_TRUE(compare_exact<float>(img1, img2));
+
+    mve::image::save_mvei_file(img1, filename,
+        mve::image::MVEI_COMPRESSION_NONE, 50);
+    img2 = std::dynamic_pointer_cast<mve::FloatImage>
+        (mve::image::load_mvei_file(filename));
+    EXPECT_TRUE(compare_exact<float>(img1, img2));
+}
+
+TEST(ImageFileTest, MVEISaveLoadTiledByteImage)
+{
+    TempFile filename("mveitesttiledbyte");
+    mve::ByteImage::Ptr img1, img2;
+
+    /* Constant images compress, others are stored as is. */
+    img1 = mve::ByteImage::create(64, 48, 2);
+    img1->fill(17);
+    mve::image::save_mvei_file(img1, filename,
+        mve::image::MVEI_COMPRESSION_DEFLATE, 16);
+    img2 = std::dynamic_pointer_cast<mve::ByteImage>
+        (mve::image::load_mvei_file(filename));
+    EXPECT_TRUE(compare_exact<uint8_t>(img1, img2));
+
+    img1 = make_byte_image(5, 3, 1);
+    mve::image::save_mvei_file(img1, filename,
+        mve::image::MVEI_COMPRESSION_DEFLATE);
+    img2 = std::dynamic_pointer_cast<mve::ByteImage>
+        (mve::image::load_mvei_file(filename));
+    EXPECT_TRUE(compare_exact<uint8_t>(img1, img2));
+}
+
+TEST(ImageFileTest, MVEILoadTiledHeaders)
+{
+    TempFile filename("mveitesttiledheaders");
+    mve::ByteImage::Ptr img1 = make_byte_image(11, 22, 6);
+    mve::image::save_mvei_file(img1, filename,
+        mve::image::MVEI_COMPRESSION_DEFLATE, 8);
+    mve::image::ImageHeaders headers;
+    headers = mve::image::load_mvei_file_headers(filename);
+    EXPECT_EQ(img1->width(), headers.width);
+    EXPECT_EQ(img1->height(), headers.height);
+    EXPECT_EQ(img1->channels(), headers.channels);
+    EXPECT_EQ(img1->get_type(), headers.type);
+}
+
+TEST(ImageFileTest, MVEILoadRegion)
+{
+    TempFile filename("mveitestregion");
+    mve::FloatImage::Ptr img = make_float_image(97, 61, 2);
+
+    for (int tiled = 0; tiled < 2; ++tiled)
+    {
+        if (tiled)
+            mve::image::save_mvei_file(img, filename,
+                mve::image::MVEI_COMPRESSION_DEFLATE, 16);
+        else
+            mve::image::save_mvei_file(img, filename);
+
+        mve::FloatImage::Ptr region = std::dynamic_pointer_cast
+            <mve::FloatImage>(mve::image::load_mvei_file_region(filename,
+            13, 40, 70, 21));
+        ASSERT_TRUE(region != nullptr);
+        EXPECT_EQ(70, region->width());
+        EXPECT_EQ(21, region->height());
+        EXPECT_EQ(2, region->channels());
+        bool equal = true;
+        for (int y = 0; y < 21; ++y)
+            for (int x = 0; x < 70; ++x)
+                for (int c = 0; c < 2; ++c)
+                    equal = equal && region->at(x, y, c)
+                        == img->at(x + 13, y + 40, c);
+        EXPECT_TRUE(equal);
+
+        EXPECT_THROW(mve::image::load_mvei_file_region(filename,
+            0, 0, 98, 1), std::invalid_argument);
+    }
+}
+
+TEST(ImageFileTest, MVEILoadTiledTruncated)
+{
+    TempFile filename("mveitesttiledtrunc");
+    mve::FloatImage::Ptr img = make_float_image(40, 40, 1);
+    mve::image::save_mvei_file(img, filename,
+        mve::image::MVEI_COMPRESSION_DEFLATE, 16);
+
+    std::string data;
+    {
+        std::ifstream in(filename.c_str(), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in),
+            std::istreambuf_iterator<char>());
+    }
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    out.write(data.data(), data.size() - 10);
+    out.close();
+    EXPECT_THROW(mve::image::load_mvei_file(filename), util::Exception);
+}
+
+TEST(ImageFileTest, MVEILoadTiledCorruptOffsets)
+{
+    mve::FloatImage::Ptr img = make_float_image(40, 40, 1);
+    std::ostringstream out;
+    mve::image::save_mvei_file(img, out,
+        mve::image::MVEI_COMPRESSION_DEFLATE, 16);
+    std::string const data = out.str();
+
+    /* The offset table follows the signature and six header values. */
+    std::size_t const table_pos = 11 + 6 * sizeof(int32_t);
+    std::size_t const num_offsets = 3 * 3 + 1;
+    uint64_t const bad_offsets[] = { 0, data.size() + 1,
+        std::numeric_limits<uint64_t>::max() };
+    for (std::size_t i = 0; i < num_offsets; ++i)
+        for (uint64_t offset : bad_offsets)
+        {
+            std::string corrupt = data;
+            std::memcpy(&corrupt[table_pos + i * sizeof(uint64_t)],
+                &offset, sizeof(uint64_t));
+            std::istringstream in(corrupt);
+            EXPECT_THROW(mve::image::load_mvei_file(in), util::Exception);
+        }
+
+    /* A tile count that exceeds the stream is rejected. */
+    std::string corrupt = data;
+    int32_t const tile_size = 1;
+    std::memcpy(&corrupt[11 + 5 * sizeof(int32_t)],
+        &tile_size, sizeof(int32_t));
+    std::istringstream in(corrupt);
+    EXPECT_THROW(mve::image::load_mvei_file(in), util::Exception);
+
+    std::istringstream valid(data);
+    mve::FloatImage::Ptr img2 = std::dynamic_pointer_cast
+        <mve::FloatImage>(mve::image::load_mvei_file(valid));
+    EXPECT_TRUE(compare_exact<float>(img, img2));
+}
+
+TEST(ImageFileTest, MVEISaveLoadStream)
+{
+    mve::FloatImage::Ptr img = make_float_image(17, 9, 2);
+    std::ostringstream out;
+    mve::image::save_mvei_file(img, out);
+    std::istringstream in(out.str());
+    mve::FloatImage::Ptr img2 = std::dynamic_pointer_cast
+        <mve::FloatImage>(mve::image::load_mvei_file(in));
+    EXPECT_TRUE(compare_exact<float>(img, img2));
+}
@@ -1,6 +1,8 @@
 // Test cases for the MVE image tools.
 // Written by Simon Fuhrmann.
 
+#include <algorithm>
+#include <limits>
 #include <gtest/gtest.h>
 
 #include "mve/image.h"
@@ -50,6 +52,112 @@ TEST(ImageToolsTest, ImageConversion)
     // TODO
 }
 
+TEST(ImageToolsTest, ByteToFloatAndBackAllValues)
+{
+    /* 257 values cover the vectorized loop and the remainder. */
+    mve::ByteImage::Ptr img = mve::ByteImage::create(257, 1, 1);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i);
+
+    mve::FloatImage::Ptr fimg = mve::image::byte_to_float_image(img);
+    for (int i = 0; i < fimg->get_value_amount(); ++i)
+        EXPECT_EQ(static_cast<float>(img->at(i)) / 255.0f, fimg->at(i));
+
+    mve::ByteImage::Ptr img2 = mve::image::float_to_byte_image(fimg);
+    for (int i = 0; i < img2->get_value_amount(); ++i)
+        EXPECT_EQ(img->at(i), img2->at(i));
+}
+
+TEST(ImageToolsTest, FloatToByteClampingAndRange)
+{
+    mve::FloatImage::Ptr img = mve::FloatImage::create(19, 1, 1);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = -2.0f + static_cast<float>(i) * 0.25f;
+    img->at(3) = std::numeric_limits<float>::quiet_NaN();
+    img->at(4) = std::numeric_limits<float>::infinity();
+    img->at(18) = -std::numeric_limits<float>::infinity();
+
+    mve::ByteImage::Ptr out = mve::image::float_to_byte_image(img, -1.0f, 2.0f);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+    {
+        float value = img->at(i);
+        if (i == 3)
+            value = -1.0f;
+        value = std::min(2.0f, std::max(-1.0f, value));
+        value = 255.0f * (value + 1.0f) / 3.0f;
+        EXPECT_EQ(static_cast<int>(value + 0.5f), out->at(i)) << i;
+    }
+}
+
+TEST(ImageToolsTest, DesaturateByteImage)
+{
+    mve::ByteImage::Ptr img = mve::ByteImage::create(5, 1, 4);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i * 37 % 256);
+    mve::ByteImage::Ptr rgb = img->duplicate();
+    mve::image::reduce_alpha<uint8_t>(rgb);
+
+    mve::ByteImage::Ptr max = mve::image::desaturate<uint8_t>
+        (rgb, mve::image::DESATURATE_MAXIMUM);
+    mve::ByteImage::Ptr light = mve::image::desaturate<uint8_t>
+        (rgb, mve::image::DESATURATE_LIGHTNESS);
+    mve::ByteImage::Ptr lum = mve::image::desaturate<uint8_t>
+        (img, mve::image::DESATURATE_LUMINANCE);
+    ASSERT_EQ(1, max->channels());
+    ASSERT_EQ(2, lum->channels());
+    for (int i = 0; i < img->get_pixel_amount(); ++i)
+    {
+        int const r = img->at(i, 0), g = img->at(i, 1), b = img->at(i, 2);
+        int const vmax = std::max(r, std::max(g, b));
+        int const vmin = std::min(r, std::min(g, b));
+        EXPECT_EQ(vmax, max->at(i));
+        EXPECT_EQ(static_cast<int>(vmax * 0.5f + vmin * 0.5f + 0.5f),
+            light->at(i));
+        EXPECT_EQ(static_cast<int>(r * 0.30f + g * 0.59f + b * 0.11f + 0.5f),
+            lum->at(i, 0));
+        EXPECT_EQ(img->at(i, 3), lum->at(i, 1));
+    }
+}
+
+TEST(ImageToolsTest, DesaturateFloatImage)
+{
+    mve::FloatImage::Ptr img = create_test_float_image(4, 3, 3);
+    mve::FloatImage::Ptr avg = mve::image::desaturate<float>
+        (img, mve::image::DESATURATE_AVERAGE);
+    mve::FloatImage::Ptr lum = mve::image::desaturate<float>
+        (img, mve::image::DESATURATE_LUMINOSITY);
+    for (int i = 0; i < img->get_pixel_amount(); ++i)
+    {
+        float const* v = &img->at(i, 0);
+        EXPECT_NEAR((v[0] + v[1] + v[2]) / 3.0f, avg->at(i), 1e-6f);
+        EXPECT_NEAR(v[0] * 0.21f + v[1] * 0.72f + v[2] * 0.07f,
+            lum->at(i), 1e-6f);
+    }
+}
+
+TEST(ImageToolsTest, ExpandGrayscale)
+{
+    mve::ByteImage::Ptr gray = mve::ByteImage::create(3, 2, 1);
+    mve::ByteImage::Ptr gray_alpha = mve::ByteImage::create(3, 2, 2);
+    for (int i = 0; i < gray->get_value_amount(); ++i)
+        gray->at(i) = static_cast<uint8_t>(i * 10);
+    for (int i = 0; i < gray_alpha->get_value_amount(); ++i)
+        gray_alpha->at(i) = static_cast<uint8_t>(i * 5);
+
+    mve::ByteImage::Ptr rgb = mve::image::expand_grayscale<uint8_t>(gray);
+    mve::ByteImage::Ptr rgba
+        = mve::image::expand_grayscale<uint8_t>(gray_alpha);
+    ASSERT_EQ(3, rgb->channels());
+    ASSERT_EQ(4, rgba->channels());
+    for (int i = 0; i < gray->get_pixel_amount(); ++i)
+        for (int c = 0; c < 3; ++c)
+        {
+            EXPECT_EQ(gray->at(i, 0), rgb->at(i, c));
+            EXPECT_EQ(gray_alpha->at(i, 0), rgba->at(i, c));
+            EXPECT_EQ(gray_alpha->at(i, 1), rgba->at(i, 3));
+        }
+}
+
 TEST(ImageToolsTest, ImageFindMinMax)
 {
     mve::FloatImage::Ptr fimg = mve::FloatImage::create(4, 1, 1);
@@ -330,6 +438,33 @@ TEST(ImageToolsTest, IntegralImage)
     EXPECT_EQ(256, sat->at(3, 3, 1));
 }
 
+TEST(ImageToolsTest, IntegralImageLargeImage)
+{
+    /* The image is wide enough to be processed in several blocks. */
+    mve::ByteImage::Ptr img = mve::ByteImage::create(700, 5, 3);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i * 37 + i / 7);
+
+    mve::IntImage::Ptr sat = mve::image::integral_image<uint8_t, int>(img);
+    for (int y = 0; y < img->height(); ++y)
+        for (int x = 0; x < img->width(); ++x)
+            for (int c = 0; c < img->channels(); ++c)
+            {
+                int expected = img->at(x, y, c);
+                if (x > 0)
+                    expected += sat->at(x - 1, y, c);
+                if (y > 0)
+                    expected += sat->at(x, y - 1, c);
+                if (x > 0 && y > 0)
+                    expected -= sat->at(x - 1, y - 1, c);
+                ASSERT_EQ(expected, sat->at(x, y, c));
+            }
+
+    mve::ByteImage::Ptr empty = mve::ByteImage::create(0, 3, 1);
+    sat = mve::image::integral_image<uint8_t, int>(empty);
+    EXPECT_EQ(0, sat->get_value_amount());
+}
+
 TEST(ImageToolsTest, GammaCorrect_Float_GoldenValues)
 {
     mve::FloatImage::Ptr img = mve::FloatImage::create(1, 1, 3);
@@ -378,6 +513,30 @@ TEST(ImageToolsTest, GammaCorrectSRGB_Float_BackAndForth)
         EXPECT_NEAR(img->at(i), out->at(i), 1e-6f);
 }
 
+TEST(ImageToolsTest, GammaCorrectSRGB_Byte_MatchesFloat)
+{
+    mve::ByteImage::Ptr img = mve::ByteImage::create(256, 1, 1);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i);
+    mve::ByteImage::Ptr inv = img->duplicate();
+    mve::FloatImage::Ptr fimg = mve::image::byte_to_float_image(img);
+    mve::FloatImage::Ptr finv = fimg->duplicate();
+
+    mve::image::gamma_correct_srgb(img);
+    mve::image::gamma_correct_inv_srgb(inv);
+    mve::image::gamma_correct_srgb<float>(fimg);
+    mve::image::gamma_correct_inv_srgb<float>(finv);
+
+    for (int i = 0; i < img->get_value_amount(); ++i)
+    {
+        EXPECT_NEAR(fimg->at(i) * 255.0f, img->at(i), 0.5f);
+        EXPECT_NEAR(finv->at(i) * 255.0f, inv->at(i), 0.5f);
+    }
+    EXPECT_EQ(0, img->at(0));
+    EXPECT_EQ(255, img->at(255));
+    EXPECT_EQ(255, inv->at(255));
+}
+
 TEST(ImageToolsTest, ByteImageSubtractDifference)
 {
     mve::ByteImage::Ptr img1 = create_test_byte_image(3, 2, 2);
@@ -513,6 +672,140 @@ TEST(ImageToolsTest, ImageFlippingTwoChannels)
 // TODO
 // Test rescale_half_size and variations
 // Test rescale_double_size and variations
+TEST(ImageToolsTest, UndistortIdentity)
+{
+    mve::ByteImage::Ptr img = mve::ByteImage::create(31, 17, 3);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i * 37 % 256);
+
+    /* Equal parameters of the Photosynther model leave the image as is. */
+    mve::ByteImage::Ptr out
+        = mve::image::image_undistort_msps<uint8_t>(img, 0.2, 0.2);
+    ASSERT_EQ(img->width(), out->width());
+    ASSERT_EQ(img->height(), out->height());
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        EXPECT_EQ(img->at(i), out->at(i));
+}
+
+TEST(ImageToolsTest, UndistortK2K4MatchesLinearInterpolation)
+{
+    int const width = 40, height = 30;
+    mve::FloatImage::Ptr img = create_test_float_image(width, height, 3);
+    double const flen = 1.1, k2 = -0.2, k4 = 0.05;
+    mve::FloatImage::Ptr out = mve::image::UndistortMap::create_k2k4
+        (width, height, flen, k2, k4)->apply<float>(img);
+
+    float const fnorm = std::max(width, height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            float const fx = (x + 0.5f - width / 2.0f) / fnorm;
+            float const fy = (y + 0.5f - height / 2.0f) / fnorm;
+            float const rd = (fx * fx + fy * fy) / (flen * flen);
+            float const factor = 1.0f + k2 * rd + k4 * rd * rd;
+            float const ix = fx * factor * fnorm + width / 2.0f - 0.5f;
+            float const iy = fy * factor * fnorm + height / 2.0f - 0.5f;
+            for (int c = 0; c < 3; ++c)
+                EXPECT_NEAR(img->linear_at(ix, iy, c), out->at(x, y, c),
+                    1e-3f);
+        }
+}
+
+TEST(ImageToolsTest, UndistortMapZeroDistortion)
+{
+    mve::ByteImage::Ptr img = mve::ByteImage::create(8, 6, 1);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i);
+
+    mve::image::UndistortMapCache cache;
+    mve::ByteImage::Ptr vsfm = cache.get_vsfm(8, 6, 1.2, 0.0)
+        ->apply<uint8_t>(img);
+    mve::ByteImage::Ptr k2k4 = cache.get_k2k4(8, 6, 1.2, 0.0, 0.0)
+        ->apply<uint8_t>(img);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+    {
+        EXPECT_EQ(img->at(i), vsfm->at(i));
+        EXPECT_EQ(img->at(i), k2k4->at(i));
+    }
+}
+
+TEST(ImageToolsTest, UndistortMapFloatWeights)
+{
+    /* A steep ramp reveals coarsely quantized interpolation weights. */
+    int const width = 40, height = 30;
+    mve::FloatImage::Ptr img = mve::FloatImage::create(width, height, 1);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            img->at(x, y, 0) = 1000.0f * x + 100.0f * y;
+
+    double const flen = 1.1, k2 = -0.2, k4 = 0.05;
+    mve::FloatImage::Ptr out = mve::image::UndistortMap::create_k2k4
+        (width, height, flen, k2, k4)->apply<float>(img);
+    mve::FloatImage::Ptr ref = mve::image::image_undistort_k2k4<float>
+        (img, flen, k2, k4);
+    double const fnorm = std::max(width, height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            double const fx = (x + 0.5 - width / 2.0) / fnorm;
+            double const fy = (y + 0.5 - height / 2.0) / fnorm;
+            double const rd = (fx * fx + fy * fy) / (flen * flen);
+            double const factor = 1.0 + k2 * rd + k4 * rd * rd;
+            float const ix = fx * factor * fnorm + width / 2.0 - 0.5;
+            float const iy = fy * factor * fnorm + height / 2.0 - 0.5;
+            if (ix < -0.5f || ix > width - 0.5f
+                || iy < -0.5f || iy > height - 0.5f)
+                continue;
+            /* 15-bit weights, the error is below 1100 / 2^15. */
+            EXPECT_NEAR(img->linear_at(ix, iy, 0), out->at(x, y, 0), 0.05f);
+            EXPECT_NEAR(ref->at(x, y, 0), out->at(x, y, 0), 0.05f);
+        }
+}
+
+TEST(ImageToolsTest, UndistortMapInvalidImage)
+{
+    mve::image::UndistortMap::Ptr map
+        = mve::image::UndistortMap::create_vsfm(20, 10, 1.0, 0.1);
+    mve::ByteImage::Ptr img = mve::ByteImage::create(10, 20, 1);
+    EXPECT_THROW(map->apply<uint8_t>(img), std::invalid_argument);
+}
+
+TEST(ImageToolsTest, UndistortMapCache)
+{
+    /* The budget holds two tables. */
+    mve::image::UndistortMapCache cache
+        (2 * mve::image::UndistortMap::get_byte_size(64, 48));
+    mve::image::UndistortMap::ConstPtr map1
+        = cache.get_k2k4(64, 48, 1.0, 0.1, 0.0);
+    EXPECT_EQ(64, map1->width());
+    EXPECT_EQ(48, map1->height());
+    EXPECT_EQ(map1, cache.get_k2k4(64, 48, 1.0, 0.1, 0.0));
+    EXPECT_NE(map1, cache.get_k2k4(64, 48, 1.1, 0.1, 0.0));
+    EXPECT_NE(map1, cache.get_vsfm(64, 48, 1.0, 0.1));
+
+    /* The budget is exceeded, the first table has been released. */
+    EXPECT_NE(map1, cache.get_k2k4(64, 48, 1.0, 0.1, 0.0));
+
+    /* A table larger than the budget is still returned. */
+    mve::image::UndistortMap::ConstPtr large
+        = cache.get_k2k4(256, 256, 1.0, 0.1, 0.0);
+    EXPECT_EQ(large, cache.get_k2k4(256, 256, 1.0, 0.1, 0.0));
+}
+
+TEST(ImageToolsTest, UndistortMapMatchesDirect)
+{
+    mve::ByteImage::Ptr img = mve::ByteImage::create(37, 23, 3);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<uint8_t>(i * 37 % 256);
+
+    mve::ByteImage::Ptr map = mve::image::UndistortMap::create_vsfm
+        (37, 23, 1.2, -0.1)->apply<uint8_t>(img);
+    mve::ByteImage::Ptr direct
+        = mve::image::image_undistort_vsfm<uint8_t>(img, 1.2, -0.1);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        EXPECT_NEAR(direct->at(i), map->at(i), 1);
+}
+
 // Test blurring of images, boxfilter, gaussian
 // Test gamma correction with byte and float
 // Test image flipping with all parameters
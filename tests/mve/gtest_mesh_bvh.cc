@@ -0,0 +1,223 @@
+// Test cases for the mesh BVH.
+// Written by Simon Fuhrmann.
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "mve/camera.h"
+#include "mve/depthmap.h"
+#include "mve/mesh.h"
+#include "mve/mesh_bvh.h"
+
+namespace
+{
+    /* Creates a wavy grid of (size x size) quads in the xy-plane. */
+    mve::TriangleMesh::Ptr
+    create_wavy_mesh (int size)
+    {
+        mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+        mve::TriangleMesh::VertexList& verts = mesh->get_vertices();
+        mve::TriangleMesh::FaceList& faces = mesh->get_faces();
+        for (int y = 0; y <= size; ++y)
+            for (int x = 0; x <= size; ++x)
+                verts.push_back(math::Vec3f(x, y,
+                    std::sin(x * 0.5f) * std::cos(y * 0.3f)));
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+            {
+                unsigned int const i = y * (size + 1) + x;
+                unsigned int const j = i + size + 1;
+                faces.push_back(i); faces.push_back(i + 1); faces.push_back(j);
+                faces.push_back(i + 1); faces.push_back(j + 1);
+                faces.push_back(j);
+            }
+        return mesh;
+    }
+
+    float
+    random_float (float min, float max)
+    {
+        return min + (max - min) * static_cast<float>(std::rand()) / RAND_MAX;
+    }
+
+    /* Brute force intersection of the ray with all faces. */
+    float
+    brute_force_intersect (mve::TriangleMesh::ConstPtr mesh,
+        mve::geom::MeshBVH::Ray const& ray)
+    {
+        mve::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+        mve::TriangleMesh::FaceList const& faces = mesh->get_faces();
+        float best = std::numeric_limits<float>::max();
+        for (std::size_t i = 0; i < faces.size(); i += 3)
+        {
+            math::Vec3f const& v0 = verts[faces[i + 0]];
+            math::Vec3f const e1 = verts[faces[i + 1]] - v0;
+            math::Vec3f const e2 = verts[faces[i + 2]] - v0;
+            math::Vec3f const p = ray.dir.cross(e2);
+            float const inv_det = 1.0f / e1.dot(p);
+            math::Vec3f const s = ray.origin - v0;
+            float const u = s.dot(p) * inv_det;
+            math::Vec3f const q = s.cross(e1);
+            float const v = ray.dir.dot(q) * inv_det;
+            float const t = e2.dot(q) * inv_det;
+            if (u >= 0.0f && v >= 0.0f && u + v <= 1.0f && t >= ray.tmin)
+                best = std::min(best, t);
+        }
+        return best;
+    }
+
+    std::vector<mve::geom::MeshBVH::Ray>
+    create_random_rays (std::size_t num)
+    {
+        std::vector<mve::geom::MeshBVH::Ray> rays(num);
+        for (std::size_t i = 0; i < num; ++i)
+        {
+            rays[i].origin = math::Vec3f(random_float(-5.0f, 35.0f),
+                random_float(-5.0f, 35.0f), 5.0f);
+            rays[i].dir = math::Vec3f(random_float(-0.5f, 0.5f),
+                random_float(-0.5f, 0.5f), -1.0f).normalized();
+        }
+        return rays;
+    }
+}
+
+TEST(MeshBVHTest, EmptyMesh)
+{
+    mve::geom::MeshBVH::Ptr bvh
+        = mve::geom::MeshBVH::create(mve::TriangleMesh::create());
+    mve::geom::MeshBVH::Ray ray;
+    ray.dir = math::Vec3f(0.0f, 0.0f, 1.0f);
+    mve::geom::MeshBVH::Hit hit;
+    EXPECT_FALSE(bvh->intersect(ray, &hit));
+    EXPECT_FALSE(bvh->occluded(ray));
+    EXPECT_FALSE(bvh->closest_point(math::Vec3f(0.0f), &hit));
+    EXPECT_EQ(0, bvh->get_num_nodes());
+}
+
+TEST(MeshBVHTest, IntersectBruteForce)
+{
+    std::srand(1);
+    mve::TriangleMesh::Ptr mesh = create_wavy_mesh(30);
+    mve::geom::MeshBVH::Ptr bvh = mve::geom::MeshBVH::create(mesh);
+
+    math::Vec3f aabb_min, aabb_max;
+    bvh->get_aabb(&aabb_min, &aabb_max);
+    EXPECT_NEAR(0.0f, aabb_min[0], 1e-6f);
+    EXPECT_NEAR(30.0f, aabb_max[1], 1e-6f);
+
+    std::vector<mve::geom::MeshBVH::Ray> rays = create_random_rays(500);
+    std::size_t num_hits = 0;
+    for (std::size_t i = 0; i < rays.size(); ++i)
+    {
+        float const expected = brute_force_intersect(mesh, rays[i]);
+        mve::geom::MeshBVH::Hit hit;
+        bool const found = bvh->intersect(rays[i], &hit);
+        EXPECT_EQ(expected != std::numeric_limits<float>::max(), found);
+        EXPECT_EQ(found, bvh->occluded(rays[i]));
+        if (!found)
+            continue;
+        num_hits += 1;
+        EXPECT_NEAR(expected, hit.t, 1e-4f);
+        math::Vec3f const pos = rays[i].origin + rays[i].dir * hit.t;
+        EXPECT_NEAR(0.0f, (bvh->get_position(hit) - pos).norm(), 1e-4f);
+    }
+    EXPECT_GT(num_hits, 250);
+}
+
+TEST(MeshBVHTest, IntersectBatch)
+{
+    std::srand(2);
+    mve::TriangleMesh::Ptr mesh = create_wavy_mesh(30);
+    mve::geom::MeshBVH::Ptr bvh = mve::geom::MeshBVH::create(mesh);
+
+    /* Use a count that is not a multiple of the packet size. */
+    std::vector<mve::geom::MeshBVH::Ray> rays = create_random_rays(501);
+    std::vector<mve::geom::MeshBVH::Hit> hits;
+    bvh->intersect(rays, &hits);
+    ASSERT_EQ(rays.size(), hits.size());
+    for (std::size_t i = 0; i < rays.size(); ++i)
+    {
+        mve::geom::MeshBVH::Hit hit;
+        bvh->intersect(rays[i], &hit);
+        EXPECT_EQ(hit.face_id, hits[i].face_id);
+        EXPECT_NEAR(hit.t, hits[i].t, 1e-4f);
+    }
+}
+
+TEST(MeshBVHTest, RayInterval)
+{
+    mve::TriangleMesh::Ptr mesh = create_wavy_mesh(4);
+    mve::geom::MeshBVH::Ptr bvh = mve::geom::MeshBVH::create(mesh);
+    mve::geom::MeshBVH::Ray ray;
+    ray.origin = math::Vec3f(0.3f, 0.4f, 5.0f);
+    ray.dir = math::Vec3f(0.0f, 0.0f, -1.0f);
+    ray.tmax = 2.0f;
+    mve::geom::MeshBVH::Hit hit;
+    EXPECT_FALSE(bvh->intersect(ray, &hit));
+    EXPECT_FALSE(bvh->occluded(ray));
+    ray.tmax = 10.0f;
+    EXPECT_TRUE(bvh->intersect(ray, &hit));
+    EXPECT_TRUE(bvh->occluded(ray));
+}
+
+TEST(MeshBVHTest, ClosestPoint)
+{
+    std::srand(3);
+    mve::TriangleMesh::Ptr mesh = create_wavy_mesh(20);
+    mve::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+    mve::geom::MeshBVH::Ptr bvh = mve::geom::MeshBVH::create(mesh);
+
+    for (int i = 0; i < 200; ++i)
+    {
+        math::Vec3f const point(random_float(-5.0f, 25.0f),
+            random_float(-5.0f, 25.0f), random_float(-3.0f, 3.0f));
+        mve::geom::MeshBVH::Hit hit;
+        ASSERT_TRUE(bvh->closest_point(point, &hit));
+        math::Vec3f const pos = bvh->get_position(hit);
+        EXPECT_NEAR(hit.t, (pos - point).norm(), 1e-4f);
+
+        /* No vertex may be closer than the closest point. */
+        float min_dist = std::numeric_limits<float>::max();
+        for (std::size_t j = 0; j < verts.size(); ++j)
+            min_dist = std::min(min_dist, (verts[j] - point).norm());
+        EXPECT_LE(hit.t, min_dist + 1e-5f);
+
+        /* The query fails if the distance limit is too small. */
+        EXPECT_FALSE(bvh->closest_point(point, &hit, hit.t * 0.99f));
+    }
+}
+
+TEST(MeshBVHTest, DepthmapFromMesh)
+{
+    /* Large quad at z = 2 in front of the default camera. */
+    mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+    mve::TriangleMesh::VertexList& verts = mesh->get_vertices();
+    verts.push_back(math::Vec3f(-10.0f, -10.0f, 2.0f));
+    verts.push_back(math::Vec3f(10.0f, -10.0f, 2.0f));
+    verts.push_back(math::Vec3f(10.0f, 10.0f, 2.0f));
+    verts.push_back(math::Vec3f(-10.0f, 10.0f, 2.0f));
+    unsigned int const faces[] = { 0, 1, 2, 0, 2, 3 };
+    mesh->get_faces().assign(faces, faces + 6);
+    mve::geom::MeshBVH::Ptr bvh = mve::geom::MeshBVH::create(mesh);
+
+    mve::CameraInfo cam;
+    cam.flen = 1.0f;
+    int const width = 15, height = 10;
+    mve::FloatImage::Ptr dm = mve::geom::depthmap_from_mesh(*bvh, cam,
+        width, height);
+    ASSERT_EQ(width, dm->width());
+    ASSERT_EQ(height, dm->height());
+
+    math::Matrix3f invproj;
+    cam.fill_inverse_calibration(*invproj, width, height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            math::Vec3f const dir = invproj
+                * math::Vec3f(x + 0.5f, y + 0.5f, 1.0f);
+            float const expected = 2.0f * dir.norm() / dir[2];
+            EXPECT_NEAR(expected, dm->at(x, y, 0), 1e-4f);
+        }
+}
@@ -0,0 +1,108 @@
+// Test cases for the mesh decimation.
+// Written by Simon Fuhrmann.
+
+#include <gtest/gtest.h>
+
+#include "mve/mesh.h"
+#include "mve/mesh_info.h"
+#include "mve/mesh_decimate.h"
+
+namespace
+{
+    /* Creates a flat grid of (size x size) quads in the xy-plane. */
+    mve::TriangleMesh::Ptr
+    create_grid_mesh (int size)
+    {
+        mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+        mve::TriangleMesh::VertexList& verts = mesh->get_vertices();
+        mve::TriangleMesh::FaceList& faces = mesh->get_faces();
+        for (int y = 0; y <= size; ++y)
+            for (int x = 0; x <= size; ++x)
+                verts.push_back(math::Vec3f(x, y, 0.0f));
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+            {
+                unsigned int const i = y * (size + 1) + x;
+                unsigned int const j = i + size + 1;
+                faces.push_back(i); faces.push_back(i + 1); faces.push_back(j);
+                faces.push_back(i + 1); faces.push_back(j + 1);
+                faces.push_back(j);
+            }
+        mesh->get_vertex_values().resize(verts.size(), 1.0f);
+        return mesh;
+    }
+}
+
+TEST(MeshDecimateTest, FlatGrid)
+{
+    mve::TriangleMesh::Ptr mesh = create_grid_mesh(20);
+    mve::geom::MeshDecimateOptions options;
+    options.target_faces = 100;
+    std::size_t num_collapses = mve::geom::mesh_decimate(mesh, options);
+    EXPECT_GT(num_collapses, 0);
+
+    mve::TriangleMesh::VertexList const& verts = mesh->get_vertices();
+    mve::TriangleMesh::FaceList const& faces = mesh->get_faces();
+    EXPECT_LE(faces.size() / 3, 100);
+    EXPECT_LT(100 - 2, faces.size() / 3);
+    EXPECT_EQ(441 - verts.size(), num_collapses);
+    ASSERT_EQ(verts.size(), mesh->get_vertex_values().size());
+
+    /* The grid stays flat, no face is flipped and the corners are kept. */
+    math::Vec3f min(verts[0]), max(verts[0]);
+    for (std::size_t i = 0; i < verts.size(); ++i)
+    {
+        EXPECT_NEAR(0.0f, verts[i][2], 1e-5f);
+        EXPECT_FLOAT_EQ(1.0f, mesh->get_vertex_values()[i]);
+        for (int j = 0; j < 3; ++j)
+        {
+            min[j] = std::min(min[j], verts[i][j]);
+            max[j] = std::max(max[j], verts[i][j]);
+        }
+    }
+    EXPECT_NEAR(0.0f, min[0], 1e-4f);
+    EXPECT_NEAR(0.0f, min[1], 1e-4f);
+    EXPECT_NEAR(20.0f, max[0], 1e-4f);
+    EXPECT_NEAR(20.0f, max[1], 1e-4f);
+
+    for (std::size_t i = 0; i < faces.size(); i += 3)
+    {
+        math::Vec3f const normal = (verts[faces[i + 1]] - verts[faces[i]])
+            .cross(verts[faces[i + 2]] - verts[faces[i]]);
+        EXPECT_GT(normal[2], 0.0f);
+    }
+
+    /* The result is a manifold mesh without unreferenced vertices. */
+    mve::CompactMeshInfo mesh_info(mesh);
+    for (std::size_t i = 0; i < mesh_info.size(); ++i)
+    {
+        EXPECT_NE(mve::MeshInfo::VERTEX_CLASS_COMPLEX, mesh_info[i].vclass);
+        EXPECT_NE(mve::MeshInfo::VERTEX_CLASS_UNREF, mesh_info[i].vclass);
+    }
+}
+
+TEST(MeshDecimateTest, MaxError)
+{
+    /* Bend the grid along the diagonal: Only flat parts can be decimated. */
+    mve::TriangleMesh::Ptr mesh = create_grid_mesh(10);
+    mve::TriangleMesh::VertexList& verts = mesh->get_vertices();
+    for (std::size_t i = 0; i < verts.size(); ++i)
+        verts[i][2] = std::abs(verts[i][0] - verts[i][1]);
+
+    mve::geom::MeshDecimateOptions options;
+    options.max_error = 1e-6;
+    mve::geom::mesh_decimate(mesh, options);
+    EXPECT_LT(mesh->get_faces().size() / 3, 200);
+    for (std::size_t i = 0; i < verts.size(); ++i)
+        EXPECT_NEAR(std::abs(verts[i][0] - verts[i][1]), verts[i][2], 1e-4f);
+}
+
+TEST(MeshDecimateTest, TargetReached)
+{
+    mve::TriangleMesh::Ptr mesh = create_grid_mesh(4);
+    mve::geom::MeshDecimateOptions options;
+    options.target_faces = 32;
+    EXPECT_EQ(0, mve::geom::mesh_decimate(mesh, options));
+    EXPECT_EQ(32, mesh->get_faces().size() / 3);
+    EXPECT_EQ(25, mesh->get_vertices().size());
+}
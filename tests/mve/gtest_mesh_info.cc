@@ -90,3 +90,32 @@ TEST(MeshInfoTest, ClassificationTest)
     EXPECT_EQ(0, mesh_info[10].faces.size());
     EXPECT_EQ(0, mesh_info[10].verts.size());
 }
+
+TEST(MeshInfoTest, CompactMeshInfoTest)
+{
+    mve::TriangleMesh::Ptr mesh = create_test_mesh();
+    mve::MeshInfo mesh_info(mesh);
+    mve::CompactMeshInfo compact_info(mesh);
+
+    ASSERT_EQ(mesh_info.size(), compact_info.size());
+    for (std::size_t i = 0; i < mesh_info.size(); ++i)
+    {
+        mve::MeshInfo::VertexInfo const& vinfo = mesh_info[i];
+        mve::CompactMeshInfo::VertexInfo const cinfo = compact_info[i];
+        EXPECT_EQ(vinfo.vclass, cinfo.vclass);
+        ASSERT_EQ(vinfo.faces.size(), cinfo.faces.size());
+        for (std::size_t j = 0; j < vinfo.faces.size(); ++j)
+            EXPECT_EQ(vinfo.faces[j], cinfo.faces[j]);
+        ASSERT_EQ(vinfo.verts.size(), cinfo.verts.size());
+        for (std::size_t j = 0; j < vinfo.verts.size(); ++j)
+            EXPECT_EQ(vinfo.verts[j], cinfo.verts[j]);
+    }
+
+    EXPECT_TRUE(compact_info.is_mesh_edge(6, 7));
+    EXPECT_FALSE(compact_info.is_mesh_edge(0, 7));
+    std::vector<std::size_t> faces;
+    compact_info.get_faces_for_edge(6, 7, &faces);
+    ASSERT_EQ(2, faces.size());
+    EXPECT_EQ(1, faces[0]);
+    EXPECT_EQ(5, faces[1]);
+}
@@ -1,12 +1,18 @@
 // Test cases for the MVE mesh file reader/writer.
 // Written by Nils Moehrle.
 
+#include <fstream>
 #include <gtest/gtest.h>
 
+#include "util/exception.h"
 #include "util/file_system.h"
+#include "util/string.h"
 #include "mve/mesh_io_obj.h"
 #include "mve/mesh_io_ply.h"
 #include "mve/mesh_io_off.h"
+#include "mve/mesh_io_npts.h"
+#include "mve/mesh_io_mvem.h"
+#include "mve/point_set_writer.h"
 
 struct TempFile : public std::string
 {
@@ -96,6 +102,77 @@ TEST(MeshFileTest, OBJSaveLoad)
     EXPECT_TRUE(compare_mesh(mesh1, mesh2));
 }
 
+TEST(MeshFileTest, OBJLoadFaceFormats)
+{
+    TempFile filename("objtest2");
+    util::fs::write_string_to_file("# Comment\n"
+        "v 0 0 0\nv 1 0 0\nv 0 1 0 2\n"
+        "vt 0.25 0.5\nvt 1 1 2\n"
+        "vn 0 0 1\n"
+        "f 1/1/1 2/2/1 3/1/1\n"
+        "f 1//1 2//1 3//1\r\n"
+        "  f 1/2 2/1 3/2\n"
+        "f 1/1/1 2/2/1 3/1/1", filename);
+
+    /* The face without normals makes the normals inconsistent. */
+    std::vector<mve::geom::ObjModelPart> parts;
+    EXPECT_THROW(mve::geom::load_obj_mesh(filename, &parts),
+        util::Exception);
+
+    util::fs::write_string_to_file("v 0 0 0\nv 1 0 0\nv 0 1 0 2\n"
+        "vt 0.25 0.5\nvt 1 1 2\nvn 0 0 1\n"
+        "f 1/1/1 2/2/1 3/1/1\nf 3/1/1 2/2/1 1/1/1", filename);
+    mve::geom::load_obj_mesh(filename, &parts);
+    ASSERT_EQ(1, parts.size());
+    mve::TriangleMesh::ConstPtr mesh = parts[0].mesh;
+    ASSERT_EQ(3, mesh->get_vertices().size());
+    EXPECT_EQ(math::Vec3f(0.0f, 0.5f, 0.0f), mesh->get_vertices()[2]);
+    ASSERT_EQ(3, mesh->get_vertex_texcoords().size());
+    EXPECT_EQ(math::Vec2f(0.25f, 0.5f), mesh->get_vertex_texcoords()[0]);
+    EXPECT_EQ(math::Vec2f(0.5f, 0.5f), mesh->get_vertex_texcoords()[1]);
+    ASSERT_EQ(3, mesh->get_vertex_normals().size());
+    ASSERT_EQ(6, mesh->get_faces().size());
+    EXPECT_EQ(2, mesh->get_faces()[3]);
+    EXPECT_EQ(0, mesh->get_faces()[5]);
+}
+
+TEST(MeshFileTest, OBJLoadParts)
+{
+    /* Many lines to parse the file in multiple chunks. */
+    TempFile filename("objtest3");
+    std::string data;
+    for (int i = 0; i < 10000; ++i)
+        data += "v " + util::string::get(0.001f * i) + " 1.5e-3 -7\n";
+    data += "usemtl first\n";
+    for (int i = 0; i < 5000; ++i)
+        data += "f " + util::string::get(i + 1) + "//" + " "
+            + util::string::get(i + 2) + " " + util::string::get(i + 3) + "\n";
+    data += "usemtl second\nf 10000 1 2\n";
+    util::fs::write_string_to_file(data, filename);
+
+    std::vector<mve::geom::ObjModelPart> parts;
+    mve::geom::load_obj_mesh(filename, &parts);
+    ASSERT_EQ(2, parts.size());
+    EXPECT_EQ(5002, parts[0].mesh->get_vertices().size());
+    EXPECT_EQ(15000, parts[0].mesh->get_faces().size());
+    EXPECT_EQ(3, parts[1].mesh->get_vertices().size());
+    for (int i = 0; i < 5002; ++i)
+    {
+        math::Vec3f const& v = parts[0].mesh->get_vertices()[i];
+        EXPECT_EQ(util::string::convert<float>(
+            util::string::get(0.001f * i)), v[0]);
+        EXPECT_EQ(1.5e-3f, v[1]);
+        EXPECT_EQ(-7.0f, v[2]);
+    }
+    EXPECT_EQ(parts[0].mesh->get_vertices()[0],
+        parts[1].mesh->get_vertices()[1]);
+
+    /* Indices must refer to previously defined vertices. */
+    util::fs::write_string_to_file(data + "f 1 2 10001\n", filename);
+    EXPECT_THROW(mve::geom::load_obj_mesh(filename, &parts),
+        util::Exception);
+}
+
 TEST(MeshFileTest, PLYSaveLoad)
 {
     TempFile filename("plytest1");
@@ -117,6 +194,70 @@ TEST(MeshFileTest, PLYSaveLoad)
     EXPECT_TRUE(compare_mesh(mesh1, mesh2));
 }
 
+TEST(MeshFileTest, PLYSaveLoadLarge)
+{
+    /* Enough vertices and faces for multiple blocks of binary records. */
+    TempFile filename("plytest2");
+    mve::TriangleMesh::Ptr mesh1 = mve::TriangleMesh::create(), mesh2;
+    for (std::size_t i = 0; i < 100000; ++i)
+    {
+        float const f = static_cast<float>(i);
+        mesh1->get_vertices().push_back(math::Vec3f(f, 2.0f * f, -f));
+        mesh1->get_vertex_normals().push_back(math::Vec3f(0.0f, 1.0f, 0.0f));
+        mesh1->get_vertex_colors().push_back(math::Vec4f(
+            0.0f, 1.0f, (i % 2) ? 1.0f : 0.0f, 1.0f));
+        mesh1->get_vertex_confidences().push_back(0.5f * f);
+        mesh1->get_vertex_values().push_back(0.25f * f);
+        if (i + 2 < 100000)
+        {
+            mesh1->get_faces().push_back(i);
+            mesh1->get_faces().push_back(i + 1);
+            mesh1->get_faces().push_back(i + 2);
+        }
+    }
+
+    mve::geom::SavePLYOptions options;
+    options.write_vertex_normals = true;
+    mve::geom::save_ply_mesh(mesh1, filename, options);
+    mesh2 = mve::geom::load_ply_mesh(filename);
+    EXPECT_TRUE(compare_mesh(mesh1, mesh2));
+}
+
+TEST(MeshFileTest, PLYLoadBigEndian)
+{
+    TempFile filename("plytest3");
+    std::string data = "ply\nformat binary_big_endian 1.0\n"
+        "element vertex 2\nproperty double x\nproperty float y\n"
+        "property float z\nproperty uchar red\nproperty int flags\n"
+        "element face 1\nproperty list uchar int vertex_indices\n"
+        "end_header\n";
+    char const vertices[] = {
+        0x3f, static_cast<char>(0xf0), 0, 0, 0, 0, 0, 0, /* 1.0 */
+        0x40, 0, 0, 0, /* 2.0f */
+        0x40, 0x40, 0, 0, /* 3.0f */
+        static_cast<char>(0xff), 0, 0, 0, 1,
+        0x40, 0, 0, 0, 0, 0, 0, 0, /* 2.0 */
+        0x40, static_cast<char>(0x80), 0, 0, /* 4.0f */
+        0x40, static_cast<char>(0xa0), 0, 0, /* 5.0f */
+        0, 0, 0, 0, 2 };
+    char const faces[] = { 3, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1 };
+    data.append(vertices, sizeof(vertices));
+    data.append(faces, sizeof(faces));
+    util::fs::write_string_to_file(data, filename);
+
+    mve::TriangleMesh::Ptr mesh = mve::geom::load_ply_mesh(filename);
+    ASSERT_EQ(2, mesh->get_vertices().size());
+    EXPECT_EQ(math::Vec3f(1.0f, 2.0f, 3.0f), mesh->get_vertices()[0]);
+    EXPECT_EQ(math::Vec3f(2.0f, 4.0f, 5.0f), mesh->get_vertices()[1]);
+    ASSERT_EQ(2, mesh->get_vertex_colors().size());
+    EXPECT_EQ(1.0f, mesh->get_vertex_colors()[0][0]);
+    EXPECT_EQ(0.0f, mesh->get_vertex_colors()[1][0]);
+    ASSERT_EQ(3, mesh->get_faces().size());
+    EXPECT_EQ(1, mesh->get_faces()[0]);
+    EXPECT_EQ(0, mesh->get_faces()[1]);
+    EXPECT_EQ(1, mesh->get_faces()[2]);
+}
+
 TEST(MeshFileTest, OFFSaveLoad)
 {
     TempFile filename("offtest1");
@@ -135,3 +276,120 @@ TEST(MeshFileTest, OFFSaveLoad)
 
     EXPECT_TRUE(compare_mesh(mesh1, mesh2));
 }
+
+TEST(MeshFileTest, MVEMSaveLoad)
+{
+    TempFile filename("mvemtest1.mvem");
+    mve::TriangleMesh::Ptr mesh1 = create_test_mesh(true);
+    mesh1->get_vertex_colors().resize(3, math::Vec4f(0.5f));
+    mesh1->get_vertex_confidences().resize(3, 1.0f);
+    mesh1->get_vertex_texcoords().resize(3, math::Vec2f(0.25f));
+    mesh1->get_face_colors().push_back(math::Vec4f(1.0f));
+
+    mve::geom::save_mvem_mesh(mesh1, filename);
+    mve::TriangleMesh::Ptr mesh2 = mve::geom::load_mvem_mesh(filename);
+    EXPECT_TRUE(compare_mesh(mesh1, mesh2));
+}
+
+TEST(MeshFileTest, MVEMMappedAccess)
+{
+    TempFile filename("mvemtest2.mvem");
+    mve::TriangleMesh::Ptr mesh = create_test_mesh();
+    mve::geom::save_mvem_mesh(mesh, filename);
+
+    mve::geom::MappedMesh::Ptr mapped
+        = mve::geom::MappedMesh::create(filename);
+    EXPECT_EQ(3, mapped->get_vertices().size());
+    EXPECT_EQ(3, mapped->get_faces().size());
+    EXPECT_TRUE(mapped->get_vertex_normals().empty());
+    EXPECT_TRUE(mapped->get_face_colors().empty());
+    EXPECT_EQ(0, reinterpret_cast<std::size_t>(
+        mapped->get_vertices().begin()) % 64);
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(mesh->get_vertices()[i], mapped->get_vertices()[i]);
+        EXPECT_EQ(mesh->get_faces()[i], mapped->get_faces()[i]);
+    }
+}
+
+TEST(MeshFileTest, MVEMLoadInvalid)
+{
+    TempFile filename("mvemtest3.mvem");
+    {
+        std::ofstream out(filename.c_str(), std::ios::binary);
+        out << "This is not a mesh file, but long enough for the header. "
+            << std::string(200, 'x');
+    }
+    EXPECT_THROW(mve::geom::MappedMesh::create(filename), util::Exception);
+    EXPECT_THROW(mve::geom::load_mvem_mesh("/no/such/file.mvem"),
+        util::Exception);
+}
+
+TEST(MeshFileTest, PointSetWriterPLY)
+{
+    TempFile filename("psettest1.ply");
+    mve::TriangleMesh::Ptr mesh1 = create_test_mesh(true);
+    mesh1->get_faces().clear();
+    mesh1->get_vertex_colors().resize(3, math::Vec4f(1.0f, 0.0f, 1.0f, 1.0f));
+    mesh1->get_vertex_confidences().resize(3, 0.5f);
+    mesh1->get_vertex_values().resize(3, 2.0f);
+
+    /* The second batch has no colors, which are written as black. */
+    mve::TriangleMesh::Ptr mesh2 = create_test_mesh(true);
+    mesh2->get_faces().clear();
+    mesh2->get_vertex_confidences().resize(3, 0.5f);
+    mesh2->get_vertex_values().resize(3, 2.0f);
+
+    mve::geom::PointSetWriter::Options options;
+    options.write_normals = true;
+    options.write_confidences = true;
+    options.write_values = true;
+    mve::geom::PointSetWriter writer(filename, options);
+    writer.write(mesh1);
+    writer.write(mesh2);
+    EXPECT_EQ(6, writer.get_num_points());
+    writer.close();
+
+    mve::TriangleMesh::Ptr mesh3 = mve::geom::load_ply_mesh(filename);
+    ASSERT_EQ(6, mesh3->get_vertices().size());
+    ASSERT_EQ(6, mesh3->get_vertex_colors().size());
+    for (std::size_t i = 0; i < 6; ++i)
+    {
+        EXPECT_EQ(mesh1->get_vertices()[i % 3], mesh3->get_vertices()[i]);
+        EXPECT_EQ(mesh1->get_vertex_normals()[i % 3],
+            mesh3->get_vertex_normals()[i]);
+        EXPECT_EQ(0.5f, mesh3->get_vertex_confidences()[i]);
+        EXPECT_EQ(2.0f, mesh3->get_vertex_values()[i]);
+        EXPECT_EQ(i < 3 ? 1.0f : 0.0f, mesh3->get_vertex_colors()[i][0]);
+    }
+}
+
+TEST(MeshFileTest, PointSetWriterEmptyPLY)
+{
+    TempFile filename("psettest2.ply");
+    {
+        mve::geom::PointSetWriter writer(filename,
+            mve::geom::PointSetWriter::Options());
+    }
+    mve::TriangleMesh::Ptr mesh = mve::geom::load_ply_mesh(filename);
+    EXPECT_TRUE(mesh->get_vertices().empty());
+}
+
+TEST(MeshFileTest, PointSetWriterNPTS)
+{
+    TempFile filename("psettest3.bnpts");
+    mve::TriangleMesh::Ptr mesh1 = create_test_mesh(true), mesh2;
+    mesh1->get_faces().clear();
+
+    mve::geom::PointSetWriter writer(filename,
+        mve::geom::PointSetWriter::Options());
+    writer.write(mesh1);
+    writer.close();
+
+    mesh2 = mve::geom::load_npts_mesh(filename, true);
+    EXPECT_TRUE(compare_mesh(mesh1, mesh2));
+
+    EXPECT_THROW(writer.write(mesh1), std::logic_error);
+    EXPECT_THROW(writer.write(create_test_mesh(false)),
+        std::invalid_argument);
+}
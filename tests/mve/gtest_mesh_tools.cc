@@ -33,6 +33,41 @@ TEST(MeshToolsTest, Components)
     EXPECT_EQ(0, tmp->get_vertices().size());
 }
 
+TEST(MeshToolsTest, ComponentsLabel)
+{
+    mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
+    mve::TriangleMesh::VertexList& verts = mesh->get_vertices();
+    mve::TriangleMesh::FaceList& faces = mesh->get_faces();
+    verts.insert(verts.end(), 8, math::Vec3f(0.0f));
+    /* Two faces sharing an edge, one isolated vertex, one separate face. */
+    faces.push_back(6); faces.push_back(2); faces.push_back(7);
+    faces.push_back(0); faces.push_back(6); faces.push_back(2);
+    faces.push_back(5); faces.push_back(3); faces.push_back(4);
+
+    std::vector<std::size_t> labels;
+    std::vector<mve::geom::MeshComponentInfo> components;
+    std::size_t num = mve::geom::mesh_components_label(mesh,
+        &labels, &components);
+    EXPECT_EQ(3, num);
+    ASSERT_EQ(8, labels.size());
+    EXPECT_EQ(0, labels[0]);
+    EXPECT_EQ(1, labels[1]);
+    EXPECT_EQ(0, labels[2]);
+    EXPECT_EQ(2, labels[3]);
+    EXPECT_EQ(2, labels[4]);
+    EXPECT_EQ(2, labels[5]);
+    EXPECT_EQ(0, labels[6]);
+    EXPECT_EQ(0, labels[7]);
+
+    ASSERT_EQ(3, components.size());
+    EXPECT_EQ(4, components[0].num_vertices);
+    EXPECT_EQ(2, components[0].num_faces);
+    EXPECT_EQ(1, components[1].num_vertices);
+    EXPECT_EQ(0, components[1].num_faces);
+    EXPECT_EQ(3, components[2].num_vertices);
+    EXPECT_EQ(1, components[2].num_faces);
+}
+
 TEST(MeshToolsTest, DeleteUnreferenced)
 {
     mve::TriangleMesh::Ptr mesh = mve::TriangleMesh::create();
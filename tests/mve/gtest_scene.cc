@@ -1,9 +1,16 @@
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <cstdio>
+#include <fstream>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <thread>
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <sys/stat.h>
+#endif
 
 #include "mve/bundle_io.h"
 #include "mve/scene.h"
@@ -208,6 +215,125 @@ TEST(SceneTest, LoadingFromADirectoryWithNoBundleFileMakesGetBundleThrow)
     EXPECT_THROW(scene->get_bundle(), util::Exception);
 }
 
+//== Loading a scene with the scene index =====================================
+
+TEST(SceneTest, LoadingWithTheIndexMatchesLoadingWithout)
+{
+    OnScopeExit clean_up;
+
+    std::string path = create_scene_on_disk(7, make_bundle(0), &clean_up);
+    std::string index_file = util::fs::join_path(path, "views.index");
+    for (mve::View::Ptr const& view : load_views_from(path))
+    {
+        view->set_image(mve::ByteImage::create(4, 3, 1), "image");
+        view->save_view();
+    }
+    mve::Scene::Ptr scene = mve::Scene::create(path);
+    EXPECT_FALSE(util::fs::file_exists(index_file.c_str()));
+
+    /* The first load writes the index, the second load reads it.
+     * Recently modified views are not indexed. */
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    for (int i = 0; i < 2; ++i)
+    {
+        scene = mve::Scene::create(path, true);
+        EXPECT_TRUE(util::fs::file_exists(index_file.c_str()));
+        EXPECT_TRUE(views_match(load_views_from(path), scene->get_views()));
+        EXPECT_FALSE(scene->is_dirty());
+        for (mve::View::Ptr const& view : scene->get_views())
+        {
+            EXPECT_EQ(1u, view->get_images().size());
+            EXPECT_TRUE(view->get_byte_image("image") != nullptr);
+            EXPECT_FALSE(view->get_directory().empty());
+        }
+    }
+}
+
+TEST(SceneTest, LoadingWithTheIndexDetectsChangedViews)
+{
+    OnScopeExit clean_up;
+
+    std::string path = create_scene_on_disk(5, make_bundle(0), &clean_up);
+    mve::Scene::Ptr scene = mve::Scene::create(path, true);
+
+    /* Change a view on disk after the index has been written. */
+    mve::View::Ptr view = scene->get_view_by_id(3);
+    view->set_name("changed");
+    view->set_image(mve::FloatImage::create(2, 2, 1), "depthmap");
+    view->save_view();
+
+    scene = mve::Scene::create(path, true);
+    EXPECT_EQ("changed", scene->get_view_by_id(3)->get_name());
+    EXPECT_TRUE(scene->get_view_by_id(3)->has_image("depthmap"));
+    EXPECT_FALSE(scene->get_view_by_id(2)->has_image("depthmap"));
+    EXPECT_TRUE(views_match(load_views_from(path), scene->get_views()));
+}
+
+#ifndef _WIN32
+TEST(SceneTest, LoadingWithTheIndexDetectsChangedMetaDataSize)
+{
+    OnScopeExit clean_up;
+
+    std::string path = create_scene_on_disk(3, make_bundle(0), &clean_up);
+
+    /* Recently modified views are not indexed. */
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    mve::Scene::Ptr scene = mve::Scene::create(path, true);
+
+    /* Change meta.ini in place and keep its modification time. */
+    std::string const meta_file = util::fs::join_path(
+        scene->get_view_by_id(1)->get_directory(), "meta.ini");
+    struct stat statbuf;
+    ASSERT_EQ(0, ::stat(meta_file.c_str(), &statbuf));
+    {
+        std::ofstream out(meta_file.c_str(), std::ios::app);
+        out << "\n[test]\nkey = value\n";
+    }
+    struct timespec times[2] = { statbuf.st_atim, statbuf.st_mtim };
+    ASSERT_EQ(0, ::utimensat(AT_FDCWD, meta_file.c_str(), times, 0));
+
+    scene = mve::Scene::create(path, true);
+    EXPECT_EQ("value", scene->get_view_by_id(1)->get_value("test.key"));
+    EXPECT_EQ("view1", scene->get_view_by_id(1)->get_name());
+}
+#endif
+
+//== Loading a packed scene ===================================================
+
+TEST(SceneTest, LoadingAPackedSceneMatchesLoadingTheViewsDirectory)
+{
+    OnScopeExit clean_up;
+
+    std::string path = create_scene_on_disk(6, make_bundle(0), &clean_up);
+    mve::Scene::ViewList views_on_disk = load_views_from(path);
+    {
+        mve::SceneArchive::Ptr archive = mve::SceneArchive::open(
+            util::fs::join_path(path, "views.pack"));
+        for (mve::View::Ptr const& view : views_on_disk)
+        {
+            view->set_image(mve::ByteImage::create(4, 3, 1), "image");
+            view->save_view_as(archive,
+                util::fs::basename(view->get_directory()));
+        }
+    }
+
+    /* Views are loaded from and saved to the archive. */
+    mve::Scene::Ptr scene = mve::Scene::create(path);
+    EXPECT_TRUE(views_match(views_on_disk, scene->get_views()));
+    mve::View::Ptr view = scene->get_view_by_id(4);
+    ASSERT_TRUE(view->get_archive() != nullptr);
+    EXPECT_TRUE(view->get_byte_image("image") != nullptr);
+    view->set_name("changed");
+    view->set_image(mve::FloatImage::create(2, 2, 1), "depthmap");
+    scene->save_views();
+
+    scene = mve::Scene::create(path);
+    EXPECT_EQ("changed", scene->get_view_by_id(4)->get_name());
+    EXPECT_TRUE(scene->get_view_by_id(4)->has_image("depthmap",
+        mve::IMAGE_TYPE_FLOAT));
+    EXPECT_FALSE(scene->get_view_by_id(3)->has_image("depthmap"));
+}
+
 //== Test saving onto disk =====================================================
 
 TEST(SceneTest, WhenSaveIsCalledOnASceneTheSceneOnDiskUpdatesAccordingly)
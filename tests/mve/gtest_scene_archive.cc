@@ -0,0 +1,283 @@
+// Test cases for the scene archive.
+// Written by Simon Fuhrmann.
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include "util/exception.h"
+#include "util/file_system.h"
+#include "mve/image.h"
+#include "mve/scene_archive.h"
+#include "mve/view.h"
+
+namespace
+{
+    /* Temporary archive file name, removed on destruction. */
+    struct TempArchive
+    {
+        std::string filename;
+
+        TempArchive (void)
+            : filename(std::string(std::tmpnam(nullptr)) + ".pack")
+        {
+        }
+
+        ~TempArchive (void)
+        {
+            util::fs::unlink(this->filename.c_str());
+        }
+    };
+
+    std::string
+    read_archive_file (mve::SceneArchive::Ptr archive,
+        std::string const& path)
+    {
+        std::string data;
+        archive->read_file(path, &data);
+        return data;
+    }
+}
+
+TEST(SceneArchiveTest, WriteReadAndReopen)
+{
+    TempArchive temp;
+    std::string const large(100000, 'x');
+    {
+        mve::SceneArchive::Ptr archive
+            = mve::SceneArchive::open(temp.filename);
+        EXPECT_TRUE(archive->get_directories().empty());
+        archive->write_file("view_0001.mve/meta.ini", "meta1");
+        archive->write_file("view_0000.mve/meta.ini", "meta0");
+        archive->write_file("view_0000.mve/image.png", large);
+        archive->write_file("view_0000.mve/empty.blob", "");
+        archive->write_file("top-level", "file");
+        EXPECT_EQ("meta0", read_archive_file(archive,
+            "view_0000.mve/meta.ini"));
+    }
+
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+    std::vector<std::string> dirs = archive->get_directories();
+    ASSERT_EQ(2u, dirs.size());
+    EXPECT_EQ("view_0000.mve", dirs[0]);
+    EXPECT_EQ("view_0001.mve", dirs[1]);
+
+    std::vector<std::string> files = archive->get_files("view_0000.mve");
+    ASSERT_EQ(3u, files.size());
+    EXPECT_EQ("empty.blob", files[0]);
+    EXPECT_EQ("image.png", files[1]);
+    EXPECT_EQ("meta.ini", files[2]);
+
+    EXPECT_EQ(large, read_archive_file(archive, "view_0000.mve/image.png"));
+    EXPECT_EQ("", read_archive_file(archive, "view_0000.mve/empty.blob"));
+    EXPECT_EQ("meta1", read_archive_file(archive, "view_0001.mve/meta.ini"));
+    EXPECT_EQ("file", read_archive_file(archive, "top-level"));
+    EXPECT_FALSE(archive->has_file("view_0001.mve/image.png"));
+    EXPECT_THROW(read_archive_file(archive, "missing"), util::FileException);
+}
+
+TEST(SceneArchiveTest, ReplaceAndRemoveFiles)
+{
+    TempArchive temp;
+    {
+        mve::SceneArchive::Ptr archive
+            = mve::SceneArchive::open(temp.filename);
+        archive->write_file("view.mve/a", "first");
+        archive->write_file("view.mve/b", "second");
+        archive->flush();
+        archive->write_file("view.mve/a", "replaced");
+        archive->remove_file("view.mve/b");
+        archive->remove_file("view.mve/missing");
+        EXPECT_EQ("replaced", read_archive_file(archive, "view.mve/a"));
+        EXPECT_FALSE(archive->has_file("view.mve/b"));
+    }
+
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+    EXPECT_EQ("replaced", read_archive_file(archive, "view.mve/a"));
+    EXPECT_FALSE(archive->has_file("view.mve/b"));
+    EXPECT_EQ(1u, archive->get_files("view.mve").size());
+}
+
+TEST(SceneArchiveTest, RecoverFromIncompleteFile)
+{
+    TempArchive temp;
+    {
+        mve::SceneArchive::Ptr archive
+            = mve::SceneArchive::open(temp.filename);
+        archive->write_file("view.mve/a", std::string(1000, 'a'));
+        archive->flush();
+        archive->write_file("view.mve/b", std::string(1000, 'b'));
+    }
+
+    /* Cut off the index and the trailer, and half of file "b". */
+    std::string data;
+    util::fs::read_file_to_string(temp.filename, &data);
+    data.resize(data.size() - 1500);
+    util::fs::write_string_to_file(data, temp.filename);
+    {
+        mve::SceneArchive::Ptr archive
+            = mve::SceneArchive::open(temp.filename);
+        EXPECT_EQ(std::string(1000, 'a'),
+            read_archive_file(archive, "view.mve/a"));
+        EXPECT_FALSE(archive->has_file("view.mve/b"));
+        archive->write_file("view.mve/c", "c");
+    }
+
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+    EXPECT_EQ(std::string(1000, 'a'), read_archive_file(archive, "view.mve/a"));
+    EXPECT_EQ("c", read_archive_file(archive, "view.mve/c"));
+    EXPECT_EQ(2u, archive->get_files("view.mve").size());
+}
+
+TEST(SceneArchiveTest, InvalidSignature)
+{
+    TempArchive temp;
+    util::fs::write_string_to_file(std::string(100, 'x'), temp.filename);
+    EXPECT_THROW(mve::SceneArchive::open(temp.filename), util::FileException);
+}
+
+TEST(SceneArchiveTest, SaveAndLoadView)
+{
+    TempArchive temp;
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+
+    mve::ByteImage::Ptr image = mve::ByteImage::create(8, 6, 3);
+    mve::FloatImage::Ptr depth = mve::FloatImage::create(8, 6, 1);
+    mve::ByteImage::Ptr blob = mve::ByteImage::create(5, 1, 1);
+    for (int i = 0; i < image->get_value_amount(); ++i)
+        image->at(i) = static_cast<uint8_t>(i);
+    for (int i = 0; i < depth->get_value_amount(); ++i)
+        depth->at(i) = static_cast<float>(i) / 3.0f;
+    blob->fill(7);
+
+    mve::View::Ptr view = mve::View::create();
+    view->set_id(3);
+    view->set_name("packed");
+    view->set_image(image, "image");
+    view->set_image(depth, "depthmap");
+    view->set_blob(blob, "data");
+    view->save_view_as(archive, "view_0003.mve");
+    EXPECT_FALSE(view->is_dirty());
+    EXPECT_TRUE(archive->has_file("view_0003.mve/image.png"));
+    EXPECT_TRUE(archive->has_file("view_0003.mve/depthmap.mvei"));
+
+    view = mve::View::create();
+    view->load_view(archive, "view_0003.mve");
+    EXPECT_EQ(3, view->get_id());
+    EXPECT_EQ("packed", view->get_name());
+    EXPECT_EQ("view_0003.mve", view->get_directory());
+
+    mve::View::ImageProxy const* proxy = view->get_image_proxy("depthmap");
+    ASSERT_TRUE(proxy != nullptr);
+    EXPECT_EQ(8, proxy->width);
+    EXPECT_EQ(mve::IMAGE_TYPE_FLOAT, proxy->type);
+    mve::ByteImage::Ptr image2 = view->get_byte_image("image");
+    mve::FloatImage::Ptr depth2 = view->get_float_image("depthmap");
+    ASSERT_TRUE(image2 != nullptr && depth2 != nullptr);
+    EXPECT_TRUE(std::equal(image->begin(), image->end(), image2->begin()));
+    EXPECT_TRUE(std::equal(depth->begin(), depth->end(), depth2->begin()));
+    EXPECT_EQ(5u, view->get_blob_proxy("data")->size);
+    EXPECT_EQ(7, view->get_blob("data")->at(4));
+
+    view->cache_cleanup();
+    mve::ByteImage::Ptr region = std::dynamic_pointer_cast<mve::ByteImage>(
+        view->get_image_region("image", 2, 1, 3, 2));
+    ASSERT_TRUE(region != nullptr);
+    EXPECT_EQ(3, region->width());
+    EXPECT_EQ(image->at(2, 1, 0), region->at(0, 0, 0));
+    EXPECT_EQ(image->at(4, 2, 2), region->at(2, 1, 2));
+
+    /* Removing an embedding removes the file from the archive. */
+    view->remove_image("depthmap");
+    view->save_view();
+    EXPECT_FALSE(archive->has_file("view_0003.mve/depthmap.mvei"));
+    view->reload_view();
+    EXPECT_FALSE(view->has_image("depthmap"));
+    EXPECT_TRUE(view->has_image("image"));
+}
+
+TEST(SceneArchiveTest, StagedFilesAreVisibleAfterCommit)
+{
+    TempArchive temp;
+    {
+        mve::SceneArchive::Ptr archive
+            = mve::SceneArchive::open(temp.filename);
+        archive->write_file("view.mve/a", "first");
+        archive->flush();
+
+        mve::SceneArchive::StagedFiles staged;
+        staged.push_back(archive->stage_file("view.mve/a", "replaced"));
+        staged.push_back(archive->stage_file("view.mve/b", "second"));
+        EXPECT_EQ("first", read_archive_file(archive, "view.mve/a"));
+        EXPECT_FALSE(archive->has_file("view.mve/b"));
+        archive->commit_files(staged);
+        EXPECT_EQ("replaced", read_archive_file(archive, "view.mve/a"));
+        EXPECT_EQ("second", read_archive_file(archive, "view.mve/b"));
+
+        /* Never committed, the data is unused space. */
+        archive->stage_file("view.mve/c", "discarded");
+    }
+
+    /* Cut off the index and the trailer, the log is scanned. */
+    std::string data;
+    util::fs::read_file_to_string(temp.filename, &data);
+    data.resize(data.size() - 128);
+    util::fs::write_string_to_file(data, temp.filename);
+
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+    EXPECT_EQ("replaced", read_archive_file(archive, "view.mve/a"));
+    EXPECT_EQ("second", read_archive_file(archive, "view.mve/b"));
+    EXPECT_FALSE(archive->has_file("view.mve/c"));
+}
+
+TEST(SceneArchiveTest, FailedViewSaveKeepsArchiveFiles)
+{
+    TempArchive temp;
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+    mve::View::Ptr view = mve::View::create();
+    view->set_name("old");
+    view->save_view_as(archive, "view_0000.mve");
+
+    /* The second image no longer matches its proxy and fails to save. */
+    view->set_name("new");
+    view->set_image(mve::ByteImage::create(4, 4, 1), "first");
+    mve::FloatImage::Ptr image = mve::FloatImage::create(2, 2, 1);
+    view->set_image(image, "second");
+    image->allocate(3, 3, 1);
+    EXPECT_THROW(view->save_view_prepare(), std::exception);
+    EXPECT_FALSE(archive->has_file("view_0000.mve/first.png"));
+    mve::View::Ptr loaded = mve::View::create();
+    loaded->load_view(archive, "view_0000.mve");
+    EXPECT_EQ("old", loaded->get_name());
+
+    /* The view is saved completely once the error is resolved. */
+    view->set_image(image, "second");
+    view->save_view();
+    loaded->load_view(archive, "view_0000.mve");
+    EXPECT_EQ("new", loaded->get_name());
+    EXPECT_TRUE(loaded->has_image("first", mve::IMAGE_TYPE_UINT8));
+    EXPECT_TRUE(loaded->has_image("second", mve::IMAGE_TYPE_FLOAT));
+}
+
+TEST(SceneArchiveTest, ConcurrentReads)
+{
+    TempArchive temp;
+    mve::SceneArchive::Ptr archive = mve::SceneArchive::open(temp.filename);
+    for (int i = 0; i < 16; ++i)
+        archive->write_file("view.mve/" + std::to_string(i),
+            std::string(1000 + i, 'a' + i));
+
+    int num_errors = 0;
+#pragma omp parallel for reduction(+:num_errors)
+    for (int i = 0; i < 256; ++i)
+    {
+        int const id = i % 16;
+        std::string const data = read_archive_file(archive,
+            "view.mve/" + std::to_string(id));
+        if (data != std::string(1000 + id, 'a' + id))
+            num_errors += 1;
+    }
+    EXPECT_EQ(0, num_errors);
+}
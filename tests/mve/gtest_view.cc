@@ -1,8 +1,12 @@
 // Test cases for the image class and related features.
 // Written by Simon Fuhrmann.
 
+#include <cstdio>
+#include <fstream>
+#include <string>
 #include <gtest/gtest.h>
 
+#include "util/file_system.h"
 #include "mve/image.h"
 #include "mve/view.h"
 
@@ -184,3 +188,198 @@ TEST(ViewTest, GetSetNameIdCamera)
     EXPECT_TRUE(view->is_camera_valid());
     EXPECT_EQ(view->get_camera().flen, camera.flen);
 }
+
+TEST(ViewTest, GetImageRegionFromCache)
+{
+    mve::View::Ptr view = mve::View::create();
+    EXPECT_EQ(mve::ImageBase::Ptr(), view->get_image_region("image",
+        0, 0, 1, 1));
+
+    mve::FloatImage::Ptr image = mve::FloatImage::create(10, 12, 2);
+    for (int i = 0; i < image->get_value_amount(); ++i)
+        image->at(i) = static_cast<float>(i);
+    view->set_image(image, "image");
+
+    mve::FloatImage::Ptr region = std::dynamic_pointer_cast
+        <mve::FloatImage>(view->get_image_region("image", 3, 4, 5, 2));
+    ASSERT_TRUE(region != nullptr);
+    EXPECT_EQ(5, region->width());
+    EXPECT_EQ(2, region->height());
+    EXPECT_EQ(2, region->channels());
+    for (int y = 0; y < 2; ++y)
+        for (int x = 0; x < 5; ++x)
+            for (int c = 0; c < 2; ++c)
+                EXPECT_EQ(image->at(x + 3, y + 4, c), region->at(x, y, c));
+
+    EXPECT_THROW(view->get_image_region("image", 6, 0, 5, 1),
+        std::invalid_argument);
+    EXPECT_THROW(view->get_image_region("image", -1, 0, 5, 1),
+        std::invalid_argument);
+}
+
+TEST(ViewTest, GetImageRegionFromFile)
+{
+    std::string const path = std::tmpnam(nullptr);
+    mve::FloatImage::Ptr image = mve::FloatImage::create(300, 200, 1);
+    for (int i = 0; i < image->get_value_amount(); ++i)
+        image->at(i) = static_cast<float>(i);
+    mve::ByteImage::Ptr byte_image = mve::ByteImage::create(30, 20, 3);
+    for (int i = 0; i < byte_image->get_value_amount(); ++i)
+        byte_image->at(i) = static_cast<uint8_t>(i);
+
+    mve::View::Ptr view = mve::View::create();
+    view->set_image(image, "depthmap");
+    view->set_image(byte_image, "image");
+    view->save_view_as(path);
+    view = mve::View::create(path);
+
+    mve::FloatImage::Ptr region = std::dynamic_pointer_cast
+        <mve::FloatImage>(view->get_image_region("depthmap",
+        250, 190, 50, 10));
+    ASSERT_TRUE(region != nullptr);
+    for (int y = 0; y < 10; ++y)
+        for (int x = 0; x < 50; ++x)
+            EXPECT_EQ(image->at(x + 250, y + 190, 0), region->at(x, y, 0));
+
+    mve::ByteImage::Ptr byte_region = std::dynamic_pointer_cast
+        <mve::ByteImage>(view->get_image_region("image", 1, 2, 3, 4));
+    ASSERT_TRUE(byte_region != nullptr);
+    for (int y = 0; y < 4; ++y)
+        for (int x = 0; x < 3; ++x)
+            for (int c = 0; c < 3; ++c)
+                EXPECT_EQ(byte_image->at(x + 1, y + 2, c),
+                    byte_region->at(x, y, c));
+
+    /* Region reads do not populate the image cache. */
+    mve::View::ImageProxies const& proxies = view->get_images();
+    for (std::size_t i = 0; i < proxies.size(); ++i)
+        EXPECT_EQ(mve::ImageBase::Ptr(), proxies[i].image);
+
+    view.reset();
+    util::fs::Directory dir(path);
+    for (std::size_t i = 0; i < dir.size(); ++i)
+        util::fs::unlink(dir[i].get_absolute_name().c_str());
+    util::fs::rmdir(path.c_str());
+}
+
+TEST(ViewTest, InterruptedSaveIsCompletedOrDiscarded)
+{
+    std::string const path = std::tmpnam(nullptr);
+    mve::View::Ptr view = mve::View::create();
+    view->set_name("old");
+    view->set_image(mve::ByteImage::create(4, 4, 1), "image");
+    view->save_view_as(path);
+
+    /* Interrupt the save after the journal has been written. */
+    view->set_name("new");
+    view->remove_image("image");
+    view->set_image(mve::FloatImage::create(2, 2, 1), "depthmap");
+    view->save_view_prepare();
+    view->save_view_journal(false);
+    mve::View::Ptr loaded = mve::View::create(path);
+    EXPECT_EQ("new", loaded->get_name());
+    EXPECT_FALSE(loaded->has_image("image"));
+    EXPECT_TRUE(loaded->has_image("depthmap", mve::IMAGE_TYPE_FLOAT));
+    EXPECT_FALSE(util::fs::file_exists(util::fs::join_path(path,
+        "save.journal").c_str()));
+
+    /* Interrupt the save before the journal has been written. */
+    loaded->set_name("discarded");
+    loaded->save_view_prepare();
+    loaded = mve::View::create(path);
+    EXPECT_EQ("new", loaded->get_name());
+
+    /* Interrupt the save while the journal is written. */
+    std::string const meta_new = util::fs::join_path(path, "meta.ini.new");
+    loaded->set_name("discarded");
+    loaded->save_view_prepare();
+    ASSERT_TRUE(util::fs::file_exists(meta_new.c_str()));
+    {
+        std::ofstream journal(util::fs::join_path(path,
+            "save.journal").c_str(), std::ios::binary);
+        journal << "MVE_VIEW_JOURNAL\nreplace meta.ini\n";
+    }
+    loaded = mve::View::create(path);
+    EXPECT_EQ("new", loaded->get_name());
+    EXPECT_FALSE(util::fs::file_exists(meta_new.c_str()));
+
+    view.reset();
+    loaded.reset();
+    util::fs::Directory dir(path);
+    for (std::size_t i = 0; i < dir.size(); ++i)
+        util::fs::unlink(dir[i].get_absolute_name().c_str());
+    util::fs::rmdir(path.c_str());
+}
+
+TEST(ViewTest, MVEICompressionIsOptIn)
+{
+    std::string const path = std::tmpnam(nullptr);
+    std::string const filename = util::fs::join_path(path, "depthmap.mvei");
+    mve::View::Ptr view = mve::View::create();
+    view->set_image(mve::FloatImage::create(40, 30, 1), "depthmap");
+    view->save_view_as(path);
+
+    char signature[11];
+    std::ifstream in(filename.c_str(), std::ios::binary);
+    in.read(signature, 11);
+    in.close();
+    EXPECT_EQ("\211MVE_IMAGE\n", std::string(signature, 11));
+
+    view->set_mvei_compression(true);
+    view->set_image(mve::FloatImage::create(40, 30, 1), "depthmap");
+    view->save_view();
+    in.open(filename.c_str(), std::ios::binary);
+    in.read(signature, 11);
+    in.close();
+    EXPECT_EQ("\211MVE_IMAGT\n", std::string(signature, 11));
+    EXPECT_EQ(40, view->get_float_image("depthmap")->width());
+
+    view.reset();
+    util::fs::Directory dir(path);
+    for (std::size_t i = 0; i < dir.size(); ++i)
+        util::fs::unlink(dir[i].get_absolute_name().c_str());
+    util::fs::rmdir(path.c_str());
+}
+
+TEST(ViewTest, FailedSaveKeepsViewDirty)
+{
+    std::string const path = std::tmpnam(nullptr);
+    mve::View::Ptr view = mve::View::create();
+    view->set_name("old");
+    view->save_view_as(path);
+
+    /* The second image no longer matches its proxy and fails to save. */
+    view->set_name("new");
+    view->set_image(mve::ByteImage::create(4, 4, 1), "first");
+    mve::FloatImage::Ptr image = mve::FloatImage::create(2, 2, 1);
+    view->set_image(image, "second");
+    image->allocate(3, 3, 1);
+    EXPECT_THROW(view->save_view_prepare(), std::exception);
+
+    EXPECT_TRUE(view->is_dirty());
+    EXPECT_TRUE(view->get_meta_data().is_dirty);
+    mve::View::ImageProxies const& proxies = view->get_images();
+    for (std::size_t i = 0; i < proxies.size(); ++i)
+    {
+        EXPECT_TRUE(proxies[i].is_dirty);
+        EXPECT_TRUE(proxies[i].filename.empty());
+    }
+    util::fs::Directory dir(path);
+    for (std::size_t i = 0; i < dir.size(); ++i)
+        EXPECT_EQ(std::string::npos, dir[i].name.find(".new"));
+
+    /* The view is saved completely once the error is resolved. */
+    view->set_image(image, "second");
+    view->save_view();
+    mve::View::Ptr loaded = mve::View::create(path);
+    EXPECT_EQ("new", loaded->get_name());
+    EXPECT_TRUE(loaded->has_image("first", mve::IMAGE_TYPE_UINT8));
+    EXPECT_TRUE(loaded->has_image("second", mve::IMAGE_TYPE_FLOAT));
+
+    view.reset();
+    loaded.reset();
+    dir.scan(path);
+    for (std::size_t i = 0; i < dir.size(); ++i)
+        util::fs::unlink(dir[i].get_absolute_name().c_str());
+    util::fs::rmdir(path.c_str());
+}
@@ -0,0 +1,125 @@
+// Test cases for the view prefetcher.
+// Written by Simon Fuhrmann.
+
+#include <cstdio>
+#include <string>
+#include <gtest/gtest.h>
+
+#include "util/file_system.h"
+#include "mve/image.h"
+#include "mve/view.h"
+#include "mve/view_prefetcher.h"
+
+namespace
+{
+    /* Temporary directory with views, removed on destruction. */
+    struct TempViews
+    {
+        std::string path;
+        mve::Scene::ViewList views;
+
+        TempViews (int num_views)
+            : path(std::tmpnam(nullptr))
+        {
+            util::fs::mkdir(this->path.c_str());
+            for (int i = 0; i < num_views; ++i)
+            {
+                mve::ByteImage::Ptr image = mve::ByteImage::create(8, 4, 1);
+                image->fill(static_cast<uint8_t>(i));
+                mve::View::Ptr view = mve::View::create();
+                view->set_id(i);
+                view->set_image(image, "image");
+                view->save_view_as(this->get_view_path(i));
+                this->views.push_back(mve::View::create(
+                    this->get_view_path(i)));
+            }
+        }
+
+        ~TempViews (void)
+        {
+            this->views.clear();
+            for (int i = 0; true; ++i)
+            {
+                std::string const view_path = this->get_view_path(i);
+                if (!util::fs::dir_exists(view_path.c_str()))
+                    break;
+                util::fs::Directory dir(view_path);
+                for (std::size_t j = 0; j < dir.size(); ++j)
+                    util::fs::unlink(dir[j].get_absolute_name().c_str());
+                util::fs::rmdir(view_path.c_str());
+            }
+            util::fs::rmdir(this->path.c_str());
+        }
+
+        std::string get_view_path (int id) const
+        {
+            return util::fs::join_path(this->path,
+                "view_" + std::to_string(id) + ".mve");
+        }
+    };
+
+    bool
+    is_cached (mve::View::Ptr view, std::string const& name)
+    {
+        mve::View::ImageProxies const& proxies = view->get_images();
+        for (std::size_t i = 0; i < proxies.size(); ++i)
+            if (proxies[i].name == name)
+                return proxies[i].image != nullptr;
+        return false;
+    }
+}
+
+TEST(ViewPrefetcherTest, PrefetchAllViews)
+{
+    TempViews temp(10);
+    mve::ViewPrefetcher prefetcher(temp.views,
+        std::vector<std::string>(1, "image"), 2, 3);
+    prefetcher.prefetch_all();
+
+    for (std::size_t i = 0; i < temp.views.size(); ++i)
+    {
+        mve::ByteImage::Ptr image = prefetcher.get_byte_image(i, "image");
+        ASSERT_TRUE(image != nullptr);
+        EXPECT_EQ(8, image->width());
+        EXPECT_EQ(static_cast<uint8_t>(i), image->at(0));
+        EXPECT_TRUE(prefetcher.get_float_image(i, "image") == nullptr);
+        EXPECT_TRUE(prefetcher.get_image(i, "missing") == nullptr);
+    }
+}
+
+TEST(ViewPrefetcherTest, ReleaseAndReschedule)
+{
+    TempViews temp(3);
+    mve::ViewPrefetcher prefetcher(temp.views,
+        std::vector<std::string>(1, "image"), 1, 1);
+
+    /* Released views are not accessed, whether loaded or not. */
+    prefetcher.prefetch(0);
+    prefetcher.prefetch(1);
+    prefetcher.prefetch(2);
+    prefetcher.release(1);
+    prefetcher.release(0);
+    prefetcher.release(0);
+    temp.views[0]->cache_cleanup();
+    temp.views[1]->cache_cleanup();
+    EXPECT_FALSE(is_cached(temp.views[0], "image"));
+    EXPECT_FALSE(is_cached(temp.views[1], "image"));
+
+    /* Views can be scheduled again after the release. */
+    prefetcher.prefetch(0);
+    EXPECT_TRUE(prefetcher.get_byte_image(0, "image") != nullptr);
+    EXPECT_TRUE(prefetcher.get_byte_image(2, "image") != nullptr);
+    EXPECT_TRUE(is_cached(temp.views[2], "image"));
+}
+
+TEST(ViewPrefetcherTest, DestroyWithPendingViews)
+{
+    TempViews temp(20);
+    {
+        mve::ViewPrefetcher prefetcher(temp.views,
+            std::vector<std::string>(1, "image"), 3, 2);
+        prefetcher.prefetch_all();
+        prefetcher.prefetch(100);
+    }
+    SUCCEED();
+}
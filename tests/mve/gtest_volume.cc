@@ -0,0 +1,80 @@
+// Test cases for the volume polygonization.
+// Written by Simon Fuhrmann.
+
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "mve/marching_cubes.h"
+#include "mve/marching_tets.h"
+#include "mve/volume.h"
+
+namespace
+{
+    /* Sphere SDF, optionally rounded to produce exact zero values. */
+    mve::FloatVolume::Ptr
+    create_sphere_volume (int width, int height, int depth, bool round)
+    {
+        mve::FloatVolume::Ptr volume
+            = mve::FloatVolume::create(width, height, depth);
+        mve::FloatVolume::Voxels& data = volume->get_data();
+        float const radius = depth / 3.0f;
+        for (int z = 0, i = 0; z < depth; ++z)
+            for (int y = 0; y < height; ++y)
+                for (int x = 0; x < width; ++x, ++i)
+                {
+                    math::Vec3f const p(x - width / 2.0f,
+                        y - height / 2.0f, z - depth / 2.0f);
+                    float const value = p.norm() - radius
+                        + 0.5f * std::sin(x * 0.7f);
+                    data[i] = round ? std::round(value) : value;
+                }
+        return volume;
+    }
+}
+
+TEST(VolumeTest, MarchingCubesSlabs)
+{
+    for (int round = 0; round < 2; ++round)
+    {
+        /* More layers than a single slab to test the slab merge. */
+        mve::FloatVolume::Ptr volume
+            = create_sphere_volume(23, 17, 60, round != 0);
+        mve::VolumeMCAccessor accessor;
+        accessor.vol = volume;
+        mve::TriangleMesh::Ptr expected = mve::geom::marching_cubes(accessor);
+        mve::TriangleMesh::Ptr mesh = mve::geom::volume_marching_cubes(volume);
+        ASSERT_FALSE(expected->get_faces().empty());
+        EXPECT_EQ(expected->get_vertices(), mesh->get_vertices());
+        EXPECT_EQ(expected->get_faces(), mesh->get_faces());
+    }
+}
+
+TEST(VolumeTest, MarchingTetrahedraSlabs)
+{
+    for (int round = 0; round < 2; ++round)
+    {
+        /* Rounded values test the vertex snapping across slabs. */
+        mve::FloatVolume::Ptr volume
+            = create_sphere_volume(23, 17, 60, round != 0);
+        mve::VolumeMTAccessor accessor;
+        accessor.vol = volume;
+        mve::TriangleMesh::Ptr expected
+            = mve::geom::marching_tetrahedra(accessor);
+        mve::TriangleMesh::Ptr mesh
+            = mve::geom::volume_marching_tetrahedra(volume);
+        ASSERT_FALSE(expected->get_faces().empty());
+        EXPECT_EQ(expected->get_vertices(), mesh->get_vertices());
+        EXPECT_EQ(expected->get_faces(), mesh->get_faces());
+    }
+}
+
+TEST(VolumeTest, MarchingEmptyVolume)
+{
+    mve::FloatVolume::Ptr volume = mve::FloatVolume::create(1, 5, 5);
+    EXPECT_TRUE(mve::geom::volume_marching_cubes(volume)->get_faces().empty());
+    volume = mve::FloatVolume::create(4, 4, 4);
+    volume->get_data().assign(64, 1.0f);
+    EXPECT_TRUE(mve::geom::volume_marching_cubes(volume)->get_faces().empty());
+    EXPECT_TRUE(mve::geom::volume_marching_tetrahedra(volume)
+        ->get_vertices().empty());
+}
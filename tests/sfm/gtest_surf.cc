@@ -1,6 +1,7 @@
 // Test cases for the SURF feature detector.
 // Written by Simon Fuhrmann.
 
+#include <vector>
 #include <gtest/gtest.h>
 
 #include "sfm/surf.h"
@@ -110,6 +111,36 @@ TEST_F(SurfTest, TestFilterDxxDyy)
     EXPECT_EQ(0, dyy);
 }
 
+TEST_F(SurfTest, TestResponseRowMatchesFilters)
+{
+    // The response of whole rows equals the response of the single filters.
+    mve::ByteImage::Ptr img = mve::ByteImage::create(80, 80, 1);
+    for (int i = 0; i < img->get_value_amount(); ++i)
+        img->at(i) = static_cast<unsigned char>((i * 37) ^ (i / 80 * 11));
+    this->set_image(img);
+
+    int const sizes[4] = { 3, 9, 17, 25 };
+    for (int s = 0; s < 4; ++s)
+        for (int step = 1; step <= 2; ++step)
+        {
+            int const fs = sizes[s];
+            int const border = fs + fs / 2 + 1;
+            int const x_begin = (border + step - 1) / step;
+            int const x_end = (80 - border + step - 1) / step;
+            std::vector<float> row(x_end, 0.0f);
+            this->create_response_row(fs, 40, step, x_begin, x_end, &row[0]);
+            for (int i = x_begin; i < x_end; ++i)
+            {
+                float const inv_karea = 1.0 / (fs * (2 * fs - 1));
+                float dxx = this->filter_dxx(fs, i * step, 40) * inv_karea;
+                float dyy = this->filter_dyy(fs, i * step, 40) * inv_karea;
+                float dxy = this->filter_dxy(fs, i * step, 40) * inv_karea;
+                float const weight = 0.912;
+                EXPECT_FLOAT_EQ(dxx * dyy - weight * dxy * dxy, row[i]);
+            }
+        }
+}
+
 TEST_F(SurfTest, TestHaarWaveletsDXY)
 {
     float dx, dy;